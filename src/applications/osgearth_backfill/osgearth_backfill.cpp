@@ -55,6 +55,9 @@ usage( const std::string& msg = "" )
         << "            [--min-level <num>]             : The minimum level to stop backfilling to.  (default=0)\n"
         << "            [--max-level <num>]             : The level to start backfilling from(default=inf)\n"                
         << "            [--db-options]                : db options string to pass to the image writer in quotes (e.g., \"JPEG_QUALITY 60\")\n"
+        << "            [--threads <num>]               : number of threads building tiles (default=number of processors)\n"
+        << "            [--filter <box|lanczos>]        : downsampling filter (default=box)\n"
+        << "            [--cache-mb <num>]              : memory for tiles waiting on their parents, in MB (default=512)\n"
         << std::endl
         << "         [--quiet]               : suppress progress output" << std::endl;
 
@@ -97,6 +100,22 @@ main(int argc, char** argv)
     unsigned maxLevel = ~0;
     args.read( "--max-level", maxLevel );  
 
+    // number of threads building tiles
+    unsigned threads = 0;
+    args.read( "--threads", threads );
+
+    // downsampling filter
+    std::string filter = "box";
+    args.read( "--filter", filter );
+    if ( filter != "box" && filter != "lanczos" )
+    {
+        return usage( "Unknown filter: " + filter );
+    }
+
+    // memory for built tiles waiting on their parents
+    unsigned cacheMB = 512;
+    args.read( "--cache-mb", cacheMB );
+
     std::string dbOptions;
     args.read("--db-options", dbOptions);
     std::string::size_type n = 0;
@@ -129,5 +148,21 @@ main(int argc, char** argv)
     backfiller.setMinLevel( minLevel );
     backfiller.setMaxLevel( maxLevel );
     backfiller.setBounds( bounds );
+    if ( threads > 0 )
+        backfiller.setNumThreads( threads );
+    backfiller.setFilter( filter == "lanczos" ? TMSBackFiller::FILTER_LANCZOS : TMSBackFiller::FILTER_BOX );
+    backfiller.setMaxCachedBytes( (unsigned long long)cacheMB * 1024u * 1024u );
     backfiller.process( tmsPath, options.get() );
+
+    if ( verbose )
+    {
+        TMSBackFiller::Stats stats = backfiller.getStats();
+        std::cout
+            << "Built " << stats.tilesBuilt << " tiles in " << stats.elapsed << "s ("
+            << stats.getTilesPerSecond() << " tiles/s) with " << backfiller.getNumThreads() << " threads" << std::endl
+            << "Children read from disk: " << stats.tilesRead << ", reused from memory: " << stats.tilesReused
+            << ", tiles skipped: " << stats.tilesSkipped << std::endl;
+    }
+
+    return 0;
 }
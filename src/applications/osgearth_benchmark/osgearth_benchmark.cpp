@@ -0,0 +1,1222 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2015 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+#define LC "[osgearth_benchmark] "
+
+#include <osgEarth/Notify>
+#include <osgEarth/ThreadingUtils>
+#include <osgEarth/Tessellator>
+#include <osgEarth/Registry>
+#include <osgEarth/SpatialReference>
+#include <osgEarth/AnalyticTransforms>
+#include <osgEarth/TileSource>
+#include <osgEarth/Random>
+#include <osgEarth/StringUtils>
+#include <osgEarth/MapNode>
+#include <osgEarth/StateSetCache>
+#include <osgEarth/ObjectIndex>
+#include <osgEarthFeatures/FeatureSource>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthFeatures/BuildGeometryFilter>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/InMemoryFeatureSource>
+#include <osgEarthFeatures/FeatureTileSource>
+#include <osgEarthFeatures/GeometryTilePyramid>
+#include <osgEarthSymbology/Style>
+#include <osgEarthSymbology/PolygonSymbol>
+#include <osgEarthSymbology/LineSymbol>
+#include <osgEarthSymbology/TextSymbol>
+#include <osgEarthAnnotation/TrackNode>
+#include <osgEarthAnnotation/TrackBatchNode>
+#include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
+#include <osgEarthDrivers/agglite/AGGLiteOptions>
+#include <osgEarthDrivers/kml/KML>
+#include <osg/ArgumentParser>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/BlendFunc>
+#include <osg/LineWidth>
+#include <osg/Material>
+#include <osg/Timer>
+#include <osgDB/fstream>
+#include <OpenThreads/Thread>
+#include <iomanip>
+#include <cfloat>
+#include <cstring>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Drivers;
+using namespace osgEarth::Annotation;
+
+// documentation
+int usage(char** argv)
+{
+    std::cout
+        << "Measures the performance of various osgEarth subsystems.\n\n"
+        << argv[0]
+        << "\n    --tessellate [file]                 : tessellate the polygons in a feature file"
+        << "\n                                          with each polygon tessellator"
+        << "\n    --ogr [file]                        : run concurrent tile queries against an OGR"
+        << "\n                                          feature source (shapefile, GeoPackage...),"
+        << "\n                                          directly and from an in-memory index"
+        << "\n    --raster [file]                     : rasterize the features in a file into image"
+        << "\n                                          tiles, with and without the geometry tile cache"
+        << "\n    --lod [int]                         : first raster level; renders it and the two"
+        << "\n                                          levels below it (default = 6)"
+        << "\n    --transform [srs]                   : reproject batches of WGS84 points into an SRS"
+        << "\n                                          (e.g. \"+proj=utm +zone=33 +datum=WGS84\")"
+        << "\n                                          with 1 thread and with --threads threads, through"
+        << "\n                                          OGR and through the closed-form kernels"
+        << "\n    --kml [file]                        : load a KML file into a scene graph, reading the"
+        << "\n                                          whole document first and streaming it"
+        << "\n    --tracks [int]                      : move and cull that many tracks, as TrackNodes and"
+        << "\n                                          as a TrackBatchNode; reports ms per 10k tracks"
+        << "\n    --share [file]                      : build a node per feature in a file and share their"
+        << "\n                                          state with StateSetCache::optimize, from 1 thread"
+        << "\n                                          and from --threads threads"
+        << "\n    --index [int]                       : page that many features in and out of an object"
+        << "\n                                          index, one ID at a time and one range per tile"
+        << "\n    --threads [int]                     : number of query threads (default = 4)"
+        << "\n    --tiles [int]                       : query grid size per side (default = 16)"
+        << "\n    --runs [int]                        : number of times to repeat each test (default = 3)"
+        << std::endl;
+
+    return 0;
+}
+
+//.........................................................................
+
+namespace
+{
+    // loads every feature from an OGR data source.
+    bool loadFeatures(const std::string& url, FeatureList& out_features)
+    {
+        OGRFeatureOptions featureOpt;
+        featureOpt.url() = url;
+
+        osg::ref_ptr<FeatureSource> features = FeatureSourceFactory::create( featureOpt );
+        if ( !features.valid() )
+        {
+            OE_WARN << LC << "Failed to open " << url << std::endl;
+            return false;
+        }
+
+        features->initialize();
+        if ( !features->getFeatureProfile() )
+        {
+            OE_WARN << LC << "Failed to create a valid profile for " << url << std::endl;
+            return false;
+        }
+
+        osg::ref_ptr<FeatureCursor> cursor = features->createFeatureCursor();
+        if ( cursor.valid() )
+        {
+            cursor->fill( out_features );
+        }
+        return true;
+    }
+
+    // counts the triangles in all the geometries under a node.
+    unsigned countTriangles(osg::Node* node)
+    {
+        unsigned count = 0;
+        osg::Group* group = node ? node->asGroup() : 0L;
+        if ( group )
+        {
+            for(unsigned i=0; i<group->getNumChildren(); ++i)
+                count += countTriangles( group->getChild(i) );
+        }
+
+        osg::Geode* geode = node ? node->asGeode() : 0L;
+        if ( geode )
+        {
+            for(unsigned i=0; i<geode->getNumDrawables(); ++i)
+            {
+                osg::Geometry* geom = geode->getDrawable(i)->asGeometry();
+                if ( !geom ) continue;
+                for(unsigned p=0; p<geom->getNumPrimitiveSets(); ++p)
+                {
+                    const osg::PrimitiveSet* ps = geom->getPrimitiveSet(p);
+                    if ( ps->getMode() == GL_TRIANGLES )
+                        count += ps->getNumIndices()/3;
+                }
+            }
+        }
+        return count;
+    }
+
+    // clones the feature list so each run tessellates pristine geometry.
+    void cloneFeatures(const FeatureList& input, FeatureList& output)
+    {
+        output.clear();
+        for(FeatureList::const_iterator i = input.begin(); i != input.end(); ++i)
+        {
+            output.push_back( new Feature(*i->get(), osg::CopyOp::DEEP_COPY_ALL) );
+        }
+    }
+}
+
+//.........................................................................
+
+int
+benchmarkTessellation(const std::string& url, int runs)
+{
+    FeatureList features;
+    if ( !loadFeatures(url, features) )
+        return -1;
+
+    unsigned numPolygons = 0, numVerts = 0, maxVerts = 0;
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        const Geometry* geom = i->get()->getGeometry();
+        if ( geom && geom->getComponentType() == Geometry::TYPE_POLYGON )
+        {
+            GeometryIterator parts( const_cast<Geometry*>(geom), false );
+            while( parts.hasMore() )
+            {
+                unsigned count = parts.next()->getTotalPointCount();
+                numPolygons++;
+                numVerts += count;
+                maxVerts = osg::maximum(maxVerts, count);
+            }
+        }
+    }
+
+    std::cout
+        << "Loaded " << features.size() << " features from " << url << "\n"
+        << "    polygons = " << numPolygons << "\n"
+        << "    vertices = " << numVerts << " (largest polygon = " << maxVerts << ")\n"
+        << std::endl;
+
+    if ( numPolygons == 0 )
+        return 0;
+
+    Style style;
+    style.getOrCreate<PolygonSymbol>()->fill()->color() = Color::White;
+
+    struct Method {
+        Tessellator::Method method;
+        const char*         name;
+    };
+    Method methods[2] = {
+        { Tessellator::METHOD_EAR_CLIPPING,        "ear_clipping" },
+        { Tessellator::METHOD_ZORDER_EAR_CLIPPING, "zorder" }
+    };
+
+    std::cout << std::setw(16) << std::left << "tessellator"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(16) << "verts/s"
+        << std::setw(14) << "triangles" << std::endl;
+
+    for(unsigned m=0; m<2; ++m)
+    {
+        double total = 0.0, best = DBL_MAX;
+        unsigned triangles = 0;
+
+        for(int r=0; r<runs; ++r)
+        {
+            FeatureList working;
+            cloneFeatures(features, working);
+
+            BuildGeometryFilter filter( style );
+            filter.tessellator() = methods[m].method;
+
+            FilterContext cx;
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            osg::ref_ptr<osg::Node> node = filter.push( working, cx );
+            double t = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            total += t;
+            best = osg::minimum(best, t);
+            triangles = countTriangles( node.get() );
+        }
+
+        std::cout << std::setw(16) << std::left << methods[m].name
+            << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+            << std::setw(14) << total/(double)runs
+            << std::setw(16) << std::setprecision(0) << (best > 0.0 ? (double)numVerts/best : 0.0)
+            << std::setw(14) << triangles << std::endl;
+    }
+
+    return 0;
+}
+
+//.........................................................................
+
+namespace
+{
+    // Shared state for a set of threads issuing tile queries.
+    struct QueryJob
+    {
+        QueryJob() : _next(0u), _features(0u) { }
+
+        osg::ref_ptr<FeatureSource> _source;
+        std::vector<Bounds>         _tiles;
+        unsigned                    _next;
+        unsigned                    _features;
+        Threading::Mutex            _mutex;
+
+        // claims the next tile to query, returning false when there are none left.
+        bool claim(Bounds& out_bounds)
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _next >= _tiles.size() )
+                return false;
+            out_bounds = _tiles[_next++];
+            return true;
+        }
+
+        void report(unsigned count)
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            _features += count;
+        }
+    };
+
+    // Thread that queries tiles until the job runs out.
+    struct QueryThread : public OpenThreads::Thread
+    {
+        QueryThread(QueryJob& job) : _job(job) { }
+
+        void run()
+        {
+            Bounds bounds;
+            while( _job.claim(bounds) )
+            {
+                Query query;
+                query.bounds() = bounds;
+
+                unsigned count = 0;
+                osg::ref_ptr<FeatureCursor> cursor = _job._source->createFeatureCursor( query );
+                while( cursor.valid() && cursor->hasMore() )
+                {
+                    if ( cursor->nextFeature() )
+                        ++count;
+                }
+                _job.report( count );
+            }
+        }
+
+        QueryJob& _job;
+    };
+
+    // opens an OGR feature source for the query benchmark.
+    FeatureSource* openQuerySource(const std::string& url, bool concurrent, bool inMemory)
+    {
+        OGRFeatureOptions featureOpt;
+        featureOpt.url() = url;
+        featureOpt.concurrentReads() = concurrent;
+        featureOpt.inMemory() = inMemory;
+
+        osg::ref_ptr<FeatureSource> source = FeatureSourceFactory::create( featureOpt );
+        if ( !source.valid() )
+            return 0L;
+
+        source->initialize();
+        if ( !source->getFeatureProfile() )
+            return 0L;
+
+        return source.release();
+    }
+}
+
+int
+benchmarkOGRQueries(const std::string& url, int runs, int numThreads, int tilesPerSide)
+{
+    struct Mode {
+        bool        concurrent;
+        bool        inMemory;
+        int         threads;
+        const char* name;
+    };
+    Mode modes[4] = {
+        { false, false, 1,          "1 thread" },
+        { false, false, numThreads, "global lock" },
+        { true,  false, numThreads, "concurrent" },
+        { true,  true,  numThreads, "in memory" }
+    };
+
+    std::cout << "Querying " << url << " in " << tilesPerSide << "x" << tilesPerSide
+        << " tiles with " << numThreads << " threads\n" << std::endl;
+
+    std::cout << std::setw(16) << std::left << "mode"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(14) << "queries/s"
+        << std::setw(14) << "features" << std::endl;
+
+    osg::ref_ptr<InMemoryFeatureSource> inMemorySource;
+
+    for(unsigned m=0; m<4; ++m)
+    {
+        osg::ref_ptr<FeatureSource> source = openQuerySource( url, modes[m].concurrent, modes[m].inMemory );
+        if ( !source.valid() )
+        {
+            OE_WARN << LC << "Failed to open " << url << std::endl;
+            return -1;
+        }
+
+        // grid of query tiles covering the source extent.
+        const GeoExtent& extent = source->getFeatureProfile()->getExtent();
+        std::vector<Bounds> tiles;
+        double dx = extent.width() / (double)tilesPerSide;
+        double dy = extent.height() / (double)tilesPerSide;
+        for(int y=0; y<tilesPerSide; ++y)
+        {
+            for(int x=0; x<tilesPerSide; ++x)
+            {
+                tiles.push_back( Bounds(
+                    extent.xMin() + dx*(double)x,     extent.yMin() + dy*(double)y,
+                    extent.xMin() + dx*(double)(x+1), extent.yMin() + dy*(double)(y+1)) );
+            }
+        }
+
+        double total = 0.0, best = DBL_MAX;
+        unsigned features = 0;
+
+        for(int r=0; r<runs; ++r)
+        {
+            QueryJob job;
+            job._source = source.get();
+            job._tiles  = tiles;
+
+            std::vector<QueryThread*> threads;
+            for(int t=0; t<modes[m].threads; ++t)
+                threads.push_back( new QueryThread(job) );
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            for(unsigned t=0; t<threads.size(); ++t)
+                threads[t]->start();
+
+            for(unsigned t=0; t<threads.size(); ++t)
+            {
+                threads[t]->join();
+                delete threads[t];
+            }
+
+            double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            total += time;
+            best = osg::minimum(best, time);
+            features = job._features;
+        }
+
+        std::cout << std::setw(16) << std::left << modes[m].name
+            << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+            << std::setw(14) << total/(double)runs
+            << std::setw(14) << std::setprecision(0) << (best > 0.0 ? (double)tiles.size()/best : 0.0)
+            << std::setw(14) << features << std::endl;
+
+        if ( modes[m].inMemory )
+            inMemorySource = dynamic_cast<InMemoryFeatureSource*>( source.get() );
+    }
+
+    if ( inMemorySource.valid() )
+    {
+        InMemoryFeatureSource::Stats stats = inMemorySource->getStats();
+        std::cout
+            << "\nIn memory: " << stats.features << " features, " << stats.points << " points, "
+            << stats.bytes/1024 << " KB, loaded in " << std::setprecision(4) << stats.loadTime << " s, "
+            << "average index lookup = " << std::setprecision(1) << stats.avgQueryTime()*1e6 << " us"
+            << std::endl;
+    }
+
+    return 0;
+}
+
+//.........................................................................
+
+int
+benchmarkRasterize(const std::string& url, int runs, int firstLOD)
+{
+    const Profile* profile = Registry::instance()->getGlobalGeodeticProfile();
+
+    Style style;
+    style.getOrCreate<PolygonSymbol>()->fill()->color() = Color(Color::Yellow, 0.5f);
+
+    struct Mode {
+        unsigned    cacheSize;
+        const char* name;
+    };
+    Mode modes[2] = {
+        { 0u,   "no cache" },
+        { 256u, "geometry cache" }
+    };
+
+    std::cout << "Rasterizing " << url << " at levels " << firstLOD << "-" << firstLOD+2 << "\n" << std::endl;
+
+    std::cout << std::setw(16) << std::left << "mode"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(14) << "tiles/s"
+        << std::setw(14) << "tiles" << std::endl;
+
+    GeometryTilePyramid::Stats cacheStats;
+
+    for(unsigned m=0; m<2; ++m)
+    {
+        double total = 0.0, best = DBL_MAX;
+        unsigned numTiles = 0;
+
+        for(int r=0; r<runs; ++r)
+        {
+            // new tile source each run, so every run starts with a cold cache.
+            OGRFeatureOptions featureOpt;
+            featureOpt.url() = url;
+
+            AGGLiteOptions rasterOpt;
+            rasterOpt.featureOptions() = featureOpt;
+            rasterOpt.styles() = new StyleSheet();
+            rasterOpt.styles()->addStyle( style );
+            rasterOpt.geometryCacheSize() = modes[m].cacheSize;
+            rasterOpt.L2CacheSize() = 0;
+
+            osg::ref_ptr<TileSource> source = TileSourceFactory::create( rasterOpt );
+            if ( !source.valid() || source->open().isError() )
+            {
+                OE_WARN << LC << "Failed to open a rasterizer for " << url << std::endl;
+                return -1;
+            }
+
+            FeatureTileSource* featureTiles = dynamic_cast<FeatureTileSource*>( source.get() );
+            const FeatureProfile* featureProfile = featureTiles ? featureTiles->getFeatureSource()->getFeatureProfile() : 0L;
+            if ( !featureProfile )
+            {
+                OE_WARN << LC << "No feature profile for " << url << std::endl;
+                return -1;
+            }
+
+            // the tiles covering the data, coarse to fine, like a seeder would.
+            std::vector<TileKey> keys;
+            for(int lod=firstLOD; lod<=firstLOD+2; ++lod)
+            {
+                profile->getIntersectingTiles( featureProfile->getExtent(), lod, keys );
+            }
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            for(unsigned k=0; k<keys.size(); ++k)
+            {
+                osg::ref_ptr<osg::Image> image = source->createImage( keys[k] );
+            }
+
+            double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            total += time;
+            best = osg::minimum(best, time);
+            numTiles = keys.size();
+
+            if ( featureTiles->getGeometryTilePyramid() )
+                cacheStats = featureTiles->getGeometryTilePyramid()->getStats();
+        }
+
+        std::cout << std::setw(16) << std::left << modes[m].name
+            << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+            << std::setw(14) << total/(double)runs
+            << std::setw(14) << std::setprecision(0) << (best > 0.0 ? (double)numTiles/best : 0.0)
+            << std::setw(14) << numTiles << std::endl;
+    }
+
+    std::cout
+        << "\nGeometry cache: " << cacheStats.tilesBuilt << " geometry tiles built for "
+        << cacheStats.requests << " raster tile requests, " << cacheStats.pointsIn << " => "
+        << cacheStats.pointsOut << " points after simplification, build time "
+        << std::setprecision(4) << cacheStats.buildTime << " s" << std::endl;
+
+    return 0;
+}
+
+//.........................................................................
+
+namespace
+{
+    // Thread that reprojects its share of point batches.
+    struct TransformThread : public OpenThreads::Thread
+    {
+        TransformThread(const SpatialReference* from, const SpatialReference* to, unsigned batches, unsigned batchSize, unsigned seed) :
+            _from(from), _to(to), _batches(batches), _failures(0u)
+        {
+            // points spread over a 6x60 degree strip east of 12E, i.e. inside UTM zone 33.
+            for(unsigned i=0; i<batchSize; ++i)
+            {
+                unsigned h = (seed + i) * 2654435761u;
+                _points.push_back( osg::Vec3d(
+                    12.0 + 6.0 * (double)(h & 0xffff) / 65535.0,
+                    60.0 * (double)(h >> 16) / 65535.0,
+                    0.0) );
+            }
+        }
+
+        void run()
+        {
+            std::vector<osg::Vec3d> batch;
+            for(unsigned b=0; b<_batches; ++b)
+            {
+                batch = _points;
+                if ( !_from->transform(batch, _to.get()) )
+                    ++_failures;
+            }
+        }
+
+        osg::ref_ptr<const SpatialReference> _from, _to;
+        std::vector<osg::Vec3d>              _points;
+        unsigned                             _batches;
+        unsigned                             _failures;
+    };
+}
+
+int
+benchmarkTransform(const std::string& init, int runs, int numThreads)
+{
+    const unsigned batchSize  = 64;
+    const unsigned numBatches = 16384;
+
+    osg::ref_ptr<const SpatialReference> from = SpatialReference::get("wgs84");
+    osg::ref_ptr<const SpatialReference> to   = SpatialReference::get(init);
+    if ( !from.valid() || !to.valid() )
+    {
+        OE_WARN << LC << "Failed to create an SRS from \"" << init << "\"" << std::endl;
+        return -1;
+    }
+
+    std::cout << "Transforming " << numBatches << " batches of " << batchSize
+        << " points from WGS84 to " << to->getName() << "\n" << std::endl;
+
+    // compare OGR/PROJ against the closed-form kernels when the SRS has them.
+    bool wasEnabled = AnalyticTransforms::isEnabled();
+    AnalyticTransforms::setEnabled( true );
+
+    std::vector<osg::Vec3d> sample = TransformThread(from.get(), to.get(), 0, 4096, 0)._points;
+
+    bool hasAnalytic = from->hasAnalyticTransform(to.get()) && to->hasAnalyticTransform(from.get());
+
+    std::vector<osg::Vec3d> analytic = sample;
+    std::vector<osg::Vec3d> roundTrip;
+    if ( hasAnalytic )
+    {
+        from->transform(analytic, to.get());
+        roundTrip = analytic;
+        to->transform(roundTrip, from.get());
+    }
+
+    AnalyticTransforms::setEnabled( false );
+
+    std::vector<osg::Vec3d> reference = sample;
+    from->transform(reference, to.get());
+
+    std::cout << std::setw(12) << std::left << "path"
+        << std::setw(10) << "threads"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(16) << "points/s"
+        << std::setw(14) << "speedup" << std::endl;
+
+    int threadCounts[2] = { 1, numThreads };
+    double singleThreaded = 0.0;
+
+    for(unsigned path=0; path<2; ++path)
+    {
+        if ( path > 0 && !hasAnalytic )
+            break;
+
+        AnalyticTransforms::setEnabled( path > 0 );
+
+        for(unsigned m=0; m<2; ++m)
+        {
+            if ( m > 0 && threadCounts[m] == threadCounts[0] )
+                break;
+
+            double total = 0.0, best = DBL_MAX;
+            unsigned failures = 0;
+
+            for(int r=0; r<runs; ++r)
+            {
+                std::vector<TransformThread*> threads;
+                for(int t=0; t<threadCounts[m]; ++t)
+                    threads.push_back( new TransformThread(from.get(), to.get(), numBatches/threadCounts[m], batchSize, t*batchSize) );
+
+                osg::Timer_t start = osg::Timer::instance()->tick();
+
+                for(unsigned t=0; t<threads.size(); ++t)
+                    threads[t]->start();
+
+                failures = 0;
+                for(unsigned t=0; t<threads.size(); ++t)
+                {
+                    threads[t]->join();
+                    failures += threads[t]->_failures;
+                    delete threads[t];
+                }
+
+                double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+                total += time;
+                best = osg::minimum(best, time);
+            }
+
+            // speedups are relative to single-threaded OGR.
+            if ( path == 0 && m == 0 )
+                singleThreaded = best;
+
+            double points = (double)(numBatches/threadCounts[m]) * (double)threadCounts[m] * (double)batchSize;
+
+            std::cout << std::setw(12) << std::left << (path == 0 ? "ogr" : "analytic")
+                << std::setw(10) << threadCounts[m]
+                << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+                << std::setw(14) << total/(double)runs
+                << std::setw(16) << std::setprecision(0) << (best > 0.0 ? points/best : 0.0)
+                << std::setw(14) << std::setprecision(2) << (best > 0.0 ? singleThreaded/best : 0.0) << std::endl;
+
+            if ( failures > 0 )
+                OE_WARN << LC << failures << " batches failed to transform" << std::endl;
+        }
+    }
+
+    AnalyticTransforms::setEnabled( wasEnabled );
+
+    if ( hasAnalytic )
+    {
+        // accuracy of the closed-form path, against PROJ and against itself.
+        double maxError = 0.0, maxRoundTrip = 0.0;
+        for(unsigned i=0; i<sample.size(); ++i)
+        {
+            maxError     = osg::maximum( maxError, (analytic[i] - reference[i]).length() );
+            maxRoundTrip = osg::maximum( maxRoundTrip, (roundTrip[i] - sample[i]).length() );
+        }
+
+        std::cout << "\nMax deviation from PROJ = " << std::scientific << std::setprecision(3) << maxError
+            << " (" << to->getUnits().getAbbr() << ")"
+            << "\nMax round-trip error    = " << maxRoundTrip << " (deg)" << std::endl;
+    }
+    else
+    {
+        std::cout << "\nNo closed-form transform for this SRS; OGR only." << std::endl;
+    }
+
+    return 0;
+}
+
+//.........................................................................
+
+int
+benchmarkKML(const std::string& url, int runs)
+{
+    osgDB::ifstream file( url.c_str(), std::ios::in | std::ios::binary );
+    if ( !file.is_open() )
+    {
+        OE_WARN << LC << "Failed to open " << url << std::endl;
+        return -1;
+    }
+    file.seekg( 0, std::ios::end );
+    double megabytes = (double)file.tellg() / 1048576.0;
+    file.close();
+
+    osg::ref_ptr<MapNode> mapNode = new MapNode( new Map() );
+
+    struct Mode {
+        bool        streaming;
+        const char* name;
+    };
+    Mode modes[2] = {
+        { false, "document" },
+        { true,  "streaming" }
+    };
+
+    std::cout << "Loading " << url << " (" << std::fixed << std::setprecision(1) << megabytes << " MB)\n" << std::endl;
+
+    std::cout << std::setw(16) << std::left << "mode"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(14) << "MB/s"
+        << std::setw(14) << "children" << std::endl;
+
+    for(unsigned m=0; m<2; ++m)
+    {
+        KMLOptions kmlOptions;
+        kmlOptions.streaming() = modes[m].streaming;
+
+        double total = 0.0, best = DBL_MAX;
+        unsigned numChildren = 0;
+
+        for(int r=0; r<runs; ++r)
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+
+            osg::ref_ptr<osg::Node> node = KML::load( URI(url), mapNode.get(), kmlOptions );
+
+            double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            if ( !node.valid() )
+            {
+                OE_WARN << LC << "Failed to load " << url << std::endl;
+                return -1;
+            }
+
+            total += time;
+            best = osg::minimum(best, time);
+
+            osg::Group* group = node->asGroup();
+            numChildren = group ? group->getNumChildren() : 0u;
+        }
+
+        std::cout << std::setw(16) << std::left << modes[m].name
+            << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+            << std::setw(14) << total/(double)runs
+            << std::setw(14) << std::setprecision(1) << (best > 0.0 ? megabytes/best : 0.0)
+            << std::setw(14) << numChildren << std::endl;
+    }
+
+    return 0;
+}
+
+//.........................................................................
+
+namespace
+{
+    // a random walk for each track.
+    void moveTracks(Random& prng, std::vector<TrackBatchNode::Update>& updates)
+    {
+        for(unsigned i=0; i<updates.size(); ++i)
+        {
+            TrackBatchNode::Update& u = updates[i];
+            u.lon     = osg::clampBetween( u.lon + (prng.next()-0.5)*0.1, -180.0, 180.0 );
+            u.lat     = osg::clampBetween( u.lat + (prng.next()-0.5)*0.1,  -80.0,  80.0 );
+            u.heading = (float)(prng.next()*360.0);
+        }
+    }
+
+    void printTrackRow(const char* name, double best, double total, int runs, unsigned count)
+    {
+        double per10k = 10000.0 / (double)count;
+        std::cout << std::setw(24) << std::left << name
+            << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+            << std::setw(14) << total/(double)runs
+            << std::setw(16) << std::setprecision(3) << best*1000.0*per10k << std::endl;
+    }
+}
+
+int
+benchmarkTracks(unsigned count, int runs)
+{
+    osg::ref_ptr<MapNode> mapNode = new MapNode( new Map() );
+    const SpatialReference* geoSRS = mapNode->getMapSRS()->getGeographicSRS();
+
+    // two fields, like the osgearth_tracks example.
+    TrackNodeFieldSchema schema;
+    TextSymbol* nameSymbol = new TextSymbol();
+    nameSymbol->pixelOffset()->set( 0, 18 );
+    nameSymbol->alignment() = TextSymbol::ALIGN_CENTER_BOTTOM;
+    schema["name"] = TrackNodeField(nameSymbol, false);
+
+    TextSymbol* posSymbol = new TextSymbol();
+    posSymbol->pixelOffset()->set( 0, -18 );
+    posSymbol->alignment() = TextSymbol::ALIGN_CENTER_TOP;
+    schema["position"] = TrackNodeField(posSymbol, true);
+
+    osg::ref_ptr<osg::Image> icon = new osg::Image();
+    icon->allocateImage( 32, 32, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+    ::memset( icon->data(), 255, icon->getTotalSizeInBytes() );
+
+    Random prng( 0 );
+    std::vector<TrackBatchNode::Update> updates( count );
+    for(unsigned i=0; i<count; ++i)
+    {
+        updates[i].id  = i;
+        updates[i].lon = -180.0 + prng.next()*360.0;
+        updates[i].lat =  -80.0 + prng.next()*160.0;
+        updates[i].alt = 10000.0;
+    }
+
+    std::cout << "Moving " << count << " tracks\n" << std::endl;
+
+    std::cout << std::setw(24) << std::left << "mode"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(16) << "ms/10k tracks" << std::endl;
+
+    // one TrackNode per track:
+    {
+        std::vector< osg::ref_ptr<TrackNode> > nodes( count );
+        for(unsigned i=0; i<count; ++i)
+        {
+            nodes[i] = new TrackNode( mapNode.get(), GeoPoint(geoSRS, updates[i].lon, updates[i].lat, updates[i].alt), icon.get(), schema );
+            nodes[i]->setFieldValue( "name", Stringify() << "Track:" << i );
+        }
+
+        double total = 0.0, best = DBL_MAX;
+        for(int r=0; r<runs; ++r)
+        {
+            moveTracks( prng, updates );
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            for(unsigned i=0; i<count; ++i)
+            {
+                const TrackBatchNode::Update& u = updates[i];
+                nodes[i]->setPosition( GeoPoint(geoSRS, u.lon, u.lat, u.alt, ALTMODE_ABSOLUTE) );
+                nodes[i]->setFieldValue( "position", Stringify() << std::setprecision(4) << u.lat << ", " << u.lon );
+            }
+            double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+            total += time;
+            best = osg::minimum(best, time);
+        }
+        printTrackRow( "TrackNode update", best, total, runs, count );
+    }
+
+    // one batch for all tracks:
+    osg::ref_ptr<TrackBatchNode> batch = new TrackBatchNode( mapNode.get(), schema );
+    unsigned iconIndex = batch->addIcon( icon.get() );
+    for(unsigned i=0; i<count; ++i)
+    {
+        TrackBatchNode::TrackID id = batch->addTrack( GeoPoint(geoSRS, updates[i].lon, updates[i].lat, updates[i].alt), iconIndex );
+        batch->setFieldValue( id, "name", Stringify() << "Track:" << i );
+    }
+    batch->sync();
+
+    double updateTotal = 0.0, updateBest = DBL_MAX;
+    double syncTotal = 0.0, syncBest = DBL_MAX;
+    for(int r=0; r<runs; ++r)
+    {
+        moveTracks( prng, updates );
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        batch->setPositions( updates );
+        for(unsigned i=0; i<count; ++i)
+        {
+            const TrackBatchNode::Update& u = updates[i];
+            batch->setFieldValue( u.id, "position", Stringify() << std::setprecision(4) << u.lat << ", " << u.lon );
+        }
+        osg::Timer_t mid = osg::Timer::instance()->tick();
+        batch->sync();
+        osg::Timer_t end = osg::Timer::instance()->tick();
+
+        double t0 = osg::Timer::instance()->delta_s(start, mid);
+        double t1 = osg::Timer::instance()->delta_s(mid, end);
+        updateTotal += t0; updateBest = osg::minimum(updateBest, t0);
+        syncTotal   += t1; syncBest   = osg::minimum(syncBest, t1);
+    }
+    printTrackRow( "TrackBatchNode update", updateBest, updateTotal, runs, count );
+    printTrackRow( "TrackBatchNode sync", syncBest, syncTotal, runs, count );
+
+    // a full-globe HD view: about half of the tracks face the camera.
+    osg::Viewport viewport( 0, 0, 1920, 1080 );
+    osg::Matrixd view = osg::Matrixd::lookAt( osg::Vec3d(2.0e7, 0, 0), osg::Vec3d(0,0,0), osg::Vec3d(0,0,1) );
+    osg::Matrixd proj = osg::Matrixd::perspective( 45.0, viewport.aspectRatio(), 1.0e5, 1.0e8 );
+
+    TrackBatchNode::CullData cullData;
+    for(int d=0; d<2; ++d)
+    {
+        batch->setDeclutter( d == 1 );
+        double total = 0.0, best = DBL_MAX;
+        for(int r=0; r<runs; ++r)
+        {
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            batch->cull( view, proj, viewport, cullData );
+            double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+            total += time;
+            best = osg::minimum(best, time);
+        }
+        printTrackRow( d == 1 ? "TrackBatchNode cull+dc" : "TrackBatchNode cull", best, total, runs, count );
+
+        TrackBatchNode::Stats stats = batch->getStats();
+        std::cout << "    " << stats.drawn << " drawn, " << stats.decluttered << " decluttered, "
+            << stats.culled << " culled, " << stats.instances << " quads" << std::endl;
+    }
+
+    return 0;
+}
+
+//.........................................................................
+
+namespace
+{
+    // Thread that optimizes one part of a scene into a shared cache.
+    struct OptimizeThread : public OpenThreads::Thread
+    {
+        OptimizeThread(StateSetCache* cache, osg::Node* node) : _cache(cache), _node(node) { }
+
+        void run()
+        {
+            _cache->optimize( _node.get() );
+        }
+
+        osg::ref_ptr<StateSetCache> _cache;
+        osg::ref_ptr<osg::Node>     _node;
+    };
+}
+
+int
+benchmarkStateSharing(const std::string& url, int runs, int numThreads)
+{
+    FeatureList features;
+    if ( !loadFeatures(url, features) )
+        return -1;
+
+    // One node per feature, each with its own copy of a styled stateset, the
+    // way per-feature compilation leaves a scene before sharing.
+    const unsigned numStyles = 32;
+    osg::ref_ptr<osg::Group> scene = new osg::Group();
+    unsigned index = 0;
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i, ++index)
+    {
+        unsigned s = index % numStyles;
+        Color color( (float)(s%4)/3.0f, (float)((s/4)%4)/3.0f, 1.0f, 1.0f );
+        float width = 1.0f + (float)(s/16);
+
+        Style style;
+        style.getOrCreate<PolygonSymbol>()->fill()->color() = color;
+        style.getOrCreate<LineSymbol>()->stroke()->color() = color;
+        style.getOrCreate<LineSymbol>()->stroke()->width() = width;
+
+        FeatureList one;
+        one.push_back( new Feature(*i->get(), osg::CopyOp::DEEP_COPY_ALL) );
+
+        BuildGeometryFilter filter( style );
+        FilterContext cx;
+        osg::ref_ptr<osg::Node> node = filter.push( one, cx );
+        if ( !node.valid() )
+            continue;
+
+        osg::Material* material = new osg::Material();
+        material->setDiffuse( osg::Material::FRONT_AND_BACK, color );
+        osg::StateSet* stateSet = node->getOrCreateStateSet();
+        stateSet->setAttributeAndModes( material, 1 );
+        stateSet->setAttributeAndModes( new osg::LineWidth(width), 1 );
+        stateSet->setAttributeAndModes( new osg::BlendFunc(), 1 );
+
+        scene->addChild( node.get() );
+    }
+
+    std::cout << "Built " << scene->getNumChildren() << " feature nodes from " << url
+        << " in " << numStyles << " styles\n" << std::endl;
+
+    std::cout << std::setw(16) << std::left << "mode"
+        << std::setw(14) << std::right << "best (s)"
+        << std::setw(14) << "avg (s)"
+        << std::setw(12) << "dedupe"
+        << std::setw(12) << "unique"
+        << std::setw(12) << "compares"
+        << std::setw(16) << "lock wait (s)" << std::endl;
+
+    int threadCounts[2] = { 1, numThreads };
+
+    for(unsigned m=0; m<2; ++m)
+    {
+        int n = threadCounts[m];
+        double total = 0.0, best = DBL_MAX;
+        StateSetCache::Stats stats;
+        unsigned unique = 0;
+
+        for(int r=0; r<runs; ++r)
+        {
+            // deep copy so every run starts with unshared state.
+            std::vector< osg::ref_ptr<osg::Group> > parts( n );
+            for(int t=0; t<n; ++t)
+                parts[t] = new osg::Group();
+            for(unsigned c=0; c<scene->getNumChildren(); ++c)
+                parts[c % n]->addChild( osg::clone(scene->getChild(c), osg::CopyOp::DEEP_COPY_ALL) );
+
+            osg::ref_ptr<StateSetCache> cache = new StateSetCache();
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            if ( n == 1 )
+            {
+                cache->optimize( parts[0].get() );
+            }
+            else
+            {
+                std::vector< osg::ref_ptr<OptimizeThread> > threads;
+                for(int t=0; t<n; ++t)
+                {
+                    threads.push_back( new OptimizeThread(cache.get(), parts[t].get()) );
+                    threads.back()->start();
+                }
+                for(int t=0; t<n; ++t)
+                    threads[t]->join();
+            }
+            double time = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            total += time;
+            best = osg::minimum(best, time);
+            stats = cache->getStats();
+            unique = cache->size();
+        }
+
+        std::string name = Stringify() << n << (n == 1 ? " thread" : " threads");
+        std::cout << std::setw(16) << std::left << name
+            << std::setw(14) << std::right << std::fixed << std::setprecision(4) << best
+            << std::setw(14) << total/(double)runs
+            << std::setw(12) << std::setprecision(3) << stats.getDedupeRatio()
+            << std::setw(12) << unique
+            << std::setw(12) << stats.compares
+            << std::setw(16) << std::setprecision(4) << stats.lockWaitTime << std::endl;
+    }
+
+    return 0;
+}
+
+//.........................................................................
+
+int
+benchmarkObjectIndex(unsigned count, int runs)
+{
+    // features per simulated tile
+    const unsigned tileSize = 1000u;
+    unsigned numTiles = (count + tileSize - 1u) / tileSize;
+
+    std::cout << "Paging " << count << " features in " << numTiles << " tiles\n" << std::endl;
+
+    std::cout << std::setw(12) << std::left << "mode"
+        << std::setw(14) << std::right << "insert (ms)"
+        << std::setw(14) << "lookup (ms)"
+        << std::setw(14) << "remove (ms)" << std::endl;
+
+    osg::ref_ptr<osg::Referenced> owner = new osg::Referenced();
+
+    for(unsigned m=0; m<2; ++m)
+    {
+        bool ranges = m == 1;
+        double insertTime = DBL_MAX, lookupTime = DBL_MAX, removeTime = DBL_MAX;
+
+        for(int r=0; r<runs; ++r)
+        {
+            osg::ref_ptr<ObjectIndex> index = new ObjectIndex();
+            std::vector<ObjectID> ids;
+            ids.reserve( count );
+            std::vector<ObjectID> firsts;
+
+            osg::Timer_t t0 = osg::Timer::instance()->tick();
+            for(unsigned t=0; t<numTiles; ++t)
+            {
+                unsigned n = osg::minimum(tileSize, count - t*tileSize);
+                if ( ranges )
+                {
+                    ObjectID first = index->insertRange( owner.get(), n );
+                    firsts.push_back( first );
+                    for(unsigned i=0; i<n; ++i)
+                        ids.push_back( first + i );
+                }
+                else
+                {
+                    for(unsigned i=0; i<n; ++i)
+                        ids.push_back( index->insert(owner.get()) );
+                }
+            }
+
+            osg::Timer_t t1 = osg::Timer::instance()->tick();
+            unsigned found = 0;
+            for(unsigned i=0; i<ids.size(); ++i)
+            {
+                if ( index->get<osg::Referenced>(ids[i]).valid() )
+                    ++found;
+            }
+
+            osg::Timer_t t2 = osg::Timer::instance()->tick();
+            if ( ranges )
+            {
+                for(unsigned t=0; t<numTiles; ++t)
+                    index->removeRange( firsts[t], osg::minimum(tileSize, count - t*tileSize) );
+            }
+            else
+            {
+                index->remove( ids.begin(), ids.end() );
+            }
+            osg::Timer_t t3 = osg::Timer::instance()->tick();
+
+            if ( found != count || index->size() != 0u )
+            {
+                OE_WARN << "Index mismatch: found " << found << " of " << count << ", " << index->size() << " left\n";
+            }
+
+            insertTime = osg::minimum(insertTime, osg::Timer::instance()->delta_m(t0, t1));
+            lookupTime = osg::minimum(lookupTime, osg::Timer::instance()->delta_m(t1, t2));
+            removeTime = osg::minimum(removeTime, osg::Timer::instance()->delta_m(t2, t3));
+        }
+
+        std::cout << std::setw(12) << std::left << (ranges ? "per tile" : "per feature")
+            << std::setw(14) << std::right << std::fixed << std::setprecision(3) << insertTime
+            << std::setw(14) << lookupTime
+            << std::setw(14) << removeTime << std::endl;
+    }
+
+    std::cout << "\nPer-vertex ID memory: " << sizeof(ObjectID) << " bytes (full), "
+        << sizeof(unsigned short) << " bytes (compact_ids)" << std::endl;
+
+    return 0;
+}
+
+//.........................................................................
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc, argv);
+
+    if ( argc < 2 || args.read("--help") )
+        return usage(argv);
+
+    int runs = 3;
+    args.read("--runs", runs);
+    runs = osg::maximum(runs, 1);
+
+    int threads = 4;
+    args.read("--threads", threads);
+    threads = osg::maximum(threads, 1);
+
+    int tiles = 16;
+    args.read("--tiles", tiles);
+    tiles = osg::maximum(tiles, 1);
+
+    int lod = 6;
+    args.read("--lod", lod);
+    lod = osg::maximum(lod, 0);
+
+    std::string url;
+    if ( args.read("--tessellate", url) )
+        return benchmarkTessellation(url, runs);
+
+    if ( args.read("--ogr", url) )
+        return benchmarkOGRQueries(url, runs, threads, tiles);
+
+    if ( args.read("--raster", url) )
+        return benchmarkRasterize(url, runs, lod);
+
+    if ( args.read("--kml", url) )
+        return benchmarkKML(url, runs);
+
+    if ( args.read("--share", url) )
+        return benchmarkStateSharing(url, runs, threads);
+
+    unsigned count = 0;
+    if ( args.read("--tracks", count) )
+        return benchmarkTracks(osg::maximum(count, 1u), runs);
+
+    if ( args.read("--index", count) )
+        return benchmarkObjectIndex(osg::maximum(count, 1u), runs);
+
+    std::string srs;
+    if ( args.read("--transform", srs) )
+        return benchmarkTransform(srs, runs, threads);
+
+    return usage(argv);
+}
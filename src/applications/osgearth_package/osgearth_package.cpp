@@ -32,10 +32,12 @@
 #include <osgEarthUtil/TMSPackager>
 #include <osgEarthDrivers/feature_ogr/OGRFeatureOptions>
 #include <osgEarthDrivers/tms/TMSOptions>
+#include <osgEarthDrivers/mbtiles/MBTilesOptions>
 
 #include <iostream>
 #include <sstream>
 #include <iterator>
+#include <iomanip>
 
 using namespace osgEarth;
 using namespace osgEarth::Util;
@@ -73,6 +75,10 @@ usage( const std::string& msg = "" )
         << "            [--mt]                          ; Use multithreading to process the tiles." << std::endl
         << "            [--concurrency]                 ; The number of threads or proceses to use if --mp or --mt are provided." << std::endl
         << "            [--alpha-mask]                  ; Mask out imagery that isn't in the provided extents." << std::endl
+        << "            [--encoders <num>]              ; Number of threads that encode and write tiles while others are created (default=0, inline)" << std::endl
+        << "            [--max-pending-mb <num>]        ; Memory limit for tiles waiting on the encoders (default=256)" << std::endl
+        << "            [--mbtiles]                     ; Write each layer into a single MBTiles file instead of a TMS folder" << std::endl
+        << "            [--archive-batch <num>]         ; Number of tiles to insert into an MBTiles file at once (default=64)" << std::endl
         << std::endl
         << "            [--verbose]                     ; Displays progress of the operation" << std::endl;
 
@@ -92,6 +98,27 @@ message( const std::string& msg )
 }
 
 
+/** Prints the throughput of the last packaged layer. */
+void
+reportThroughput( const TMSPackager& packager, const std::string& layerName )
+{
+    TMSPackager::Stats stats = packager.getStats();
+    double elapsed = osg::maximum( stats.elapsed, 1e-6 );
+
+    std::cout
+        << std::fixed << std::setprecision(1)
+        << layerName << ": " << stats.tilesWritten << " tiles"
+        << " (" << stats.tilesFailed << " failed) in " << stats.elapsed << "s; "
+        << (double)stats.tilesWritten / elapsed << " tiles/s, "
+        << stats.bytesWritten / (1024.0*1024.0) / elapsed << " MB/s; "
+        << "create " << stats.createTime << "s, "
+        << "encode " << stats.encodeTime << "s, "
+        << "write " << stats.writeTime << "s, "
+        << "waited " << stats.waitTime << "s"
+        << std::endl;
+}
+
+
 /** Finds an argument with the specified extension. */
 std::string
 findArgumentWithExtension( osg::ArgumentParser& args, const std::string& ext )
@@ -148,6 +175,18 @@ makeTMS( osg::ArgumentParser& args )
 
     bool applyAlphaMask = args.read("--alpha-mask");
 
+    // encoder pipeline and archive output
+    unsigned int encoders = 0;
+    args.read("--encoders", encoders);
+
+    unsigned int maxPendingMB = 256;
+    args.read("--max-pending-mb", maxPendingMB);
+
+    bool writeMBTiles = args.read("--mbtiles");
+
+    unsigned int archiveBatch = 64;
+    args.read("--archive-batch", archiveBatch);
+
     bool writeXML = true;
 
     // load up the map
@@ -330,6 +369,10 @@ makeTMS( osg::ArgumentParser& args )
     packager.setOverwrite(overwrite);
     packager.setKeepEmpties(keepEmpties);
     packager.setApplyAlphaMask(applyAlphaMask);
+    packager.setNumEncoderThreads(encoders);
+    packager.setMaxPendingBytes((unsigned long long)maxPendingMB * 1024u * 1024u);
+    packager.setWriteMBTiles(writeMBTiles);
+    packager.setBatchSize(archiveBatch);
 
 
     // new map for an output earth file if necessary.
@@ -350,6 +393,7 @@ makeTMS( osg::ArgumentParser& args )
         if (layer)
         {
             packager.run(layer, map);
+            reportThroughput(packager, packager.getLayerName());
             if (writeXML)
             {
                 packager.writeXML(layer, map);
@@ -368,6 +412,7 @@ makeTMS( osg::ArgumentParser& args )
         if (layer)
         {
             packager.run(layer, map);
+            reportThroughput(packager, packager.getLayerName());
             if (writeXML)
             {
                 packager.writeXML(layer, map );
@@ -389,6 +434,7 @@ makeTMS( osg::ArgumentParser& args )
             osg::Timer_t start = osg::Timer::instance()->tick();
             packager.run(layer, map);
             osg::Timer_t end = osg::Timer::instance()->tick();
+            reportThroughput(packager, packager.getLayerName());
             if (verbose)
             {
                 OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
@@ -410,7 +456,11 @@ makeTMS( osg::ArgumentParser& args )
                     osgDB::concatPaths( layerFolder, "tms.xml" ),
                     outEarthFile );
 
-                ImageLayerOptions layerOptions( packager.getLayerName(), tms );
+                // or MBTiles driver info:
+                MBTilesTileSourceOptions mbtiles;
+                mbtiles.filename() = URI( layerFolder + ".mbtiles", outEarthFile );
+
+                ImageLayerOptions layerOptions( packager.getLayerName(), writeMBTiles ? TileSourceOptions(mbtiles) : TileSourceOptions(tms) );
                 layerOptions.mergeConfig( layer->getInitialOptions().getConfig( true ) );
                 layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
 
@@ -426,6 +476,7 @@ makeTMS( osg::ArgumentParser& args )
             osg::Timer_t start = osg::Timer::instance()->tick();
             packager.run(layer, map);
             osg::Timer_t end = osg::Timer::instance()->tick();
+            reportThroughput(packager, packager.getLayerName());
             if (verbose)
             {
                 OE_NOTICE << "Completed seeding layer " << layer->getName() << " in " << prettyPrintTime( osg::Timer::instance()->delta_s( start, end ) ) << std::endl;
@@ -446,7 +497,11 @@ makeTMS( osg::ArgumentParser& args )
                     osgDB::concatPaths( layerFolder, "tms.xml" ),
                     outEarthFile );
 
-                ElevationLayerOptions layerOptions( packager.getLayerName(), tms );
+                // or MBTiles driver info:
+                MBTilesTileSourceOptions mbtiles;
+                mbtiles.filename() = URI( layerFolder + ".mbtiles", outEarthFile );
+
+                ElevationLayerOptions layerOptions( packager.getLayerName(), writeMBTiles ? TileSourceOptions(mbtiles) : TileSourceOptions(tms) );
                 layerOptions.mergeConfig( layer->getInitialOptions().getConfig( true ) );
                 layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
 
@@ -34,6 +34,7 @@
 #include <osgEarthUtil/AnnotationEvents>
 #include <osgEarthUtil/HTM>
 #include <osgEarthAnnotation/TrackNode>
+#include <osgEarthAnnotation/TrackBatchNode>
 #include <osgEarthAnnotation/AnnotationData>
 #include <osgEarthSymbology/Color>
 
@@ -211,6 +212,80 @@ createTrackNodes( MapNode* mapNode, osg::Group* parent, const TrackNodeFieldSche
 }
 
 
+/**
+ * Simulates the same great circle tracks in a single TrackBatchNode,
+ * moving all of them with one bulk update per frame.
+ */
+struct TrackBatchSim : public osg::Operation
+{
+    TrackBatchSim(TrackBatchNode* batch) : osg::Operation( "trackbatchsim", true ), _batch(batch) { }
+
+    void operator()( osg::Object* obj ) {
+        osg::View* view = dynamic_cast<osg::View*>(obj);
+        double t = fmod(view->getFrameStamp()->getSimulationTime(), (double)g_duration.get()) / (double)g_duration.get();
+
+        for( unsigned i=0; i<_updates.size(); ++i )
+        {
+            GeoMath::interpolate(
+                _start[i].y(), _start[i].x(), _end[i].y(), _end[i].x(), t,
+                _updates[i].lat, _updates[i].lon );
+            _updates[i].lat = osg::RadiansToDegrees(_updates[i].lat);
+            _updates[i].lon = osg::RadiansToDegrees(_updates[i].lon);
+        }
+        _batch->setPositions( _updates );
+
+        for( unsigned i=0; i<_updates.size(); ++i )
+        {
+            GeoPoint geo(_srs.get(), _updates[i].lon, _updates[i].lat, 10000.0, ALTMODE_ABSOLUTE);
+            _batch->setFieldValue( _updates[i].id, FIELD_POSITION, g_showCoords ? s_format(geo) : "" );
+        }
+    }
+
+    osg::ref_ptr<TrackBatchNode>         _batch;
+    osg::ref_ptr<const SpatialReference> _srs;
+    std::vector<osg::Vec2d>              _start, _end; // lon/lat radians
+    std::vector<TrackBatchNode::Update>  _updates;
+};
+
+
+/** Builds a bunch of tracks in one TrackBatchNode. */
+TrackBatchNode*
+createTrackBatch( MapNode* mapNode, const TrackNodeFieldSchema& schema, TrackBatchSim*& sim )
+{
+    osg::ref_ptr<osg::Image> srcImage = osgDB::readImageFile( ICON_URL );
+    osg::ref_ptr<osg::Image> image;
+    ImageUtils::resizeImage( srcImage.get(), ICON_SIZE, ICON_SIZE, image );
+
+    TrackBatchNode* batch = new TrackBatchNode(mapNode, schema);
+    unsigned icon = batch->addIcon( image.get() );
+
+    sim = new TrackBatchSim( batch );
+
+    Random prng;
+    const SpatialReference* geoSRS = mapNode->getMapSRS()->getGeographicSRS();
+    sim->_srs = geoSRS;
+
+    for( unsigned i=0; i<g_numTracks; ++i )
+    {
+        double lon0 = -180.0 + prng.next() * 360.0;
+        double lat0 = -80.0 + prng.next() * 160.0;
+        double lon1 = -180.0 + prng.next() * 360.0;
+        double lat1 = -80.0 + prng.next() * 160.0;
+
+        TrackBatchNode::TrackID id = batch->addTrack( GeoPoint(geoSRS, lon0, lat0, 10000.0, ALTMODE_ABSOLUTE), icon );
+        batch->setFieldValue( id, FIELD_NAME,   Stringify() << "Track:" << i );
+        batch->setFieldValue( id, FIELD_NUMBER, Stringify() << (1 + prng.next(9)) );
+        batch->setPriority  ( id, float(i) );
+
+        sim->_start.push_back( osg::Vec2d(osg::DegreesToRadians(lon0), osg::DegreesToRadians(lat0)) );
+        sim->_end.push_back  ( osg::Vec2d(osg::DegreesToRadians(lon1), osg::DegreesToRadians(lat1)) );
+        sim->_updates.push_back( TrackBatchNode::Update(id, lon0, lat0, 10000.0) );
+    }
+
+    return batch;
+}
+
+
 /** creates some UI controls for adjusting the decluttering parameters. */
 void
 createControls( osgViewer::View* view )
@@ -320,6 +395,17 @@ main(int argc, char** argv)
     TrackNodeFieldSchema schema;
     createFieldSchema( schema );
 
+    // --batch draws all the tracks with a single TrackBatchNode.
+    if ( arguments.read("--batch") )
+    {
+        TrackBatchSim* sim = 0L;
+        root->addChild( createTrackBatch(mapNode, schema, sim) );
+        viewer.addUpdateOperation( sim );
+        viewer.setRunFrameScheme( viewer.CONTINUOUS );
+        viewer.getCamera()->setSmallFeatureCullingPixelSize(-1.0f);
+        return viewer.run();
+    }
+
     // create some track nodes.
     TrackSims trackSims;
     osg::Group* tracks = new osg::Group();
@@ -0,0 +1,524 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/AnalyticTransforms>
+#include <osgEarth/Cube>
+#include <osgEarth/StringUtils>
+#include <osg/Math>
+#include <cmath>
+#include <cfloat>
+#include <cstdlib>
+#include <limits>
+#include <map>
+
+#define LC "[AnalyticTransforms] "
+
+using namespace osgEarth;
+
+// points per structure-of-arrays chunk
+#define CHUNK_SIZE 256
+
+namespace
+{
+    typedef AnalyticTransforms::Definition Definition;
+
+    // WGS84 ellipsoid
+    const double WGS84_A  = 6378137.0;
+    const double WGS84_F  = 1.0/298.257223563;
+    const double WGS84_B  = WGS84_A*(1.0-WGS84_F);
+    const double WGS84_E2 = WGS84_F*(2.0-WGS84_F);
+    const double WGS84_E  = sqrt(WGS84_E2);
+
+    const double D2R = osg::PI/180.0;
+    const double R2D = 180.0/osg::PI;
+
+    bool s_enabled = ::getenv("OSGEARTH_NO_ANALYTIC_TRANSFORMS") == 0L;
+
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    inline bool isFinite(double v)
+    {
+        return !osg::isNaN(v) && fabs(v) <= DBL_MAX;
+    }
+
+    inline void fail(double* x, double* y, double* z, unsigned i)
+    {
+        x[i] = y[i] = z[i] = NaN;
+    }
+
+    // Sets any point with a non-finite coordinate to NaN. Returns false if
+    // there were any (including points a kernel already failed).
+    bool validate(double* x, double* y, double* z, unsigned count)
+    {
+        bool ok = true;
+        for(unsigned i=0; i<count; ++i)
+        {
+            if ( !isFinite(x[i]) || !isFinite(y[i]) || !isFinite(z[i]) )
+            {
+                fail(x, y, z, i);
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    //..................................................................
+    // Geodetic <=> ECEF
+
+    bool geodeticToECEF(const Definition&, double* x, double* y, double* z, unsigned count)
+    {
+        for(unsigned i=0; i<count; ++i)
+        {
+            double lon = x[i]*D2R, lat = y[i]*D2R, h = z[i];
+            double sinLat = sin(lat), cosLat = cos(lat);
+            double N = WGS84_A / sqrt(1.0 - WGS84_E2*sinLat*sinLat);
+            x[i] = (N + h) * cosLat * cos(lon);
+            y[i] = (N + h) * cosLat * sin(lon);
+            z[i] = (N*(1.0-WGS84_E2) + h) * sinLat;
+        }
+        return validate(x, y, z, count);
+    }
+
+    // Heikkinen's closed-form (non-iterative) solution.
+    bool ecefToGeodetic(const Definition&, double* x, double* y, double* z, unsigned count)
+    {
+        const double a2 = WGS84_A*WGS84_A, b2 = WGS84_B*WGS84_B;
+        const double ep2 = (a2-b2)/b2;
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            double X = x[i], Y = y[i], Z = z[i];
+            double p = sqrt(X*X + Y*Y);
+
+            // on the polar axis the longitude is arbitrary and the formula degenerates.
+            if ( p < 1e-6 )
+            {
+                x[i] = 0.0;
+                y[i] = Z >= 0.0 ? 90.0 : -90.0;
+                z[i] = fabs(Z) - WGS84_B;
+                continue;
+            }
+
+            double F  = 54.0*b2*Z*Z;
+            double G  = p*p + (1.0-WGS84_E2)*Z*Z - WGS84_E2*(a2-b2);
+            double c  = WGS84_E2*WGS84_E2*F*p*p/(G*G*G);
+            double s  = pow(1.0 + c + sqrt(c*c + 2.0*c), 1.0/3.0);
+            double k  = s + 1.0 + 1.0/s;
+            double P  = F/(3.0*k*k*G*G);
+            double Q  = sqrt(1.0 + 2.0*WGS84_E2*WGS84_E2*P);
+            double r0 = -(P*WGS84_E2*p)/(1.0+Q) +
+                sqrt(osg::maximum(0.0, 0.5*a2*(1.0+1.0/Q) - P*(1.0-WGS84_E2)*Z*Z/(Q*(1.0+Q)) - 0.5*P*p*p));
+            double t  = p - WGS84_E2*r0;
+            double U  = sqrt(t*t + Z*Z);
+            double V  = sqrt(t*t + (1.0-WGS84_E2)*Z*Z);
+            double z0 = b2*Z/(WGS84_A*V);
+
+            x[i] = atan2(Y, X)*R2D;
+            y[i] = atan((Z + ep2*z0)/p)*R2D;
+            z[i] = U*(1.0 - b2/(WGS84_A*V));
+        }
+        return validate(x, y, z, count);
+    }
+
+    //..................................................................
+    // Geodetic <=> UTM, using Krueger's series to sixth order in the third
+    // flattening (Karney 2011, "Transverse Mercator with an accuracy of a
+    // few nanometers"). Within a few zones of the central meridian this
+    // agrees with PROJ's etmerc to well under a millimeter.
+
+    struct TransverseMercator
+    {
+        TransverseMercator()
+        {
+            double n = WGS84_F/(2.0-WGS84_F);
+            double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+
+            A = WGS84_A/(1.0+n) * (1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+
+            alpha[0] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0 + 41.0*n4/180.0 - 127.0*n5/288.0 + 7891.0*n6/37800.0;
+            alpha[1] = 13.0*n2/48.0 - 3.0*n3/5.0 + 557.0*n4/1440.0 + 281.0*n5/630.0 - 1983433.0*n6/1935360.0;
+            alpha[2] = 61.0*n3/240.0 - 103.0*n4/140.0 + 15061.0*n5/26880.0 + 167603.0*n6/181440.0;
+            alpha[3] = 49561.0*n4/161280.0 - 179.0*n5/168.0 + 6601661.0*n6/7257600.0;
+            alpha[4] = 34729.0*n5/80640.0 - 3418889.0*n6/1995840.0;
+            alpha[5] = 212378941.0*n6/319334400.0;
+
+            beta[0] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0 - n4/360.0 - 81.0*n5/512.0 + 96199.0*n6/604800.0;
+            beta[1] = n2/48.0 + n3/15.0 - 437.0*n4/1440.0 + 46.0*n5/105.0 - 1118711.0*n6/3870720.0;
+            beta[2] = 17.0*n3/480.0 - 37.0*n4/840.0 - 209.0*n5/4480.0 + 5569.0*n6/90720.0;
+            beta[3] = 4397.0*n4/161280.0 - 11.0*n5/504.0 - 830251.0*n6/7257600.0;
+            beta[4] = 4583.0*n5/161280.0 - 108847.0*n6/3991680.0;
+            beta[5] = 20648693.0*n6/638668800.0;
+        }
+
+        double A;
+        double alpha[6];
+        double beta[6];
+    };
+
+    const TransverseMercator& tm()
+    {
+        static TransverseMercator s_tm;
+        return s_tm;
+    }
+
+    const double UTM_K0 = 0.9996;
+    const double UTM_FE = 500000.0;
+    const double UTM_FN_SOUTH = 10000000.0;
+
+    // The projection is singular 90 degrees from the central meridian (PROJ
+    // fails there too), so points that far out are rejected.
+    const double UTM_MAX_LAMBDA = 0.5*osg::PI - 1e-6;
+
+    bool geodeticToUTM(const Definition& def, double* x, double* y, double* z, unsigned count)
+    {
+        const TransverseMercator& t = tm();
+        const double lon0 = (6.0*def.zone - 183.0)*D2R;
+        const double kA   = UTM_K0*t.A;
+        const double fn   = def.south ? UTM_FN_SOUTH : 0.0;
+
+        bool ok = true;
+        for(unsigned i=0; i<count; ++i)
+        {
+            // longitude from the central meridian, in [-pi, pi):
+            double lam = x[i]*D2R - lon0;
+            lam -= 2.0*osg::PI * floor((lam + osg::PI)/(2.0*osg::PI));
+            double phi = y[i]*D2R;
+
+            if ( !(fabs(lam) <= UTM_MAX_LAMBDA) || !(fabs(phi) <= 0.5*osg::PI) )
+            {
+                fail(x, y, z, i);
+                ok = false;
+                continue;
+            }
+
+            // conformal latitude, as a tangent:
+            double sinPhi = sin(phi);
+            double tau    = sinh(atanh(sinPhi) - WGS84_E*atanh(WGS84_E*sinPhi));
+
+            double xi  = atan2(tau, cos(lam));
+            double eta = atanh(sin(lam)/sqrt(1.0 + tau*tau));
+
+            double sxi = xi, seta = eta;
+            for(int j=0; j<6; ++j)
+            {
+                double k = 2.0*(j+1);
+                sxi  += t.alpha[j] * sin(k*xi) * cosh(k*eta);
+                seta += t.alpha[j] * cos(k*xi) * sinh(k*eta);
+            }
+
+            x[i] = UTM_FE + kA*seta;
+            y[i] = fn + kA*sxi;
+        }
+        return validate(x, y, z, count) && ok;
+    }
+
+    bool utmToGeodetic(const Definition& def, double* x, double* y, double* z, unsigned count)
+    {
+        const TransverseMercator& t = tm();
+        const double lon0 = (6.0*def.zone - 183.0)*D2R;
+        const double kA   = UTM_K0*t.A;
+        const double fn   = def.south ? UTM_FN_SOUTH : 0.0;
+        const double e2m  = 1.0 - WGS84_E2;
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            double xi  = (y[i] - fn)/kA;
+            double eta = (x[i] - UTM_FE)/kA;
+
+            double pxi = xi, peta = eta;
+            for(int j=0; j<6; ++j)
+            {
+                double k = 2.0*(j+1);
+                pxi  -= t.beta[j] * sin(k*xi) * cosh(k*eta);
+                peta -= t.beta[j] * cos(k*xi) * sinh(k*eta);
+            }
+
+            double sinhEta = sinh(peta), cosXi = cos(pxi);
+            double taup = sin(pxi)/sqrt(sinhEta*sinhEta + cosXi*cosXi);
+            double lam  = atan2(sinhEta, cosXi);
+
+            // recover the geodetic latitude from the conformal one with a fixed
+            // number of Newton steps (converges to machine precision in 3).
+            double tau = taup;
+            for(int j=0; j<3; ++j)
+            {
+                double tau1  = sqrt(1.0 + tau*tau);
+                double sig   = sinh(WGS84_E*atanh(WGS84_E*tau/tau1));
+                double taupi = tau*sqrt(1.0 + sig*sig) - sig*tau1;
+                tau += (taup - taupi)/sqrt(1.0 + taupi*taupi) * (1.0 + e2m*tau*tau)/(e2m*tau1);
+            }
+
+            // clamp like the OGR path does for projected => geographic.
+            x[i] = osg::clampBetween((lon0 + lam)*R2D, -180.0, 180.0);
+            y[i] = osg::clampBetween(atan(tau)*R2D, -90.0, 90.0);
+        }
+        return validate(x, y, z, count);
+    }
+
+    //..................................................................
+    // Geodetic <=> Plate Carree ("+proj=eqc" with no offsets), which PROJ
+    // evaluates on the sphere of the ellipsoid's semi-major axis.
+
+    bool geodeticToPlateCarree(const Definition&, double* x, double* y, double* z, unsigned count)
+    {
+        const double s = WGS84_A*D2R;
+        for(unsigned i=0; i<count; ++i)
+        {
+            x[i] *= s;
+            y[i] *= s;
+        }
+        return validate(x, y, z, count);
+    }
+
+    bool plateCarreeToGeodetic(const Definition&, double* x, double* y, double* z, unsigned count)
+    {
+        const double s = R2D/WGS84_A;
+        for(unsigned i=0; i<count; ++i)
+        {
+            x[i] = osg::clampBetween(x[i]*s, -180.0, 180.0);
+            y[i] = osg::clampBetween(y[i]*s, -90.0, 90.0);
+        }
+        return validate(x, y, z, count);
+    }
+
+    //..................................................................
+    // Geodetic <=> unified cube. Face selection branches, so this one is
+    // batched but not vectorizable; it still skips the generic per-point
+    // pre/post transform path.
+
+    bool cubeToGeodetic(const Definition&, double* x, double* y, double* z, unsigned count)
+    {
+        bool ok = true;
+        for(unsigned i=0; i<count; ++i)
+        {
+            int face;
+            double fx = x[i], fy = y[i], lat, lon;
+            if ( CubeUtils::cubeToFace(fx, fy, face) && CubeUtils::faceCoordsToLatLon(fx, fy, face, lat, lon) )
+            {
+                x[i] = lon;
+                y[i] = lat;
+            }
+            else
+            {
+                fail(x, y, z, i);
+                ok = false;
+            }
+        }
+        return validate(x, y, z, count) && ok;
+    }
+
+    bool geodeticToCube(const Definition&, double* x, double* y, double* z, unsigned count)
+    {
+        bool ok = true;
+        for(unsigned i=0; i<count; ++i)
+        {
+            int face;
+            double fx, fy;
+            if ( CubeUtils::latLonToFaceCoords(y[i], x[i], fx, fy, face) && CubeUtils::faceToCube(fx, fy, face) )
+            {
+                x[i] = fx;
+                y[i] = fy;
+            }
+            else
+            {
+                fail(x, y, z, i);
+                ok = false;
+            }
+        }
+        return validate(x, y, z, count) && ok;
+    }
+
+    //..................................................................
+
+    // The kernel registry, indexed by AnalyticTransforms::Type. Geodetic
+    // is the hub, so its kernels are the identity.
+    struct Entry
+    {
+        AnalyticTransforms::Kernel toGeodetic;
+        AnalyticTransforms::Kernel fromGeodetic;
+    };
+
+    const Entry s_kernels[AnalyticTransforms::NUM_TYPES] =
+    {
+        { 0L,                    0L                    }, // TYPE_NONE
+        { 0L,                    0L                    }, // TYPE_GEODETIC
+        { ecefToGeodetic,        geodeticToECEF        }, // TYPE_ECEF
+        { utmToGeodetic,         geodeticToUTM         }, // TYPE_UTM
+        { plateCarreeToGeodetic, geodeticToPlateCarree }, // TYPE_PLATE_CARREE
+        { cubeToGeodetic,        geodeticToCube        }  // TYPE_CUBE
+    };
+
+    // splits a PROJ4 string into parameters; flags like "+south" get an empty value.
+    void parsePROJ4(const std::string& proj4, std::map<std::string,std::string>& out)
+    {
+        StringVector tokens;
+        StringTokenizer( proj4, tokens, " \t", "", false, true );
+        for(StringVector::const_iterator i = tokens.begin(); i != tokens.end(); ++i)
+        {
+            if ( i->empty() || (*i)[0] != '+' )
+                continue;
+            std::string::size_type eq = i->find('=');
+            if ( eq == std::string::npos )
+                out[toLower(i->substr(1))] = "";
+            else
+                out[toLower(i->substr(1, eq-1))] = toLower(i->substr(eq+1));
+        }
+    }
+
+    // true if the parameter is absent or numerically zero.
+    bool isZero(const std::map<std::string,std::string>& params, const char* name)
+    {
+        std::map<std::string,std::string>::const_iterator i = params.find(name);
+        return i == params.end() || as<double>(i->second, 1.0) == 0.0;
+    }
+}
+
+//------------------------------------------------------------------------
+
+AnalyticTransforms::Definition
+AnalyticTransforms::fromPROJ4(const std::string& proj4)
+{
+    Definition def;
+
+    std::map<std::string,std::string> params;
+    parsePROJ4( proj4, params );
+
+    // must be plain WGS84: no datum shift, grid shift or alternate prime meridian.
+    std::map<std::string,std::string>::const_iterator datum = params.find("datum");
+    std::map<std::string,std::string>::const_iterator ellps = params.find("ellps");
+    bool wgs84 =
+        (datum != params.end() && datum->second == "wgs84") ||
+        (datum == params.end() && ellps != params.end() && ellps->second == "wgs84");
+
+    if ( !wgs84 || params.count("pm") || params.count("nadgrids") || params.count("geoidgrids") || params.count("axis") )
+        return def;
+
+    std::map<std::string,std::string>::const_iterator towgs84 = params.find("towgs84");
+    if ( towgs84 != params.end() )
+    {
+        StringVector shift;
+        StringTokenizer( towgs84->second, shift, ",", "", false, true );
+        for(unsigned i=0; i<shift.size(); ++i)
+            if ( as<double>(shift[i], 1.0) != 0.0 )
+                return def;
+    }
+
+    std::map<std::string,std::string>::const_iterator units = params.find("units");
+    bool meters = units == params.end() || units->second == "m";
+
+    const std::string proj = params.count("proj") ? params["proj"] : "";
+
+    if ( proj == "longlat" || proj == "latlong" || proj == "lonlat" || proj == "latlon" )
+    {
+        def.type = TYPE_GEODETIC;
+    }
+    else if ( proj == "utm" && meters )
+    {
+        int zone = as<int>( params["zone"], 0 );
+        if ( zone >= 1 && zone <= 60 )
+        {
+            def.type  = TYPE_UTM;
+            def.zone  = zone;
+            def.south = params.count("south") > 0;
+        }
+    }
+    else if ( proj == "eqc" && meters &&
+              isZero(params, "lat_ts") && isZero(params, "lat_0") && isZero(params, "lon_0") &&
+              isZero(params, "x_0")    && isZero(params, "y_0") )
+    {
+        def.type = TYPE_PLATE_CARREE;
+    }
+
+    return def;
+}
+
+bool
+AnalyticTransforms::canTransform(const Definition& from, const Definition& to)
+{
+    return s_enabled && from.type != TYPE_NONE && to.type != TYPE_NONE;
+}
+
+bool
+AnalyticTransforms::transform(const Definition&        from,
+                              const Definition&        to,
+                              std::vector<osg::Vec3d>& points,
+                              std::vector<unsigned>*   out_failed)
+{
+    if ( from.type == TYPE_NONE || to.type == TYPE_NONE )
+        return false;
+
+    if ( from == to )
+        return true;
+
+    Kernel toGeodetic   = s_kernels[from.type].toGeodetic;
+    Kernel fromGeodetic = s_kernels[to.type].fromGeodetic;
+
+    double x[CHUNK_SIZE], y[CHUNK_SIZE], z[CHUNK_SIZE];
+    bool ok = true;
+
+    for(unsigned start=0; start < points.size(); start += CHUNK_SIZE)
+    {
+        unsigned count = osg::minimum( (unsigned)points.size()-start, (unsigned)CHUNK_SIZE );
+        osg::Vec3d* p = &points[start];
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            x[i] = p[i].x();
+            y[i] = p[i].y();
+            z[i] = p[i].z();
+        }
+
+        bool chunkOK = true;
+
+        if ( toGeodetic && !toGeodetic(from, x, y, z, count) )
+            chunkOK = false;
+
+        // a failed point stays NaN through the second kernel.
+        if ( fromGeodetic && !fromGeodetic(to, x, y, z, count) )
+            chunkOK = false;
+
+        for(unsigned i=0; i<count; ++i)
+        {
+            if ( chunkOK || !osg::isNaN(x[i]) )
+            {
+                p[i].set( x[i], y[i], z[i] );
+            }
+            else if ( out_failed )
+            {
+                out_failed->push_back( start+i );
+            }
+        }
+
+        if ( !chunkOK )
+            ok = false;
+    }
+
+    return ok;
+}
+
+void
+AnalyticTransforms::setEnabled(bool value)
+{
+    s_enabled = value;
+}
+
+bool
+AnalyticTransforms::isEnabled()
+{
+    return s_enabled;
+}
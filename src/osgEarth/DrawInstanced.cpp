@@ -45,6 +45,17 @@ using namespace osgEarth::DrawInstanced;
 #define POSTEX_TBO_UNIT 5
 #define TAG_MATRIX_VECTOR "osgEarth::DrawInstanced::MatrixRefVector"
 
+// default maximum number of instances in one (separately culled) batch
+#define DEFAULT_BATCH_SIZE 1024
+
+// bytes per instance in the matrix and quantized TBO layouts
+#define MATRIX_INSTANCE_BYTES    64
+#define QUANTIZED_INSTANCE_BYTES 24
+
+// largest vertex error the quantized layout may introduce, as a fraction of
+// the size of the smallest instance in the batch
+#define QUANTIZED_MAX_ERROR 0.01
+
 //Uncomment to experiment with instance count adjustment
 //#define USE_INSTANCE_LODS
 
@@ -149,6 +160,160 @@ namespace
         x |= x >> 16;
         return x+1;
     }
+
+    DrawInstanced::Stats s_stats;
+    Threading::Mutex     s_statsMutex;
+
+    /**
+     * Decomposes an instance matrix into a uniform scale, a rotation and a
+     * translation. Fails if the matrix is anything else (shear, non-uniform
+     * or negative scale), in which case the instance needs the full matrix.
+     */
+    bool decomposeTRS(const osg::Matrixd& m, osg::Vec3d& translation, osg::Quat& rotation, double& scale)
+    {
+        osg::Vec3d s;
+        osg::Quat  so;
+        m.decompose( translation, rotation, s, so );
+
+        if ( s.x() <= 0.0 ||
+             !osg::equivalent(s.x(), s.y(), 1e-5*s.x()) ||
+             !osg::equivalent(s.x(), s.z(), 1e-5*s.x()) )
+        {
+            return false;
+        }
+        scale = s.x();
+
+        osg::Matrixd check =
+            osg::Matrixd::scale(scale, scale, scale) *
+            osg::Matrixd::rotate(rotation) *
+            osg::Matrixd::translate(translation);
+
+        for(int r=0; r<4; ++r)
+            for(int c=0; c<4; ++c)
+                if ( !osg::equivalent(check(r,c), m(r,c), 1e-5*osg::maximum(1.0, fabs(m(r,c)))) )
+                    return false;
+
+        return true;
+    }
+
+    // maps [lo, lo+range] to [0, 65535]
+    inline GLushort quantize16(double value, double lo, double range)
+    {
+        if ( range <= 0.0 )
+            return 0;
+        return (GLushort)osg::clampBetween( osg::round((value-lo)/range * 65535.0), 0.0, 65535.0 );
+    }
+
+    /**
+     * Worst-case displacement of a model vertex (at most "radius" from the
+     * model origin) after quantizing a batch's positions over "origins" and
+     * its scales over [minScale, maxScale] to 16 bits.
+     */
+    double quantizationError(const osg::BoundingBoxd& origins, double minScale, double maxScale, double radius)
+    {
+        const double step = 1.0/65535.0;
+
+        // rounding moves each value by up to half a step of its range.
+        double positionError = 0.5 * step * (origins._max - origins._min).length();
+        double scaleError    = 0.5 * step * (maxScale - minScale);
+
+        // each quaternion component (range [-1,1]) is off by up to one step,
+        // which rotates the model by at most twice the length of that error.
+        double rotationError = 2.0 * (2.0 * step);
+
+        return positionError + radius * (scaleError + maxScale * rotationError);
+    }
+
+    /**
+     * Sorts instances into spatially compact runs of at most maxSize, by
+     * recursively splitting at the median along the longest axis. Output
+     * is a list of [begin, end) ranges into the (reordered) instance vector.
+     */
+    void partitionInstances(std::vector<ModelInstance>& instances, unsigned begin, unsigned end, unsigned maxSize,
+                   std::vector< std::pair<unsigned,unsigned> >& output)
+    {
+        if ( end - begin <= maxSize )
+        {
+            output.push_back( std::make_pair(begin, end) );
+            return;
+        }
+
+        osg::BoundingBoxd box;
+        for(unsigned i=begin; i<end; ++i)
+            box.expandBy( instances[i].matrix.getTrans() );
+
+        osg::Vec3d size = box._max - box._min;
+        int axis = size.x() >= size.y() && size.x() >= size.z() ? 0 : size.y() >= size.z() ? 1 : 2;
+
+        struct AxisLess {
+            int _axis;
+            AxisLess(int axis) : _axis(axis) { }
+            bool operator()(const ModelInstance& lhs, const ModelInstance& rhs) const {
+                return lhs.matrix.getTrans()[_axis] < rhs.matrix.getTrans()[_axis];
+            }
+        };
+
+        unsigned middle = begin + (end-begin)/2;
+        std::nth_element( instances.begin()+begin, instances.begin()+middle, instances.begin()+end, AxisLess(axis) );
+
+        partitionInstances( instances, begin, middle, maxSize, output );
+        partitionInstances( instances, middle, end, maxSize, output );
+    }
+
+    /**
+     * Counts the primitive sets (i.e. draw calls) in a graph, and optionally
+     * the size of its vertex data.
+     */
+    struct CountDrawCalls : public osg::NodeVisitor
+    {
+        unsigned _drawCalls;
+        double   _bytes;
+        CountDrawCalls() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN), _drawCalls(0), _bytes(0.0) { }
+
+        void apply(osg::Geode& geode)
+        {
+            for(unsigned i=0; i<geode.getNumDrawables(); ++i)
+            {
+                osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+                if ( geom )
+                {
+                    _drawCalls += geom->getNumPrimitiveSets();
+
+                    osg::Geometry::ArrayList arrays;
+                    geom->getArrayList( arrays );
+                    for(unsigned a=0; a<arrays.size(); ++a)
+                    {
+                        if ( arrays[a].valid() )
+                            _bytes += (double)arrays[a]->getTotalDataSize();
+                    }
+                }
+            }
+            traverse(geode);
+        }
+    };
+
+    /**
+     * Switches a graph's geometry to VBOs up front, so that copies which share
+     * its arrays never need to modify them.
+     */
+    struct PrepareForInstancing : public osg::NodeVisitor
+    {
+        PrepareForInstancing() : osg::NodeVisitor(TRAVERSE_ALL_CHILDREN) { }
+
+        void apply(osg::Geode& geode)
+        {
+            for(unsigned i=0; i<geode.getNumDrawables(); ++i)
+            {
+                osg::Geometry* geom = geode.getDrawable(i)->asGeometry();
+                if ( geom )
+                {
+                    geom->setUseDisplayList( false );
+                    geom->setUseVertexBufferObjects( true );
+                }
+            }
+            traverse(geode);
+        }
+    };
 }
 
 //----------------------------------------------------------------------
@@ -245,6 +410,7 @@ DrawInstanced::install(osg::StateSet* stateset)
     pkg.load( vp, pkg.InstancingVertex );
 
     stateset->getOrCreateUniform("oe_di_postex_TBO", osg::Uniform::SAMPLER_BUFFER)->set(POSTEX_TBO_UNIT);
+    stateset->getOrCreateUniform("oe_di_quantized", osg::Uniform::BOOL)->set(false);
 }
 
 
@@ -263,11 +429,19 @@ DrawInstanced::remove(osg::StateSet* stateset)
 
     stateset->removeUniform("oe_di_postex_TBO");
     stateset->removeUniform("oe_di_postex_TBO_size");
+    stateset->removeUniform("oe_di_quantized");
 }
 
 
 void
 DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
+{
+    convertGraphToUseDrawInstanced( parent, DEFAULT_BATCH_SIZE );
+}
+
+
+void
+DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent, unsigned maxInstancesPerBatch )
 {
     // place a static bounding sphere on the graph since we intend to alter
     // the structure of the subgraph.
@@ -314,7 +488,11 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
 	// This is the total number of instances it can store
 	// We will iterate below. If the number of instances is larger than the buffer can store
 	// we make more tbos
-	int maxTBOInstancesSize = maxTBOSize/4;// 4 vec4s per matrix.
+	unsigned maxTBOInstancesSize = maxTBOSize/4;// 4 vec4s per matrix.
+
+    unsigned batchSize = osg::clampBetween( maxInstancesPerBatch, 1u, osg::maximum(maxTBOInstancesSize, 1u) );
+
+    Stats stats;
 
     // For each model:
     for( ModelInstanceMap::iterator i = models.begin(); i != models.end(); ++i )
@@ -327,102 +505,211 @@ DrawInstanced::convertGraphToUseDrawInstanced( osg::Group* parent )
         node->accept( cbv );
         const osg::BoundingBox& nodeBox = cbv.getBoundingBox();
 
-        osg::BoundingBox bbox;
-        for( std::vector<ModelInstance>::iterator m = instances.begin(); m != instances.end(); ++m )
+        // Split the instances into spatially compact batches, so each batch
+        // gets tight bounds and the cull traversal can discard it on its own.
+        std::vector< std::pair<unsigned,unsigned> > batches;
+        partitionInstances( instances, 0, instances.size(), batchSize, batches );
+
+        // Use the compact layout if every instance is a plain scale/rotate/translate.
+        std::vector<osg::Vec3d> translations( instances.size() );
+        std::vector<osg::Quat>  rotations   ( instances.size() );
+        std::vector<double>     scales      ( instances.size() );
+
+        bool quantized = true;
+        for( unsigned m=0; m<instances.size() && quantized; ++m )
         {
-            bbox.expandBy(nodeBox.corner(0) * m->matrix);
-            bbox.expandBy(nodeBox.corner(1) * m->matrix);
-            bbox.expandBy(nodeBox.corner(2) * m->matrix);
-            bbox.expandBy(nodeBox.corner(3) * m->matrix);
-            bbox.expandBy(nodeBox.corner(4) * m->matrix);
-            bbox.expandBy(nodeBox.corner(5) * m->matrix);
-            bbox.expandBy(nodeBox.corner(6) * m->matrix);
-            bbox.expandBy(nodeBox.corner(7) * m->matrix);
+            quantized = decomposeTRS( instances[m].matrix, translations[m], rotations[m], scales[m] );
         }
 
-		unsigned tboSize = 0;
-		unsigned numInstancesToStore = 0;
-
-		if (instances.size()<maxTBOInstancesSize)
-		{
-			tboSize = nextPowerOf2(instances.size());
-			numInstancesToStore = instances.size();
-		}
-		else
-		{
-			OE_WARN << "Number of Instances: " << instances.size() << " exceeds Number of instances TBO can store: " << maxTBOInstancesSize << std::endl;
-			OE_WARN << "Storing maximum possible instances in TBO, and skipping the rest"<<std::endl;
-			tboSize = maxTBOInstancesSize;
-			numInstancesToStore = maxTBOInstancesSize;
-		}
-		
-        // Convert the node's primitive sets to use "draw-instanced" rendering; at the
-        // same time, assign our computed bounding box as the static bounds for all
-        // geometries. (As DI's they cannot report bounds naturally.)
-        ConvertToDrawInstanced cdi(numInstancesToStore, bbox, true);
-        node->accept( cdi );
+        for( unsigned b=0; b<batches.size(); ++b )
+        {
+            unsigned first = batches[b].first;
+            unsigned numInstancesToStore = batches[b].second - first;
+
+            osg::BoundingBox bbox;
+            osg::BoundingBoxd origins;
+            double minScale = DBL_MAX, maxScale = -DBL_MAX;
+
+            for( unsigned m=first; m<first+numInstancesToStore; ++m )
+            {
+                const osg::Matrix& mat = instances[m].matrix;
+                for(unsigned c=0; c<8; ++c)
+                    bbox.expandBy(nodeBox.corner(c) * mat);
+
+                if ( quantized )
+                {
+                    origins.expandBy( translations[m] );
+                    minScale = osg::minimum( minScale, scales[m] );
+                    maxScale = osg::maximum( maxScale, scales[m] );
+                }
+            }
+
+            // Fall back on the float layout when 16 bits cannot place the
+            // batch's instances precisely enough (e.g. small models spread
+            // over a large area).
+            bool quantizeBatch = quantized;
+            if ( quantizeBatch )
+            {
+                double radius    = nodeBox.valid() ? nodeBox.radius() : 0.0;
+                double tolerance = QUANTIZED_MAX_ERROR * radius * minScale;
+                quantizeBatch = quantizationError(origins, minScale, maxScale, radius) <= tolerance;
+            }
+
+            unsigned tboSize = nextPowerOf2(numInstancesToStore);
+
+            // Each batch draws its own copy of the model's nodes, drawables,
+            // primitive sets (which carry the instance count) and state sets;
+            // the vertex arrays, state attributes and textures stay shared with
+            // the original. The state sets are copied because the compiler
+            // consolidates them on its own thread, while the palette original
+            // may be in use by another batch that is already rendering.
+            osg::ref_ptr<osg::Node> batchNode = osg::clone( node,
+                osg::CopyOp::DEEP_COPY_NODES      |
+                osg::CopyOp::DEEP_COPY_DRAWABLES  |
+                osg::CopyOp::DEEP_COPY_PRIMITIVES |
+                osg::CopyOp::DEEP_COPY_STATESETS  |
+                osg::CopyOp::DEEP_COPY_USERDATA );
+
+            // Convert the node's primitive sets to use "draw-instanced" rendering; at the
+            // same time, assign our computed bounding box as the static bounds for all
+            // geometries. (As DI's they cannot report bounds naturally.)
+            ConvertToDrawInstanced cdi(numInstancesToStore, bbox, true);
+            batchNode->accept( cdi );
+
+            CountDrawCalls counter;
+            batchNode->accept( counter );
 		
-        // Assign matrix vectors to the node, so the application can easily retrieve
-        // the original position data if necessary.
-        MatrixRefVector* nodeMats = new MatrixRefVector();
-        nodeMats->setName(TAG_MATRIX_VECTOR);
-        nodeMats->reserve(numInstancesToStore);
-        node->getOrCreateUserDataContainer()->addUserObject(nodeMats);
-
-        // this group is simply a container for the uniform:
-        osg::Group* instanceGroup = new osg::Group();
-
-        // sampler that will hold the instance matrices:
-        osg::Image* image = new osg::Image();
-        image->setName("osgearth.drawinstanced.postex");
-		image->allocateImage( tboSize*4, 1, 1, GL_RGBA, GL_FLOAT );
-
-		// could use PixelWriter but we know the format.
-		// Note: we are building a transposed matrix because it makes the decoding easier in the shader.
-		GLfloat* ptr = reinterpret_cast<GLfloat*>( image->data() );
-		for(unsigned m=0; m<numInstancesToStore; ++m)
-		{
-			ModelInstance& i = instances[m];
-			const osg::Matrixf& mat = i.matrix;
-
-			// copy the first 3 columns:
-			for(int col=0; col<3; ++col)
-			{
-				for(int row=0; row<4; ++row)
-				{
-					*ptr++ = mat(row,col);
-				}
-			}
-
-			// encode the ObjectID in the last column, which is always (0,0,0,1)
-			// in a standard scale/rot/trans matrix. We will reinstate it in the 
-			// shader after extracting the object ID.
-			*ptr++ = (float)((i.objectID      ) & 0xff);
-			*ptr++ = (float)((i.objectID >>  8) & 0xff);
-			*ptr++ = (float)((i.objectID >> 16) & 0xff);
-			*ptr++ = (float)((i.objectID >> 24) & 0xff);
-
-			// store them int the metadata as well
-			nodeMats->push_back(mat);
-		}
-
-        osg::TextureBuffer* posTBO = new osg::TextureBuffer;
-		posTBO->setImage(image);
-        posTBO->setInternalFormat( GL_RGBA32F_ARB );
-        posTBO->setUnRefImageDataAfterApply( true );
-
-        // Tell the SG to skip the positioning texture.
-        ShaderGenerator::setIgnoreHint(posTBO, true);
-
-        osg::StateSet* stateset = instanceGroup->getOrCreateStateSet();
-        stateset->setTextureAttribute(POSTEX_TBO_UNIT, posTBO);
-        stateset->getOrCreateUniform("oe_di_postex_TBO_size", osg::Uniform::INT)->set((int)tboSize);
-
-		// add the node as a child:
-        instanceGroup->addChild( node );
-
-        parent->addChild( instanceGroup );
+            // Assign matrix vectors to the node, so the application can easily retrieve
+            // the original position data if necessary.
+            MatrixRefVector* nodeMats = new MatrixRefVector();
+            nodeMats->setName(TAG_MATRIX_VECTOR);
+            nodeMats->reserve(numInstancesToStore);
+            batchNode->getOrCreateUserDataContainer()->addUserObject(nodeMats);
+
+            // this group is simply a container for the uniform:
+            osg::Group* instanceGroup = new osg::Group();
+            osg::StateSet* stateset = instanceGroup->getOrCreateStateSet();
+
+            // sampler that will hold the instance data:
+            osg::Image* image = new osg::Image();
+            image->setName("osgearth.drawinstanced.postex");
+
+            osg::TextureBuffer* posTBO = new osg::TextureBuffer;
+
+            if ( quantizeBatch )
+            {
+                // 3 normalized 16-bit RGBA texels per instance:
+                //   position (relative to the batch's origins box) and scale,
+                //   rotation quaternion,
+                //   ObjectID as two 16-bit halves.
+                image->allocateImage( tboSize*3, 1, 1, GL_RGBA, GL_UNSIGNED_SHORT );
+
+                osg::Vec3d origin = origins._min;
+                osg::Vec3d range  = origins._max - origins._min;
+                double     scaleRange = maxScale - minScale;
+
+                GLushort* ptr = reinterpret_cast<GLushort*>( image->data() );
+                for(unsigned m=first; m<first+numInstancesToStore; ++m)
+                {
+                    const osg::Vec3d& t = translations[m];
+                    *ptr++ = quantize16( t.x(), origin.x(), range.x() );
+                    *ptr++ = quantize16( t.y(), origin.y(), range.y() );
+                    *ptr++ = quantize16( t.z(), origin.z(), range.z() );
+                    *ptr++ = quantize16( scales[m], minScale, scaleRange );
+
+                    const osg::Quat& q = rotations[m];
+                    for(int c=0; c<4; ++c)
+                        *ptr++ = quantize16( q[c], -1.0, 2.0 );
+
+                    ObjectID id = instances[m].objectID;
+                    *ptr++ = (GLushort)( id        & 0xffff);
+                    *ptr++ = (GLushort)((id >> 16) & 0xffff);
+                    *ptr++ = 0;
+                    *ptr++ = 0;
+
+                    nodeMats->push_back( instances[m].matrix );
+                }
+
+                posTBO->setInternalFormat( GL_RGBA16 );
+
+                stateset->getOrCreateUniform("oe_di_quantized",    osg::Uniform::BOOL)->set(true);
+                stateset->getOrCreateUniform("oe_di_quant_origin", osg::Uniform::FLOAT_VEC3)->set(osg::Vec3f(origin));
+                stateset->getOrCreateUniform("oe_di_quant_size",   osg::Uniform::FLOAT_VEC3)->set(osg::Vec3f(range));
+                stateset->getOrCreateUniform("oe_di_quant_scale",  osg::Uniform::FLOAT_VEC2)->set(osg::Vec2f(minScale, maxScale));
+            }
+            else
+            {
+		        image->allocateImage( tboSize*4, 1, 1, GL_RGBA, GL_FLOAT );
+
+		        // could use PixelWriter but we know the format.
+		        // Note: we are building a transposed matrix because it makes the decoding easier in the shader.
+		        GLfloat* ptr = reinterpret_cast<GLfloat*>( image->data() );
+		        for(unsigned m=first; m<first+numInstancesToStore; ++m)
+		        {
+			        ModelInstance& i = instances[m];
+			        const osg::Matrixf& mat = i.matrix;
+
+			        // copy the first 3 columns:
+			        for(int col=0; col<3; ++col)
+			        {
+				        for(int row=0; row<4; ++row)
+				        {
+					        *ptr++ = mat(row,col);
+				        }
+			        }
+
+			        // encode the ObjectID in the last column, which is always (0,0,0,1)
+			        // in a standard scale/rot/trans matrix. We will reinstate it in the 
+			        // shader after extracting the object ID.
+			        *ptr++ = (float)((i.objectID      ) & 0xff);
+			        *ptr++ = (float)((i.objectID >>  8) & 0xff);
+			        *ptr++ = (float)((i.objectID >> 16) & 0xff);
+			        *ptr++ = (float)((i.objectID >> 24) & 0xff);
+
+			        // store them int the metadata as well
+			        nodeMats->push_back(mat);
+		        }
+
+                posTBO->setInternalFormat( GL_RGBA32F_ARB );
+
+                stateset->getOrCreateUniform("oe_di_quantized", osg::Uniform::BOOL)->set(false);
+            }
+
+		    posTBO->setImage(image);
+            posTBO->setUnRefImageDataAfterApply( true );
+
+            // Tell the SG to skip the positioning texture.
+            ShaderGenerator::setIgnoreHint(posTBO, true);
+
+            stateset->setTextureAttribute(POSTEX_TBO_UNIT, posTBO);
+            stateset->getOrCreateUniform("oe_di_postex_TBO_size", osg::Uniform::INT)->set((int)tboSize);
+
+		    // add the node as a child:
+            instanceGroup->addChild( batchNode.get() );
+
+            parent->addChild( instanceGroup );
+
+            stats.batches++;
+            stats.drawCalls               += counter._drawCalls;
+            stats.drawCallsUninstanced    += counter._drawCalls * numInstancesToStore;
+            stats.instanceBytes           += (double)(numInstancesToStore * (quantizeBatch ? QUANTIZED_INSTANCE_BYTES : MATRIX_INSTANCE_BYTES));
+            stats.instanceBytesAsMatrices += (double)(numInstancesToStore * MATRIX_INSTANCE_BYTES);
+        }
+
+        stats.instances += instances.size();
     }
+
+    OE_DEBUG << LC << "Converted " << stats.instances << " instances to " << stats.batches << " batches: "
+        << stats.drawCalls << " draw calls (vs. " << stats.drawCallsUninstanced << "), "
+        << stats.instanceBytes << " instance bytes (vs. " << stats.instanceBytesAsMatrices << ")" << std::endl;
+
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    s_stats.instances               += stats.instances;
+    s_stats.batches                 += stats.batches;
+    s_stats.drawCalls               += stats.drawCalls;
+    s_stats.drawCallsUninstanced    += stats.drawCallsUninstanced;
+    s_stats.instanceBytes           += stats.instanceBytes;
+    s_stats.instanceBytesAsMatrices += stats.instanceBytesAsMatrices;
 }
 
 
@@ -443,3 +730,81 @@ DrawInstanced::getMatrixVector(osg::Node* node)
     // cast is safe because of our unique tag
     return static_cast<const MatrixRefVector*>( obj );
 }
+
+
+DrawInstanced::Stats
+DrawInstanced::getStats()
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    return s_stats;
+}
+
+
+void
+DrawInstanced::resetStats()
+{
+    Threading::ScopedMutexLock lock( s_statsMutex );
+    s_stats = Stats();
+}
+
+//----------------------------------------------------------------------
+
+ModelPalette::ModelPalette(unsigned maxModels) :
+_prototypes( false, osg::maximum(maxModels, 1u) )
+{
+    //nop
+}
+
+
+bool
+ModelPalette::getOrCreatePrototype(const std::string&       key,
+                                   osg::Node*               model,
+                                   osg::ref_ptr<osg::Node>& output)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    Prototypes::Record rec;
+    if ( _prototypes.get(key, rec) && rec.value()._node.valid() )
+    {
+        output = rec.value()._node.get();
+
+        Threading::ScopedMutexLock statsLock( s_statsMutex );
+        s_stats.prototypeReuses++;
+        s_stats.vertexBytesShared += rec.value()._vertexBytes;
+    }
+    else if ( model )
+    {
+        // Deep copy everything except for images, since the caller's model
+        // may be live elsewhere; then switch it to VBOs once, here, so the
+        // per-batch copies that share its arrays never touch them.
+        Entry entry;
+        entry._node = osg::clone( model, osg::CopyOp::DEEP_COPY_ALL & ~osg::CopyOp::DEEP_COPY_IMAGES );
+
+        PrepareForInstancing prepare;
+        entry._node->accept( prepare );
+
+        CountDrawCalls counter;
+        entry._node->accept( counter );
+        entry._vertexBytes = counter._bytes;
+
+        _prototypes.insert( key, entry );
+        output = entry._node.get();
+
+        Threading::ScopedMutexLock statsLock( s_statsMutex );
+        s_stats.prototypes++;
+    }
+    else
+    {
+        output = 0L;
+    }
+
+    return output.valid();
+}
+
+
+void
+ModelPalette::clear()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _prototypes.clear();
+}
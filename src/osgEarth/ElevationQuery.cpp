@@ -21,6 +21,8 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/DPLineSegmentIntersector>
 #include <osgUtil/IntersectionVisitor>
+#include <climits>
+#include <map>
 
 #define LC "[ElevationQuery] "
 
@@ -146,6 +148,13 @@ ElevationQuery::sync()
         _cache.clear();
         gatherPatchLayers();
     }
+
+    // a shared cache belongs to one map revision; don't flush it for the
+    // other queries that use it, just stop using it.
+    if ( _sharedCache.valid() && (int)_sharedCache->getRevision() != (int)_mapf.getRevision() )
+    {
+        _sharedCache = 0L;
+    }
 }
 
 void
@@ -263,13 +272,13 @@ ElevationQuery::getMaxLevel( double x, double y, const SpatialReference* srs, co
 void
 ElevationQuery::setMaxTilesToCache( int value )
 {
-    _cache.setMaxSize( value );   
+    tiles().setMaxSize( value );   
 }
 
 int
 ElevationQuery::getMaxTilesToCache() const
 {
-    return _cache.getMaxSize();    
+    return tiles().getMaxSize();    
 }
         
 void
@@ -309,15 +318,14 @@ ElevationQuery::getElevations(std::vector<osg::Vec3d>& points,
                               bool                     ignoreZ,
                               double                   desiredResolution )
 {
-    sync();
-    for( osg::Vec3dArray::iterator i = points.begin(); i != points.end(); ++i )
+    std::vector<double> elevations;
+    sampleElevations( points, pointsSRS, elevations, desiredResolution );
+
+    for( unsigned i=0; i<points.size(); ++i )
     {
-        double elevation;
-        double z = (*i).z();
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
-        if ( getElevationImpl( p, elevation, desiredResolution ) )
+        if ( elevations[i] != NO_DATA_VALUE )
         {
-            (*i).z() = ignoreZ ? elevation : elevation + z;
+            points[i].z() = ignoreZ ? elevations[i] : elevations[i] + points[i].z();
         }
     }
     return true;
@@ -328,23 +336,181 @@ ElevationQuery::getElevations(const std::vector<osg::Vec3d>& points,
                               const SpatialReference*        pointsSRS,
                               std::vector<double>&           out_elevations,
                               double                         desiredResolution )
+{
+    std::vector<double> elevations;
+    sampleElevations( points, pointsSRS, elevations, desiredResolution );
+
+    for( unsigned i=0; i<elevations.size(); ++i )
+    {
+        out_elevations.push_back( elevations[i] != NO_DATA_VALUE ? elevations[i] : 0.0 );
+    }
+    return true;
+}
+
+unsigned
+ElevationQuery::sampleElevations(const std::vector<osg::Vec3d>& points,
+                                 const SpatialReference*        pointsSRS,
+                                 std::vector<double>&           out_elevations,
+                                 double                         desiredResolution)
 {
     sync();
-    for( osg::Vec3dArray::const_iterator i = points.begin(); i != points.end(); ++i )
+
+    out_elevations.assign( points.size(), NO_DATA_VALUE );
+    if ( points.empty() || !pointsSRS )
+        return 0u;
+
+    unsigned count = 0u;
+
+    // Terrain patches need an intersection test per point, so there's nothing to batch.
+    if ( _patchLayers.size() > 0 )
     {
-        double elevation;
-        GeoPoint p(pointsSRS, *i, ALTMODE_ABSOLUTE);
+        for( unsigned i=0; i<points.size(); ++i )
+        {
+            double elevation;
+            if ( getElevationImpl(GeoPoint(pointsSRS, points[i], ALTMODE_ABSOLUTE), elevation, desiredResolution) )
+            {
+                out_elevations[i] = elevation;
+                ++count;
+            }
+        }
+        return count;
+    }
 
-        if ( getElevationImpl(p, elevation, desiredResolution) )
+    if ( _mapf.elevationLayers().empty() )
+    {
+        // this means there are no heightfields.
+        out_elevations.assign( points.size(), 0.0 );
+        return points.size();
+    }
+
+    osg::Timer_t begin = osg::Timer::instance()->tick();
+
+    const Profile*          profile = _mapf.getProfile();
+    const SpatialReference* mapSRS  = profile->getSRS();
+    unsigned                tileSize = 33; // same as getElevationImpl
+
+    // transform all the points into the map SRS at once:
+    std::vector<osg::Vec3d> mapPoints( points );
+    std::vector<bool>       transformed( points.size(), true );
+    if ( !pointsSRS->isHorizEquivalentTo(mapSRS) && !pointsSRS->transform(mapPoints, mapSRS) )
+    {
+        // at least one failed; redo them one by one to find out which.
+        for( unsigned i=0; i<points.size(); ++i )
         {
-            out_elevations.push_back( elevation );
+            transformed[i] = pointsSRS->transform( points[i], mapSRS, mapPoints[i] );
         }
-        else
+    }
+
+    // The best available level only varies by location if a layer reports data extents;
+    // otherwise compute it once for the whole batch.
+    bool levelVaries = false;
+    for( ElevationLayerVector::const_iterator i = _mapf.elevationLayers().begin(); i != _mapf.elevationLayers().end(); ++i )
+    {
+        TileSource* ts = i->get()->getTileSource();
+        if ( ts && ts->getDataExtents().size() > 0 )
+            levelVaries = true;
+    }
+
+    int batchLevel = levelVaries ? -1 : getMaxLevel( points[0].x(), points[0].y(), pointsSRS, profile, tileSize );
+
+    int desiredLevel = INT_MAX;
+    if ( desiredResolution > 0.0 )
+        desiredLevel = profile->getLevelOfDetailForHorizResolution( desiredResolution, tileSize );
+
+    // sort the points into buckets, one per elevation tile:
+    typedef std::map< TileKey, std::vector<unsigned> > Buckets;
+    Buckets buckets;
+
+    for( unsigned i=0; i<points.size(); ++i )
+    {
+        if ( !transformed[i] )
+            continue;
+
+        int level = levelVaries ? getMaxLevel( points[i].x(), points[i].y(), pointsSRS, profile, tileSize ) : batchLevel;
+
+        // A negative value means that no data is avaialble at that point at any resolution.
+        if ( level < 0 )
+            continue;
+
+        TileKey key = profile->createTileKey( mapPoints[i].x(), mapPoints[i].y(), osg::minimum(level, desiredLevel) );
+        if ( key.valid() )
+            buckets[key].push_back( i );
+    }
+
+    // sample each tile once for all the points that fall in it. Points that don't
+    // get a value fall back to the parent tile, as in getElevationImpl.
+    ElevationInterpolation interp = _mapf.getMapInfo().getElevationInterpolation();
+
+    while( !buckets.empty() )
+    {
+        TileKey               key = buckets.begin()->first;
+        std::vector<unsigned> indices;
+        indices.swap( buckets.begin()->second );
+        buckets.erase( buckets.begin() );
+
+        GeoHeightField geoHF;
+        bool haveTile = getTile( key, tileSize, geoHF );
+
+        std::vector<unsigned> misses;
+        for( std::vector<unsigned>::const_iterator i = indices.begin(); i != indices.end(); ++i )
+        {
+            float elevation = NO_DATA_VALUE;
+            const osg::Vec3d& p = mapPoints[*i];
+            if ( haveTile && geoHF.getElevation(0L, p.x(), p.y(), interp, mapSRS, elevation) && elevation != NO_DATA_VALUE )
+            {
+                out_elevations[*i] = (double)elevation;
+                ++count;
+            }
+            else
+            {
+                misses.push_back( *i );
+            }
+        }
+
+        if ( !misses.empty() && (!haveTile || _fallBackOnNoData) )
         {
-            out_elevations.push_back( 0.0 );
+            TileKey parentKey = key.createParentKey();
+            if ( parentKey.valid() )
+            {
+                std::vector<unsigned>& parent = buckets[parentKey];
+                parent.insert( parent.end(), misses.begin(), misses.end() );
+            }
         }
     }
-    return true;
+
+    osg::Timer_t end = osg::Timer::instance()->tick();
+    _queries   += (double)points.size();
+    _totalTime += osg::Timer::instance()->delta_s( begin, end );
+
+    return count;
+}
+
+bool
+ElevationQuery::getTile(const TileKey& key, unsigned tileSize, GeoHeightField& out_tile)
+{
+    // Try to get the hf from the cache
+    TileCache::Record record;
+    if ( tiles().get( key, record ) )
+    {
+        out_tile = record.value();
+    }
+    else
+    {
+        // Create it            
+        osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+        hf->allocate( tileSize, tileSize );
+
+        // Initialize the heightfield to nodata
+        hf->getFloatArray()->assign( hf->getFloatArray()->size(), NO_DATA_VALUE );
+
+        if (_mapf.populateHeightField(hf, key, false /*heightsAsHAE*/, 0L))
+        {                
+            out_tile = GeoHeightField( hf.get(), key.getExtent() );
+            tiles().insert( key, out_tile );
+        }
+    }
+
+    return out_tile.valid();
 }
 
 bool
@@ -484,28 +650,7 @@ ElevationQuery::getElevationImpl(const GeoPoint& point, /* abs */
     while ( !result && key.valid() )
     {
         GeoHeightField geoHF;
-        
-        // Try to get the hf from the cache
-        TileCache::Record record;
-        if ( _cache.get( key, record ) )
-        {                        
-            geoHF = record.value();
-        }
-        else
-        {
-            // Create it            
-            osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
-            hf->allocate( tileSize, tileSize );
-
-            // Initialize the heightfield to nodata
-            hf->getFloatArray()->assign( hf->getFloatArray()->size(), NO_DATA_VALUE );
-
-            if (_mapf.populateHeightField(hf, key, false /*heightsAsHAE*/, 0L))
-            {                
-                geoHF = GeoHeightField( hf.get(), key.getExtent() );
-                _cache.insert( key, geoHF );
-            }
-        }
+        getTile( key, tileSize, geoHF );
 
         if (geoHF.valid())
         {            
@@ -94,21 +94,34 @@ GeoTransform::setPosition(const GeoPoint& position)
     p.createLocalToWorld( local2world );
     this->setMatrix( local2world );
 
+    bool moved =
+        position.x() != _position.x() ||
+        position.y() != _position.y();
+
     // save the last know position
     _position = position;
 
-    // install auto-recompute?
+    // install auto-recompute? The callback only hears about tiles under the
+    // position, so it has to follow the position when it moves.
     if (_autoRecompute &&
         _position.altitudeMode() == ALTMODE_RELATIVE &&
         !_autoRecomputeReady)
     {
         // by using the adapter, there's no need to remove
         // the callback then this object destructs.
+        _autoRecomputeCallback = new TerrainCallbackAdapter<GeoTransform>(this);
         terrain->addTerrainCallback(
-           new TerrainCallbackAdapter<GeoTransform>(this) );
+           _autoRecomputeCallback.get(),
+           GeoExtent(p.getSRS(), p.x(), p.y(), p.x(), p.y()) );
 
         _autoRecomputeReady = true;
     }
+    else if (_autoRecomputeReady && moved && _autoRecomputeCallback.valid() && terrain.valid())
+    {
+        terrain->addTerrainCallback(
+           _autoRecomputeCallback.get(),
+           GeoExtent(p.getSRS(), p.x(), p.y(), p.x(), p.y()) );
+    }
 
     return true;
 }
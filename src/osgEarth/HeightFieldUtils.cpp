@@ -597,6 +597,91 @@ HeightFieldUtils::createClusterCullingCallback(const osg::HeightField*    grid,
 }
 
 
+namespace
+{
+    // Spacing of heightfield samples in meters. The east-west interval
+    // depends on the latitude of the row in a geographic SRS.
+    struct NormalMapSpacing
+    {
+        NormalMapSpacing(const osg::HeightField* hf, const SpatialReference* srs) :
+            _hf(hf), _geographic(srs->isGeographic())
+        {
+            _mPerDegAtEquator = (srs->getEllipsoid()->getRadiusEquator() * 2.0 * osg::PI)/360.0;
+            _tIntervalMeters = _geographic ? hf->getYInterval() * _mPerDegAtEquator : hf->getYInterval();
+        }
+
+        double sIntervalMeters(int t) const
+        {
+            double lat = _hf->getOrigin().y() + _hf->getYInterval()*(double)t;
+            return _geographic ?
+                _hf->getXInterval() * _mPerDegAtEquator * cos(osg::DegreesToRadians(lat)) :
+                _hf->getXInterval();
+        }
+
+        const osg::HeightField* _hf;
+        bool   _geographic;
+        double _mPerDegAtEquator;
+        double _tIntervalMeters;
+    };
+
+    // Encodes a normal and a curvature value into one RGBA8 texel.
+    inline void encodeNormal(unsigned char* ptr, float nx, float ny, float nz, float curvature)
+    {
+        ptr[0] = (unsigned char)((nx + 1.0f) * 0.5f * 255.0f);
+        ptr[1] = (unsigned char)((ny + 1.0f) * 0.5f * 255.0f);
+        ptr[2] = (unsigned char)((nz + 1.0f) * 0.5f * 255.0f);
+        ptr[3] = (unsigned char)((curvature + 1.0f) * 0.5f * 255.0f);
+    }
+
+    // Computes one texel using the neighborhood to sample across tile edges.
+    // Missing neighbor samples fall back on a one-sided difference.
+    void computeNormalTexel(const HeightFieldNeighborhood& hood,
+                            const NormalMapSpacing&        spacing,
+                            osg::Image*                    image,
+                            int s, int t)
+    {
+        const osg::HeightField* hf = hood._center.get();
+
+        double xres = 1.0/(double)(hf->getNumColumns()-1);
+        double yres = 1.0/(double)(hf->getNumRows()-1);
+        double sIntervalMeters = spacing.sIntervalMeters(t);
+        double tIntervalMeters = spacing._tIntervalMeters;
+
+        float centerHeight = hf->getHeight(s, t);
+
+        double nx = xres*(double)s;
+        double ny = yres*(double)t;
+
+        osg::Vec3f west ( -sIntervalMeters, 0, centerHeight );
+        osg::Vec3f east (  sIntervalMeters, 0, centerHeight );
+        osg::Vec3f south( 0, -tIntervalMeters, centerHeight );
+        osg::Vec3f north( 0,  tIntervalMeters, centerHeight );
+
+        if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx-xres, ny, west.z()) )
+            west.x() = 0.0;
+
+        if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx+xres, ny, east.z()) )
+            east.x() = 0.0;
+
+        if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx, ny-yres, south.z()) )
+            south.y() = 0.0;
+
+        if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx, ny+yres, north.z()) )
+            north.y() = 0.0;
+
+        osg::Vec3f n = (east-west) ^ (north-south);
+        n.normalize();
+
+        // calculate and encode curvature (2nd derivative of elevation)
+        float L2inv = 1.0f/(sIntervalMeters*sIntervalMeters);
+        float D = (0.5*(west.z()+east.z()) - centerHeight) * L2inv;
+        float E = (0.5*(south.z()+north.z()) - centerHeight) * L2inv;
+        float curvature = osg::clampBetween(-2.0f*(D+E)*100.0f, -1.0f, 1.0f);
+
+        encodeNormal(image->data(s, t), n.x(), n.y(), n.z(), curvature);
+    }
+}
+
 osg::Image*
 HeightFieldUtils::convertToNormalMap(const HeightFieldNeighborhood& hood,
                                      const SpatialReference*        hoodSRS)
@@ -604,73 +689,88 @@ HeightFieldUtils::convertToNormalMap(const HeightFieldNeighborhood& hood,
     const osg::HeightField* hf = hood._center.get();
     if ( !hf )
         return 0L;
+
+    int cols = (int)hf->getNumColumns();
+    int rows = (int)hf->getNumRows();
     
     osg::Image* image = new osg::Image();
-    image->allocateImage(hf->getNumColumns(), hf->getNumRows(), 1, GL_RGBA, GL_UNSIGNED_BYTE);
+    image->allocateImage(cols, rows, 1, GL_RGBA, GL_UNSIGNED_BYTE);
 
-    double xcells = (double)(hf->getNumColumns()-1);
-    double ycells = (double)(hf->getNumRows()-1);
-    double xres = 1.0/xcells;
-    double yres = 1.0/ycells;
+    NormalMapSpacing spacing(hf, hoodSRS);
 
-    // north-south interval in meters:
-    double mPerDegAtEquator = (hoodSRS->getEllipsoid()->getRadiusEquator() * 2.0 * osg::PI)/360.0;
-    double tIntervalMeters = 
-        hoodSRS->isGeographic() ? hf->getYInterval() * mPerDegAtEquator :
-        hf->getYInterval();
+    // Interior samples never need the neighborhood, so compute them with a
+    // tight central-difference kernel that reads the height array directly.
+    // (east-west) ^ (north-south) reduces to (-2ty*dzx, -2sx*dzy, 4sx*ty).
+    const float* heights = &hf->getFloatArray()->front();
+    const float ty = (float)spacing._tIntervalMeters;
 
-    ImageUtils::PixelWriter write(image);
-    
-    for(int t=0; t<(int)hf->getNumRows(); ++t)
+    for(int t=1; t<rows-1; ++t)
     {
-        // east-west interval in meters (changes for each row):
-        double lat = hf->getOrigin().y() + hf->getYInterval()*(double)t;
-        double sIntervalMeters =
-            hoodSRS->isGeographic() ? hf->getXInterval() * mPerDegAtEquator * cos(osg::DegreesToRadians(lat)) :
-            hf->getXInterval();
-
-        for(int s=0; s<(int)hf->getNumColumns(); ++s)
+        const float sx    = (float)spacing.sIntervalMeters(t);
+        const float L2inv = 1.0f/(sx*sx);
+        const float a     = -2.0f*ty;
+        const float b     = -2.0f*sx;
+        const float c     =  4.0f*sx*ty;
+
+        const float* row   = heights + t*cols;
+        const float* south = row - cols;
+        const float* north = row + cols;
+        unsigned char* out = image->data(0, t);
+
+        for(int s=1; s<cols-1; ++s)
         {
-            float centerHeight = hf->getHeight(s, t);
+            float h  = row[s];
+            float hw = row[s-1], he = row[s+1];
+            float hs = south[s], hn = north[s];
 
-            double nx = xres*(double)s;
-            double ny = yres*(double)t;
+            float x = a*(he-hw);
+            float y = b*(hn-hs);
+            float invLen = 1.0f/sqrtf(x*x + y*y + c*c);
 
-            osg::Vec3f west ( -sIntervalMeters, 0, centerHeight );
-            osg::Vec3f east (  sIntervalMeters, 0, centerHeight );
-            osg::Vec3f south( 0, -tIntervalMeters, centerHeight );
-            osg::Vec3f north( 0,  tIntervalMeters, centerHeight );
+            float D = (0.5f*(hw+he) - h) * L2inv;
+            float E = (0.5f*(hs+hn) - h) * L2inv;
+            float curvature = osg::clampBetween(-2.0f*(D+E)*100.0f, -1.0f, 1.0f);
 
-            if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx-xres, ny, west.z()) )
-                west.x() = 0.0;
+            encodeNormal(out + 4*s, x*invLen, y*invLen, c*invLen, curvature);
+        }
+    }
 
-            if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx+xres, ny, east.z()) )
-                east.x() = 0.0;
+    // Edge samples come from the neighborhood.
+    updateNormalMapEdges(image, hood, hoodSRS);
 
-            if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx, ny-yres, south.z()) )
-                south.y() = 0.0;
+    return image;
+}
 
-            if ( !HeightFieldUtils::getHeightAtNormalizedLocation(hood, nx, ny+yres, north.z()) )
-                north.y() = 0.0;
+void
+HeightFieldUtils::updateNormalMapEdges(osg::Image*                    image,
+                                       const HeightFieldNeighborhood& hood,
+                                       const SpatialReference*        hoodSRS)
+{
+    const osg::HeightField* hf = hood._center.get();
+    if ( !hf || !image || !hoodSRS )
+        return;
 
-            osg::Vec3f n = (east-west) ^ (north-south);
-            n.normalize();
+    int cols = (int)hf->getNumColumns();
+    int rows = (int)hf->getNumRows();
 
-            // calculate and encode curvature (2nd derivative of elevation)
-            float L2inv = 1.0f/(sIntervalMeters*sIntervalMeters);
-            float D = (0.5*(west.z()+east.z()) - centerHeight) * L2inv;
-            float E = (0.5*(south.z()+north.z()) - centerHeight) * L2inv;
-            float curvature = osg::clampBetween(-2.0f*(D+E)*100.0f, -1.0f, 1.0f);
+    if ( image->s() != cols || image->t() != rows || image->getPixelSizeInBits() != 32 )
+        return;
 
-            // encode for RGBA [0..1]
-            osg::Vec4f enc( n.x(), n.y(), n.z(), curvature );
-            enc = (enc + osg::Vec4f(1.0,1.0,1.0,1.0))*0.5;
+    NormalMapSpacing spacing(hf, hoodSRS);
 
-            write(enc, s, t);
-        }
+    for(int s=0; s<cols; ++s)
+    {
+        computeNormalTexel(hood, spacing, image, s, 0);
+        if ( rows > 1 )
+            computeNormalTexel(hood, spacing, image, s, rows-1);
     }
 
-    return image;
+    for(int t=1; t<rows-1; ++t)
+    {
+        computeNormalTexel(hood, spacing, image, 0, t);
+        if ( cols > 1 )
+            computeNormalTexel(hood, spacing, image, cols-1, t);
+    }
 }
 
 /******************************************************************************************/
@@ -9,22 +9,52 @@
 uniform samplerBuffer oe_di_postex_TBO;
 uniform int			  oe_di_postex_TBO_size;
 
+// quantized instances (see DrawInstanced.cpp)
+uniform bool oe_di_quantized;
+uniform vec3 oe_di_quant_origin;
+uniform vec3 oe_di_quant_size;
+uniform vec2 oe_di_quant_scale;
+
 // Stage-global containing object ID
 uint oe_index_objectid;
 
 void oe_di_setInstancePosition(inout vec4 VertexMODEL)
 { 
+    if ( oe_di_quantized )
+    {
+        // 3 normalized 16-bit texels per instance: position and scale,
+        // rotation quaternion, and the ObjectID split into two halves.
+        int index = 3 * gl_InstanceID;
+
+        vec4 t0 = texelFetch(oe_di_postex_TBO, index);
+        vec4 t1 = texelFetch(oe_di_postex_TBO, index+1);
+        vec4 t2 = texelFetch(oe_di_postex_TBO, index+2);
+
+        uvec2 id = uvec2(t2.xy * 65535.0 + 0.5);
+        oe_index_objectid = id.x + (id.y << 16u);
+
+        vec3  position = oe_di_quant_origin + oe_di_quant_size * t0.xyz;
+        float scale    = mix(oe_di_quant_scale[0], oe_di_quant_scale[1], t0.w);
+        vec4  q        = normalize(t1 * 2.0 - 1.0);
+
+        // scale, then rotate by q, then translate:
+        vec3 v = VertexMODEL.xyz * scale;
+        v = v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+        VertexMODEL.xyz = v + position * VertexMODEL.w;
+        return;
+    }
+
     int index = 4 * gl_InstanceID;
 
     vec4 m0 = texelFetch(oe_di_postex_TBO, index);
     vec4 m1 = texelFetch(oe_di_postex_TBO, index+1); 
     vec4 m2 = texelFetch(oe_di_postex_TBO, index+2); 
     vec4 m3 = texelFetch(oe_di_postex_TBO, index+3);
-
+    
     // decode the ObjectID from the last column:
     
     oe_index_objectid = uint(m3[0]) + (uint(m3[1]) << 8u) + (uint(m3[2]) << 16u) + (uint(m3[3]) << 24u);
-    
+
     // rebuild positioning matrix and transform the vert. (Note, the matrix is actually
     // transposed so we have to reverse the multiplication order.)
     VertexMODEL = VertexMODEL * mat4(m0, m1, m2, vec4(0,0,0,1));
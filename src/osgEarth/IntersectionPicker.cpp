@@ -187,7 +187,8 @@ IntersectionPicker::getObjectIDs(const Hits& results, std::set<ObjectID>& out_ob
             const osg::Geometry* geom = hit->drawable ? hit->drawable->asGeometry() : 0L;
             if ( geom )
             {
-                const ObjectIDArray* ids = dynamic_cast<const ObjectIDArray*>( geom->getVertexAttribArray(index->getObjectIDAttribLocation()) );
+                const osg::Array* attr = geom->getVertexAttribArray(index->getObjectIDAttribLocation());
+                const ObjectIDArray* ids = dynamic_cast<const ObjectIDArray*>( attr );
                 if ( ids )
                 {
                     for(unsigned i=0; i < hit->indexList.size(); ++i)
@@ -200,6 +201,30 @@ IntersectionPicker::getObjectIDs(const Hits& results, std::set<ObjectID>& out_ob
                         }
                     }
                 }
+
+                // compact IDs are offsets from the nearest base uniform above.
+                const osg::UShortArray* offsets = dynamic_cast<const osg::UShortArray*>( attr );
+                if ( offsets )
+                {
+                    ObjectID base = 0u;
+                    for(osg::NodePath::const_reverse_iterator n = path.rbegin(); n != path.rend(); ++n )
+                    {
+                        osg::Node* node = *n;
+                        osg::Uniform* u = node && node->getStateSet() ?
+                            node->getStateSet()->getUniform( index->getObjectIDBaseUniformName() ) : 0L;
+                        if ( u && u->get(base) )
+                            break;
+                    }
+
+                    for(unsigned i=0; i < hit->indexList.size(); ++i)
+                    {
+                        unsigned index = hit->indexList[i];
+                        if ( index < offsets->size() && (*offsets)[index] > 0 )
+                        {
+                            out_objectIDs.insert( base + (*offsets)[index] );
+                        }
+                    }
+                }
             }
         }
     }
@@ -37,6 +37,14 @@ using namespace osgEarth;
 // Object IDs under this reserved
 #define STARTING_OBJECT_ID 10
 
+// Number of IDs in each block of the table
+#define BLOCK_SIZE 256u
+
+// Largest offset a compact (16-bit) ID can hold
+#define MAX_COMPACT_OFFSET 0xFFFFu
+
+#define NO_BLOCK (~0u)
+
 namespace
 {
     const char* indexVertexInit =
@@ -47,6 +55,7 @@ namespace
         "#pragma vp_order      first \n"
 
         "uniform uint oe_index_objectid_uniform; \n"   // override objectid if > 0
+        "uniform uint oe_index_objectid_base; \n"      // added to the attribute; non-zero for compact IDs
         "in uint      oe_index_objectid_attr; \n"      // Vertex attribute containing the object ID.
         "uint         oe_index_objectid; \n"           // Stage global containing the Object ID.
 
@@ -55,18 +64,35 @@ namespace
         "    if ( oe_index_objectid_uniform > 0u ) \n"
         "        oe_index_objectid = oe_index_objectid_uniform; \n"
         "    else if ( oe_index_objectid_attr > 0u ) \n"
-        "        oe_index_objectid = oe_index_objectid_attr; \n"
+        "        oe_index_objectid = oe_index_objectid_base + oe_index_objectid_attr; \n"
         "    else \n"
         "        oe_index_objectid = 0u; \n"
         "} \n";
+
+    inline unsigned blockOf(ObjectID id)
+    {
+        return (id - (STARTING_OBJECT_ID+1)) / BLOCK_SIZE;
+    }
+
+    inline unsigned offsetOf(ObjectID id)
+    {
+        return (id - (STARTING_OBJECT_ID+1)) % BLOCK_SIZE;
+    }
+
+    inline ObjectID firstID(unsigned block)
+    {
+        return (STARTING_OBJECT_ID+1) + block*BLOCK_SIZE;
+    }
 }
 
 ObjectIndex::ObjectIndex() :
-_idGen( STARTING_OBJECT_ID )
+_singlesBlock( NO_BLOCK ),
+_size        ( 0u )
 {
-    _attribName     = "oe_index_objectid_attr";
-    _attribLocation = osg::Drawable::SECONDARY_COLORS;
-    _oidUniformName = "oe_index_objectid_uniform";
+    _attribName      = "oe_index_objectid_attr";
+    _attribLocation  = osg::Drawable::SECONDARY_COLORS;
+    _oidUniformName  = "oe_index_objectid_uniform";
+    _baseUniformName = "oe_index_objectid_base";
 
     // set up the shader package.
     _shaders.add( "ObjectIndex.vert.glsl", indexVertexInit );
@@ -86,7 +112,8 @@ ObjectIndex::loadShaders(VirtualProgram* vp) const
 void
 ObjectIndex::setObjectIDAtrribLocation(int value)
 {
-    if ( _index.size() == 0 )
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( _size == 0 )
     {
         _attribLocation = value;
     } 
@@ -107,9 +134,30 @@ ObjectID
 ObjectIndex::insertImpl(osg::Referenced* object)
 {
     // internal: assume mutex is locked
-    ObjectID id = ++_idGen;
-    _index[id] = object;
-    OE_DEBUG << LC << "Insert " << id << "; size = " << _index.size() << "\n";
+
+    // Singles fill one block at a time. Slots are not reused within a block;
+    // the whole block returns to the free list once all its objects are gone.
+    if ( _singlesBlock == NO_BLOCK || _blocks[_singlesBlock]._slots->_next == BLOCK_SIZE )
+    {
+        unsigned previous = _singlesBlock;
+        _singlesBlock = allocateBlocks( 1u );
+        Slots* slots = new Slots();
+        slots->_objects.resize( BLOCK_SIZE );
+        _blocks[_singlesBlock]._slots = slots;
+
+        // a retired block that emptied while it was being filled:
+        if ( previous != NO_BLOCK && _blocks[previous]._slots->_live == 0u )
+            releaseBlocks( previous, 1u );
+    }
+
+    Slots* slots = _blocks[_singlesBlock]._slots.get();
+    unsigned offset = slots->_next++;
+    slots->_objects[offset] = object;
+    slots->_live++;
+    _size++;
+
+    ObjectID id = firstID(_singlesBlock) + offset;
+    OE_DEBUG << LC << "Insert " << id << "; size = " << _size << "\n";
     return id;
 }
 
@@ -117,8 +165,180 @@ osg::Referenced*
 ObjectIndex::getImpl(ObjectID id) const
 {
     // assume the mutex is locked
-    IndexMap::const_iterator i = _index.find(id);
-    return i != _index.end() ? i->second.get() : 0L;
+    if ( id <= STARTING_OBJECT_ID )
+        return 0L;
+
+    unsigned b = blockOf(id);
+    if ( b >= _blocks.size() )
+        return 0L;
+
+    const Block& block = _blocks[b];
+    if ( block._owner.valid() )
+        return block._owner.get();
+    else if ( block._slots.valid() )
+        return block._slots->_objects[offsetOf(id)].get();
+    else
+        return 0L;
+}
+
+ObjectID
+ObjectIndex::insertRange(osg::Referenced* object, unsigned count)
+{
+    if ( object == 0L || count == 0u )
+        return OSGEARTH_OBJECTID_EMPTY;
+
+    unsigned numBlocks = (count + BLOCK_SIZE - 1u) / BLOCK_SIZE;
+
+    Threading::ScopedMutexLock excl( _mutex );
+
+    unsigned first = allocateBlocks( numBlocks );
+    for(unsigned b = first; b < first + numBlocks; ++b)
+    {
+        _blocks[b]._owner = object;
+    }
+    _size += count;
+
+    ObjectID id = firstID(first);
+    OE_DEBUG << LC << "Insert range " << id << "+" << count << "; size = " << _size << "\n";
+    return id;
+}
+
+ObjectID
+ObjectIndex::insertRange(osg::Referenced* object, unsigned count, ObjectID base)
+{
+    if ( object == 0L || count == 0u || count > MAX_COMPACT_OFFSET )
+        return OSGEARTH_OBJECTID_EMPTY;
+
+    // every ID in the range must be within (base, base + MAX_COMPACT_OFFSET].
+    ObjectID lastID = base + MAX_COMPACT_OFFSET;
+    if ( base < STARTING_OBJECT_ID || lastID - count + 1u < STARTING_OBJECT_ID+1 )
+        return OSGEARTH_OBJECTID_EMPTY;
+
+    unsigned minFirst  = blockOf(base + 1u) + (offsetOf(base + 1u) > 0u ? 1u : 0u);
+    unsigned maxFirst  = blockOf(lastID - count + 1u);
+    unsigned numBlocks = (count + BLOCK_SIZE - 1u) / BLOCK_SIZE;
+
+    Threading::ScopedMutexLock excl( _mutex );
+
+    unsigned first = allocateBlocks( numBlocks, minFirst, maxFirst );
+    if ( first == NO_BLOCK )
+        return OSGEARTH_OBJECTID_EMPTY;
+
+    for(unsigned b = first; b < first + numBlocks; ++b)
+    {
+        _blocks[b]._owner = object;
+    }
+    _size += count;
+
+    ObjectID id = firstID(first);
+    OE_DEBUG << LC << "Insert range " << id << "+" << count << " near " << base << "; size = " << _size << "\n";
+    return id;
+}
+
+void
+ObjectIndex::removeRange(ObjectID first, unsigned count)
+{
+    if ( first <= STARTING_OBJECT_ID || count == 0u || offsetOf(first) != 0u )
+        return;
+
+    unsigned b         = blockOf(first);
+    unsigned numBlocks = (count + BLOCK_SIZE - 1u) / BLOCK_SIZE;
+
+    Threading::ScopedMutexLock excl( _mutex );
+
+    if ( b + numBlocks > _blocks.size() || !_blocks[b]._owner.valid() )
+    {
+        OE_WARN << LC << "Illegal: range " << first << "+" << count << " is not in the index\n";
+        return;
+    }
+
+    releaseBlocks( b, numBlocks );
+    _size -= count;
+
+    OE_DEBUG << LC << "Remove range " << first << "+" << count << "; size = " << _size << "\n";
+}
+
+unsigned
+ObjectIndex::size() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _size;
+}
+
+unsigned
+ObjectIndex::allocateBlocks(unsigned count, unsigned minFirst, unsigned maxFirst)
+{
+    // internal - assume mutex is locked
+
+    // first fit from the free list, starting no lower than minFirst:
+    for(std::map<unsigned, unsigned>::iterator i = _freeBlocks.begin(); i != _freeBlocks.end(); ++i)
+    {
+        unsigned start = i->first;
+        unsigned end   = i->first + i->second;
+        unsigned first = osg::maximum( start, minFirst );
+
+        if ( first > maxFirst )
+            break;
+
+        if ( first + count <= end )
+        {
+            _freeBlocks.erase( i );
+            if ( first > start )
+                _freeBlocks[start] = first - start;
+            if ( first + count < end )
+                _freeBlocks[first + count] = end - (first + count);
+            return first;
+        }
+    }
+
+    // otherwise grow the table.
+    unsigned first = _blocks.size();
+    if ( first < minFirst || first > maxFirst )
+        return NO_BLOCK;
+
+    _blocks.resize( first + count );
+    return first;
+}
+
+void
+ObjectIndex::releaseBlocks(unsigned first, unsigned count)
+{
+    // internal - assume mutex is locked
+    for(unsigned b = first; b < first + count; ++b)
+    {
+        _blocks[b]._owner = 0L;
+        _blocks[b]._slots = 0L;
+    }
+
+    // coalesce with the neighboring free ranges:
+    std::map<unsigned, unsigned>::iterator next = _freeBlocks.find( first + count );
+    if ( next != _freeBlocks.end() )
+    {
+        count += next->second;
+        _freeBlocks.erase( next );
+    }
+
+    std::map<unsigned, unsigned>::iterator prev = _freeBlocks.lower_bound( first );
+    if ( prev != _freeBlocks.begin() )
+    {
+        --prev;
+        if ( prev->first + prev->second == first )
+        {
+            first = prev->first;
+            count += prev->second;
+            _freeBlocks.erase( prev );
+        }
+    }
+
+    // free space at the end of the table goes away instead of into the list.
+    if ( first + count == _blocks.size() )
+    {
+        _blocks.resize( first );
+    }
+    else
+    {
+        _freeBlocks[first] = count;
+    }
 }
 
 void
@@ -132,9 +352,27 @@ void
 ObjectIndex::removeImpl(ObjectID id)
 {
     // internal - assume mutex is locked
-    _index.erase( id );
-    OE_DEBUG << "Remove " << id << "; size = " << _index.size() << "\n";
+    if ( id <= STARTING_OBJECT_ID )
+        return;
 
+    unsigned b = blockOf(id);
+    if ( b >= _blocks.size() || !_blocks[b]._slots.valid() )
+        return;
+
+    // IDs in a range are released with removeRange.
+    Slots* slots = _blocks[b]._slots.get();
+    osg::ref_ptr<osg::Referenced>& object = slots->_objects[offsetOf(id)];
+    if ( object.valid() )
+    {
+        object = 0L;
+        slots->_live--;
+        _size--;
+
+        if ( slots->_live == 0u && b != _singlesBlock )
+            releaseBlocks( b, 1u );
+    }
+
+    OE_DEBUG << LC << "Remove " << id << "; size = " << _size << "\n";
 }
 
 ObjectID
@@ -171,11 +409,42 @@ ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id) const
     ids->assign( geom->getVertexArray()->getNumElements(), id );
 }
 
+void
+ObjectIndex::tagDrawable(osg::Drawable* drawable, ObjectID id, ObjectID base) const
+{
+    if ( drawable == 0L )
+        return;
+
+    osg::Geometry* geom = drawable->asGeometry();
+    if ( !geom )
+        return;
+
+    // Offset zero means "no object", so the ID must be strictly above the base.
+    if ( id <= base || id - base > MAX_COMPACT_OFFSET )
+    {
+        OE_WARN << LC << "Illegal: object ID " << id << " cannot be encoded relative to base " << base << "\n";
+        return;
+    }
+
+    // 16 bits per vertex; the shader adds the base uniform back in.
+    osg::UShortArray* ids = new osg::UShortArray();
+    geom->setVertexAttribArray    (_attribLocation, ids);
+    geom->setVertexAttribBinding  (_attribLocation, osg::Geometry::BIND_PER_VERTEX);
+    geom->setVertexAttribNormalize(_attribLocation, false);
+
+#if OSG_VERSION_GREATER_OR_EQUAL(3,1,8)
+    ids->setPreserveDataType(true);
+#endif
+
+    ids->assign( geom->getVertexArray()->getNumElements(), (unsigned short)(id - base) );
+}
+
 namespace
 {
     struct FindAndTagDrawables : public osg::NodeVisitor
     {
-        FindAndTagDrawables(const ObjectIndex* index, ObjectID id) : _index(index), _id(id)
+        FindAndTagDrawables(const ObjectIndex* index, ObjectID id, ObjectID base, bool compact) :
+            _index(index), _id(id), _base(base), _compact(compact)
         {
             setTraversalMode(TRAVERSE_ALL_CHILDREN);
             setNodeMaskOverride(~0);
@@ -185,13 +454,18 @@ namespace
         {
             for(unsigned i=0; i<geode.getNumDrawables(); ++i)
             {
-                _index->tagDrawable( geode.getDrawable(i), _id );
+                if ( _compact )
+                    _index->tagDrawable( geode.getDrawable(i), _id, _base );
+                else
+                    _index->tagDrawable( geode.getDrawable(i), _id );
             }
             traverse( geode );
         }
 
         const ObjectIndex* _index;
         ObjectID           _id;
+        ObjectID           _base;
+        bool               _compact;
     };
 }
 
@@ -209,7 +483,17 @@ ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id) const
 {
     if ( node )
     {
-        FindAndTagDrawables visitor(this, id);
+        FindAndTagDrawables visitor(this, id, 0u, false);
+        node->accept( visitor );
+    }
+}
+
+void
+ObjectIndex::tagAllDrawables(osg::Node* node, ObjectID id, ObjectID base) const
+{
+    if ( node )
+    {
+        FindAndTagDrawables visitor(this, id, base, true);
         node->accept( visitor );
     }
 }
@@ -232,3 +516,13 @@ ObjectIndex::tagNode(osg::Node* node, ObjectID id) const
         stateSet->addUniform( new osg::Uniform(_oidUniformName.c_str(), id) );
     }
 }
+
+void
+ObjectIndex::tagBase(osg::Node* node, ObjectID base) const
+{
+    if ( node )
+    {
+        osg::StateSet* stateSet = node->getOrCreateStateSet();
+        stateSet->addUniform( new osg::Uniform(_baseUniformName.c_str(), base) );
+    }
+}
@@ -30,6 +30,7 @@
 #include <osgEarth/StringUtils>
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/ObjectIndex>
+#include <osgEarth/DrawInstanced>
 
 #include <osgEarth/Units>
 #include <osg/Notify>
@@ -95,6 +96,9 @@ _cacheDriver        ( "filesystem" )
     // Default object index for tracking scene object by UID.
     _objectIndex = new ObjectIndex();
 
+    // Models shared by instanced feature rendering.
+    _instancePalette = new DrawInstanced::ModelPalette();
+
     // activate KMZ support
     osgDB::Registry::instance()->addArchiveExtension  ( "kmz" );
     //osgDB::Registry::instance()->addFileExtensionAlias( "kmz", "kml" );
@@ -567,6 +571,27 @@ Registry::getObjectIndex() const
     return _objectIndex.get();
 }
 
+DrawInstanced::ModelPalette*
+Registry::getInstancePalette() const
+{
+    return _instancePalette.get();
+}
+
+TaskService*
+Registry::getCompileTaskService(unsigned numThreads)
+{
+    Threading::ScopedMutexLock lock( _compileTaskServiceMutex );
+    if ( !_compileTaskService.valid() )
+    {
+        _compileTaskService = new TaskService( "osgEarth.Compile", osg::maximum(numThreads, 1u) );
+    }
+    else if ( _compileTaskService->getNumThreads() < (int)numThreads )
+    {
+        _compileTaskService->setNumThreads( numThreads );
+    }
+    return _compileTaskService.get();
+}
+
 void
 Registry::startActivity(const std::string& activity)
 {
@@ -24,12 +24,16 @@
 #include <osgEarth/ECEF>
 #include <osgEarth/ThreadingUtils>
 #include <osg/Notify>
+#include <OpenThreads/Atomic>
 #include <ogr_api.h>
 #include <ogr_spatialref.h>
 #include <algorithm>
 
 #define LC "[SpatialReference] "
 
+// Most idle OGR transformation handles an SRS keeps for reuse.
+#define MAX_IDLE_TRANSFORM_HANDLES 16u
+
 using namespace osgEarth;
 
 // took this out, see issue #79
@@ -40,6 +44,10 @@ using namespace osgEarth;
 
 namespace
 {
+    // source of SRS UIDs, which key the transform handle caches. Unlike the
+    // SRS pointer, a UID is never reused after the SRS is deleted.
+    OpenThreads::Atomic s_srsUID;
+
     std::string
     getOGRAttrValue( void* _handle, const std::string& name, int child_num, bool lowercase =false)
     {
@@ -397,7 +405,9 @@ _is_contiguous  ( false ),
 _is_user_defined( false ),
 _is_ltp         ( false ),
 _is_plate_carre ( false ),
-_is_spherical_mercator( false )
+_is_spherical_mercator( false ),
+_uid            ( ++s_srsUID ),
+_analyticInitialized( 0 )
 {
     // nop
 }
@@ -409,7 +419,9 @@ _handle        ( handle ),
 _owns_handle   ( ownsHandle ),
 _is_ltp        ( false ),
 _is_plate_carre( false ),
-_is_ecef       ( false )
+_is_ecef       ( false ),
+_uid           ( ++s_srsUID ),
+_analyticInitialized( 0 )
 {
     //nop
 }
@@ -420,7 +432,7 @@ SpatialReference::~SpatialReference()
     {
         GDAL_SCOPED_LOCK;
 
-        for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
+        for (TransformHandleList::iterator itr = _transformHandles.begin(); itr != _transformHandles.end(); ++itr)
         {
             OCTDestroyCoordinateTransformation(itr->second);
         }
@@ -999,7 +1011,36 @@ SpatialReference::transform(std::vector<osg::Vec3d>& points,
     // trivial equivalency:
     if ( isEquivalentTo(outputSRS) )
         return true;
-    
+
+    // closed-form fast path for the common WGS84 systems; bypasses OGR entirely.
+    if ( hasAnalyticTransform(outputSRS) )
+    {
+        std::vector<unsigned> failed;
+        if ( AnalyticTransforms::transform(getAnalyticDefinition(), outputSRS->getAnalyticDefinition(), points, &failed) )
+            return true;
+
+        // Points the closed form can't handle (e.g. far outside a UTM zone)
+        // take the generic path, which decides whether they fail.
+        std::vector<osg::Vec3d> retry;
+        retry.reserve( failed.size() );
+        for(unsigned i=0; i<failed.size(); ++i)
+            retry.push_back( points[failed[i]] );
+
+        bool success = transformGeneric( retry, outputSRS );
+
+        for(unsigned i=0; i<failed.size() && i<retry.size(); ++i)
+            points[failed[i]] = retry[i];
+
+        return success;
+    }
+
+    return transformGeneric( points, outputSRS );
+}
+
+bool
+SpatialReference::transformGeneric(std::vector<osg::Vec3d>& points,
+                                   const SpatialReference*  outputSRS) const
+{
     bool success = false;
 
     // do the pre-transformation pass:
@@ -1121,22 +1162,7 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
-
-    void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
-    {
-        //OE_DEBUG << LC << "using cached transform handle" << std::endl;
-        xform_handle = itr->second;
-    }
-    else
-    {
-        OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
-        xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
-    }
+    void* xform_handle = checkoutTransformHandle( out_srs );
 
     if ( !xform_handle )
     {
@@ -1147,7 +1173,113 @@ SpatialReference::transformXYPointArrays(double*  x,
         return false;
     }
 
-    return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+    // The handle is checked out to the calling thread, so the transform
+    // itself does not need the GDAL lock.
+    bool ok = OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+
+    checkinTransformHandle( out_srs, xform_handle );
+    return ok;
+}
+
+
+bool
+SpatialReference::hasAnalyticTransform(const SpatialReference* outputSRS) const
+{
+    return
+        outputSRS &&
+        AnalyticTransforms::isEnabled() &&
+        !_vdatum.valid() &&
+        !outputSRS->getVerticalDatum() &&
+        AnalyticTransforms::canTransform(getAnalyticDefinition(), outputSRS->getAnalyticDefinition());
+}
+
+const AnalyticTransforms::Definition&
+SpatialReference::getAnalyticDefinition() const
+{
+    if ( _analyticInitialized == 0 )
+    {
+        GDAL_SCOPED_LOCK;
+
+        if ( _analyticInitialized == 0 )
+        {
+            if ( !_initialized )
+                const_cast<SpatialReference*>(this)->init();
+
+            AnalyticTransforms::Definition def;
+
+            // LTP and other user-defined systems (besides the cube) override
+            // pre/postTransform, so they always take the generic path. So
+            // does osgEarth's own "plate-carre", which is degrees in disguise.
+            if ( isCube() )
+            {
+                // the cube's geodetic basis must be plain WGS84 as well.
+                if ( AnalyticTransforms::fromPROJ4(_proj4).type == AnalyticTransforms::TYPE_GEODETIC )
+                    def.type = AnalyticTransforms::TYPE_CUBE;
+            }
+            else if ( !_is_user_defined && !_is_ltp && !_is_plate_carre )
+            {
+                def = AnalyticTransforms::fromPROJ4( _proj4 );
+
+                // ECEF shares its PROJ4 string with its geodetic basis.
+                if ( _is_ecef )
+                {
+                    if ( def.type == AnalyticTransforms::TYPE_GEODETIC )
+                        def.type = AnalyticTransforms::TYPE_ECEF;
+                    else
+                        def = AnalyticTransforms::Definition();
+                }
+            }
+
+            // publish the definition before the flag (the atomic increment
+            // is a full barrier), so unlocked readers never see it half-written.
+            _analytic = def;
+            ++_analyticInitialized;
+        }
+    }
+    return _analytic;
+}
+
+void*
+SpatialReference::checkoutTransformHandle(const SpatialReference* out_srs) const
+{
+    {
+        Threading::ScopedMutexLock lock( _transformHandlesMutex );
+        for(TransformHandleList::iterator itr = _transformHandles.begin(); itr != _transformHandles.end(); ++itr)
+        {
+            if ( itr->first == out_srs->_uid )
+            {
+                void* xform_handle = itr->second;
+                _transformHandles.erase( itr );
+                return xform_handle;
+            }
+        }
+    }
+
+    // Creating the handle reads both OGR SRS handles, which needs the global lock.
+    OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
+    GDAL_SCOPED_LOCK;
+    return OCTNewCoordinateTransformation( _handle, out_srs->_handle );
+}
+
+void
+SpatialReference::checkinTransformHandle(const SpatialReference* out_srs, void* xform_handle) const
+{
+    void* evicted = 0L;
+    {
+        Threading::ScopedMutexLock lock( _transformHandlesMutex );
+        _transformHandles.push_front( std::make_pair(out_srs->_uid, xform_handle) );
+        if ( _transformHandles.size() > MAX_IDLE_TRANSFORM_HANDLES )
+        {
+            evicted = _transformHandles.back().second;
+            _transformHandles.pop_back();
+        }
+    }
+
+    if ( evicted )
+    {
+        GDAL_SCOPED_LOCK;
+        OCTDestroyCoordinateTransformation( evicted );
+    }
 }
 
 
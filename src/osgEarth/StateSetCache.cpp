@@ -20,6 +20,18 @@
 #include <osg/NodeVisitor>
 #include <osg/Geode>
 #include <osg/BufferIndexBinding>
+#include <osg/BlendFunc>
+#include <osg/CullFace>
+#include <osg/Depth>
+#include <osg/LineStipple>
+#include <osg/LineWidth>
+#include <osg/Material>
+#include <osg/Point>
+#include <osg/PolygonMode>
+#include <osg/PolygonOffset>
+#include <osg/Texture>
+#include <osg/Timer>
+#include <cstring>
 
 #define LC "[StateSetCache] "
 
@@ -91,6 +103,186 @@ namespace
 #endif
     }
 
+    // FNV-1a style mixing for the structural hashes.
+    inline void mix(unsigned& hash, unsigned value)
+    {
+        hash = (hash ^ value) * 16777619u;
+    }
+
+    inline void mix(unsigned& hash, float value)
+    {
+        // +0.0f folds -0.0 into 0.0, which compare() treats as equal.
+        value += 0.0f;
+        unsigned bits;
+        ::memcpy( &bits, &value, sizeof(bits) );
+        mix( hash, bits );
+    }
+
+    inline void mix(unsigned& hash, const osg::Vec4& value)
+    {
+        for(unsigned i=0; i<4; ++i)
+            mix( hash, value[i] );
+    }
+
+    /**
+     * Structural hash of an attribute. Attributes for which compare() returns
+     * zero must hash the same, so this only includes the type and, for the
+     * common attribute types, values that compare() checks. Everything else
+     * is left for compare() to sort out.
+     */
+    unsigned hashAttribute(const osg::StateAttribute* attr)
+    {
+        unsigned hash = 2166136261u;
+        mix( hash, (unsigned)attr->getType() );
+        mix( hash, attr->getMember() );
+
+        switch( attr->getType() )
+        {
+        case osg::StateAttribute::TEXTURE:
+            if ( const osg::Texture* t = attr->asTexture() )
+            {
+                mix( hash, (unsigned)t->getWrap(osg::Texture::WRAP_S) );
+                mix( hash, (unsigned)t->getWrap(osg::Texture::WRAP_T) );
+                mix( hash, (unsigned)t->getFilter(osg::Texture::MIN_FILTER) );
+                mix( hash, (unsigned)t->getFilter(osg::Texture::MAG_FILTER) );
+            }
+            break;
+
+        case osg::StateAttribute::MATERIAL:
+            if ( const osg::Material* m = dynamic_cast<const osg::Material*>(attr) )
+            {
+                mix( hash, m->getDiffuse(osg::Material::FRONT) );
+                mix( hash, m->getAmbient(osg::Material::FRONT) );
+                mix( hash, m->getEmission(osg::Material::FRONT) );
+            }
+            break;
+
+        case osg::StateAttribute::LINEWIDTH:
+            if ( const osg::LineWidth* w = dynamic_cast<const osg::LineWidth*>(attr) )
+                mix( hash, w->getWidth() );
+            break;
+
+        case osg::StateAttribute::LINESTIPPLE:
+            if ( const osg::LineStipple* ls = dynamic_cast<const osg::LineStipple*>(attr) )
+            {
+                mix( hash, (unsigned)ls->getFactor() );
+                mix( hash, (unsigned)ls->getPattern() );
+            }
+            break;
+
+        case osg::StateAttribute::POINT:
+            if ( const osg::Point* p = dynamic_cast<const osg::Point*>(attr) )
+                mix( hash, p->getSize() );
+            break;
+
+        case osg::StateAttribute::BLENDFUNC:
+            if ( const osg::BlendFunc* b = dynamic_cast<const osg::BlendFunc*>(attr) )
+            {
+                mix( hash, (unsigned)b->getSource() );
+                mix( hash, (unsigned)b->getDestination() );
+                mix( hash, (unsigned)b->getSourceAlpha() );
+                mix( hash, (unsigned)b->getDestinationAlpha() );
+            }
+            break;
+
+        case osg::StateAttribute::DEPTH:
+            if ( const osg::Depth* d = dynamic_cast<const osg::Depth*>(attr) )
+            {
+                mix( hash, (unsigned)d->getFunction() );
+                mix( hash, d->getWriteMask() ? 1u : 0u );
+            }
+            break;
+
+        case osg::StateAttribute::POLYGONOFFSET:
+            if ( const osg::PolygonOffset* po = dynamic_cast<const osg::PolygonOffset*>(attr) )
+            {
+                mix( hash, po->getFactor() );
+                mix( hash, po->getUnits() );
+            }
+            break;
+
+        case osg::StateAttribute::POLYGONMODE:
+            if ( const osg::PolygonMode* pm = dynamic_cast<const osg::PolygonMode*>(attr) )
+            {
+                mix( hash, (unsigned)pm->getMode(osg::PolygonMode::FRONT) );
+                mix( hash, (unsigned)pm->getMode(osg::PolygonMode::BACK) );
+            }
+            break;
+
+        case osg::StateAttribute::CULLFACE:
+            if ( const osg::CullFace* cf = dynamic_cast<const osg::CullFace*>(attr) )
+                mix( hash, (unsigned)cf->getMode() );
+            break;
+
+        default:
+            break;
+        }
+
+        return hash;
+    }
+
+    void mixAttributeList(unsigned& hash, const osg::StateSet::AttributeList& attrs)
+    {
+        mix( hash, (unsigned)attrs.size() );
+        for( osg::StateSet::AttributeList::const_iterator i = attrs.begin(); i != attrs.end(); ++i )
+        {
+            if ( i->second.first.valid() )
+                mix( hash, hashAttribute(i->second.first.get()) );
+            mix( hash, (unsigned)i->second.second );
+        }
+    }
+
+    void mixModeList(unsigned& hash, const osg::StateSet::ModeList& modes)
+    {
+        mix( hash, (unsigned)modes.size() );
+        for( osg::StateSet::ModeList::const_iterator i = modes.begin(); i != modes.end(); ++i )
+        {
+            mix( hash, (unsigned)i->first );
+            mix( hash, (unsigned)i->second );
+        }
+    }
+
+    /**
+     * Structural hash of a stateset, consistent with a deep compare(): it
+     * covers the modes and the attributes (by content), which are the parts
+     * that usually differ in practice.
+     */
+    unsigned hashStateSet(const osg::StateSet* stateSet)
+    {
+        unsigned hash = 2166136261u;
+
+        mixModeList( hash, stateSet->getModeList() );
+        mixAttributeList( hash, stateSet->getAttributeList() );
+
+        const osg::StateSet::TextureModeList& texModes = stateSet->getTextureModeList();
+        mix( hash, (unsigned)texModes.size() );
+        for( unsigned i=0; i<texModes.size(); ++i )
+            mixModeList( hash, texModes[i] );
+
+        const osg::StateSet::TextureAttributeList& texAttrs = stateSet->getTextureAttributeList();
+        mix( hash, (unsigned)texAttrs.size() );
+        for( unsigned i=0; i<texAttrs.size(); ++i )
+            mixAttributeList( hash, texAttrs[i] );
+
+        return hash;
+    }
+
+    bool equivalent(const osg::StateSet* lhs, const osg::StateSet* rhs)
+    {
+        return lhs->compare(*rhs, true) == 0;
+    }
+
+    bool equivalent(const osg::StateAttribute* lhs, const osg::StateAttribute* rhs)
+    {
+        return lhs->compare(*rhs) == 0;
+    }
+
+    // shards use the high bits; the tables themselves key on the whole hash.
+    inline unsigned shardOf(unsigned hash, unsigned numShards)
+    {
+        return (hash >> 24) % numShards;
+    }
+
     /**
      * Visitor that calls StateSetCache::share on all attributes found
      * in a scene graph.
@@ -247,30 +439,24 @@ namespace
 //------------------------------------------------------------------------
 
 StateSetCache::StateSetCache() :
-_pruneCount       ( 0 ),
 _maxSize          ( DEFAULT_PRUNE_ACCESS_COUNT ),
-_attrShareAttempts( 0 ),
-_attrsIneligible  ( 0 ),
-_attrShareHits    ( 0 ),
-_attrShareMisses  ( 0 )
+_lockWaitTime     ( 0.0 ),
+_optimizeTime     ( 0.0 ),
+_optimizeCalls    ( 0 )
 {
     //nop
 }
 
 StateSetCache::~StateSetCache()
 {
-    Threading::ScopedMutexLock lock( _mutex );
-    prune();
+    pruneAll( true );
 }
 
 void
 StateSetCache::setMaxSize(unsigned value)
 {
     _maxSize = value;
-    {
-        Threading::ScopedMutexLock lock( _mutex );
-        pruneIfNecessary();
-    }
+    pruneAll( false );
 }
 
 void
@@ -300,8 +486,16 @@ StateSetCache::optimize(osg::Node* node)
 {
     if ( node )
     {
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
         consolidateStateAttributes( node );
         consolidateStateSets( node );
+
+        double t = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+        Threading::ScopedMutexLock lock( _statsMutex );
+        _optimizeTime += t;
+        _optimizeCalls++;
     }
 }
 
@@ -325,113 +519,172 @@ StateSetCache::share(osg::ref_ptr<osg::StateSet>& input,
                      osg::ref_ptr<osg::StateSet>& output,
                      bool                         checkEligible)
 {
-    bool shared     = false;
-    //bool shareattrs = true;
-
-    if ( !checkEligible || eligible(input.get()) )
-    {
-        Threading::ScopedMutexLock lock( _mutex );
-
-        pruneIfNecessary();
-
-        //shareattrs = false;
-
-        std::pair<StateSetSet::iterator,bool> result = _stateSetCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            //shareattrs = true;
-            shared = false;
-        }
-        else
-        {
-            // found a share!
-            output = result.first->get();
-            shared = true;
-        }
-    }
-    else
+    if ( !input.valid() || (checkEligible && !eligible(input.get())) )
     {
         output = input.get();
-        shared = false;
+        return false;
     }
 
-    // OBE.
-    //if ( shareattrs )
-    //{
-    //    ShareStateAttributes sa(this);
-    //    sa.applyStateSet( input.get() );
-    //}
+    ++_stateSetAttempts;
+
+    unsigned hash = hashStateSet( input.get() );
+    bool shared = shareInShard( _stateSetShards[shardOf(hash, NUM_SHARDS)], hash, input, output );
+
+    if ( shared )
+        ++_stateSetHits;
 
     return shared;
 }
 
 
-
 bool
 StateSetCache::share(osg::ref_ptr<osg::StateAttribute>& input,
                      osg::ref_ptr<osg::StateAttribute>& output,
                      bool                               checkEligible)
 {
-    _attrShareAttempts++;
+    ++_attrShareAttempts;
 
-    if ( !checkEligible || eligible(input.get()) )
+    if ( !input.valid() || (checkEligible && !eligible(input.get())) )
     {
-        Threading::ScopedMutexLock lock( _mutex );
+        ++_attrsIneligible;
+        output = input.get();
+        return false;
+    }
 
-        pruneIfNecessary();
+    unsigned hash = hashAttribute( input.get() );
+    bool shared = shareInShard( _stateAttributeShards[shardOf(hash, NUM_SHARDS)], hash, input, output );
 
-        std::pair<StateAttributeSet::iterator,bool> result = _stateAttributeCache.insert( input );
-        if ( result.second )
-        {
-            // first use
-            output = input.get();
-            _attrShareMisses++;
-            return false;
-        }
-        else
-        {
-            // found a share!
-            output = result.first->get();
-            _attrShareHits++;
+    if ( shared )
+        ++_attrShareHits;
+
+    return shared;
+}
+
+template<typename T>
+bool
+StateSetCache::shareInShard(Shard<T>&        shard,
+                            unsigned         hash,
+                            osg::ref_ptr<T>& input,
+                            osg::ref_ptr<T>& output)
+{
+    const osg::Timer* timer = osg::Timer::instance();
+
+    // Usual case: an equivalent object is already in the table, and a read
+    // lock (shared with other threads) is all we need to find it.
+    {
+        osg::Timer_t start = timer->tick();
+        shard._mutex.readLock();
+        recordLockWait( start );
+
+        // take the reference before unlocking; once unlocked, another thread's
+        // insert may prune the table and free an entry nobody else holds.
+        T* found = findEquivalent( shard._table, hash, input.get() );
+        if ( found )
+            output = found;
+
+        shard._mutex.readUnlock();
+
+        if ( found )
             return true;
-        }
     }
-    else
+
+    // Not there; take the write lock, check again in case another thread
+    // just inserted one, and failing that insert the input.
+    osg::Timer_t start = timer->tick();
+    Threading::ScopedWriteLock exclusive( shard._mutex );
+    recordLockWait( start );
+
+    T* found = findEquivalent( shard._table, hash, input.get() );
+    if ( found )
+    {
+        output = found;
+        return true;
+    }
+
+    shard._table.insert( std::make_pair(hash, input) );
+    output = input.get();
+
+    if ( ++shard._inserts >= _maxSize )
     {
-        _attrsIneligible++;
-        output = input.get();
-        return false;
+        prune( shard );
+        shard._inserts = 0;
     }
+
+    return false;
+}
+
+template<typename T>
+T*
+StateSetCache::findEquivalent(const std::multimap< unsigned, osg::ref_ptr<T> >& table,
+                    unsigned                                          hash,
+                    const T*                                          input)
+{
+    // only objects with the same hash can be equivalent, so that's all
+    // that needs a deep compare.
+    typedef typename std::multimap< unsigned, osg::ref_ptr<T> >::const_iterator Iter;
+    std::pair<Iter, Iter> range = table.equal_range( hash );
+    for( Iter i = range.first; i != range.second; ++i )
+    {
+        if ( i->second.get() == input )
+            return i->second.get();
+
+        ++_compares;
+        if ( equivalent(i->second.get(), input) )
+            return i->second.get();
+    }
+    return 0L;
 }
 
 void
-StateSetCache::pruneIfNecessary()
+StateSetCache::recordLockWait(osg::Timer_t start)
 {
-    // assume an exclusve mutex is taken
-    if ( _pruneCount++ >= _maxSize )
+    // only touch the stats mutex when there was real contention.
+    double us = osg::Timer::instance()->delta_u( start, osg::Timer::instance()->tick() );
+    if ( us >= 1.0 )
     {
-        prune();
-        _pruneCount = 0;
+        Threading::ScopedMutexLock lock( _statsMutex );
+        _lockWaitTime += us * 1e-6;
     }
 }
 
 void
-StateSetCache::prune()
+StateSetCache::pruneAll(bool force)
 {
-    // assume an exclusive mutex is taken.
+    for( unsigned s=0; s<NUM_SHARDS; ++s )
+    {
+        {
+            Threading::ScopedWriteLock exclusive( _stateSetShards[s]._mutex );
+            if ( force || _stateSetShards[s]._inserts >= _maxSize )
+            {
+                prune( _stateSetShards[s] );
+                _stateSetShards[s]._inserts = 0;
+            }
+        }
+        {
+            Threading::ScopedWriteLock exclusive( _stateAttributeShards[s]._mutex );
+            if ( force || _stateAttributeShards[s]._inserts >= _maxSize )
+            {
+                prune( _stateAttributeShards[s] );
+                _stateAttributeShards[s]._inserts = 0;
+            }
+        }
+    }
+}
 
-    unsigned ss_count = 0, sa_count = 0;
+void
+StateSetCache::prune(StateSetShard& shard)
+{
+    // assume the shard's write lock is taken.
+    unsigned count = 0;
 
-    for( StateSetSet::iterator i = _stateSetCache.begin(); i != _stateSetCache.end(); )
+    for( StateSetShard::Table::iterator i = shard._table.begin(); i != shard._table.end(); )
     {
-        if ( i->get()->referenceCount() <= 1 )
+        if ( i->second->referenceCount() <= 1 )
         {
             // do not call releaseGLObjects since the attrs themselves might still be shared
             // TODO: review this.
-            _stateSetCache.erase( i++ );
-            ss_count++;
+            shard._table.erase( i++ );
+            count++;
         }
         else
         {
@@ -439,13 +692,22 @@ StateSetCache::prune()
         }
     }
 
-    for( StateAttributeSet::iterator i = _stateAttributeCache.begin(); i != _stateAttributeCache.end(); )
+    OE_DEBUG << LC << "Pruned " << count << " statesets" << std::endl;
+}
+
+void
+StateSetCache::prune(StateAttributeShard& shard)
+{
+    // assume the shard's write lock is taken.
+    unsigned count = 0;
+
+    for( StateAttributeShard::Table::iterator i = shard._table.begin(); i != shard._table.end(); )
     {
-        if ( i->get()->referenceCount() <= 1 )
+        if ( i->second->referenceCount() <= 1 )
         {
-            i->get()->releaseGLObjects( 0L );
-            _stateAttributeCache.erase( i++ );
-            sa_count++;
+            i->second->releaseGLObjects( 0L );
+            shard._table.erase( i++ );
+            count++;
         }
         else
         {
@@ -453,27 +715,86 @@ StateSetCache::prune()
         }
     }
 
-    OE_DEBUG << LC << "Pruned " << sa_count << " attributes, " << ss_count << " statesets" << std::endl;
+    OE_DEBUG << LC << "Pruned " << count << " attributes" << std::endl;
+}
+
+unsigned
+StateSetCache::size() const
+{
+    unsigned count = 0;
+    for( unsigned s=0; s<NUM_SHARDS; ++s )
+    {
+        Threading::ScopedReadLock shared( _stateSetShards[s]._mutex );
+        count += _stateSetShards[s]._table.size();
+    }
+    return count;
 }
 
 void
 StateSetCache::clear()
 {
-    Threading::ScopedMutexLock lock( _mutex );
+    for( unsigned s=0; s<NUM_SHARDS; ++s )
+    {
+        {
+            Threading::ScopedWriteLock exclusive( _stateAttributeShards[s]._mutex );
+            _stateAttributeShards[s]._table.clear();
+        }
+        {
+            Threading::ScopedWriteLock exclusive( _stateSetShards[s]._mutex );
+            _stateSetShards[s]._table.clear();
+        }
+    }
+}
+
+StateSetCache::Stats
+StateSetCache::getStats() const
+{
+    Stats stats;
+    stats.stateSetAttempts = _stateSetAttempts;
+    stats.stateSetHits     = _stateSetHits;
+    stats.attrAttempts     = _attrShareAttempts;
+    stats.attrsIneligible  = _attrsIneligible;
+    stats.attrHits         = _attrShareHits;
+    stats.compares         = _compares;
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    stats.lockWaitTime     = _lockWaitTime;
+    stats.optimizeTime     = _optimizeTime;
+    stats.optimizeCalls    = _optimizeCalls;
+    return stats;
+}
 
-    _stateAttributeCache.clear();
-    _stateSetCache.clear();
+void
+StateSetCache::resetStats()
+{
+    _stateSetAttempts.exchange( 0 );
+    _stateSetHits.exchange( 0 );
+    _attrShareAttempts.exchange( 0 );
+    _attrsIneligible.exchange( 0 );
+    _attrShareHits.exchange( 0 );
+    _compares.exchange( 0 );
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _lockWaitTime  = 0.0;
+    _optimizeTime  = 0.0;
+    _optimizeCalls = 0;
 }
 
 
 void
 StateSetCache::dumpStats()
 {
-    Threading::ScopedMutexLock lock( _mutex );
+    Stats stats = getStats();
 
     OE_NOTICE << LC << "StateSetCache Dump:" << std::endl
-        << "    attr attempts     = " << _attrShareAttempts << std::endl
-        << "    ineligibles attrs = " << _attrsIneligible << std::endl
-        << "    attr share hits   = " << _attrShareHits << std::endl
-        << "    attr share misses = " << _attrShareMisses << std::endl;
+        << "    stateset attempts = " << stats.stateSetAttempts << std::endl
+        << "    stateset hits     = " << stats.stateSetHits << std::endl
+        << "    attr attempts     = " << stats.attrAttempts << std::endl
+        << "    ineligibles attrs = " << stats.attrsIneligible << std::endl
+        << "    attr share hits   = " << stats.attrHits << std::endl
+        << "    attr share misses = " << (stats.attrAttempts - stats.attrsIneligible - stats.attrHits) << std::endl
+        << "    deep compares     = " << stats.compares << std::endl
+        << "    dedupe ratio      = " << stats.getDedupeRatio() << std::endl
+        << "    lock wait (s)     = " << stats.lockWaitTime << std::endl
+        << "    optimize (s)      = " << stats.optimizeTime << " in " << stats.optimizeCalls << " calls" << std::endl;
 }
@@ -22,11 +22,20 @@
 #include <osgUtil/IntersectionVisitor>
 #include <osgUtil/LineSegmentIntersector>
 #include <osgViewer/View>
+#include <osg/Timer>
+#include <algorithm>
 
 #define LC "[Terrain] "
 
 using namespace osgEarth;
 
+// deepest level of the terrain callback index; finer areas of interest
+// share cells at this level.
+#define MAX_INDEX_LEVEL 16
+
+// number of dispatched tiles between callback statistics reports.
+#define CALLBACK_STATS_INTERVAL 1000
+
 //---------------------------------------------------------------------------
 
 namespace
@@ -84,9 +93,20 @@ Terrain::Terrain(osg::Node* graph, const Profile* mapProfile, bool geocentric, c
 _graph         ( graph ),
 _profile       ( mapProfile ),
 _geocentric    ( geocentric ),
-_terrainOptions( terrainOptions )
+_terrainOptions( terrainOptions ),
+_indexOrder    ( 0u )
 {
-    //nop
+    // the callback index is a grid per level, aligned with the profile's tiles.
+    if ( _profile.valid() )
+    {
+        _indexLevels.resize( MAX_INDEX_LEVEL+1 );
+        for(unsigned level=0; level<=MAX_INDEX_LEVEL; ++level)
+        {
+            double w, h;
+            _profile->getTileDimensions( level, w, h );
+            _indexCellSizes.push_back( osg::Vec2d(w, h) );
+        }
+    }
 }
 
 bool
@@ -281,6 +301,74 @@ Terrain::addTerrainCallback( TerrainCallback* cb )
     }
 }
 
+void
+Terrain::addTerrainCallback( TerrainCallback* cb, const GeoExtent& extent )
+{
+    if ( !cb )
+        return;
+
+    // no index (or no usable extent)? fall back on the global list.
+    GeoExtent local = extent;
+    if ( local.isValid() && _profile.valid() && !local.getSRS()->isHorizEquivalentTo(getSRS()) )
+    {
+        local = extent.transform( getSRS() );
+    }
+
+    if ( !local.isValid() || _indexLevels.empty() )
+    {
+        // hold a ref in case the terrain owns the only one.
+        osg::ref_ptr<TerrainCallback> hold = cb;
+        removeTerrainCallback( cb );
+        addTerrainCallback( cb );
+        return;
+    }
+
+    IndexedCallback entry;
+    entry._callback = cb;
+
+    GeoExtent west, east;
+    if ( local.splitAcrossAntimeridian(west, east) )
+    {
+        entry._bounds.push_back( west.bounds() );
+        entry._bounds.push_back( east.bounds() );
+    }
+    else
+    {
+        entry._bounds.push_back( local.bounds() );
+    }
+
+    Threading::ScopedWriteLock exclusiveLock( _callbacksMutex );
+
+    // re-registering moves the callback; keep its place in the dispatch order.
+    IndexedCallbacks::iterator i = _indexed.find( cb );
+    if ( i != _indexed.end() )
+    {
+        entry._order = i->second._order;
+        removeIndexed( cb );
+    }
+    else
+    {
+        entry._order = _indexOrder++;
+        ++_callbacksSize;
+
+        // it may be moving out of the global list.
+        for( CallbackList::iterator j = _callbacks.begin(); j != _callbacks.end(); )
+        {
+            if ( j->get() == cb )
+            {
+                j = _callbacks.erase( j );
+                --_callbacksSize;
+            }
+            else
+            {
+                ++j;
+            }
+        }
+    }
+
+    insertIndexed( _indexed[cb] = entry );
+}
+
 void
 Terrain::removeTerrainCallback( TerrainCallback* cb )
 {
@@ -298,6 +386,166 @@ Terrain::removeTerrainCallback( TerrainCallback* cb )
             ++i;
         }
     }
+
+    if ( _indexed.find(cb) != _indexed.end() )
+    {
+        removeIndexed( cb );
+        _indexed.erase( cb );
+        --_callbacksSize;
+    }
+}
+
+void
+Terrain::getIndexCells(const Bounds& b, unsigned level, int& x0, int& y0, int& x1, int& y1) const
+{
+    const GeoExtent& pe = _profile->getExtent();
+    const osg::Vec2d& size = _indexCellSizes[level];
+
+    int maxX = osg::maximum( (int)ceil(pe.width()/size.x()) - 1, 0 );
+    int maxY = osg::maximum( (int)ceil(pe.height()/size.y()) - 1, 0 );
+
+    x0 = osg::clampBetween( (int)floor((b.xMin()-pe.xMin())/size.x()), 0, maxX );
+    x1 = osg::clampBetween( (int)floor((b.xMax()-pe.xMin())/size.x()), 0, maxX );
+    y0 = osg::clampBetween( (int)floor((b.yMin()-pe.yMin())/size.y()), 0, maxY );
+    y1 = osg::clampBetween( (int)floor((b.yMax()-pe.yMin())/size.y()), 0, maxY );
+}
+
+namespace
+{
+    inline unsigned long long cellKey(int x, int y)
+    {
+        return ((unsigned long long)(unsigned)x << 32) | (unsigned long long)(unsigned)y;
+    }
+
+    struct SortByOrder
+    {
+        template<typename T>
+        bool operator()(const T& a, const T& b) const {
+            return a.first < b.first;
+        }
+    };
+}
+
+void
+Terrain::insertIndexed( IndexedCallback& entry )
+{
+    // NOTE: called with _callbacksMutex write-locked.
+
+    unsigned level = getIndexLevel( entry._bounds );
+
+    entry._level = level;
+    entry._cells.clear();
+
+    IndexCells& cells = _indexLevels[level];
+    for(unsigned b=0; b<entry._bounds.size(); ++b)
+    {
+        int x0, y0, x1, y1;
+        getIndexCells( entry._bounds[b], level, x0, y0, x1, y1 );
+        for(int x=x0; x<=x1; ++x)
+        {
+            for(int y=y0; y<=y1; ++y)
+            {
+                unsigned long long key = cellKey(x, y);
+                if ( std::find(entry._cells.begin(), entry._cells.end(), key) == entry._cells.end() )
+                {
+                    entry._cells.push_back( key );
+                    cells[key].push_back( &entry );
+                }
+            }
+        }
+    }
+}
+
+unsigned
+Terrain::getIndexLevel( const std::vector<Bounds>& bounds ) const
+{
+    // find the deepest level at which every part spans at most 2x2 cells.
+    unsigned level = MAX_INDEX_LEVEL;
+    for( ; level > 0; --level )
+    {
+        bool fits = true;
+        for(unsigned b=0; b<bounds.size() && fits; ++b)
+        {
+            int x0, y0, x1, y1;
+            getIndexCells( bounds[b], level, x0, y0, x1, y1 );
+            fits = (x1-x0 <= 1) && (y1-y0 <= 1);
+        }
+        if ( fits )
+            break;
+    }
+    return level;
+}
+
+GeoExtent
+Terrain::getTerrainCallbackCells( const GeoExtent& extent ) const
+{
+    GeoExtent local = extent;
+    if ( local.isValid() && _profile.valid() && !local.getSRS()->isHorizEquivalentTo(getSRS()) )
+    {
+        local = extent.transform( getSRS() );
+    }
+
+    // the cells of a split extent aren't contiguous; keep it simple.
+    if ( !local.isValid() || _indexLevels.empty() || local.crossesAntimeridian() )
+        return GeoExtent::INVALID;
+
+    std::vector<Bounds> bounds( 1, local.bounds() );
+    unsigned level = getIndexLevel( bounds );
+
+    int x0, y0, x1, y1;
+    getIndexCells( bounds[0], level, x0, y0, x1, y1 );
+
+    const GeoExtent& pe = _profile->getExtent();
+    const osg::Vec2d& size = _indexCellSizes[level];
+
+    GeoExtent cells(
+        getSRS(),
+        pe.xMin() + size.x()*(double)x0,
+        pe.yMin() + size.y()*(double)y0,
+        osg::minimum( pe.xMin() + size.x()*(double)(x1+1), pe.xMax() ),
+        osg::minimum( pe.yMin() + size.y()*(double)(y1+1), pe.yMax() ) );
+
+    // clamped to the profile's edge cells, they may not hold the extent at all.
+    return cells.contains( local ) ? cells : GeoExtent::INVALID;
+}
+
+void
+Terrain::removeIndexed( TerrainCallback* cb )
+{
+    // NOTE: called with _callbacksMutex write-locked.
+    IndexedCallbacks::iterator i = _indexed.find( cb );
+    if ( i == _indexed.end() )
+        return;
+
+    IndexedCallback& entry = i->second;
+    IndexCells& cells = _indexLevels[entry._level];
+
+    for(unsigned c=0; c<entry._cells.size(); ++c)
+    {
+        IndexCells::iterator cell = cells.find( entry._cells[c] );
+        if ( cell != cells.end() )
+        {
+            std::vector<IndexedCallback*>& list = cell->second;
+            list.erase( std::remove(list.begin(), list.end(), &entry), list.end() );
+            if ( list.empty() )
+                cells.erase( cell );
+        }
+    }
+    entry._cells.clear();
+}
+
+Terrain::CallbackStats
+Terrain::getCallbackStats() const
+{
+    Threading::ScopedMutexLock lock( _callbackStatsMutex );
+    return _callbackStats;
+}
+
+void
+Terrain::resetCallbackStats()
+{
+    Threading::ScopedMutexLock lock( _callbackStatsMutex );
+    _callbackStats = CallbackStats();
 }
 
 void
@@ -318,18 +566,129 @@ Terrain::notifyTileAdded( const TileKey& key, osg::Node* node )
 void
 Terrain::fireTileAdded( const TileKey& key, osg::Node* node )
 {
-    Threading::ScopedReadLock sharedLock( _callbacksMutex );
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    double lookupTime = 0.0;
+    unsigned fired = 0, skipped = 0;
 
-    for( CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); )
-    {       
+    // extent-registered callbacks that intersect the tile, in registration order.
+    typedef std::pair<unsigned, osg::ref_ptr<TerrainCallback> > Hit;
+    std::vector<Hit> hits;
+    {
+        Threading::ScopedReadLock sharedLock( _callbacksMutex );
+
+        for( CallbackList::iterator i = _callbacks.begin(); i != _callbacks.end(); )
+        {       
+            TerrainCallbackContext context( this );
+            i->get()->onTileAdded( key, node, context );
+            ++fired;
+
+            // if the callback set the "remove" flag, discard the callback.
+            if ( context.markedForRemoval() )
+                i = _callbacks.erase( i );
+            else
+                ++i;
+        }
+
+        if ( !_indexed.empty() )
+        {
+            osg::Timer_t lookupStart = osg::Timer::instance()->tick();
+
+            GeoExtent tileExtent = key.getExtent();
+            if ( !tileExtent.getSRS()->isHorizEquivalentTo(getSRS()) )
+                tileExtent = tileExtent.transform( getSRS() );
+
+            Bounds tb = tileExtent.bounds();
+
+            // collect the callbacks whose areas of interest touch the tile.
+            for(unsigned level=0; level<_indexLevels.size() && tileExtent.isValid(); ++level)
+            {
+                IndexCells& cells = _indexLevels[level];
+                if ( cells.empty() )
+                    continue;
+
+                int x0, y0, x1, y1;
+                getIndexCells( tb, level, x0, y0, x1, y1 );
+
+                // visit whichever is smaller: the covered cells or the occupied ones.
+                std::vector<IndexedCallback*> candidates;
+                double numCovered = (double)(x1-x0+1) * (double)(y1-y0+1);
+                if ( numCovered <= (double)cells.size() )
+                {
+                    for(int x=x0; x<=x1; ++x)
+                    {
+                        for(int y=y0; y<=y1; ++y)
+                        {
+                            IndexCells::const_iterator cell = cells.find( cellKey(x, y) );
+                            if ( cell != cells.end() )
+                                candidates.insert( candidates.end(), cell->second.begin(), cell->second.end() );
+                        }
+                    }
+                }
+                else
+                {
+                    for(IndexCells::const_iterator cell = cells.begin(); cell != cells.end(); ++cell)
+                    {
+                        int x = (int)(cell->first >> 32), y = (int)(cell->first & 0xffffffffu);
+                        if ( x >= x0 && x <= x1 && y >= y0 && y <= y1 )
+                            candidates.insert( candidates.end(), cell->second.begin(), cell->second.end() );
+                    }
+                }
+
+                // a callback spanning several cells shows up once per cell; since each
+                // one lives in a single level, de-duplicating per level is enough.
+                // (Keep this local: several threads may dispatch under the read lock.)
+                std::sort( candidates.begin(), candidates.end() );
+                candidates.erase( std::unique(candidates.begin(), candidates.end()), candidates.end() );
+
+                for(unsigned c=0; c<candidates.size(); ++c)
+                {
+                    IndexedCallback* entry = candidates[c];
+
+                    for(unsigned b=0; b<entry->_bounds.size(); ++b)
+                    {
+                        const Bounds& eb = entry->_bounds[b];
+                        if ( eb.xMin() <= tb.xMax() && eb.xMax() >= tb.xMin() &&
+                             eb.yMin() <= tb.yMax() && eb.yMax() >= tb.yMin() )
+                        {
+                            hits.push_back( Hit(entry->_order, entry->_callback.get()) );
+                            break;
+                        }
+                    }
+                }
+            }
+
+            std::sort( hits.begin(), hits.end(), SortByOrder() );
+
+            lookupTime = osg::Timer::instance()->delta_s( lookupStart, osg::Timer::instance()->tick() );
+            skipped = _indexed.size() - hits.size();
+        }
+    }
+
+    // fire these without the lock, so a callback can move its own registration.
+    for(unsigned h=0; h<hits.size(); ++h)
+    {
         TerrainCallbackContext context( this );
-        i->get()->onTileAdded( key, node, context );
+        hits[h].second->onTileAdded( key, node, context );
+        ++fired;
 
-        // if the callback set the "remove" flag, discard the callback.
         if ( context.markedForRemoval() )
-            i = _callbacks.erase( i );
-        else
-            ++i;
+            removeTerrainCallback( hits[h].second.get() );
+    }
+
+    Threading::ScopedMutexLock lock( _callbackStatsMutex );
+    _callbackStats.tiles++;
+    _callbackStats.fired        += fired;
+    _callbackStats.skipped      += skipped;
+    _callbackStats.lookupTime   += lookupTime;
+    _callbackStats.dispatchTime += osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    if ( _callbackStats.tiles % CALLBACK_STATS_INTERVAL == 0 )
+    {
+        OE_DEBUG << LC << "Callback dispatch: " << _callbackStats.tiles << " tiles, "
+            << _callbackStats.fired << " fired, " << _callbackStats.skipped << " skipped by index, "
+            << (_callbackStats.lookupTime*1000.0) << " ms lookup, "
+            << (_callbackStats.dispatchTime*1.0e6/(double)_callbackStats.tiles) << " us/tile"
+            << std::endl;
     }
 }
 
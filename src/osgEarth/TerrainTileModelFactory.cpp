@@ -265,6 +265,32 @@ TerrainTileModelFactory::addNormalMap(TerrainTileModel*            model,
     const osgEarth::ElevationInterpolation& interp =
         frame.getMapOptions().elevationInterpolation().get();
 
+    // Borrow any neighboring heightfields that are already resident in the
+    // quick cache so the edge normals match up. Never fetch them; that would
+    // cost more than the seams it fixes.
+    if ( model->heightFields().getNeighbor(0, 0) )
+    {
+        for(int x=-1; x<=1; ++x)
+        {
+            for(int y=-1; y<=1; ++y)
+            {
+                if ( (x == 0) == (y == 0) ) // 4-connected only
+                    continue;
+
+                HFCacheKey cachekey;
+                cachekey._key          = key.createNeighborKey(x, y);
+                cachekey._revision     = frame.getRevision();
+                cachekey._samplePolicy = SAMPLE_FIRST_VALID;
+
+                HFCache::Record rec;
+                if ( _heightFieldCache.get(cachekey, rec) )
+                {
+                    model->heightFields().setNeighbor(x, y, rec.value().get());
+                }
+            }
+        }
+    }
+
     // Can only generate the normal map if the center heightfield was built:
     osg::Image* image = HeightFieldUtils::convertToNormalMap(
         model->heightFields(),
@@ -19,9 +19,31 @@
 * You should have received a copy of the GNU Lesser General Public License
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
+
+/* The z-order ear clipper (METHOD_ZORDER_EAR_CLIPPING) is adapted from
+ * earcut, https://github.com/mapbox/earcut, under the following license:
+ *
+ * ISC License
+ *
+ * Copyright (c) 2016, Mapbox
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS.
+ * IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ * ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
 #include <limits.h>
+#include <float.h>
 
 #include <osgEarth/Tessellator>
+#include <deque>
+#include <algorithm>
 
 using namespace osgEarth;
 
@@ -124,6 +146,660 @@ typedef std::vector<TriIndices> TriList;
 
 }
 
+
+/***************************************************/
+
+namespace
+{
+    // Z-order accelerated ear clipping, ported from mapbox/earcut (ISC license,
+    // see the notice at the top of this file). Polygon rings are kept as circular
+    // doubly-linked lists; a second linked list sorted by z-order (Morton
+    // code) lets the ear test visit only the vertices near a candidate ear
+    // instead of the entire ring. Holes are bridged into the outer ring
+    // from their leftmost vertex, and rings that cannot be clipped cleanly
+    // are cured of self-intersections or split along a diagonal.
+
+    struct Node
+    {
+        Node(unsigned index, double px, double py) :
+            i(index), x(px), y(py), prev(0L), next(0L), z(0), prevZ(0L), nextZ(0L), steiner(false) { }
+
+        unsigned i;       // index into the vertex array
+        double   x, y;
+        Node*    prev;
+        Node*    next;
+        unsigned z;       // z-order curve value
+        Node*    prevZ;
+        Node*    nextZ;
+        bool     steiner;
+    };
+
+    inline double area(const Node* p, const Node* q, const Node* r)
+    {
+        return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+    }
+
+    inline bool equals(const Node* p1, const Node* p2)
+    {
+        return p1->x == p2->x && p1->y == p2->y;
+    }
+
+    inline int sign(double v)
+    {
+        return v > 0.0 ? 1 : v < 0.0 ? -1 : 0;
+    }
+
+    inline bool onSegment(const Node* p, const Node* q, const Node* r)
+    {
+        return
+            q->x <= osg::maximum(p->x, r->x) && q->x >= osg::minimum(p->x, r->x) &&
+            q->y <= osg::maximum(p->y, r->y) && q->y >= osg::minimum(p->y, r->y);
+    }
+
+    bool intersects(const Node* p1, const Node* q1, const Node* p2, const Node* q2)
+    {
+        int o1 = sign(area(p1, q1, p2));
+        int o2 = sign(area(p1, q1, q2));
+        int o3 = sign(area(p2, q2, p1));
+        int o4 = sign(area(p2, q2, q1));
+
+        if (o1 != o2 && o3 != o4) return true;
+        if (o1 == 0 && onSegment(p1, p2, q1)) return true;
+        if (o2 == 0 && onSegment(p1, q2, q1)) return true;
+        if (o3 == 0 && onSegment(p2, p1, q2)) return true;
+        if (o4 == 0 && onSegment(p2, q1, q2)) return true;
+        return false;
+    }
+
+    inline bool pointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
+    {
+        return
+            (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+            (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+            (bx - px) * (cy - py) >= (cx - px) * (by - py);
+    }
+
+    bool intersectsPolygon(const Node* a, const Node* b)
+    {
+        const Node* p = a;
+        do {
+            if (p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i &&
+                intersects(p, p->next, a, b))
+                return true;
+            p = p->next;
+        } while (p != a);
+        return false;
+    }
+
+    bool locallyInside(const Node* a, const Node* b)
+    {
+        return area(a->prev, a, a->next) < 0.0 ?
+            area(a, b, a->next) >= 0.0 && area(a, a->prev, b) >= 0.0 :
+            area(a, b, a->prev) < 0.0 || area(a, a->next, b) < 0.0;
+    }
+
+    bool middleInside(const Node* a, const Node* b)
+    {
+        const Node* p = a;
+        bool inside = false;
+        double px = 0.5*(a->x + b->x);
+        double py = 0.5*(a->y + b->y);
+        do {
+            if (((p->y > py) != (p->next->y > py)) && p->next->y != p->y &&
+                (px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x))
+                inside = !inside;
+            p = p->next;
+        } while (p != a);
+        return inside;
+    }
+
+    bool isValidDiagonal(const Node* a, const Node* b)
+    {
+        return
+            a->next->i != b->i && a->prev->i != b->i && !intersectsPolygon(a, b) &&
+            ((locallyInside(a, b) && locallyInside(b, a) && middleInside(a, b) &&
+              (area(a->prev, a, b->prev) != 0.0 || area(a, b->prev, b) != 0.0)) ||
+             (equals(a, b) && area(a->prev, a, a->next) > 0.0 && area(b->prev, b, b->next) > 0.0));
+    }
+
+    class EarClipper
+    {
+    public:
+        EarClipper(const osg::Vec3Array& verts, std::vector<unsigned>& out) :
+            _verts(verts), _out(out), _minX(0.0), _minY(0.0), _invSize(0.0) { }
+
+        bool run(unsigned first, unsigned last, const std::vector<unsigned>& holeStarts)
+        {
+            unsigned outerEnd = holeStarts.empty() ? last : holeStarts.front();
+            Node* outer = linkedList(first, outerEnd, true);
+            if ( !outer || outer->next == outer->prev )
+                return false;
+
+            if ( !holeStarts.empty() )
+                outer = eliminateHoles(holeStarts, last, outer);
+
+            // only bother with the z-order hash for non-trivial polygons.
+            if ( last - first > 80u )
+            {
+                double maxX = _minX = _verts[first].x();
+                double maxY = _minY = _verts[first].y();
+                for(unsigned i=first+1; i<outerEnd; ++i)
+                {
+                    const osg::Vec3& v = _verts[i];
+                    if (v.x() < _minX) _minX = v.x();
+                    if (v.y() < _minY) _minY = v.y();
+                    if (v.x() > maxX)  maxX  = v.x();
+                    if (v.y() > maxY)  maxY  = v.y();
+                }
+                double size = osg::maximum(maxX - _minX, maxY - _minY);
+                _invSize = size != 0.0 ? 32767.0/size : 0.0;
+            }
+
+            size_t start = _out.size();
+            earcutLinked(outer, 0);
+            return _out.size() > start;
+        }
+
+    private:
+        const osg::Vec3Array&  _verts;
+        std::vector<unsigned>& _out;
+        std::deque<Node>       _nodes;  // stable addresses
+        double                 _minX, _minY, _invSize;
+
+        Node* insertNode(unsigned i, Node* last)
+        {
+            _nodes.push_back( Node(i, _verts[i].x(), _verts[i].y()) );
+            Node* p = &_nodes.back();
+            if ( !last ) {
+                p->prev = p;
+                p->next = p;
+            }
+            else {
+                p->next = last->next;
+                p->prev = last;
+                last->next->prev = p;
+                last->next = p;
+            }
+            return p;
+        }
+
+        static void removeNode(Node* p)
+        {
+            p->next->prev = p->prev;
+            p->prev->next = p->next;
+            if (p->prevZ) p->prevZ->nextZ = p->nextZ;
+            if (p->nextZ) p->nextZ->prevZ = p->prevZ;
+        }
+
+        double signedArea(unsigned start, unsigned end) const
+        {
+            double sum = 0.0;
+            for(unsigned i=start, j=end-1; i<end; j=i++)
+            {
+                sum += ((double)_verts[j].x() - (double)_verts[i].x()) * ((double)_verts[i].y() + (double)_verts[j].y());
+            }
+            return sum;
+        }
+
+        // builds a circular linked list from a ring, in the specified winding.
+        Node* linkedList(unsigned start, unsigned end, bool clockwise)
+        {
+            if ( end <= start )
+                return 0L;
+
+            Node* last = 0L;
+            if ( clockwise == (signedArea(start, end) > 0.0) )
+            {
+                for(unsigned i=start; i<end; ++i)
+                    last = insertNode(i, last);
+            }
+            else
+            {
+                for(unsigned i=end; i-- > start; )
+                    last = insertNode(i, last);
+            }
+
+            if ( last && equals(last, last->next) )
+            {
+                removeNode(last);
+                last = last->next;
+            }
+            return last;
+        }
+
+        // removes duplicate and collinear points.
+        Node* filterPoints(Node* start, Node* end =0L)
+        {
+            if ( !start ) return start;
+            if ( !end ) end = start;
+
+            Node* p = start;
+            bool again;
+            do {
+                again = false;
+                if (!p->steiner && (equals(p, p->next) || area(p->prev, p, p->next) == 0.0))
+                {
+                    removeNode(p);
+                    p = end = p->prev;
+                    if (p == p->next) break;
+                    again = true;
+                }
+                else
+                {
+                    p = p->next;
+                }
+            } while (again || p != end);
+
+            return end;
+        }
+
+        void emit(const Node* a, const Node* b, const Node* c)
+        {
+            _out.push_back(a->i);
+            _out.push_back(b->i);
+            _out.push_back(c->i);
+        }
+
+        void earcutLinked(Node* ear, int pass)
+        {
+            if ( !ear ) return;
+
+            if ( pass == 0 && _invSize != 0.0 )
+                indexCurve(ear);
+
+            Node* stop = ear;
+            while (ear->prev != ear->next)
+            {
+                Node* prev = ear->prev;
+                Node* next = ear->next;
+
+                if (_invSize != 0.0 ? isEarHashed(ear) : isEar(ear))
+                {
+                    emit(prev, ear, next);
+                    removeNode(ear);
+                    ear = next->next;
+                    stop = next->next;
+                    continue;
+                }
+
+                ear = next;
+
+                // went all the way around without finding an ear:
+                if (ear == stop)
+                {
+                    if (pass == 0)
+                    {
+                        earcutLinked(filterPoints(ear), 1);
+                    }
+                    else if (pass == 1)
+                    {
+                        ear = cureLocalIntersections(filterPoints(ear));
+                        earcutLinked(ear, 2);
+                    }
+                    else if (pass == 2)
+                    {
+                        splitEarcut(ear);
+                    }
+                    break;
+                }
+            }
+        }
+
+        bool isEar(const Node* ear) const
+        {
+            const Node* a = ear->prev;
+            const Node* b = ear;
+            const Node* c = ear->next;
+
+            if (area(a, b, c) >= 0.0) return false; // reflex
+
+            const Node* p = ear->next->next;
+            while (p != ear->prev)
+            {
+                if (pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+                    area(p->prev, p, p->next) >= 0.0)
+                    return false;
+                p = p->next;
+            }
+            return true;
+        }
+
+        bool isEarHashed(const Node* ear) const
+        {
+            const Node* a = ear->prev;
+            const Node* b = ear;
+            const Node* c = ear->next;
+
+            if (area(a, b, c) >= 0.0) return false; // reflex
+
+            // triangle bbox, and the z-order range it covers:
+            double minTX = osg::minimum(a->x, osg::minimum(b->x, c->x));
+            double minTY = osg::minimum(a->y, osg::minimum(b->y, c->y));
+            double maxTX = osg::maximum(a->x, osg::maximum(b->x, c->x));
+            double maxTY = osg::maximum(a->y, osg::maximum(b->y, c->y));
+
+            unsigned minZ = zOrder(minTX, minTY);
+            unsigned maxZ = zOrder(maxTX, maxTY);
+
+            const Node* p = ear->prevZ;
+            const Node* n = ear->nextZ;
+
+            // look for points inside the triangle in both directions:
+            while (p && p->z >= minZ && n && n->z <= maxZ)
+            {
+                if (p != ear->prev && p != ear->next &&
+                    pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+                    area(p->prev, p, p->next) >= 0.0) return false;
+                p = p->prevZ;
+
+                if (n != ear->prev && n != ear->next &&
+                    pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, n->x, n->y) &&
+                    area(n->prev, n, n->next) >= 0.0) return false;
+                n = n->nextZ;
+            }
+
+            while (p && p->z >= minZ)
+            {
+                if (p != ear->prev && p != ear->next &&
+                    pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+                    area(p->prev, p, p->next) >= 0.0) return false;
+                p = p->prevZ;
+            }
+
+            while (n && n->z <= maxZ)
+            {
+                if (n != ear->prev && n != ear->next &&
+                    pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, n->x, n->y) &&
+                    area(n->prev, n, n->next) >= 0.0) return false;
+                n = n->nextZ;
+            }
+
+            return true;
+        }
+
+        // clips small self-intersecting loops.
+        Node* cureLocalIntersections(Node* start)
+        {
+            Node* p = start;
+            do {
+                Node* a = p->prev;
+                Node* b = p->next->next;
+
+                if (!equals(a, b) && intersects(a, p, p->next, b) && locallyInside(a, b) && locallyInside(b, a))
+                {
+                    emit(a, p, b);
+                    removeNode(p);
+                    removeNode(p->next);
+                    p = start = b;
+                }
+                p = p->next;
+            } while (p != start);
+
+            return filterPoints(p);
+        }
+
+        // splits the polygon along a valid diagonal and clips each half.
+        void splitEarcut(Node* start)
+        {
+            Node* a = start;
+            do {
+                Node* b = a->next->next;
+                while (b != a->prev)
+                {
+                    if (a->i != b->i && isValidDiagonal(a, b))
+                    {
+                        Node* c = splitPolygon(a, b);
+                        a = filterPoints(a, a->next);
+                        c = filterPoints(c, c->next);
+                        earcutLinked(a, 0);
+                        earcutLinked(c, 0);
+                        return;
+                    }
+                    b = b->next;
+                }
+                a = a->next;
+            } while (a != start);
+        }
+
+        // links two vertices with a bridge; returns the new copy of "b".
+        Node* splitPolygon(Node* a, Node* b)
+        {
+            _nodes.push_back( Node(a->i, a->x, a->y) );
+            Node* a2 = &_nodes.back();
+            _nodes.push_back( Node(b->i, b->x, b->y) );
+            Node* b2 = &_nodes.back();
+
+            Node* an = a->next;
+            Node* bp = b->prev;
+
+            a->next = b;
+            b->prev = a;
+
+            a2->next = an;
+            an->prev = a2;
+
+            b2->next = a2;
+            a2->prev = b2;
+
+            bp->next = b2;
+            b2->prev = bp;
+
+            return b2;
+        }
+
+        static bool compareX(const Node* a, const Node* b)
+        {
+            return a->x < b->x;
+        }
+
+        Node* eliminateHoles(const std::vector<unsigned>& holeStarts, unsigned last, Node* outer)
+        {
+            std::vector<Node*> queue;
+            queue.reserve( holeStarts.size() );
+
+            for(unsigned h=0; h<holeStarts.size(); ++h)
+            {
+                unsigned start = holeStarts[h];
+                unsigned end = h+1 < holeStarts.size() ? holeStarts[h+1] : last;
+                Node* list = linkedList(start, end, false);
+                if ( list )
+                {
+                    if (list == list->next) list->steiner = true;
+                    queue.push_back( getLeftmost(list) );
+                }
+            }
+
+            // bridge holes from left to right:
+            std::sort(queue.begin(), queue.end(), compareX);
+
+            for(unsigned i=0; i<queue.size(); ++i)
+            {
+                outer = eliminateHole(queue[i], outer);
+            }
+
+            return outer;
+        }
+
+        Node* eliminateHole(Node* hole, Node* outer)
+        {
+            Node* bridge = findHoleBridge(hole, outer);
+            if ( !bridge )
+                return outer;
+
+            Node* bridgeReverse = splitPolygon(bridge, hole);
+            filterPoints(bridgeReverse, bridgeReverse->next);
+            return filterPoints(bridge, bridge->next);
+        }
+
+        // David Eberly's algorithm for finding a bridge between a hole and the outer ring.
+        Node* findHoleBridge(Node* hole, Node* outer)
+        {
+            Node* p = outer;
+            double hx = hole->x;
+            double hy = hole->y;
+            double qx = -DBL_MAX;
+            Node* m = 0L;
+
+            // find a segment intersected by a ray from the hole's leftmost
+            // point to the left; the segment's endpoint with the lesser x
+            // is a potential connection point.
+            do {
+                if (hy <= p->y && hy >= p->next->y && p->next->y != p->y)
+                {
+                    double x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+                    if (x <= hx && x > qx)
+                    {
+                        qx = x;
+                        m = p->x < p->next->x ? p : p->next;
+                        if (x == hx) return m; // hole touches the outer segment
+                    }
+                }
+                p = p->next;
+            } while (p != outer);
+
+            if ( !m ) return 0L;
+
+            // look for points inside the triangle (hole point, intersection
+            // point, endpoint); if any, use the one with the smallest angle
+            // to the ray as the connection point.
+            const Node* stop = m;
+            double mx = m->x;
+            double my = m->y;
+            double tanMin = DBL_MAX;
+
+            p = m;
+            do {
+                if (hx >= p->x && p->x >= mx && hx != p->x &&
+                    pointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y))
+                {
+                    double tan = fabs(hy - p->y) / (hx - p->x);
+                    if (locallyInside(p, hole) &&
+                        (tan < tanMin || (tan == tanMin && (p->x > m->x || (p->x == m->x && sectorContainsSector(m, p))))))
+                    {
+                        m = p;
+                        tanMin = tan;
+                    }
+                }
+                p = p->next;
+            } while (p != stop);
+
+            return m;
+        }
+
+        static bool sectorContainsSector(const Node* m, const Node* p)
+        {
+            return area(m->prev, m, p->prev) < 0.0 && area(p->next, m, m->next) < 0.0;
+        }
+
+        static Node* getLeftmost(Node* start)
+        {
+            Node* p = start;
+            Node* leftmost = start;
+            do {
+                if (p->x < leftmost->x || (p->x == leftmost->x && p->y < leftmost->y))
+                    leftmost = p;
+                p = p->next;
+            } while (p != start);
+            return leftmost;
+        }
+
+        // interlaces the bits of the scaled coordinates into a Morton code.
+        unsigned zOrder(double px, double py) const
+        {
+            unsigned x = (unsigned)osg::clampBetween((px - _minX) * _invSize, 0.0, 32767.0);
+            unsigned y = (unsigned)osg::clampBetween((py - _minY) * _invSize, 0.0, 32767.0);
+
+            x = (x | (x << 8)) & 0x00FF00FF;
+            x = (x | (x << 4)) & 0x0F0F0F0F;
+            x = (x | (x << 2)) & 0x33333333;
+            x = (x | (x << 1)) & 0x55555555;
+
+            y = (y | (y << 8)) & 0x00FF00FF;
+            y = (y | (y << 4)) & 0x0F0F0F0F;
+            y = (y | (y << 2)) & 0x33333333;
+            y = (y | (y << 1)) & 0x55555555;
+
+            return x | (y << 1);
+        }
+
+        // computes z-order values and links the nodes in z-order.
+        void indexCurve(Node* start)
+        {
+            Node* p = start;
+            do {
+                if (p->z == 0) p->z = zOrder(p->x, p->y);
+                p->prevZ = p->prev;
+                p->nextZ = p->next;
+                p = p->next;
+            } while (p != start);
+
+            p->prevZ->nextZ = 0L;
+            p->prevZ = 0L;
+
+            sortLinked(p);
+        }
+
+        // Simon Tatham's linked-list merge sort, on the z-order links.
+        static Node* sortLinked(Node* list)
+        {
+            unsigned inSize = 1;
+            unsigned numMerges;
+
+            do {
+                Node* p = list;
+                Node* tail = 0L;
+                list = 0L;
+                numMerges = 0;
+
+                while (p)
+                {
+                    numMerges++;
+                    Node* q = p;
+                    unsigned pSize = 0;
+                    for(unsigned i=0; i<inSize; ++i)
+                    {
+                        pSize++;
+                        q = q->nextZ;
+                        if (!q) break;
+                    }
+                    unsigned qSize = inSize;
+
+                    while (pSize > 0 || (qSize > 0 && q))
+                    {
+                        Node* e;
+                        if (pSize != 0 && (qSize == 0 || !q || p->z <= q->z))
+                        {
+                            e = p;
+                            p = p->nextZ;
+                            pSize--;
+                        }
+                        else
+                        {
+                            e = q;
+                            q = q->nextZ;
+                            qSize--;
+                        }
+
+                        if (tail) tail->nextZ = e;
+                        else list = e;
+
+                        e->prevZ = tail;
+                        tail = e;
+                    }
+
+                    p = q;
+                }
+
+                tail->nextZ = 0L;
+                inSize *= 2;
+
+            } while (numMerges > 1);
+
+            return list;
+        }
+    };
+}
+
 bool
 Tessellator::tessellateGeometry(osg::Geometry &geom)
 {
@@ -187,11 +863,10 @@ Tessellator::tessellateGeometry(osg::Geometry &geom)
                 }
             }
         }
-        else
+        else if ( _keepOtherPrimitives )
         {
-            //
-            // TODO: handle more primitive modes
-            //
+            // not a polygon; keep it as-is.
+            geom.addPrimitiveSet(primitive.get());
         }
     }
 
@@ -226,6 +901,17 @@ Tessellator::tessellatePrimitive(osg::PrimitiveSet* primitive, osg::Vec3Array* v
 osg::PrimitiveSet*
 Tessellator::tessellatePrimitive(unsigned int first, unsigned int last, osg::Vec3Array* vertices)
 {
+    if ( _method == METHOD_ZORDER_EAR_CLIPPING )
+    {
+        std::vector<unsigned> indices;
+        if ( !tessellatePolygon(*vertices, first, last, std::vector<unsigned>(), indices) )
+        {
+            OE_DEBUG << LC << "Tessellation failed!" << std::endl;
+            return 0L;
+        }
+        return new osg::DrawElementsUInt(osg::PrimitiveSet::TRIANGLES, indices.begin(), indices.end());
+    }
+
     std::vector<unsigned int> activeVerts;
     activeVerts.reserve( last-first+1 );
     for (unsigned int i=first; i < last; i++)
@@ -331,6 +1017,20 @@ Tessellator::tessellatePrimitive(unsigned int first, unsigned int last, osg::Vec
 }
 
 
+bool
+Tessellator::tessellatePolygon(const osg::Vec3Array&        vertices,
+                               unsigned                     first,
+                               unsigned                     last,
+                               const std::vector<unsigned>& holeStarts,
+                               std::vector<unsigned>&       out_indices) const
+{
+    if ( last > vertices.size() || last < first + 3 )
+        return false;
+
+    EarClipper clipper(vertices, out_indices);
+    return clipper.run(first, last, holeStarts);
+}
+
 bool
 Tessellator::isConvex(const osg::Vec3Array &vertices, const std::vector<unsigned int> &activeVerts, unsigned int cursor)
 {
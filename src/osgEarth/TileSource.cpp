@@ -379,6 +379,71 @@ TileSource::createImage(const TileKey&        key,
     return newImage.release();
 }
 
+void
+TileSource::createImages(const std::vector<TileKey>&              keys,
+                         std::vector< osg::ref_ptr<osg::Image> >& out_images,
+                         ImageOperation*                          prepOp,
+                         ProgressCallback*                        progress)
+{
+    out_images.clear();
+    out_images.resize( keys.size() );
+
+    if ( _status != STATUS_OK )
+        return;
+
+    // Satisfy what we can from the memcache, and collect the rest.
+    // Blacklisted keys are left empty, without asking the driver again.
+    std::vector<TileKey>  misses;
+    std::vector<unsigned> missIndices;
+
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        if ( _blacklist.valid() && _blacklist->contains(keys[i]) )
+            continue;
+
+        if (_memCache.valid())
+        {
+            ReadResult r = _memCache->getOrCreateDefaultBin()->readImage( keys[i].str() );
+            if ( r.succeeded() )
+            {
+                out_images[i] = r.releaseImage();
+                continue;
+            }
+        }
+        misses.push_back( keys[i] );
+        missIndices.push_back( i );
+    }
+
+    if ( misses.empty() )
+        return;
+
+    std::vector< osg::ref_ptr<osg::Image> > newImages;
+    createImages( misses, newImages, progress );
+
+    for(unsigned i=0; i<misses.size() && i<newImages.size(); ++i)
+    {
+        osg::ref_ptr<osg::Image>& newImage = newImages[i];
+
+        if ( prepOp )
+            (*prepOp)( newImage );
+
+        if ( newImage.valid() && _memCache.valid() )
+        {
+            _memCache->getOrCreateDefaultBin()->write( misses[i].str(), newImage.get() );
+        }
+
+        // Blacklist tiles that failed for a reason other than cancelation,
+        // as the layer does for single reads.
+        if ( !newImage.valid() && _blacklist.valid() &&
+             (progress == 0L || (!progress->isCanceled() && !progress->needsRetry())) )
+        {
+            _blacklist->add( misses[i] );
+        }
+
+        out_images[missIndices[i]] = newImage.get();
+    }
+}
+
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               HeightFieldOperation* prepOp, 
@@ -416,6 +481,40 @@ TileSource::createImage(const TileKey&    key,
     return 0L;
 }
 
+void
+TileSource::createImages(const std::vector<TileKey>&              keys,
+                         std::vector< osg::ref_ptr<osg::Image> >& out_images,
+                         ProgressCallback*                        progress)
+{
+    out_images.clear();
+    out_images.resize( keys.size() );
+
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        if ( progress && progress->isCanceled() )
+            break;
+
+        out_images[i] = createImage( keys[i], progress );
+    }
+}
+
+bool
+TileSource::storeImages(const std::vector<TileKey>&                    keys,
+                        const std::vector< osg::ref_ptr<osg::Image> >& images,
+                        ProgressCallback*                              progress)
+{
+    bool ok = true;
+    for(unsigned i=0; i<keys.size() && i<images.size(); ++i)
+    {
+        if ( progress && progress->isCanceled() )
+            return false;
+
+        if ( images[i].valid() && !storeImage(keys[i], images[i].get(), progress) )
+            ok = false;
+    }
+    return ok;
+}
+
 osg::HeightField*
 TileSource::createHeightField(const TileKey&        key,
                               ProgressCallback*     progress)
@@ -34,6 +34,7 @@
 #include <fstream>
 #include <sstream>
 #include <OpenThreads/Thread>
+#include <OpenThreads/Atomic>
 
 #define LC "[VirtualProgram] "
 
@@ -94,6 +95,14 @@ namespace
 
     bool s_dumpShaders = false;        // debugging
 
+    // source of VP revision numbers; see VirtualProgram::dirtyRevision.
+    OpenThreads::Atomic s_revisionGen;
+
+    // apply counters; see VirtualProgram::getApplyStats.
+    OpenThreads::Atomic s_applyHits;
+    OpenThreads::Atomic s_applyMisses;
+    OpenThreads::Atomic s_applyBuilds;
+
     /** A device that lets us do a const search on the State's attribute map. OSG does not yet
         have a const way to do this. It has getAttributeVec() but that is non-const (it creates
         the vector if it doesn't exist); Newer versions have getAttributeMap(), but that does not
@@ -671,7 +680,9 @@ _inherit           ( true ),
 _inheritSet        ( false ),
 _logShaders        ( false ),
 _logPath           ( "" ),
-_acceptCallbacksVaryPerFrame( false )
+_acceptCallbacksVaryPerFrame( false ),
+_revision          ( ++s_revisionGen ),
+_acceptCallbacksPresent( false )
 {
     // Note: we cannot set _active here. Wait until apply().
     // It will cause a conflict in the Registry.
@@ -703,7 +714,9 @@ _inherit           ( rhs._inherit ),
 _inheritSet        ( rhs._inheritSet ),
 _logShaders        ( rhs._logShaders ),
 _logPath           ( rhs._logPath ),
-_template          ( osg::clone(rhs._template.get()) )
+_template          ( osg::clone(rhs._template.get()) ),
+_revision          ( ++s_revisionGen ),
+_acceptCallbacksPresent( rhs._acceptCallbacksPresent )
 {    
     // Attribute bindings.
     const osg::Program::AttribBindingList &abl = rhs.getAttribBindingList();
@@ -779,6 +792,8 @@ VirtualProgram::addBindAttribLocation( const std::string& name, GLuint index )
     _attribBindingList[name] = index;
 #endif
 
+    dirtyRevision();
+
     _dataModelMutex.unlock();
 }
 
@@ -796,6 +811,8 @@ VirtualProgram::removeBindAttribLocation( const std::string& name )
     _attribBindingList.erase(name);
 #endif
 
+    dirtyRevision();
+
     _dataModelMutex.unlock();
 }
 
@@ -849,6 +866,16 @@ VirtualProgram::releaseGLObjects(osg::State* state) const
 
     _programCache.clear();
 
+    // forget the memoized programs too, so they are not reused after release.
+    for (unsigned i = 0; i < _apply.size(); ++i)
+    {
+        if ( state == 0L || state->getContextID() == i )
+        {
+            _apply[i].program = 0L;
+            _apply[i].stackKey.clear();
+        }
+    }
+
     _programCacheMutex.unlock();
 }
 
@@ -893,6 +920,8 @@ VirtualProgram::setShader(const std::string&                 shaderID,
         entry._overrideValue = ov;
         entry._accept        = 0L;
 
+        dirtyRevision();
+
         _dataModelMutex.unlock();
     }
 
@@ -933,6 +962,8 @@ VirtualProgram::setShader(osg::Shader*                       shader,
         entry._overrideValue = ov;
         entry._accept        = 0L;
 
+        dirtyRevision();
+
         _dataModelMutex.unlock();
     }
 
@@ -1008,6 +1039,11 @@ VirtualProgram::setFunction(const std::string&           functionName,
         entry._overrideValue = osg::StateAttribute::ON;
         entry._accept        = accept;
 
+        if ( accept )
+            _acceptCallbacksPresent = true;
+
+        dirtyRevision();
+
         _dataModelMutex.unlock();
 
     } // release lock
@@ -1025,6 +1061,7 @@ VirtualProgram::setFunctionMinRange(const std::string& name, float minRange)
     if ( findFunction(name, _functions, &function) )
     {
         function->_minRange = minRange;
+        dirtyRevision();
     }
 
     _dataModelMutex.unlock();
@@ -1042,6 +1079,7 @@ VirtualProgram::setFunctionMaxRange(const std::string& name, float maxRange)
     if ( findFunction(name, _functions, &function) )
     {
         function->_maxRange = maxRange;
+        dirtyRevision();
     }
 
     _dataModelMutex.unlock();
@@ -1055,6 +1093,8 @@ VirtualProgram::removeShader( const std::string& shaderID )
 
     _shaderMap.erase( MAKE_SHADER_ID(shaderID) );
 
+    dirtyRevision();
+
     for(FunctionLocationMap::iterator i = _functions.begin(); i != _functions.end(); ++i )
     {
         OrderedFunctionMap& ofm = i->second;
@@ -1092,6 +1132,8 @@ VirtualProgram::setInheritShaders( bool value )
         }
 
         _inheritSet = true;
+
+        dirtyRevision();
     }
 }
 
@@ -1156,10 +1198,55 @@ VirtualProgram::apply( osg::State& state ) const
     // exclude shaders based on any condition.
     bool acceptCallbacksVary = _acceptCallbacksVaryPerFrame;
 
+    // current frame number, for shader program expiry.
+    unsigned frameNumber = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0;
+
+    // Access the resuable shader map for this context. Bypasses reallocation overhead.
+    ApplyVars& local = _apply[contextID];
+
+    if ( program.valid() )
+    {
+        ++s_applyHits;
+    }
+
+    // If the VPs in the stack are the same ones, with the same contents, as
+    // the last time this VP was applied in this context, the accumulation
+    // below would select the same program; so skip it and reuse that one.
+    // Accept callbacks can reject shaders based on any state, so their
+    // presence disables this.
+    unsigned stackHash = 0u;
+    bool     memoize   = false;
+
     if ( !program.valid() )
     {
-        // Access the resuable shader map for this context. Bypasses reallocation overhead.
-        ApplyVars& local = _apply[contextID];
+        memoize =
+            !acceptCallbacksVary &&
+            computeStackKey(state, local.stackKeyScratch, stackHash);
+
+        if (memoize                               &&
+            local.program.valid()                 &&
+            local.stackHash == stackHash          &&
+            local.stackKey  == local.stackKeyScratch )
+        {
+            program = local.program.get();
+
+            // keep the program from expiring out of the cache. Once per frame is plenty.
+            if ( local.frameLastUsed != frameNumber )
+            {
+                osg::ref_ptr<osg::Program> cached;
+                _programCacheMutex.lock();
+                const_cast<VirtualProgram*>(this)->readProgramCache(local.programKey, frameNumber, cached);
+                _programCacheMutex.unlock();
+                local.frameLastUsed = frameNumber;
+            }
+
+            ++s_applyHits;
+        }
+    }
+
+    if ( !program.valid() )
+    {
+        ++s_applyMisses;
 
         local.accumShaderMap.clear();
         local.accumAttribBindings.clear();
@@ -1214,9 +1301,6 @@ VirtualProgram::apply( osg::State& state ) const
             local.programKey.push_back( i->data()._shader.get() );
         }
 
-        // current frame number, for shader program expiry.
-        unsigned frameNumber = state.getFrameStamp() ? state.getFrameStamp()->getFrameNumber() : 0;
-
         // look up the program:
         {
             _programCacheMutex.lock();
@@ -1282,6 +1366,8 @@ VirtualProgram::apply( osg::State& state ) const
                         }
                     }
 
+                    ++s_applyBuilds;
+
                     // global sharing.
                     Registry::programSharedRepo()->share( program );
 
@@ -1295,6 +1381,20 @@ VirtualProgram::apply( osg::State& state ) const
                 }
             }
         }
+
+        // memoize the selection for the next apply in this context.
+        if ( memoize && program.valid() )
+        {
+            local.stackKey.swap( local.stackKeyScratch );
+            local.stackHash     = stackHash;
+            local.program       = program.get();
+            local.frameLastUsed = frameNumber;
+        }
+        else
+        {
+            local.stackKey.clear();
+            local.program = 0L;
+        }
     }
 
     // finally, apply the program attribute.
@@ -1435,6 +1535,74 @@ VirtualProgram::checkSharing()
   return false;
 }
 
+void
+VirtualProgram::dirtyRevision()
+{
+    _revision = ++s_revisionGen;
+}
+
+bool
+VirtualProgram::computeStackKey(const osg::State&      state,
+                                std::vector<unsigned>& key,
+                                unsigned&              hash) const
+{
+    key.clear();
+
+    // Every VP that accumulateShaders() or accumulateFunctions() might visit
+    // contributes its revision. Since revisions are unique to one VP's
+    // contents, equal keys mean the same VPs in the same order, unchanged.
+    if ( _inherit )
+    {
+        const AttrStack* av = StateEx::getProgramStack(state);
+        if ( av )
+        {
+            for( unsigned i=0; i<av->size(); ++i )
+            {
+                const VirtualProgram* vp = dynamic_cast<const VirtualProgram*>( (*av)[i].first );
+                if ( vp )
+                {
+                    if ( vp->_acceptCallbacksPresent || vp->_acceptCallbacksVaryPerFrame )
+                        return false;
+
+                    key.push_back( vp->_revision );
+                }
+            }
+        }
+    }
+
+    if ( _acceptCallbacksPresent )
+        return false;
+
+    key.push_back( _revision );
+
+    // FNV-1a, to make mismatches cheap to detect.
+    hash = 2166136261u;
+    for( unsigned i=0; i<key.size(); ++i )
+    {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+
+    return true;
+}
+
+VirtualProgram::ApplyStats
+VirtualProgram::getApplyStats()
+{
+    ApplyStats stats;
+    stats.hits   = s_applyHits;
+    stats.misses = s_applyMisses;
+    stats.builds = s_applyBuilds;
+    return stats;
+}
+
+void
+VirtualProgram::resetApplyStats()
+{
+    s_applyHits.exchange( 0 );
+    s_applyMisses.exchange( 0 );
+    s_applyBuilds.exchange( 0 );
+}
+
 void
 VirtualProgram::getFunctions( FunctionLocationMap& out ) const
 {
@@ -134,19 +134,23 @@ AnnotationNode::setMapNode( MapNode* mapNode )
     if ( getMapNode() != mapNode )
     {
         // relocate the auto-clamping callback, if there is one:
+        bool relocate = false;
         osg::ref_ptr<MapNode> oldMapNode = _mapNode.get();
         if ( oldMapNode.valid() )
         {
             if ( _autoClampCallback )
             {
                 oldMapNode->getTerrain()->removeTerrainCallback( _autoClampCallback.get() );
-                if ( mapNode )
-                    mapNode->getTerrain()->addTerrainCallback( _autoClampCallback.get() );
+                _autoClampCells = GeoExtent::INVALID;
+                relocate = true;
             }
         }		
 
         _mapNode = mapNode;
 
+        if ( relocate )
+            updateAutoClampExtent();
+
 		applyStyle( this->getStyle() );
     }
 }
@@ -185,13 +189,15 @@ AnnotationNode::setCPUAutoClamping( bool value )
             if ( AnnotationSettings::getContinuousClamping() )
             {
                 _autoClampCallback = new AutoClampCallback( this );
-                getMapNode()->getTerrain()->addTerrainCallback( _autoClampCallback.get() );
+                _autoClampCells = GeoExtent::INVALID;
+                updateAutoClampExtent();
             }
         }
         else if ( _autoclamp && !value && _autoClampCallback.valid())
         {
             getMapNode()->getTerrain()->removeTerrainCallback( _autoClampCallback );
             _autoClampCallback = 0;
+            _autoClampCells = GeoExtent::INVALID;
         }
 
         _autoclamp = value;
@@ -220,6 +226,32 @@ AnnotationNode::setCPUAutoClamping( bool value )
     }
 }
 
+void
+AnnotationNode::updateAutoClampExtent()
+{
+    if ( _autoClampCallback.valid() && getMapNode() )
+    {
+        GeoExtent extent = getAutoClampExtent();
+
+        // still inside the index cells we registered for? Then the terrain
+        // already notifies us of every tile that can touch it; re-registering
+        // would only take the terrain's callback lock for nothing.
+        if ( _autoClampCells.isValid() && extent.isValid() )
+        {
+            GeoExtent local = extent.getSRS()->isHorizEquivalentTo(_autoClampCells.getSRS()) ?
+                extent : extent.transform( _autoClampCells.getSRS() );
+            if ( _autoClampCells.contains(local) )
+                return;
+        }
+
+        Terrain* terrain = getMapNode()->getTerrain();
+        _autoClampCells = terrain->getTerrainCallbackCells( extent );
+        terrain->addTerrainCallback(
+            _autoClampCallback.get(),
+            _autoClampCells.isValid() ? _autoClampCells : extent );
+    }
+}
+
 void
 AnnotationNode::setDepthAdjustment( bool enable )
 {
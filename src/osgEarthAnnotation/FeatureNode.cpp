@@ -182,6 +182,9 @@ FeatureNode::build()
         // The polytope will ensure we only clamp to intersecting tiles:
         Feature::getWorldBoundingPolytope(bounds, getMapNode()->getMapSRS(), _featurePolytope);
 
+        // the features may have moved:
+        updateAutoClampExtent();
+
     }
 
     if ( node )
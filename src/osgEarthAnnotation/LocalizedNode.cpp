@@ -117,6 +117,7 @@ LocalizedNode::setPosition( const GeoPoint& pos )
 
         // make sure the node is set up for auto-z-update if necessary:
         configureForAltitudeMode( _mapPosition.altitudeMode() );
+        updateAutoClampExtent();
 
         // update the node.
         return updateTransform( _mapPosition );
@@ -206,6 +206,7 @@ OrthoNode::setPosition( const GeoPoint& position )
 
     // make sure the node is set up for auto-z-update if necessary:
     configureForAltitudeMode( _mapPosition.altitudeMode() );
+    updateAutoClampExtent();
 
     // and update the node.
     if ( !updateTransforms(_mapPosition) )
@@ -0,0 +1,1149 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2015 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarthAnnotation/TrackBatchNode>
+#include <osgEarth/MapNode>
+#include <osgEarth/Registry>
+#include <osgEarth/Capabilities>
+#include <osgEarth/VirtualProgram>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/CullingUtils>
+#include <osgEarth/NodeUtils>
+#include <osgUtil/CullVisitor>
+#include <osgText/Glyph>
+#include <osg/Geometry>
+#include <osg/TextureBuffer>
+#include <osg/Depth>
+#include <osg/Timer>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#undef  LC
+#define LC "[TrackBatchNode] "
+
+using namespace osgEarth;
+using namespace osgEarth::Annotation;
+using namespace osgEarth::Symbology;
+
+// texture units of the icon/glyph atlas and the per-view instance buffer
+#define ATLAS_UNIT    0
+#define INSTANCE_UNIT 1
+
+// glyphs are rasterized at this resolution and scaled to each field's size
+#define GLYPH_RESOLUTION 32
+
+// printable ASCII
+#define FIRST_CHAR 32
+#define LAST_CHAR  126
+
+// icons larger than this (pixels) are scaled down when they go into the atlas
+#define MAX_ICON_SIZE 256
+
+#define ATLAS_WIDTH 1024
+
+// size of the decluttering grid cells (pixels)
+#define DECLUTTER_CELL 64
+
+// each quad instance is 4 RGBA32F texels: anchor, box, texture coords, color
+#define TEXELS_PER_QUAD 4
+
+#define VERT_FUNCTION "oe_trackbatch_vertex"
+#define FRAG_FUNCTION "oe_trackbatch_fragment"
+
+namespace
+{
+    // Places each instanced quad in window coordinates, straight into clip space.
+    const char* vertSource =
+        "#version " GLSL_VERSION_STR "\n"
+        "#extension GL_EXT_gpu_shader4 : enable\n"
+        "#extension GL_ARB_draw_instanced : enable\n"
+        "uniform samplerBuffer oe_trackbatch_instances; \n"
+        "uniform vec2 oe_trackbatch_viewport; \n"
+        "out vec2 oe_trackbatch_texcoord; \n"
+        "out vec4 oe_trackbatch_color; \n"
+        "void " VERT_FUNCTION "(inout vec4 VertexCLIP) \n"
+        "{ \n"
+        "    int i = 4 * gl_InstanceID; \n"
+        "    vec4 anchor = texelFetch(oe_trackbatch_instances, i); \n"
+        "    vec4 box    = texelFetch(oe_trackbatch_instances, i+1); \n"
+        "    vec4 uv     = texelFetch(oe_trackbatch_instances, i+2); \n"
+        "    oe_trackbatch_color = texelFetch(oe_trackbatch_instances, i+3); \n"
+        // anchor.zw is the cosine and sine of the rotation:
+        "    vec2 c = mix(box.xy, box.zw, gl_Vertex.xy); \n"
+        "    vec2 pixel = anchor.xy + vec2(c.x*anchor.z - c.y*anchor.w, c.x*anchor.w + c.y*anchor.z); \n"
+        "    VertexCLIP = vec4(2.0*pixel/oe_trackbatch_viewport - 1.0, 0.0, 1.0); \n"
+        "    oe_trackbatch_texcoord = mix(uv.xy, uv.zw, gl_Vertex.xy); \n"
+        "} \n";
+
+    const char* fragSource =
+        "#version " GLSL_VERSION_STR "\n"
+        "uniform sampler2D oe_trackbatch_atlas; \n"
+        "in vec2 oe_trackbatch_texcoord; \n"
+        "in vec4 oe_trackbatch_color; \n"
+        "void " FRAG_FUNCTION "(inout vec4 color) \n"
+        "{ \n"
+        "    color = oe_trackbatch_color * texture2D(oe_trackbatch_atlas, oe_trackbatch_texcoord); \n"
+        "} \n";
+
+    enum
+    {
+        LIVE    = 1,
+        VISIBLE = 2
+    };
+
+    // higher priority first, then nearer first.
+    struct SortByPriority
+    {
+        bool operator()(const TrackBatchNode::Candidate& lhs, const TrackBatchNode::Candidate& rhs) const
+        {
+            if ( lhs.priority > rhs.priority ) return true;
+            if ( lhs.priority < rhs.priority ) return false;
+            return lhs.depth < rhs.depth;
+        }
+    };
+
+    // one image to pack into the atlas.
+    struct AtlasItem
+    {
+        const osg::Image* image;
+        osg::Vec4f*       uv;
+        bool              isGlyph;
+    };
+
+    struct SortByHeight
+    {
+        bool operator()(const AtlasItem& lhs, const AtlasItem& rhs) const
+        {
+            return lhs.image->t() > rhs.image->t();
+        }
+    };
+
+    inline bool overlaps(const osg::Vec4f& a, const osg::Vec4f& b)
+    {
+        return a.x() < b.z() && b.x() < a.z() && a.y() < b.w() && b.y() < a.w();
+    }
+
+    inline void pushQuad(std::vector<osg::Vec4f>& out, const osg::Vec4f& anchor, const osg::Vec4f& box, const osg::Vec4f& uv, const osg::Vec4f& color)
+    {
+        out.push_back( anchor );
+        out.push_back( box );
+        out.push_back( uv );
+        out.push_back( color );
+    }
+
+    unsigned nextPowerOfTwo(unsigned n)
+    {
+        unsigned p = 1u;
+        while( p < n ) p <<= 1;
+        return p;
+    }
+}
+
+//------------------------------------------------------------------------
+
+/** Render objects for one camera. */
+struct TrackBatchNode::ViewData : public osg::Referenced
+{
+    ViewData() : _capacity(0u) { }
+
+    CullData                         _data;
+    osg::ref_ptr<osg::Geometry>      _geometry;
+    osg::ref_ptr<osg::DrawArrays>    _primset;
+    osg::ref_ptr<osg::Image>         _image;
+    osg::ref_ptr<osg::StateSet>      _stateSet;
+    osg::ref_ptr<osg::Uniform>       _viewport;
+    unsigned                         _capacity; // quads
+};
+
+//------------------------------------------------------------------------
+
+void
+TrackBatchNode::Tracks::resize(unsigned size, unsigned numFields)
+{
+    world.resize    ( size );
+    north.resize    ( size, osg::Vec3f(0,0,1) );
+    heading.resize  ( size, osg::Vec2f(0,1) );
+    priority.resize ( size, 0.0f );
+    icon.resize     ( size, 0 );
+    flags.resize    ( size, 0 );
+    text.resize     ( size*numFields );
+    textWidth.resize( size*numFields, 0.0f );
+    extent.resize   ( size );
+}
+
+void
+TrackBatchNode::Tracks::copy(const Tracks& rhs, unsigned i, unsigned numFields)
+{
+    world[i]    = rhs.world[i];
+    north[i]    = rhs.north[i];
+    heading[i]  = rhs.heading[i];
+    priority[i] = rhs.priority[i];
+    icon[i]     = rhs.icon[i];
+    flags[i]    = rhs.flags[i];
+    for(unsigned f=i*numFields; f<(i+1)*numFields; ++f)
+    {
+        text[f]      = rhs.text[f];
+        textWidth[f] = rhs.textWidth[f];
+    }
+}
+
+//------------------------------------------------------------------------
+
+TrackBatchNode::TrackBatchNode(MapNode*                    mapNode,
+                               const TrackNodeFieldSchema& fieldSchema) :
+_mapNode   ( mapNode ),
+_geocentric( false ),
+_supported ( false ),
+_declutter ( true ),
+_atlasDirty( true ),
+_numTracks ( 0u ),
+_maxQuads  ( 0 )
+{
+    if ( mapNode )
+    {
+        _mapSRS     = mapNode->getMapSRS();
+        _geoSRS     = _mapSRS->getGeographicSRS();
+        _geocentric = mapNode->isGeocentric();
+        if ( _geocentric )
+            _horizon.setEllipsoid( *_mapSRS->getEllipsoid() );
+    }
+    else
+    {
+        OE_WARN << LC << "Illegal: a TrackBatchNode requires a MapNode" << std::endl;
+    }
+
+    const Capabilities& caps = Registry::capabilities();
+    _supported =
+        caps.supportsGLSL() &&
+        caps.supportsDrawInstanced() &&
+        caps.supportsTextureBuffer();
+
+    if ( !_supported )
+    {
+        OE_WARN << LC << "Instanced drawing and texture buffers are required; tracks will not render" << std::endl;
+    }
+
+    _maxQuads = caps.supportsTextureBuffer() ? caps.getMaxTextureBufferSize() / TEXELS_PER_QUAD : 0;
+
+    setupFields( fieldSchema );
+    setupState();
+
+    // we publish the changes in the update traversal.
+    ADJUST_UPDATE_TRAV_COUNT( this, 1 );
+
+    // the bound only spans the track anchors, so small-feature and frustum
+    // culling would drop a lone track (or a tight cluster) and its labels.
+    // cull() already culls each track against the view and the horizon.
+    setCullingActive( false );
+}
+
+TrackBatchNode::~TrackBatchNode()
+{
+    //nop
+}
+
+void
+TrackBatchNode::setupFields(const TrackNodeFieldSchema& schema)
+{
+    osgText::FontResolution res( GLYPH_RESOLUTION, GLYPH_RESOLUTION );
+
+    for( TrackNodeFieldSchema::const_iterator i = schema.begin(); i != schema.end(); ++i )
+    {
+        const TextSymbol* symbol = i->second._symbol.get();
+
+        osg::ref_ptr<osgText::Font> font;
+        if ( symbol && symbol->font().isSet() )
+            font = osgText::readFontFile( *symbol->font() );
+        if ( !font.valid() )
+            font = Registry::instance()->getDefaultFont();
+        if ( !font.valid() )
+            font = osgText::Font::getDefaultFont();
+
+        // share the glyph set between fields that use the same font.
+        unsigned fontIndex = 0u;
+        for( ; fontIndex < _fonts.size() && _fonts[fontIndex].font.get() != font.get(); ++fontIndex );
+
+        if ( fontIndex == _fonts.size() )
+        {
+            _fonts.push_back( Font() );
+            Font& f = _fonts.back();
+            f.font    = font.get();
+            f.ascent  = 0.0f;
+            f.descent = 0.0f;
+            f.glyphs.resize( LAST_CHAR-FIRST_CHAR+1 );
+            f.images.resize( LAST_CHAR-FIRST_CHAR+1 );
+
+            for(unsigned c=FIRST_CHAR; c<=LAST_CHAR; ++c)
+            {
+                Glyph& g = f.glyphs[c-FIRST_CHAR];
+                g.box.set( 0, 0, 0, 0 );
+                g.uv.set( 0, 0, 0, 0 );
+                g.advance = 0.0f;
+
+                osgText::Glyph* glyph = font.valid() ? font->getGlyph( res, c ) : 0L;
+                if ( glyph )
+                {
+                    osg::Vec2 bearing = glyph->getHorizontalBearing();
+                    g.box.set( bearing.x(), bearing.y(), bearing.x() + glyph->s(), bearing.y() + glyph->t() );
+                    g.advance = glyph->getHorizontalAdvance();
+
+                    if ( glyph->s() > 0 && glyph->t() > 0 && glyph->data() && ImageUtils::PixelReader::supports(glyph) )
+                        f.images[c-FIRST_CHAR] = glyph;
+
+                    f.ascent  = osg::maximum( f.ascent,  g.box.w() );
+                    f.descent = osg::maximum( f.descent, -g.box.y() );
+                }
+            }
+        }
+
+        Field field;
+        field.font      = fontIndex;
+        field.scale     = (symbol && symbol->size().isSet() ? (float)symbol->size()->eval() : 16.0f) / (float)GLYPH_RESOLUTION;
+        field.color     = symbol && symbol->fill().isSet() ? symbol->fill()->color() : Color::White;
+        field.offset    = symbol && symbol->pixelOffset().isSet() ? osg::Vec2f(symbol->pixelOffset()->x(), symbol->pixelOffset()->y()) : osg::Vec2f(0,0);
+        field.alignment = symbol && symbol->alignment().isSet() ? *symbol->alignment() : TextSymbol::ALIGN_BASE_LINE;
+
+        _fieldNames.push_back( i->first );
+        _fields.push_back( field );
+    }
+}
+
+void
+TrackBatchNode::setupState()
+{
+    // a unit quad; the shader scales, rotates and places each instance.
+    osg::Vec3Array* quad = new osg::Vec3Array();
+    quad->push_back( osg::Vec3(0,0,0) );
+    quad->push_back( osg::Vec3(1,0,0) );
+    quad->push_back( osg::Vec3(0,1,0) );
+    quad->push_back( osg::Vec3(1,1,0) );
+    _quad = quad;
+
+    _atlas = new osg::Texture2D();
+    _atlas->setFilter( osg::Texture::MIN_FILTER, osg::Texture::LINEAR );
+    _atlas->setFilter( osg::Texture::MAG_FILTER, osg::Texture::LINEAR );
+    _atlas->setWrap( osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE );
+    _atlas->setWrap( osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE );
+    _atlas->setResizeNonPowerOfTwoHint( false );
+    _atlas->setDataVariance( osg::Object::DYNAMIC );
+
+    osg::StateSet* stateSet = getOrCreateStateSet();
+    stateSet->setDataVariance( osg::Object::DYNAMIC );
+    stateSet->setTextureAttribute( ATLAS_UNIT, _atlas.get() );
+    stateSet->addUniform( new osg::Uniform("oe_trackbatch_atlas", ATLAS_UNIT) );
+    stateSet->addUniform( new osg::Uniform("oe_trackbatch_instances", INSTANCE_UNIT) );
+
+    // like the other annotations: blended, always passing the depth test,
+    // drawn after the terrain.
+    stateSet->setMode( GL_BLEND, osg::StateAttribute::ON );
+    stateSet->setMode( GL_CULL_FACE, osg::StateAttribute::OFF );
+    stateSet->setMode( GL_LIGHTING, osg::StateAttribute::OFF | osg::StateAttribute::PROTECTED );
+    stateSet->setAttributeAndModes( new osg::Depth(osg::Depth::ALWAYS, 0, 1, false), 1 );
+    stateSet->setRenderBinDetails( 1, "DepthSortedBin" );
+
+    if ( _supported )
+    {
+        VirtualProgram* vp = VirtualProgram::getOrCreate( stateSet );
+        vp->setName( "TrackBatchNode" );
+        vp->setFunction( VERT_FUNCTION, vertSource, ShaderComp::LOCATION_VERTEX_CLIP, 1.0f );
+        vp->setFunction( FRAG_FUNCTION, fragSource, ShaderComp::LOCATION_FRAGMENT_COLORING, 0.0f );
+    }
+}
+
+unsigned
+TrackBatchNode::addIcon(osg::Image* image)
+{
+    Icon icon;
+
+    if ( image && ImageUtils::PixelReader::supports(image) )
+    {
+        unsigned s = image->s(), t = image->t();
+        if ( s > MAX_ICON_SIZE || t > MAX_ICON_SIZE )
+        {
+            float scale = (float)MAX_ICON_SIZE / (float)osg::maximum(s, t);
+            osg::ref_ptr<osg::Image> resized;
+            if ( ImageUtils::resizeImage(image, osg::maximum(1u, (unsigned)(s*scale)), osg::maximum(1u, (unsigned)(t*scale)), resized) )
+                image = resized.release();
+        }
+        icon.image = image;
+        icon.size.set( image->s(), image->t() );
+    }
+    else if ( image )
+    {
+        OE_WARN << LC << "Unsupported icon image format; icon will be blank" << std::endl;
+    }
+
+    Threading::ScopedMutexLock lock( _mutex );
+    _icons.push_back( icon );
+    _atlasDirty = true;
+    return _icons.size()-1;
+}
+
+void
+TrackBatchNode::toWorld(double lon, double lat, double alt, osg::Vec3d& world, osg::Vec3f& north) const
+{
+    if ( _geocentric )
+    {
+        double latr = osg::DegreesToRadians(lat), lonr = osg::DegreesToRadians(lon);
+        _mapSRS->getEllipsoid()->convertLatLongHeightToXYZ( latr, lonr, alt, world.x(), world.y(), world.z() );
+        double slat = sin(latr), clat = cos(latr);
+        north.set( -slat*cos(lonr), -slat*sin(lonr), clat );
+    }
+    else
+    {
+        world.set( lon, lat, alt );
+        if ( _geoSRS.valid() && _mapSRS.valid() )
+            _geoSRS->transform( world, _mapSRS.get(), world );
+        north.set( 0, 1, 0 );
+    }
+}
+
+void
+TrackBatchNode::setDirty(TrackID id)
+{
+    // NOTE: called with _mutex held.
+    if ( _dirtyFlags[id] == 0 )
+    {
+        _dirtyFlags[id] = 1;
+        _dirty.push_back( id );
+    }
+}
+
+TrackBatchNode::TrackID
+TrackBatchNode::addTrack(const GeoPoint& position, unsigned icon, float heading)
+{
+    GeoPoint geo = _geoSRS.valid() ? position.transform( _geoSRS.get() ) : position;
+    osg::Vec3d world;
+    osg::Vec3f north;
+    toWorld( geo.x(), geo.y(), geo.z(), world, north );
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    TrackID id;
+    if ( !_freeIDs.empty() )
+    {
+        id = _freeIDs.back();
+        _freeIDs.pop_back();
+    }
+    else
+    {
+        id = _tracks.flags.size();
+        _tracks.resize( id+1, _fields.size() );
+        _dirtyFlags.resize( id+1, 0 );
+    }
+
+    double h = osg::DegreesToRadians( heading );
+    _tracks.world[id]    = world;
+    _tracks.north[id]    = north;
+    _tracks.heading[id].set( sin(h), cos(h) );
+    _tracks.priority[id] = 0.0f;
+    _tracks.icon[id]     = icon;
+    _tracks.flags[id]    = LIVE | VISIBLE;
+    for(unsigned f=0; f<_fields.size(); ++f)
+    {
+        _tracks.text[id*_fields.size()+f].clear();
+        _tracks.textWidth[id*_fields.size()+f] = 0.0f;
+    }
+    setDirty( id );
+    ++_numTracks;
+
+    return id;
+}
+
+void
+TrackBatchNode::removeTrack(TrackID id)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( id < _tracks.flags.size() && (_tracks.flags[id] & LIVE) )
+    {
+        _tracks.flags[id] = 0;
+        _freeIDs.push_back( id );
+        setDirty( id );
+        --_numTracks;
+    }
+}
+
+unsigned
+TrackBatchNode::getNumTracks() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _numTracks;
+}
+
+void
+TrackBatchNode::setPosition(TrackID id, const GeoPoint& position, float heading)
+{
+    GeoPoint geo = _geoSRS.valid() ? position.transform( _geoSRS.get() ) : position;
+    Update update( id, geo.x(), geo.y(), geo.z(), heading );
+    setPositions( &update, 1 );
+}
+
+void
+TrackBatchNode::setPositions(const Update* updates, unsigned count)
+{
+    if ( !updates || count == 0 )
+        return;
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    // convert outside the lock so writers only contend for the copy.
+    std::vector<osg::Vec3d> world( count );
+    std::vector<osg::Vec3f> north( count );
+    std::vector<osg::Vec2f> heading( count );
+
+    if ( _geocentric )
+    {
+        for(unsigned i=0; i<count; ++i)
+        {
+            toWorld( updates[i].lon, updates[i].lat, updates[i].alt, world[i], north[i] );
+        }
+    }
+    else
+    {
+        for(unsigned i=0; i<count; ++i)
+        {
+            world[i].set( updates[i].lon, updates[i].lat, updates[i].alt );
+            north[i].set( 0, 1, 0 );
+        }
+        if ( _geoSRS.valid() && _mapSRS.valid() )
+            _geoSRS->transform( world, _mapSRS.get() );
+    }
+
+    for(unsigned i=0; i<count; ++i)
+    {
+        double h = osg::DegreesToRadians( (double)updates[i].heading );
+        heading[i].set( sin(h), cos(h) );
+    }
+
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        unsigned size = _tracks.flags.size();
+        for(unsigned i=0; i<count; ++i)
+        {
+            TrackID id = updates[i].id;
+            if ( id < size && (_tracks.flags[id] & LIVE) )
+            {
+                _tracks.world[id]   = world[i];
+                _tracks.north[id]   = north[i];
+                _tracks.heading[id] = heading[i];
+                setDirty( id );
+            }
+        }
+    }
+
+    double t = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _stats.updates    += count;
+    _stats.updateTime += t;
+}
+
+void
+TrackBatchNode::setIcon(TrackID id, unsigned icon)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( id < _tracks.flags.size() && (_tracks.flags[id] & LIVE) )
+    {
+        _tracks.icon[id] = icon;
+        setDirty( id );
+    }
+}
+
+void
+TrackBatchNode::setPriority(TrackID id, float priority)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( id < _tracks.flags.size() && (_tracks.flags[id] & LIVE) )
+    {
+        _tracks.priority[id] = priority;
+        setDirty( id );
+    }
+}
+
+void
+TrackBatchNode::setVisible(TrackID id, bool visible)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( id < _tracks.flags.size() && (_tracks.flags[id] & LIVE) )
+    {
+        if ( visible )
+            _tracks.flags[id] |= VISIBLE;
+        else
+            _tracks.flags[id] &= ~VISIBLE;
+        setDirty( id );
+    }
+}
+
+void
+TrackBatchNode::setFieldValue(TrackID id, const std::string& name, const std::string& value)
+{
+    unsigned field = 0u;
+    for( ; field < _fieldNames.size() && _fieldNames[field] != name; ++field );
+    if ( field == _fieldNames.size() )
+        return;
+
+    float width = computeTextWidth( field, value );
+
+    Threading::ScopedMutexLock lock( _mutex );
+    if ( id < _tracks.flags.size() && (_tracks.flags[id] & LIVE) )
+    {
+        unsigned i = id*_fields.size() + field;
+        if ( _tracks.text[i] != value )
+        {
+            _tracks.text[i]      = value;
+            _tracks.textWidth[i] = width;
+            setDirty( id );
+        }
+    }
+}
+
+TrackBatchNode::Stats
+TrackBatchNode::getStats() const
+{
+    Stats stats;
+    {
+        Threading::ScopedMutexLock lock( _statsMutex );
+        stats = _stats;
+    }
+    stats.tracks = getNumTracks();
+    return stats;
+}
+
+void
+TrackBatchNode::resetStats()
+{
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _stats = Stats();
+}
+
+float
+TrackBatchNode::computeTextWidth(unsigned field, const std::string& text) const
+{
+    // glyph metrics are fixed after construction, so no lock is needed.
+    const Font& font = _fonts[_fields[field].font];
+    float width = 0.0f;
+    for(std::string::const_iterator c = text.begin(); c != text.end(); ++c)
+    {
+        unsigned char ch = (unsigned char)*c;
+        if ( ch < FIRST_CHAR || ch > LAST_CHAR )
+            ch = ' ';
+        width += font.glyphs[ch-FIRST_CHAR].advance;
+    }
+    return width * _fields[field].scale;
+}
+
+osg::Vec2f
+TrackBatchNode::computeTextOrigin(unsigned field, float width) const
+{
+    // returns the pen position (left end of the baseline) relative to the anchor.
+    const Field& f    = _fields[field];
+    const Font&  font = _fonts[f.font];
+    float ascent  = font.ascent  * f.scale;
+    float descent = font.descent * f.scale;
+
+    float x = f.offset.x(), y = f.offset.y();
+
+    switch( f.alignment )
+    {
+    case TextSymbol::ALIGN_CENTER_TOP:
+    case TextSymbol::ALIGN_CENTER_CENTER:
+    case TextSymbol::ALIGN_CENTER_BOTTOM:
+    case TextSymbol::ALIGN_CENTER_BASE_LINE:
+    case TextSymbol::ALIGN_CENTER_BOTTOM_BASE_LINE:
+        x -= 0.5f*width; break;
+    case TextSymbol::ALIGN_RIGHT_TOP:
+    case TextSymbol::ALIGN_RIGHT_CENTER:
+    case TextSymbol::ALIGN_RIGHT_BOTTOM:
+    case TextSymbol::ALIGN_RIGHT_BASE_LINE:
+    case TextSymbol::ALIGN_RIGHT_BOTTOM_BASE_LINE:
+        x -= width; break;
+    default: break;
+    }
+
+    switch( f.alignment )
+    {
+    case TextSymbol::ALIGN_LEFT_TOP:
+    case TextSymbol::ALIGN_CENTER_TOP:
+    case TextSymbol::ALIGN_RIGHT_TOP:
+        y -= ascent; break;
+    case TextSymbol::ALIGN_LEFT_CENTER:
+    case TextSymbol::ALIGN_CENTER_CENTER:
+    case TextSymbol::ALIGN_RIGHT_CENTER:
+        y -= 0.5f*(ascent-descent); break;
+    case TextSymbol::ALIGN_LEFT_BOTTOM:
+    case TextSymbol::ALIGN_CENTER_BOTTOM:
+    case TextSymbol::ALIGN_RIGHT_BOTTOM:
+        y += descent; break;
+    default: break;
+    }
+
+    return osg::Vec2f( floor(x+0.5f), floor(y+0.5f) );
+}
+
+void
+TrackBatchNode::computeExtent(unsigned i)
+{
+    // pixel box around the anchor covering the icon and every label;
+    // used for view culling and decluttering.
+    osg::Vec4f e( 0, 0, 0, 0 );
+
+    unsigned icon = _render.icon[i];
+    if ( icon < _icons.size() )
+    {
+        // square, so that it holds the icon at any rotation.
+        float r = 0.5f*osg::maximum( _icons[icon].size.x(), _icons[icon].size.y() );
+        e.set( -r, -r, r, r );
+    }
+
+    for(unsigned f=0; f<_fields.size(); ++f)
+    {
+        unsigned k = i*_fields.size() + f;
+        if ( _render.text[k].empty() )
+            continue;
+
+        const Font& font = _fonts[_fields[f].font];
+        float width = _render.textWidth[k];
+        osg::Vec2f pen = computeTextOrigin( f, width );
+        e.x() = osg::minimum( e.x(), pen.x() );
+        e.y() = osg::minimum( e.y(), pen.y() - font.descent*_fields[f].scale );
+        e.z() = osg::maximum( e.z(), pen.x() + width );
+        e.w() = osg::maximum( e.w(), pen.y() + font.ascent*_fields[f].scale );
+    }
+
+    _render.extent[i] = e;
+}
+
+void
+TrackBatchNode::buildAtlas()
+{
+    // NOTE: called with _mutex held.
+    std::vector<AtlasItem> items;
+
+    for(unsigned i=0; i<_icons.size(); ++i)
+    {
+        if ( _icons[i].image.valid() )
+        {
+            AtlasItem item = { _icons[i].image.get(), &_icons[i].uv, false };
+            items.push_back( item );
+        }
+    }
+
+    for(unsigned f=0; f<_fonts.size(); ++f)
+    {
+        for(unsigned g=0; g<_fonts[f].images.size(); ++g)
+        {
+            if ( _fonts[f].images[g].valid() )
+            {
+                AtlasItem item = { _fonts[f].images[g].get(), &_fonts[f].glyphs[g].uv, true };
+                items.push_back( item );
+            }
+        }
+    }
+
+    // shelf packing, tallest first, with a 1-pixel gutter against filtering bleed.
+    std::sort( items.begin(), items.end(), SortByHeight() );
+
+    std::vector<osg::Vec2i> origins( items.size() );
+    int x = 1, y = 1, shelf = 0;
+    for(unsigned i=0; i<items.size(); ++i)
+    {
+        int s = items[i].image->s(), t = items[i].image->t();
+        if ( x + s + 1 > ATLAS_WIDTH )
+        {
+            x = 1;
+            y += shelf + 1;
+            shelf = 0;
+        }
+        origins[i].set( x, y );
+        x += s + 1;
+        shelf = osg::maximum( shelf, t );
+    }
+
+    unsigned width  = ATLAS_WIDTH;
+    unsigned height = nextPowerOfTwo( osg::maximum(y + shelf + 1, 1) );
+
+    osg::ref_ptr<osg::Image> atlas = new osg::Image();
+    atlas->allocateImage( width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE );
+    atlas->setInternalTextureFormat( GL_RGBA8 );
+    ::memset( atlas->data(), 0, atlas->getTotalSizeInBytes() );
+
+    ImageUtils::PixelWriter write( atlas.get() );
+
+    for(unsigned i=0; i<items.size(); ++i)
+    {
+        const osg::Image* image = items[i].image;
+        ImageUtils::PixelReader read( image );
+        int x0 = origins[i].x(), y0 = origins[i].y();
+
+        for(int t=0; t<image->t(); ++t)
+        {
+            for(int s=0; s<image->s(); ++s)
+            {
+                osg::Vec4 c = read( s, t );
+                if ( items[i].isGlyph )
+                {
+                    // glyph coverage may be in the alpha or the luminance channel.
+                    c.set( 1.0f, 1.0f, 1.0f, osg::minimum(c.r(), c.a()) );
+                }
+                write( c, x0+s, y0+t );
+            }
+        }
+
+        items[i].uv->set(
+            (float)x0 / (float)width,
+            (float)y0 / (float)height,
+            (float)(x0 + image->s()) / (float)width,
+            (float)(y0 + image->t()) / (float)height );
+    }
+
+    _atlas->setImage( atlas.get() );
+    _renderIcons = _icons;
+
+    OE_DEBUG << LC << "Built a " << width << "x" << height << " atlas for "
+        << _icons.size() << " icons and " << _fonts.size() << " fonts" << std::endl;
+}
+
+void
+TrackBatchNode::sync()
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    bool moved = false;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+
+        if ( _atlasDirty )
+        {
+            buildAtlas();
+            _atlasDirty = false;
+
+            // icon sizes may have changed
+            for(unsigned i=0; i<_render.flags.size(); ++i)
+                setDirty( i );
+        }
+
+        unsigned size = _tracks.flags.size();
+        if ( _render.flags.size() != size )
+            _render.resize( size, _fields.size() );
+
+        for(std::vector<unsigned>::const_iterator i = _dirty.begin(); i != _dirty.end(); ++i)
+        {
+            _render.copy( _tracks, *i, _fields.size() );
+            computeExtent( *i );
+            _dirtyFlags[*i] = 0;
+        }
+
+        moved = !_dirty.empty();
+        _dirty.clear();
+    }
+
+    if ( moved )
+    {
+        osg::BoundingBoxd box;
+        for(unsigned i=0; i<_render.flags.size(); ++i)
+        {
+            if ( _render.flags[i] & LIVE )
+                box.expandBy( _render.world[i] );
+        }
+        _bound = box.valid() ? osg::BoundingSphere(box.center(), box.radius()) : osg::BoundingSphere();
+        dirtyBound();
+    }
+
+    double t = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _stats.syncTime += t;
+}
+
+void
+TrackBatchNode::cull(const osg::Matrixd&  MV,
+                     const osg::Matrixd&  P,
+                     const osg::Viewport& viewport,
+                     CullData&            data)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    data.candidates.clear();
+    data.instances.clear();
+
+    const Tracks& t = _render;
+    unsigned numCulled = 0u, numDecluttered = 0u;
+
+    double W = viewport.width(), H = viewport.height();
+    if ( W <= 0.0 || H <= 0.0 )
+        return;
+
+    osg::Matrixd MVP = MV * P;
+
+    Horizon horizon( _horizon );
+    if ( _geocentric )
+        horizon.setEye( osg::Matrixd::inverse(MV).getTrans() );
+
+    // project and view-cull.
+    for(unsigned i=0; i<t.flags.size(); ++i)
+    {
+        if ( (t.flags[i] & (LIVE|VISIBLE)) != (LIVE|VISIBLE) )
+            continue;
+
+        const osg::Vec3d& p = t.world[i];
+
+        if ( _geocentric && !horizon.isVisible(p) )
+        {
+            ++numCulled;
+            continue;
+        }
+
+        double cw = p.x()*MVP(0,3) + p.y()*MVP(1,3) + p.z()*MVP(2,3) + MVP(3,3);
+        if ( cw <= 0.0 )
+        {
+            ++numCulled;
+            continue;
+        }
+
+        double cx = (p.x()*MVP(0,0) + p.y()*MVP(1,0) + p.z()*MVP(2,0) + MVP(3,0)) / cw;
+        double cy = (p.x()*MVP(0,1) + p.y()*MVP(1,1) + p.z()*MVP(2,1) + MVP(3,1)) / cw;
+
+        // snap to pixels so the icons and glyphs stay crisp.
+        float x = floor( (cx*0.5 + 0.5)*W + 0.5 );
+        float y = floor( (cy*0.5 + 0.5)*H + 0.5 );
+
+        const osg::Vec4f& e = t.extent[i];
+        if ( x + e.z() < 0.0f || x + e.x() > W || y + e.w() < 0.0f || y + e.y() > H )
+        {
+            ++numCulled;
+            continue;
+        }
+
+        // direction of north on the screen, as clockwise angle from "up":
+        const osg::Vec3f& n = t.north[i];
+        float nx = n.x()*MV(0,0) + n.y()*MV(1,0) + n.z()*MV(2,0);
+        float ny = n.x()*MV(0,1) + n.y()*MV(1,1) + n.z()*MV(2,1);
+        float len = sqrt( nx*nx + ny*ny );
+        float sn = len > 0.0f ? nx/len : 0.0f;
+        float cn = len > 0.0f ? ny/len : 1.0f;
+
+        // ...plus the heading, then negated into a counter-clockwise rotation.
+        const osg::Vec2f& h = t.heading[i];
+        Candidate c;
+        c.x        = x;
+        c.y        = y;
+        c.depth    = (float)cw;
+        c.priority = t.priority[i];
+        c.cosine   = cn*h.y() - sn*h.x();
+        c.sine     = -(sn*h.y() + cn*h.x());
+        c.index    = i;
+        data.candidates.push_back( c );
+    }
+
+    if ( _declutter && !data.candidates.empty() )
+    {
+        std::sort( data.candidates.begin(), data.candidates.end(), SortByPriority() );
+
+        int cols = (int)(W / DECLUTTER_CELL) + 1;
+        int rows = (int)(H / DECLUTTER_CELL) + 1;
+        data.grid.resize( cols*rows );
+        for(unsigned g=0; g<data.grid.size(); ++g)
+            data.grid[g].clear();
+        data.boxes.clear();
+
+        unsigned kept = 0u;
+        for(unsigned k=0; k<data.candidates.size(); ++k)
+        {
+            const Candidate& c = data.candidates[k];
+            const osg::Vec4f& e = t.extent[c.index];
+            osg::Vec4f box( c.x + e.x(), c.y + e.y(), c.x + e.z(), c.y + e.w() );
+
+            int c0 = osg::clampBetween( (int)floor(box.x()/DECLUTTER_CELL), 0, cols-1 );
+            int c1 = osg::clampBetween( (int)floor(box.z()/DECLUTTER_CELL), 0, cols-1 );
+            int r0 = osg::clampBetween( (int)floor(box.y()/DECLUTTER_CELL), 0, rows-1 );
+            int r1 = osg::clampBetween( (int)floor(box.w()/DECLUTTER_CELL), 0, rows-1 );
+
+            bool blocked = false;
+            for(int r=r0; r<=r1 && !blocked; ++r)
+            {
+                for(int col=c0; col<=c1 && !blocked; ++col)
+                {
+                    const std::vector<unsigned>& cell = data.grid[r*cols+col];
+                    for(unsigned b=0; b<cell.size() && !blocked; ++b)
+                        blocked = overlaps( box, data.boxes[cell[b]] );
+                }
+            }
+
+            if ( blocked )
+            {
+                ++numDecluttered;
+                continue;
+            }
+
+            unsigned boxIndex = data.boxes.size();
+            data.boxes.push_back( box );
+            for(int r=r0; r<=r1; ++r)
+                for(int col=c0; col<=c1; ++col)
+                    data.grid[r*cols+col].push_back( boxIndex );
+
+            data.candidates[kept++] = c;
+        }
+        data.candidates.resize( kept );
+    }
+
+    // emit the quads. With decluttering on, the winners are sorted by
+    // priority; go backwards so the most important tracks draw on top.
+    unsigned maxTexels = _maxQuads > 0 ? (unsigned)_maxQuads * TEXELS_PER_QUAD : UINT_MAX;
+    const osg::Vec4f white( 1, 1, 1, 1 );
+
+    for(int k=(int)data.candidates.size()-1; k>=0 && data.instances.size() < maxTexels; --k)
+    {
+        const Candidate& c = data.candidates[k];
+
+        unsigned icon = t.icon[c.index];
+        if ( icon < _renderIcons.size() && _renderIcons[icon].image.valid() )
+        {
+            const Icon& ic = _renderIcons[icon];
+            float hw = 0.5f*ic.size.x(), hh = 0.5f*ic.size.y();
+            pushQuad( data.instances,
+                osg::Vec4f(c.x, c.y, c.cosine, c.sine),
+                osg::Vec4f(-hw, -hh, hw, hh),
+                ic.uv,
+                white );
+        }
+
+        for(unsigned f=0; f<_fields.size(); ++f)
+        {
+            unsigned k2 = c.index*_fields.size() + f;
+            const std::string& text = t.text[k2];
+            if ( text.empty() )
+                continue;
+
+            const Field& field = _fields[f];
+            const Font&  font  = _fonts[field.font];
+            osg::Vec2f pen = computeTextOrigin( f, t.textWidth[k2] );
+            osg::Vec4f anchor( c.x, c.y, 1.0f, 0.0f );
+
+            for(std::string::const_iterator ch = text.begin(); ch != text.end() && data.instances.size() < maxTexels; ++ch)
+            {
+                unsigned char code = (unsigned char)*ch;
+                if ( code < FIRST_CHAR || code > LAST_CHAR )
+                    code = ' ';
+
+                const Glyph& g = font.glyphs[code-FIRST_CHAR];
+                if ( font.images[code-FIRST_CHAR].valid() )
+                {
+                    pushQuad( data.instances,
+                        anchor,
+                        osg::Vec4f(
+                            pen.x() + g.box.x()*field.scale, pen.y() + g.box.y()*field.scale,
+                            pen.x() + g.box.z()*field.scale, pen.y() + g.box.w()*field.scale ),
+                        g.uv,
+                        field.color );
+                }
+                pen.x() += g.advance * field.scale;
+            }
+        }
+    }
+
+    double time = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _stats.culled      = numCulled;
+    _stats.decluttered = numDecluttered;
+    _stats.drawn       = data.candidates.size();
+    _stats.instances   = data.instances.size() / TEXELS_PER_QUAD;
+    _stats.cullTime   += time;
+}
+
+void
+TrackBatchNode::traverse(osg::NodeVisitor& nv)
+{
+    if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
+    {
+        sync();
+    }
+
+    else if ( nv.getVisitorType() == nv.CULL_VISITOR && _supported )
+    {
+        osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+        const osg::Viewport* viewport = cv->getViewport();
+        if ( !viewport )
+            return;
+
+        osg::Camera* camera = cv->getCurrentCamera();
+        ViewData* view = _views.get( camera );
+        if ( !view )
+        {
+            view = new ViewData();
+            view->_primset = new osg::DrawArrays( GL_TRIANGLE_STRIP, 0, 4, 0 );
+            view->_geometry = new osg::Geometry();
+            view->_geometry->setUseDisplayList( false );
+            view->_geometry->setUseVertexBufferObjects( true );
+            view->_geometry->setDataVariance( osg::Object::DYNAMIC );
+            view->_geometry->setCullingActive( false );
+            view->_geometry->setVertexArray( _quad.get() );
+            view->_geometry->addPrimitiveSet( view->_primset.get() );
+            view->_stateSet = new osg::StateSet();
+            view->_stateSet->setDataVariance( osg::Object::DYNAMIC );
+            view->_viewport = new osg::Uniform( osg::Uniform::FLOAT_VEC2, "oe_trackbatch_viewport" );
+            view->_stateSet->addUniform( view->_viewport.get() );
+            view = _views.getOrCreate( camera, view );
+        }
+
+        cull( *cv->getModelViewMatrix(), *cv->getProjectionMatrix(), *viewport, view->_data );
+
+        unsigned numQuads = view->_data.instances.size() / TEXELS_PER_QUAD;
+        if ( numQuads > 0 )
+        {
+            // grow the instance buffer in powers of two so it is rarely reallocated.
+            if ( numQuads > view->_capacity )
+            {
+                view->_capacity = nextPowerOfTwo( osg::maximum(numQuads, 1024u) );
+                if ( _maxQuads > 0 )
+                    view->_capacity = osg::minimum( view->_capacity, (unsigned)_maxQuads );
+
+                view->_image = new osg::Image();
+                view->_image->allocateImage( view->_capacity*TEXELS_PER_QUAD, 1, 1, GL_RGBA, GL_FLOAT );
+
+                osg::TextureBuffer* tbo = new osg::TextureBuffer();
+                tbo->setInternalFormat( GL_RGBA32F_ARB );
+                tbo->setImage( view->_image.get() );
+                view->_stateSet->setTextureAttribute( INSTANCE_UNIT, tbo );
+            }
+
+            ::memcpy( view->_image->data(), &view->_data.instances[0], numQuads*TEXELS_PER_QUAD*sizeof(osg::Vec4f) );
+            view->_image->dirty();
+
+            view->_primset->setNumInstances( numQuads );
+            view->_viewport->set( osg::Vec2f(viewport->width(), viewport->height()) );
+
+            cv->pushStateSet( view->_stateSet.get() );
+            cv->addDrawableAndDepth( view->_geometry.get(), cv->getModelViewMatrix(), 0.0f );
+            cv->popStateSet();
+        }
+    }
+
+    osg::Node::traverse( nv );
+}
+
+osg::BoundingSphere
+TrackBatchNode::computeBound() const
+{
+    return _bound;
+}
@@ -131,6 +131,13 @@ public:
         return image;
     }
 
+    //override
+    bool supportsGeometryCache() const
+    {
+        // we copy any features we modify (lines for buffering).
+        return true;
+    }
+
     //override
     bool preProcess(osg::Image* image, osg::Referenced* buildData)
     {
@@ -160,9 +167,14 @@ public:
         const GeoExtent&   imageExtent,
         osg::Image*        image )
     {
-        // A processing context to use with the filters:
+        // A processing context to use with the filters. Features from the
+        // geometry tile cache are already in the image's SRS.
         FilterContext context( session );
-        context.setProfile( getFeatureSource()->getFeatureProfile() );
+        const SpatialReference* inputSRS = features.empty() ? 0L : features.front()->getSRS();
+        if ( inputSRS && inputSRS->isHorizEquivalentTo(imageExtent.getSRS()) )
+            context.setProfile( new FeatureProfile(imageExtent) );
+        else
+            context.setProfile( getFeatureSource()->getFeatureProfile() );
 
         const LineSymbol*    masterLine = style.getSymbol<LineSymbol>();
         const PolygonSymbol* masterPoly = style.getSymbol<PolygonSymbol>();
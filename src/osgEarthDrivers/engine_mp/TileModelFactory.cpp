@@ -396,6 +396,28 @@ TileModelFactory::buildNormalMap(const TileKey&    key,
                     isFallback );
 
                 model->_normalData._unit = _normalMapUnit;
+
+                // Borrow the heightfields of any live neighbors so the edge
+                // normals match up. Neighbors that arrive later will patch
+                // our edges (see TileNode::notifyOfArrival).
+                for(int x=-1; x<=1; ++x)
+                {
+                    for(int y=-1; y<=1; ++y)
+                    {
+                        if ( (x == 0) == (y == 0) ) // 4-connected only
+                            continue;
+
+                        osg::ref_ptr<TileNode> neighborNode;
+                        if (_liveTiles->get(key.createNeighborKey(x, y), neighborNode))
+                        {
+                            const TileModel* neighborModel = neighborNode->getTileModel();
+                            if ( neighborModel && !neighborModel->_normalData.isFallbackData() )
+                            {
+                                model->_normalData.setNeighbor(x, y, neighborModel->_normalData.getHeightField());
+                            }
+                        }
+                    }
+                }
             }
         }
     }
@@ -420,7 +442,10 @@ TileModelFactory::buildNormalMap(const TileKey&    key,
     }
     else
     {
+        OE_START_TIMER(generate_normalmap);
         model->generateNormalTexture();
+        if (progress)
+            progress->stats()["generate_normalmap_time"] += OE_STOP_TIMER(generate_normalmap);
     }
 }
 
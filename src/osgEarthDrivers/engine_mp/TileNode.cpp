@@ -30,7 +30,7 @@
 #include <osgEarth/DrawInstanced>
 #include <osgEarth/Registry>
 #include <osgEarth/CullingUtils>
-#include <osgEarth/ImageUtils>
+#include <osgEarth/HeightFieldUtils>
 #include <osgUtil/Optimizer>
 
 using namespace osgEarth::Drivers::MPTerrainEngine;
@@ -197,76 +197,80 @@ TileNode::notifyOfArrival(TileNode* that)
         << that->getKey().str() << " and it arrived.\n";
         
     osg::Texture* thisTex = this->getNormalTexture();
-    osg::Texture* thatTex = that->getNormalTexture();
-    if ( !thisTex || !thatTex ) {
+    if ( !thisTex ) {
         OE_TEST << LC << "bailed on " << getKey().str() << " - null normal texture\n";
         return;
     }
 
+    // a non-identity matrix means we are borrowing our parent's texture.
     osg::RefMatrixf* thisTexMat = this->getNormalTextureMatrix();
-    osg::RefMatrixf* thatTexMat = that->getNormalTextureMatrix();
-    if ( !thisTexMat || !thatTexMat || !thisTexMat->isIdentity() || !thatTexMat->isIdentity() ) {
+    if ( !thisTexMat || !thisTexMat->isIdentity() ) {
         OE_TEST << LC << "bailed on " << getKey().str() << " - null texmat\n";
         return;
     }
 
     osg::Image* thisImage = thisTex->getImage(0);
-    osg::Image* thatImage = thatTex->getImage(0);
-    if ( !thisImage || !thatImage ) {
+    if ( !thisImage ) {
         OE_TEST << LC << "bailed on " << getKey().str() << " - null image\n";
         return;
     }
 
-    int width = thisImage->s();
-    int height = thisImage->t();
-    if ( width != thatImage->s() || height != thatImage->t() ) {
-        OE_TEST << LC << "bailed on " << getKey().str() << " - mismatched sizes\n";
-        return;
-    }
-
     if (_model->_normalData.isFallbackData()) {
         OE_TEST << LC << "bailed on " << getKey().str() << " - fallback data\n";
         return;
     }
 
-    // Just copy the neighbor's edge normals over to our texture.
-    // Averaging them would be more accurate, but then we'd have to
-    // re-generate each texture multiple times instead of just once.
-    // Besides, there's almost no visual difference anyway.
-    ImageUtils::PixelReader readThat(thatImage);
-    ImageUtils::PixelWriter writeThis(thisImage);
-
-    bool thisDirty = false;
+    const TileModel* thatModel = that->getTileModel();
+    if ( !thatModel || thatModel->_normalData.isFallbackData() || !thatModel->_normalData.getHeightField() ) {
+        OE_TEST << LC << "bailed on " << getKey().str() << " - neighbor has no normal data\n";
+        return;
+    }
 
-    if ( that->getKey() == getKey().createNeighborKey(1,0) )
+    int xoffset = 0, yoffset = 0;
+    for(int x=-1; x<=1; ++x)
     {
-        // neighbor is to the east:
-        for(int t=0; t<height; ++t)
+        for(int y=-1; y<=1; ++y)
         {
-            writeThis(readThat(0,t), width-1, t);
+            if ( (x == 0) != (y == 0) && that->getKey() == getKey().createNeighborKey(x, y) )
+            {
+                xoffset = x, yoffset = y;
+            }
         }
-        thisDirty = true;
     }
 
-    else if ( that->getKey() == getKey().createNeighborKey(0,1) )
+    if ( xoffset == 0 && yoffset == 0 )
     {
-        // neighbor is to the south:
-        for(int s=0; s<width; ++s)
-        {
-            writeThis(readThat(s, height-1), s, 0);
-        }
-        thisDirty = true;
+        OE_INFO << LC << "Unhandled notify\n";
+        return;
     }
 
-    else
+    // Keep our own copy of the neighborhood so we never modify the
+    // tile model, which the pager thread may be reading.
+    if ( !_normalNeighborhood._center.valid() )
     {
-        OE_INFO << LC << "Unhandled notify\n";
+        _normalNeighborhood = _model->_normalData.getNeighborhood();
     }
 
-    if ( thisDirty )
+    osg::HeightField* thatHF = thatModel->_normalData.getHeightField();
+    if ( _normalNeighborhood.getNeighbor(xoffset, yoffset) == thatHF )
     {
-        // so heavy handed. Wish we could just write the row
-        // or column that changed.
-        thisImage->dirty();
+        // already used it when we built the normal map.
+        return;
     }
+
+    _normalNeighborhood.setNeighbor(xoffset, yoffset, thatHF);
+
+    // Only the border texels depend on the neighbor, so recompute those
+    // instead of regenerating the entire normal map.
+    OE_START_TIMER(normal_edges);
+
+    HeightFieldUtils::updateNormalMapEdges(
+        thisImage,
+        _normalNeighborhood,
+        getKey().getProfile()->getSRS() );
+
+    thisImage->dirty();
+
+    OE_TEST << LC << getKey().str() << " patched normal map edges in "
+        << OE_STOP_TIMER(normal_edges)*1000.0 << " ms\n";
 }
@@ -192,10 +192,12 @@ TilePagedLOD::addChild(osg::Node* node)
         {
             _live->add( tilenode );
 
-            // Listen for out east and south neighbors.
+            // Listen for our neighbors so we can patch our normal map edges.
             const TileKey& key = tilenode->getKey();
-            _live->listenFor( key.createNeighborKey(1, 0), tilenode );
-            _live->listenFor( key.createNeighborKey(0, 1), tilenode );
+            _live->listenFor( key.createNeighborKey( 1, 0), tilenode );
+            _live->listenFor( key.createNeighborKey(-1, 0), tilenode );
+            _live->listenFor( key.createNeighborKey( 0, 1), tilenode );
+            _live->listenFor( key.createNeighborKey( 0,-1), tilenode );
         }
 
         return osg::PagedLOD::addChild( node );
@@ -2,16 +2,69 @@
 
 #include <osgEarth/ImageUtils>
 #include <osgEarth/TileKey>
+#include <osgEarth/ThreadingUtils>
 
 #include <osg/Texture>
+#include <osg/Observer>
+#include <osg/ValueObject>
 
 #include <numeric>
+#include <map>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
 using namespace osgEarth;
 
 #define LC "[ElevationTexureUtils] "
 
+// user values that record how a quantized elevation image decodes.
+#define QUANT_SCALE  "osgEarth.elevationScale"
+#define QUANT_OFFSET "osgEarth.elevationOffset"
+
+namespace
+{
+    // Keeps a running tally of the memory held by elevation images,
+    // removing each image when it is deleted.
+    struct ElevationMemoryTracker : public osg::Observer
+    {
+        ElevationMemoryTracker() : _bytes(0u) { }
+
+        void add(const osg::Image* image)
+        {
+            const void* key = static_cast<const osg::Referenced*>(image);
+            Threading::ScopedMutexLock lock(_mutex);
+            if ( _sizes.find(key) == _sizes.end() )
+            {
+                unsigned bytes = image->getTotalSizeInBytes();
+                _sizes[key] = bytes;
+                _bytes += bytes;
+                image->addObserver( this );
+            }
+        }
+
+        void objectDeleted(void* ptr)
+        {
+            Threading::ScopedMutexLock lock(_mutex);
+            std::map<const void*, unsigned>::iterator i = _sizes.find(ptr);
+            if ( i != _sizes.end() )
+            {
+                _bytes -= i->second;
+                _sizes.erase( i );
+            }
+        }
+
+        std::map<const void*, unsigned> _sizes;
+        unsigned                        _bytes;
+        Threading::Mutex                _mutex;
+    };
+
+    // Never destroyed, since images may outlive static destruction.
+    ElevationMemoryTracker& getMemoryTracker()
+    {
+        static ElevationMemoryTracker* s_tracker = new ElevationMemoryTracker();
+        return *s_tracker;
+    }
+}
+
 ElevationImageReader::ElevationImageReader(const osg::Image* image)
 : _pixelReader(image)
 {
@@ -28,6 +81,8 @@ ElevationImageReader::ElevationImageReader(const osg::Image* image, const osg::M
 void
 ElevationImageReader::init(const osg::Image* image, const osg::Matrix& matrixScaleBias)
 {
+    _quantization = ElevationTexureUtils::getQuantization(image);
+
     double s_offset = matrixScaleBias(3,0) * (double)image->s();
     double t_offset = matrixScaleBias(3,1) * (double)image->t();
     double s_span   = matrixScaleBias(0,0) * (double)image->s();
@@ -116,4 +171,85 @@ ElevationTexureUtils::findExtrema(osg::Texture* elevationTexture, const osg::Mat
     OE_DEBUG << LC <<tileKey.getLOD()<< " Extrema Min: "<<extrema[0]<<" Max: "<<extrema[1]<<std::endl;
 
     return extrema[0] <= extrema[1];
-}
\ No newline at end of file
+}
+
+osg::Image*
+ElevationTexureUtils::quantize(const osg::Image* image)
+{
+    if ( !image ||
+         image->getPixelFormat() != GL_LUMINANCE ||
+         image->getDataType() != GL_FLOAT ||
+         image->r() != 1 )
+    {
+        return 0L;
+    }
+
+    // find the height range of the tile:
+    float minHeight =  FLT_MAX;
+    float maxHeight = -FLT_MAX;
+    for(int t=0; t<image->t(); ++t)
+    {
+        const float* row = reinterpret_cast<const float*>(image->data(0, t));
+        for(int s=0; s<image->s(); ++s)
+        {
+            if ( row[s] < minHeight ) minHeight = row[s];
+            if ( row[s] > maxHeight ) maxHeight = row[s];
+        }
+    }
+
+    if ( minHeight > maxHeight )
+        return 0L;
+
+    float range = maxHeight - minHeight;
+    float encode = range > 0.0f ? 65535.0f/range : 0.0f;
+
+    osg::Image* output = new osg::Image();
+    output->allocateImage(image->s(), image->t(), 1, GL_LUMINANCE, GL_UNSIGNED_SHORT);
+    output->setInternalTextureFormat(GL_LUMINANCE16);
+
+    for(int t=0; t<image->t(); ++t)
+    {
+        const float* in  = reinterpret_cast<const float*>(image->data(0, t));
+        GLushort*    out = reinterpret_cast<GLushort*>(output->data(0, t));
+        for(int s=0; s<image->s(); ++s)
+        {
+            out[s] = (GLushort)((in[s] - minHeight)*encode + 0.5f);
+        }
+    }
+
+    output->setUserValue( QUANT_SCALE,  range );
+    output->setUserValue( QUANT_OFFSET, minHeight );
+
+    return output;
+}
+
+osg::Vec2f
+ElevationTexureUtils::getQuantization(const osg::Image* image)
+{
+    float scale, offset;
+    if ( image &&
+         image->getUserValue(QUANT_SCALE, scale) &&
+         image->getUserValue(QUANT_OFFSET, offset) )
+    {
+        return osg::Vec2f(scale, offset);
+    }
+    return osg::Vec2f(1.0f, 0.0f);
+}
+
+void
+ElevationTexureUtils::trackMemory(const osg::Image* image)
+{
+    if ( image )
+    {
+        getMemoryTracker().add( image );
+    }
+}
+
+void
+ElevationTexureUtils::getResidentMemory(unsigned& out_count, unsigned& out_bytes)
+{
+    ElevationMemoryTracker& tracker = getMemoryTracker();
+    Threading::ScopedMutexLock lock(tracker._mutex);
+    out_count = tracker._sizes.size();
+    out_bytes = tracker._bytes;
+}
@@ -18,6 +18,7 @@
 */
 #include "EngineContext"
 #include "TileNodeRegistry"
+#include "ElevationTextureUtils"
 #include <osgEarth/TraversalData>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
@@ -84,6 +85,22 @@ EngineContext::endCull(osgUtil::CullVisitor* cv)
 
     if ( progress() )
     {
+        if ( _geometryPool )
+        {
+            GeometryPool::Stats poolStats = _geometryPool->getStats();
+            _progress->stats()["GeometryPool::pooled"] = poolStats.numPooled;
+            _progress->stats()["GeometryPool::masked"] = poolStats.numMasked;
+            _progress->stats()["GeometryPool::vertex_kb"] = poolStats.vertexBytes/1024;
+            _progress->stats()["GeometryPool::index_kb"] = poolStats.indexBytes/1024;
+            _progress->stats()["GeometryPool::shared_index_kb"] = poolStats.sharedIndexBytesSaved/1024;
+            _progress->stats()["GeometryPool::create_time"] = poolStats.createTime;
+        }
+
+        unsigned elevCount, elevBytes;
+        ElevationTexureUtils::getResidentMemory( elevCount, elevBytes );
+        _progress->stats()["Elevation::textures"] = elevCount;
+        _progress->stats()["Elevation::texture_kb"] = elevBytes/1024;
+
         OE_NOTICE << "Stats:\n";
         for(ProgressCallback::Stats::const_iterator i = _progress->stats().begin(); i != _progress->stats().end(); ++i)
         { 
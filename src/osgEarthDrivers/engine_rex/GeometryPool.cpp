@@ -67,19 +67,47 @@ GeometryPool::getPooledGeometry(const TileKey&               tileKey,
     }
     else
     {
-        // Not found. Create it.
-        out = createGeometry( tileKey, mapInfo, maskSet );
+        // Not found. Create it. A masked tile can borrow its grid vertices
+        // from the unmasked geometry with the same key, if there is one.
+        const osg::Geometry* templateGeom = i != _geometryMap.end() ? i->second.get() : 0L;
+
+        OE_START_TIMER(create_geometry);
+
+        out = createGeometry( tileKey, mapInfo, maskSet, templateGeom );
+
+        _stats.createTime += OE_STOP_TIMER(create_geometry);
 
         if (!masking)
+        {
             _geometryMap[ geomKey ] = out.get();
+            _stats.numPooled = _geometryMap.size();
+        }
+        else
+        {
+            _stats.numMasked++;
+            if ( templateGeom )
+                _stats.numFromTemplate++;
+        }
 
         if ( _debug )
         {
-            OE_NOTICE << LC << "Geometry pool size = " << _geometryMap.size() << "\n";
+            OE_NOTICE << LC << "Geometry pool size = " << _geometryMap.size()
+                << "; masked = " << _stats.numMasked
+                << "; vertex KB = " << (_stats.vertexBytes/1024)
+                << "; index KB = " << (_stats.indexBytes/1024)
+                << "; shared index KB saved = " << (_stats.sharedIndexBytesSaved/1024)
+                << "; create time = " << (1000.0*_stats.createTime) << " ms\n";
         }
     }
 }
 
+GeometryPool::Stats
+GeometryPool::getStats() const
+{
+    Threading::ScopedMutexLock exclusive( _geometryMapMutex );
+    return _stats;
+}
+
 void
 GeometryPool::createKeyForTileKey(const TileKey&             tileKey,
                                   unsigned                   size,
@@ -133,10 +161,112 @@ namespace
     } \
 }
 
+void
+GeometryPool::tessellateSurface(osg::DrawElements*    primSet,
+                                bool                  swapOrientation,
+                                const osg::Vec3Array* texCoords,
+                                const MaskGenerator*  maskSet) const
+{
+    for(unsigned j=0; j<_tileSize-1; ++j)
+    {
+        for(unsigned i=0; i<_tileSize-1; ++i)
+        {
+            int i00;
+            int i01;
+            if (swapOrientation)
+            {
+                i01 = j*_tileSize + i;
+                i00 = i01+_tileSize;
+            }
+            else
+            {
+                i00 = j*_tileSize + i;
+                i01 = i00+_tileSize;
+            }
+
+            int i10 = i00+1;
+            int i11 = i01+1;
+
+            // skip any triangles that have a discarded vertex:
+            bool discard = maskSet && (
+                maskSet->isMasked( (*texCoords)[i00] ) ||
+                maskSet->isMasked( (*texCoords)[i11] )
+            );
+
+            if ( !discard )
+            {
+                discard = maskSet && maskSet->isMasked( (*texCoords)[i01] );
+                if ( !discard )
+                {
+                    primSet->addElement(i01);
+                    primSet->addElement(i00);
+                    primSet->addElement(i11);
+                }
+            
+                discard = maskSet && maskSet->isMasked( (*texCoords)[i10] );
+                if ( !discard )
+                {
+                    primSet->addElement(i00);
+                    primSet->addElement(i10);
+                    primSet->addElement(i11);
+                }
+            }
+        }
+    }
+}
+
+osg::DrawElements*
+GeometryPool::getOrCreateSharedPrimitiveSet(bool   swapOrientation,
+                                            GLenum mode) const
+{
+    // NOTE: called with the _geometryMapMutex held.
+    osg::ref_ptr<osg::DrawElements>& primSet = _sharedPrimSet[swapOrientation ? 1 : 0];
+    if ( primSet.valid() )
+    {
+        _stats.sharedIndexBytesSaved += primSet->getNumIndices() * sizeof(GLushort);
+        return primSet.get();
+    }
+
+    primSet = new osg::DrawElementsUShort(mode);
+    primSet->reserveElements((_tileSize-1) * (_tileSize-1) * 6 + getNumSkirtElements());
+
+    tessellateSurface( primSet.get(), swapOrientation, 0L, 0L );
+
+    if ( _options.heightFieldSkirtRatio() > 0.0f )
+    {
+        // Skirt verts follow the surface verts in pairs (top, bottom), 
+        // walking the perimeter; this must match createGeometry.
+        unsigned skirtIndex = _tileSize*_tileSize;
+        unsigned numSkirtVerts = (_tileSize*4u - 2u) * 2u;
+        unsigned end = skirtIndex + numSkirtVerts;
+        unsigned i;
+        for(i=skirtIndex; i<end-2; i+=2)
+        {
+            primSet->addElement(i);
+            primSet->addElement(i+1);
+            primSet->addElement(i+2);
+            primSet->addElement(i+2);
+            primSet->addElement(i+1);
+            primSet->addElement(i+3);
+        }
+        primSet->addElement(i);
+        primSet->addElement(i+1);
+        primSet->addElement(skirtIndex);
+        primSet->addElement(skirtIndex);
+        primSet->addElement(i+1);
+        primSet->addElement(skirtIndex+1);
+    }
+
+    _stats.indexBytes += primSet->getNumIndices() * sizeof(GLushort);
+
+    return primSet.get();
+}
+
 osg::Geometry*
-GeometryPool::createGeometry(const TileKey& tileKey,
-                             const MapInfo& mapInfo,
-                             MaskGenerator* maskSet) const
+GeometryPool::createGeometry(const TileKey&       tileKey,
+                             const MapInfo&       mapInfo,
+                             MaskGenerator*       maskSet,
+                             const osg::Geometry* templateGeom) const
 {    
     // Establish a local reference frame for the tile:
     osg::Vec3d centerWorld;
@@ -159,10 +289,10 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     
     GLenum mode = (_options.gpuTessellation() == true) ? GL_PATCHES : GL_TRIANGLES;
 
-    // Pre-allocate enough space for all triangles.
-    osg::DrawElements* primSet = new osg::DrawElementsUShort(mode);
+    bool masking = maskSet && maskSet->hasMasks();
 
-    primSet->reserveElements(numIndiciesInSurface + numIncidesInSkirt);
+    // Unmasked tiles can all share the same index list.
+    bool shareIndices = !masking && _options.sharedIndexBuffers() == true;
 
     osg::BoundingSphere tileBound;
 
@@ -171,8 +301,6 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     geom->setUseVertexBufferObjects(true);
     geom->setUseDisplayList(false);
 
-    geom->addPrimitiveSet( primSet );
-
     // the vertex locations:
     osg::Vec3Array* verts = new osg::Vec3Array();
     verts->reserve( numVerts );
@@ -219,93 +347,101 @@ GeometryPool::createGeometry(const TileKey& tileKey,
 
     osg::ref_ptr<GeoLocator> locator = GeoLocator::createForKey( tileKey, mapInfo );
 
-    for(unsigned row=0; row<_tileSize; ++row)
-    {
-        float ny = (float)row/(float)(_tileSize-1);
-        for(unsigned col=0; col<_tileSize; ++col)
-        {
-            float nx = (float)col/(float)(_tileSize-1);
+    // The grid vertices of a masked tile are identical to those of the
+    // unmasked tile with the same key; copy them if we have one.
+    const osg::Vec3Array* templateVerts     = templateGeom ? static_cast<const osg::Vec3Array*>(templateGeom->getVertexArray()) : 0L;
+    const osg::Vec3Array* templateNormals   = templateGeom ? static_cast<const osg::Vec3Array*>(templateGeom->getNormalArray()) : 0L;
+    const osg::Vec3Array* templateNeighbors = templateGeom ? static_cast<const osg::Vec3Array*>(templateGeom->getTexCoordArray(1)) : 0L;
 
-            osg::Vec3d model;
-            locator->unitToModel(osg::Vec3d(nx, ny, 0.0f), model);
-            osg::Vec3d modelLTP = model*world2local;
-            verts->push_back( modelLTP );
-            tileBound.expandBy( verts->back() );
+    bool useTemplate =
+        templateVerts     && templateVerts->size() >= numVertsInSurface &&
+        templateNormals   && templateNormals->size() >= numVertsInSurface &&
+        (!neighbors || (templateNeighbors && templateNeighbors->size() >= numVertsInSurface));
 
-            if ( populateTexCoords )
-            {
-                // if masked then set textCoord z-value to 0.0
-                float marker = maskSet ? maskSet->getMarker(nx, ny) : MASK_MARKER_NORMAL;
-                texCoords->push_back( osg::Vec3f(nx, ny, marker) );
-            }
+    if ( useTemplate )
+    {
+        verts->insert  ( verts->end(),   templateVerts->begin(),   templateVerts->begin()   + numVertsInSurface );
+        normals->insert( normals->end(), templateNormals->begin(), templateNormals->begin() + numVertsInSurface );
+        if ( neighbors )
+            neighbors->insert( neighbors->end(), templateNeighbors->begin(), templateNeighbors->begin() + numVertsInSurface );
 
-            osg::Vec3d modelPlusOne;
-            locator->unitToModel(osg::Vec3d(nx, ny, 1.0f), modelPlusOne);
-            osg::Vec3d normal = (modelPlusOne*world2local)-modelLTP;                
-            normal.normalize();
-            normals->push_back( normal );
+        for(unsigned v=0; v<numVertsInSurface; ++v)
+            tileBound.expandBy( (*verts)[v] );
 
-            // neighbor:
-            if ( neighbors )
+        if ( populateTexCoords )
+        {
+            for(unsigned row=0; row<_tileSize; ++row)
             {
-                osg::Vec3d modelNeighborLTP = (*verts)[verts->size() - getMorphNeighborIndexOffset(col, row, _tileSize)];
-                neighbors->push_back(modelNeighborLTP);
+                float ny = (float)row/(float)(_tileSize-1);
+                for(unsigned col=0; col<_tileSize; ++col)
+                {
+                    float nx = (float)col/(float)(_tileSize-1);
+                    float marker = maskSet ? maskSet->getMarker(nx, ny) : MASK_MARKER_NORMAL;
+                    texCoords->push_back( osg::Vec3f(nx, ny, marker) );
+                }
             }
         }
     }
-
-    // Now tessellate the surface.
-    
-    // TODO: do we really need this??
-    bool swapOrientation = !locator->orientationOpenGL();
-
-    for(unsigned j=0; j<_tileSize-1; ++j)
+    else
     {
-        for(unsigned i=0; i<_tileSize-1; ++i)
+        for(unsigned row=0; row<_tileSize; ++row)
         {
-            int i00;
-            int i01;
-            if (swapOrientation)
-            {
-                i01 = j*_tileSize + i;
-                i00 = i01+_tileSize;
-            }
-            else
+            float ny = (float)row/(float)(_tileSize-1);
+            for(unsigned col=0; col<_tileSize; ++col)
             {
-                i00 = j*_tileSize + i;
-                i01 = i00+_tileSize;
-            }
+                float nx = (float)col/(float)(_tileSize-1);
 
-            int i10 = i00+1;
-            int i11 = i01+1;
-
-            // skip any triangles that have a discarded vertex:
-            bool discard = maskSet && (
-                maskSet->isMasked( (*texCoords)[i00] ) ||
-                maskSet->isMasked( (*texCoords)[i11] )
-            );
+                osg::Vec3d model;
+                locator->unitToModel(osg::Vec3d(nx, ny, 0.0f), model);
+                osg::Vec3d modelLTP = model*world2local;
+                verts->push_back( modelLTP );
+                tileBound.expandBy( verts->back() );
 
-            if ( !discard )
-            {
-                discard = maskSet && maskSet->isMasked( (*texCoords)[i01] );
-                if ( !discard )
+                if ( populateTexCoords )
                 {
-                    primSet->addElement(i01);
-                    primSet->addElement(i00);
-                    primSet->addElement(i11);
+                    // if masked then set textCoord z-value to 0.0
+                    float marker = maskSet ? maskSet->getMarker(nx, ny) : MASK_MARKER_NORMAL;
+                    texCoords->push_back( osg::Vec3f(nx, ny, marker) );
                 }
-            
-                discard = maskSet && maskSet->isMasked( (*texCoords)[i10] );
-                if ( !discard )
+
+                osg::Vec3d modelPlusOne;
+                locator->unitToModel(osg::Vec3d(nx, ny, 1.0f), modelPlusOne);
+                osg::Vec3d normal = (modelPlusOne*world2local)-modelLTP;                
+                normal.normalize();
+                normals->push_back( normal );
+
+                // neighbor:
+                if ( neighbors )
                 {
-                    primSet->addElement(i00);
-                    primSet->addElement(i10);
-                    primSet->addElement(i11);
+                    osg::Vec3d modelNeighborLTP = (*verts)[verts->size() - getMorphNeighborIndexOffset(col, row, _tileSize)];
+                    neighbors->push_back(modelNeighborLTP);
                 }
             }
         }
     }
 
+    // Now tessellate the surface.
+    
+    // TODO: do we really need this??
+    bool swapOrientation = !locator->orientationOpenGL();
+
+    osg::DrawElements* primSet = 0L;
+
+    if ( shareIndices )
+    {
+        primSet = getOrCreateSharedPrimitiveSet( swapOrientation, mode );
+    }
+    else
+    {
+        // Pre-allocate enough space for all triangles.
+        primSet = new osg::DrawElementsUShort(mode);
+        primSet->reserveElements(numIndiciesInSurface + numIncidesInSkirt);
+
+        tessellateSurface( primSet, swapOrientation, texCoords, maskSet );
+    }
+
+    geom->addPrimitiveSet( primSet );
+
     if ( createSkirt )
     {
         // SKIRTS:
@@ -327,12 +463,15 @@ GeometryPool::createGeometry(const TileKey& tileKey,
         for(int r=_tileSize-1; r>=0; --r)
             addSkirtDataForIndex( r*_tileSize, height ); //left
     
-        // then create the elements indices:
-        int i;
-        for(i=skirtIndex; i<(int)verts->size()-2; i+=2)
-            addSkirtTriangles( i, i+2 );
+        // then create the elements indices (already present in the shared set):
+        if ( !shareIndices )
+        {
+            int i;
+            for(i=skirtIndex; i<(int)verts->size()-2; i+=2)
+                addSkirtTriangles( i, i+2 );
 
-        addSkirtTriangles( i, skirtIndex );
+            addSkirtTriangles( i, skirtIndex );
+        }
     }
 
     // create mask geometry
@@ -340,9 +479,18 @@ GeometryPool::createGeometry(const TileKey& tileKey,
     {
         osg::ref_ptr<osg::DrawElementsUInt> maskPrim = maskSet->createMaskPrimitives(mapInfo, verts, texCoords, normals, neighbors);
         if (maskPrim)
+        {
             geom->addPrimitiveSet( maskPrim );
+            _stats.indexBytes += maskPrim->getNumIndices() * sizeof(GLuint);
+        }
     }
 
+    // account for the memory we just created:
+    unsigned numArrays = 3u + (neighbors ? 1u : 0u);
+    _stats.vertexBytes += verts->size() * sizeof(osg::Vec3f) * numArrays;
+    if ( !shareIndices )
+        _stats.indexBytes += primSet->getNumIndices() * sizeof(GLushort);
+
 #if 0
     // if we're using patches, we must create a "proxy" primitive set that supports
     // PrimitiveFunctor et al (for intersections, bounds testing, etc.)
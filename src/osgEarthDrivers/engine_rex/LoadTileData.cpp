@@ -18,9 +18,11 @@
 */
 #include "LoadTileData"
 #include "MPTexture"
+#include "ElevationTextureUtils"
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/Terrain>
 #include <osg/NodeVisitor>
+#include <osg/Texture2D>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
 using namespace osgEarth;
@@ -79,7 +81,14 @@ LoadTileData::invoke()
         _model = _context->getEngine()->createTileModel(
             _context->getMapFrame(),
             tilenode->getTileKey(),
-            0L ); // progress
+            getProgressCallback() );
+
+        // If the loader canceled us mid-fetch the model may be incomplete;
+        // discard it and leave the tile dirty so it will try again.
+        if ( getProgressCallback()->isCanceled() )
+        {
+            _model = 0L;
+        }
 
         // Prep the stateset for merging (and for GL pre-compile).
         if ( _model.valid() )
@@ -120,15 +129,29 @@ LoadTileData::invoke()
                 const SamplerBinding* binding = SamplerBinding::findUsage(bindings, SamplerBinding::ELEVATION);
                 if ( binding )
                 {                
+                    if ( _context->getOptions().quantizeElevation() == true )
+                    {
+                        quantizeElevation();
+                    }
+
+                    osg::Texture* texture = _model->elevationModel()->getTexture();
+
                     stateSet->setTextureAttribute(
                         binding->unit(),
-                        _model->elevationModel()->getTexture() );
+                        texture );
 
                     stateSet->removeUniform(binding->matrixName());
 
                     stateSet->addUniform( _context->getOrCreateMatrixUniform(
                         binding->matrixName(),
                         osg::Matrixf::identity() ) );    
+
+                    // how the shaders decode this tile's elevation samples.
+                    stateSet->addUniform( new osg::Uniform(
+                        "oe_tile_elevationQuant",
+                        ElevationTexureUtils::getQuantization(texture->getImage(0)) ) );
+
+                    ElevationTexureUtils::trackMemory( texture->getImage(0) );
                 }
             }
 
@@ -176,6 +199,31 @@ LoadTileData::invoke()
     }
 }
 
+void
+LoadTileData::quantizeElevation()
+{
+    TerrainTileElevationModel* elevModel = _model->elevationModel().get();
+    osg::Texture* texture = elevModel->getTexture();
+
+    osg::ref_ptr<osg::Image> image = ElevationTexureUtils::quantize( texture->getImage(0) );
+    if ( !image.valid() )
+        return;
+
+    // Same sampling state as the float texture, with half the footprint.
+    osg::Texture2D* tex = new osg::Texture2D( image.get() );
+    tex->setInternalFormat(GL_LUMINANCE16);
+    tex->setSourceFormat(GL_LUMINANCE);
+    tex->setSourceType(GL_UNSIGNED_SHORT);
+    tex->setFilter( osg::Texture::MAG_FILTER, texture->getFilter(osg::Texture::MAG_FILTER) );
+    tex->setFilter( osg::Texture::MIN_FILTER, texture->getFilter(osg::Texture::MIN_FILTER) );
+    tex->setWrap  ( osg::Texture::WRAP_S,     texture->getWrap(osg::Texture::WRAP_S) );
+    tex->setWrap  ( osg::Texture::WRAP_T,     texture->getWrap(osg::Texture::WRAP_T) );
+    tex->setResizeNonPowerOfTwoHint( false );
+    tex->setMaxAnisotropy( 1.0f );
+
+    elevModel->setTexture( tex );
+}
+
 void
 LoadTileData::apply()
 {
@@ -37,6 +37,7 @@ Loader::Request::Request()
     _uid = osgEarth::Registry::instance()->createUID();
     _state = IDLE;
     _loadCount = 0;
+    _progress = new ProgressCallback();
 }
 
 osg::StateSet*
@@ -147,7 +148,7 @@ namespace
 {
     struct RequestResultNode : public osg::Node
     {
-        RequestResultNode(Loader::Request* request) : _request(request)
+        RequestResultNode(Loader::Request* request, unsigned generation) : _request(request), _generation(generation)
         {
             // Do this so the pager/ICO can find and pre-compile GL objects that are
             // attached to the stateset.
@@ -161,18 +162,26 @@ namespace
 
         Loader::Request* getRequest() const { return _request.get(); }
 
+        /** Submission generation of the request when it was invoked. */
+        unsigned getGeneration() const { return _generation; }
+
         osg::ref_ptr<Loader::Request> _request;
+        unsigned                      _generation;
     };
 }
 
 
 PagerLoader::PagerLoader(TerrainEngine* engine) :
-_engineUID     ( engine->getUID() ),
-_checkpoint    ( (osg::Timer_t)0 ),
-_mergesPerFrame( 0 )
+_engineUID      ( engine->getUID() ),
+_checkpoint     ( (osg::Timer_t)0 ),
+_mergesPerFrame ( 0 ),
+_mergeTimeBudget( 0.0 )
 {
     _myNodePath.push_back( this );
 
+    // always need an update traversal to purge and cancel stale requests.
+    this->setNumChildrenRequiringUpdateTraversal( 1 );
+
     _dboptions = new osgDB::Options();
     _dboptions->setFileLocationCallback( new FileLocationCallback() );
 }
@@ -181,7 +190,19 @@ void
 PagerLoader::setMergesPerFrame(int value)
 {
     _mergesPerFrame = std::max(value, 0);
-    this->setNumChildrenRequiringUpdateTraversal( _mergesPerFrame > 0 ? 1 : 0 );
+}
+
+void
+PagerLoader::setMergeTimeBudget(float ms)
+{
+    _mergeTimeBudget = std::max(0.001 * (double)ms, 0.0);
+}
+
+void
+PagerLoader::cancel(Loader::Request* req)
+{
+    req->getProgressCallback()->cancel();
+    _stats.canceled++;
 }
 
 bool
@@ -191,6 +212,12 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
     //if ( request && !request->isMerging() && nv.getDatabaseRequestHandler() )
     if ( request && !request->isMerging() && !request->isFinished() && nv.getDatabaseRequestHandler() )
     {
+        // A canceled request may still be running on a pager thread. Wait for
+        // it to leave the pager before resubmitting it (and resetting its
+        // cancelation), so the worker never sees the flag change under it.
+        if ( request->getProgressCallback()->isCanceled() && request->_inFlight > 0 )
+            return false;
+
         //OE_INFO << LC << "load (" << request->getTileKey().str() << ")" << std::endl;
 
         unsigned fn = 0;
@@ -221,6 +248,17 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
 
             // if this is the first load request since idle, we need to remember this request.
             addToRequestSet = (request->_loadCount == 1);
+
+            // a fresh request must not inherit a previous cancelation. No pager
+            // thread can be invoking it here (see above), and it cannot be
+            // picked up again until it's back in the request set. A result from
+            // an earlier submission may still be on its way to addChild(), so
+            // start a new generation to tell it apart.
+            if ( addToRequestSet )
+            {
+                request->getProgressCallback()->reset();
+                ++request->_generation;
+            }
         }
         request->unlock();
 
@@ -240,8 +278,9 @@ PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv
             request->_internalHandle,
             _dboptions.get() );
 
-        // remember the request:
-        if ( true ) // addToRequestSet // Not sure whether we need to keep doing this in order keep it sorted -- check it out.
+        // remember the request. The request set is keyed by UID, so it only
+        // needs updating the first time a request is submitted since going idle.
+        if ( addToRequestSet )
         {
             Threading::ScopedMutexLock lock( _requestsMutex );
             _requests[request->getUID()] = request;
@@ -263,33 +302,58 @@ PagerLoader::clear()
 void
 PagerLoader::traverse(osg::NodeVisitor& nv)
 {
-    // only called when _mergesPerFrame > 0
     if ( nv.getVisitorType() == nv.UPDATE_VISITOR )
     {
-        int count;
-        for(count=0; count < _mergesPerFrame && !_mergeQueue.empty(); ++count)
+        bool limitMerges = _mergesPerFrame > 0 || _mergeTimeBudget > 0.0;
+
+        unsigned fn = 0;
+        if ( nv.getFrameStamp() )
+            fn = nv.getFrameStamp()->getFrameNumber();
+
+        // Merge the highest-priority requests first, until we exhaust either the
+        // per-frame count or the per-frame time budget. Always merge at least one
+        // so the queue cannot stall.
+        if ( limitMerges )
         {
-            Request* req = _mergeQueue.begin()->get();
-            if ( req && req->_lastTick >= _checkpoint )
+            OE_START_TIMER(merge);
+
+            int count;
+            for(count=0; !_mergeQueue.empty(); ++count)
             {
-                OE_START_TIMER(req_apply);
-                req->apply();
-                double s = OE_STOP_TIMER(req_apply);
+                if ( _mergesPerFrame > 0 && count >= _mergesPerFrame )
+                    break;
+
+                if ( _mergeTimeBudget > 0.0 && count > 0 && OE_STOP_TIMER(merge) >= _mergeTimeBudget )
+                    break;
 
-                req->setState(Request::FINISHED);
+                Request* req = _mergeQueue.begin()->get();
+                if ( req && req->getProgressCallback()->isCanceled() )
+                {
+                    // already counted as canceled.
+                }
+                else if ( req && req->_lastTick >= _checkpoint )
+                {
+                    req->apply();
+                    _stats.merged++;
+                }
+                else
+                {
+                    _stats.dropped++;
+                }
+
+                if ( req )
+                    req->setState(Request::FINISHED);
+
+                _mergeQueue.erase( _mergeQueue.begin() );
             }
 
-            _mergeQueue.erase( _mergeQueue.begin() );
+            _stats.mergeTime += 1000.0 * OE_STOP_TIMER(merge);
         }
 
         // cull finished requests.
         {
             Threading::ScopedMutexLock lock( _requestsMutex );
 
-            unsigned fn = 0;
-            if ( nv.getFrameStamp() )
-                fn = nv.getFrameStamp()->getFrameNumber();
-
             // Purge expired requests.
             for(Requests::iterator i = _requests.begin(); i != _requests.end(); )
             {
@@ -304,9 +368,14 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
                     _requests.erase( i++ );
                 }
 
-                else if ( !req->isMerging() && (fn - req->getLastFrameSubmitted() > 2) )
+                else if ( !req->isMerging() && (fn - req->getLastFrameSubmitted() > 2 || req->_lastTick < _checkpoint) )
                 {
                     //OE_INFO << LC << req->getName() << "(" << i->second->getUID() << ") died waiting after " << fn-req->getLastFrameSubmitted() << " frames" << std::endl; 
+
+                    // Nobody wants this one any more; cancel it so that a pending
+                    // or in-progress invoke stops before fetching more data.
+                    cancel( req );
+
                     req->setState( Request::IDLE );
                     if ( REPORT_ACTIVITY )
                         Registry::instance()->endActivity( req->getName() );
@@ -321,6 +390,20 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
 
             OE_DEBUG << LC << "PagerLoader: requests = " << _requests.size() << "\n";
         }
+
+        _stats.queueDepth = _mergeQueue.size();
+        _frameStats = _stats;
+        _stats = Stats();
+
+        if ( _frameStats.merged > 0 || _frameStats.dropped > 0 )
+        {
+            OE_DEBUG << LC
+                << "merged = " << _frameStats.merged
+                << ", dropped = " << _frameStats.dropped
+                << ", canceled = " << _frameStats.canceled
+                << ", queue = " << _frameStats.queueDepth
+                << ", merge time = " << _frameStats.mergeTime << " ms\n";
+        }
     }
 
     LoaderGroup::traverse( nv );
@@ -336,16 +419,27 @@ PagerLoader::addChild(osg::Node* node)
         Request* req = result->getRequest();
         if ( req )
         {
-            if ( req->_lastTick >= _checkpoint )
+            if ( req->getProgressCallback()->isCanceled() || result->getGeneration() != (unsigned)req->_generation )
+            {
+                // traverse() already purged and counted this request, or this is
+                // the stale result of a submission that was canceled and has since
+                // been resubmitted; leave the request alone.
+            }
+
+            else if ( req->_lastTick >= _checkpoint )
             {
-                if ( _mergesPerFrame > 0 )
+                if ( _mergesPerFrame > 0 || _mergeTimeBudget > 0.0 )
                 {
                     _mergeQueue.insert( req );
                     req->setState( Request::MERGING );
                 }
                 else
                 {
+                    OE_START_TIMER(merge);
                     req->apply();
+                    _stats.mergeTime += 1000.0 * OE_STOP_TIMER(merge);
+                    _stats.merged++;
+
                     req->setState( Request::FINISHED );
                     if ( REPORT_ACTIVITY )
                         Registry::instance()->endActivity( req->getName() );
@@ -354,6 +448,7 @@ PagerLoader::addChild(osg::Node* node)
 
             else
             {
+                _stats.dropped++;
                 req->setState( Request::FINISHED );
                 if ( REPORT_ACTIVITY )
                     Registry::instance()->endActivity( req->getName() );
@@ -382,7 +477,7 @@ PagerLoader::getTileKeyForRequest(UID requestUID) const
 }
 
 Loader::Request*
-PagerLoader::invokeAndRelease(UID requestUID)
+PagerLoader::invokeAndRelease(UID requestUID, unsigned& out_generation)
 {
     osg::ref_ptr<Request> request;
     {
@@ -391,15 +486,27 @@ PagerLoader::invokeAndRelease(UID requestUID)
         if ( i != _requests.end() )
         {
             request = i->second.get();
+
+            // mark it in flight while the lock still keeps it in the request set.
+            // load() cannot start a new generation while it's in flight.
+            ++request->_inFlight;
+            out_generation = request->_generation;
         }
     }
 
     if ( request.valid() )
     {
-        if ( REPORT_ACTIVITY )
-            Registry::instance()->startActivity( request->getName() );
+        // Skip the work entirely if the request was canceled while it
+        // sat in the pager's queue.
+        if ( !request->getProgressCallback()->isCanceled() )
+        {
+            if ( REPORT_ACTIVITY )
+                Registry::instance()->startActivity( request->getName() );
 
-        request->invoke();
+            request->invoke();
+        }
+
+        --request->_inFlight;
     }
 
     else
@@ -452,8 +559,9 @@ namespace osgEarth { namespace Drivers { namespace RexTerrainEngine
                     PagerLoader* loader = dynamic_cast<PagerLoader*>(engineNode->getLoader());
                     if ( loader )
                     {
-                        Loader::Request* req = loader->invokeAndRelease( requestUID );
-                        return new RequestResultNode(req);
+                        unsigned generation = 0u;
+                        Loader::Request* req = loader->invokeAndRelease( requestUID, generation );
+                        return new RequestResultNode(req, generation);
                     }
                 }
                 return ReadResult::FILE_NOT_FOUND;
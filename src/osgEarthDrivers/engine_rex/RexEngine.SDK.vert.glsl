@@ -10,6 +10,7 @@
 uniform sampler2D oe_tile_elevationTex;
 uniform mat4 oe_tile_elevationTexMatrix;
 uniform vec2 oe_tile_elevTexelCoeff;
+uniform vec2 oe_tile_elevationQuant; // scale, offset
 
 uniform sampler2D oe_tile_normalTex;
 uniform mat4 oe_tile_normalTexMatrix;
@@ -32,7 +33,8 @@ float oe_terrain_getElevation(in vec2 uv)
         + oe_tile_elevTexelCoeff.x * oe_tile_elevationTexMatrix[3].st     // bias
         + oe_tile_elevTexelCoeff.y;                                      
 
-    return texture(oe_tile_elevationTex, elevc).r;
+    // decode (identity unless the tile uses a quantized texture)
+    return texture(oe_tile_elevationTex, elevc).r * oe_tile_elevationQuant.x + oe_tile_elevationQuant.y;
 }
 
 /**
@@ -315,6 +315,7 @@ RexTerrainEngineNode::postInitialize( const Map* map, const TerrainOptions& opti
     // Make a tile loader
     PagerLoader* loader = new PagerLoader( this );
     loader->setMergesPerFrame( _terrainOptions.mergesPerFrame().get() );
+    loader->setMergeTimeBudget( _terrainOptions.mergeTimeBudget().get() );
 
     _loader = loader;
     //_loader = new SimpleLoader();
@@ -1116,6 +1117,10 @@ RexTerrainEngineNode::updateState()
 
             terrainStateSet->addUniform(new osg::Uniform("oe_tile_size", (float)_terrainOptions.tileSize().get()));
 
+            // default elevation decoding (scale, offset); tiles with quantized
+            // elevation textures override this.
+            terrainStateSet->addUniform(new osg::Uniform("oe_tile_elevationQuant", osg::Vec2f(1.0f, 0.0f)));
+
             // special object ID that denotes the terrain surface.
             surfaceStateSet->addUniform( new osg::Uniform(
                 Registry::objectIndex()->getObjectIDUniformName().c_str(), OSGEARTH_OBJECTID_TERRAIN) );
@@ -18,6 +18,7 @@
 */
 #include "TileDrawable"
 #include "MPTexture"
+#include "ElevationTextureUtils"
 
 #include <osg/Version>
 #include <osgUtil/MeshOptimizers>
@@ -307,6 +308,9 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
         ImageUtils::PixelReader elevation(_elevationRaster.get());
         elevation.setBilinear(true);
 
+        // decodes quantized rasters; identity for floating-point rasters.
+        osg::Vec2f quant = ElevationTexureUtils::getQuantization(_elevationRaster.get());
+
         float
             scaleU = _elevationScaleBias(0,0),
             scaleV = _elevationScaleBias(1,1),
@@ -327,7 +331,7 @@ TileDrawable::setElevationRaster(const osg::Image*   image,
             {
                 float u = (float)s / (float)(_tileSize-1);
                 u = u*scaleU + biasU;
-                _heightCache[t*_tileSize+s] = elevation(u, v).r();
+                _heightCache[t*_tileSize+s] = elevation(u, v).r()*quant.x() + quant.y();
             }
         }
     }
@@ -71,6 +71,8 @@ _dirty( false )
 void
 TileNode::create(const TileKey& key, EngineContext* context)
 {
+    OE_START_TIMER(create_tile);
+
     _key = key;
 
     // Create mask records
@@ -159,6 +161,9 @@ TileNode::create(const TileKey& key, EngineContext* context)
 
     // register me.
     context->liveTiles()->add( this );
+
+    if ( context->progress() )
+        context->progress()->stats()["TileNode::create_time"] += OE_STOP_TIMER(create_tile);
 }
 
 osg::BoundingSphere
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include "MVTFeatureOptions"
+#include <osgEarthDrivers/mbtiles/MBTilesConnectionPool>
 
 #include <osgEarth/Registry>
 #include <osgEarth/XmlUtils>
@@ -93,6 +94,9 @@ public:
         {          
             OE_WARN << LC << "Failed to open database " << sqlite3_errmsg(_database);
         }
+
+        // read connections for fetching tiles concurrently.
+        _pool = new MBTiles::ConnectionPool( fullFilename );
     }
 
 
@@ -148,34 +152,16 @@ public:
         key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
         tileY  = numRows - tileY - 1;
 
-        //Get the image
-        sqlite3_stmt* select = NULL;
-        std::string queryStr = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-        int rc = sqlite3_prepare_v2( _database, queryStr.c_str(), -1, &select, 0L );
-        if ( rc != SQLITE_OK )
-        {
-            OE_WARN << LC << "Failed to prepare SQL: " << queryStr << "; " << sqlite3_errmsg(_database) << std::endl;
-            return NULL;
-        }
-
-        bool valid = true;        
-
-        sqlite3_bind_int( select, 1, z );
-        sqlite3_bind_int( select, 2, tileX );
-        sqlite3_bind_int( select, 3, tileY );
-
-        rc = sqlite3_step( select );
+        // Fetch the raw tile on a pooled connection. Everything after this
+        // (inflating and parsing) runs without touching the database.
+        MBTiles::ConnectionPool::TileID id( z, tileX, tileY );
+        std::string dataBuffer;
+        bool valid = _pool.valid() && _pool->readTile( id, dataBuffer );
 
         FeatureList features;
 
-        if ( rc == SQLITE_ROW)
-        {                     
-            // the pointer returned from _blob gets freed internally by sqlite, supposedly
-            const char* data = (const char*)sqlite3_column_blob( select, 0 );
-            int dataLen = sqlite3_column_bytes( select, 0 );
-
-            std::string dataBuffer( data, dataLen );
-
+        if ( valid )
+        {
             // decompress if necessary:
             if ( _compressor.valid() )
             {
@@ -298,13 +284,6 @@ public:
                 OE_DEBUG << "Failed to parse, not surprising" << std::endl;
             }
         }
-        else
-        {
-            //OE_NOTICE << LC << "SQL QUERY failed for " << queryStr << ": " << std::endl;
-            valid = false;
-        }
-
-        sqlite3_finalize( select );
 
         if (!features.empty())
         {
@@ -413,6 +392,7 @@ private:
     osg::ref_ptr<osgDB::Options>    _dbOptions;    
     osg::ref_ptr<osgDB::BaseCompressor> _compressor;
     sqlite3* _database;
+    osg::ref_ptr<MBTiles::ConnectionPool> _pool;
     unsigned int _minLevel;
     unsigned int _maxLevel;
 };
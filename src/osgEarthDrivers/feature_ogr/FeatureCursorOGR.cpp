@@ -67,7 +67,8 @@ FeatureCursorOGR::FeatureCursorOGR(OGRDataSourceH              dsHandle,
                                    const FeatureSource*        source,
                                    const FeatureProfile*       profile,
                                    const Symbology::Query&     query,
-                                   const FeatureFilterList&    filters) :
+                                   const FeatureFilterList&    filters,
+                                   OGRHandlePool*              pool) :
 _source           ( source ),
 _dsHandle         ( dsHandle ),
 _layerHandle      ( layerHandle ),
@@ -77,10 +78,14 @@ _query            ( query ),
 _chunkSize        ( 500 ),
 _nextHandleToQueue( 0L ),
 _profile          ( profile ),
-_filters          ( filters )
+_filters          ( filters ),
+_pool             ( pool ),
+_locking          ( pool == 0L || !pool->isConcurrent() )
 {
     {
-        OGR_SCOPED_LOCK;
+        // pooled handles are private to this cursor, so they only need
+        // the global lock if the pool isn't concurrent.
+        OGRScopedLock lock( _locking );
 
         std::string expr;
         std::string from = OGR_FD_GetName( OGR_L_GetLayerDefn( _layerHandle ));        
@@ -168,19 +173,28 @@ _filters          ( filters )
 
 FeatureCursorOGR::~FeatureCursorOGR()
 {
-    OGR_SCOPED_LOCK;
+    {
+        OGRScopedLock lock( _locking );
 
-    if ( _nextHandleToQueue )
-        OGR_F_Destroy( _nextHandleToQueue );
+        if ( _nextHandleToQueue )
+            OGR_F_Destroy( _nextHandleToQueue );
 
-    if ( _resultSetHandle != _layerHandle )
-        OGR_DS_ReleaseResultSet( _dsHandle, _resultSetHandle );
+        if ( _resultSetHandle && _resultSetHandle != _layerHandle )
+            OGR_DS_ReleaseResultSet( _dsHandle, _resultSetHandle );
 
-    if ( _spatialFilter )
-        OGR_G_DestroyGeometry( _spatialFilter );
+        if ( _spatialFilter )
+            OGR_G_DestroyGeometry( _spatialFilter );
+    }
 
-    if ( _dsHandle )
+    if ( _pool.valid() )
+    {
+        _pool->checkin( _dsHandle, _layerHandle );
+    }
+    else if ( _dsHandle )
+    {
+        OGR_SCOPED_LOCK;
         OGRReleaseDataSource( _dsHandle );
+    }
 }
 
 bool
@@ -217,8 +231,8 @@ FeatureCursorOGR::readChunk()
         return;
     
     FeatureList preProcessList;
-    
-    OGR_SCOPED_LOCK;
+
+    OGRScopedLock lock( _locking );
 
     if ( _nextHandleToQueue )
     {
@@ -27,6 +27,7 @@
 #include <osgEarthFeatures/GeometryUtils>
 #include "OGRFeatureOptions"
 #include "FeatureCursorOGR"
+#include "OGRHandlePool"
 #include <osgEarthFeatures/OgrUtils>
 #include <osg/Notify>
 #include <osgDB/FileNameUtils>
@@ -43,22 +44,6 @@ using namespace osgEarth::Drivers;
 
 #define OGR_SCOPED_LOCK GDAL_SCOPED_LOCK
 
-namespace
-{
-    // helper function.
-    OGRLayerH openLayer(OGRDataSourceH ds, const std::string& layer)
-    {
-        OGRLayerH h = OGR_DS_GetLayerByName(ds, layer.c_str());
-        if ( !h )
-        {
-            unsigned index = osgEarth::as<unsigned>(layer, 0);
-            h = OGR_DS_GetLayer(ds, index);
-        }
-        return h;
-    }
-}
-
-
 /**
  * A FeatureSource that reads features from an OGR driver.
  *
@@ -183,7 +168,7 @@ public:
             {
                 if (openMode == 1) _writable = true;
                 
-                _layerHandle = openLayer(_dsHandle, _options.layer().value());
+                _layerHandle = OGRHandlePool::openLayer(_dsHandle, _options.layer().value());
 
                 if ( _layerHandle )
                 {                                     
@@ -246,6 +231,13 @@ public:
                     //Get the feature count
                     _featureCount = OGR_L_GetFeatureCount( _layerHandle, 1 );
 
+                    // readers get their own handles from this pool.
+                    _handlePool = new OGRHandlePool(
+                        _source,
+                        _options.layer().value(),
+                        _ogrDriverHandle,
+                        _options.concurrentReads() == true );
+
                     initSchema();
 
                     OGRwkbGeometryType wkbType = OGR_FD_GetGeomType( OGR_L_GetLayerDefn( _layerHandle ) );
@@ -324,38 +316,21 @@ public:
             OGRDataSourceH dsHandle = 0L;
             OGRLayerH layerHandle = 0L;
 
-            // open the handles safely:
+            // Each cursor requires its own handles so that multi-threaded access
+            // will work. The cursor returns them to the pool when it's done.
+            if ( _handlePool.valid() && _handlePool->checkout(dsHandle, layerHandle) )
             {
-                OGR_SCOPED_LOCK;
-
-                // Each cursor requires its own DS handle so that multi-threaded access will work.
-                // The cursor impl will dispose of the new DS handle.
-                dsHandle = OGROpenShared( _source.c_str(), 0, &_ogrDriverHandle );
-                if ( dsHandle )
-                {
-                    layerHandle = openLayer(dsHandle, _options.layer().get());
-                }
-            }
-
-            if ( dsHandle && layerHandle )
-            {
-                // cursor is responsible for the OGR handles.
                 return new FeatureCursorOGR( 
                     dsHandle,
                     layerHandle, 
                     this,
                     getFeatureProfile(),
                     query,
-                    _options.filters() );
+                    _options.filters(),
+                    _handlePool.get() );
             }
             else
             {
-                if ( dsHandle )
-                {
-                    OGR_SCOPED_LOCK;
-                    OGRReleaseDataSource( dsHandle );
-                }
-
                 return 0L;
             }
         }
@@ -369,6 +344,8 @@ public:
             if (OGR_L_DeleteFeature( _layerHandle, fid ) == OGRERR_NONE)
             {
                 _needsSync = true;
+                if ( _handlePool.valid() )
+                    _handlePool->invalidate();
                 return true;
             }            
         }
@@ -389,7 +366,13 @@ public:
     {
         Feature* result = NULL;
 
-        if ( !isBlacklisted(fid) )
+        if ( isBlacklisted(fid) )
+        {
+            return result;
+        }
+
+        // an editable source reads from its own handle so it sees its edits.
+        if ( _writable )
         {
             OGR_SCOPED_LOCK;
             OGRFeatureH handle = OGR_L_GetFeature( _layerHandle, fid);
@@ -399,6 +382,25 @@ public:
                 OGR_F_Destroy( handle );
             }
         }
+
+        else if ( _handlePool.valid() )
+        {
+            OGRDataSourceH dsHandle = 0L;
+            OGRLayerH layerHandle = 0L;
+            if ( _handlePool->checkout(dsHandle, layerHandle) )
+            {
+                {
+                    OGRScopedLock lock( !_handlePool->isConcurrent() );
+                    OGRFeatureH handle = OGR_L_GetFeature( layerHandle, fid );
+                    if (handle)
+                    {
+                        result = OgrUtils::createFeature( handle, getFeatureProfile() );
+                        OGR_F_Destroy( handle );
+                    }
+                }
+                _handlePool->checkin( dsHandle, layerHandle );
+            }
+        }
         return result;
     }
 
@@ -476,6 +478,9 @@ public:
             return false;
         }
 
+        if ( _handlePool.valid() )
+            _handlePool->invalidate();
+
         dirty();
 
         return true;
@@ -528,6 +533,7 @@ private:
     OGRDataSourceH _dsHandle;
     OGRLayerH _layerHandle;
     OGRSFDriverH _ogrDriverHandle;
+    osg::ref_ptr<OGRHandlePool> _handlePool;
     osg::ref_ptr<Symbology::Geometry> _geometry; // explicit geometry.
     const OGRFeatureOptions _options;
     int _featureCount;
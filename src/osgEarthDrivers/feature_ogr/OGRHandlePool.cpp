@@ -0,0 +1,182 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "OGRHandlePool"
+#include <osgEarth/Registry>
+#include <osgEarth/Notify>
+#include <osgEarth/StringUtils>
+
+#define LC "[OGRHandlePool] "
+
+// Most idle handles to keep open; handles returned beyond this are closed.
+#define MAX_IDLE_HANDLES 8u
+
+using namespace osgEarth;
+
+OGRHandlePool::OGRHandlePool(const std::string& source,
+                             const std::string& layer,
+                             OGRSFDriverH       driver,
+                             bool               concurrent) :
+_source    ( source ),
+_layer     ( layer ),
+_driver    ( driver ),
+_concurrent( concurrent ),
+_numHandles( 0u )
+{
+    //nop
+}
+
+OGRHandlePool::~OGRHandlePool()
+{
+    GDAL_SCOPED_LOCK;
+
+    for(std::vector<Handles>::iterator i = _idle.begin(); i != _idle.end(); ++i)
+    {
+        OGRReleaseDataSource( i->_ds );
+    }
+    _idle.clear();
+}
+
+OGRLayerH
+OGRHandlePool::openLayer(OGRDataSourceH ds, const std::string& layer)
+{
+    OGRLayerH h = OGR_DS_GetLayerByName(ds, layer.c_str());
+    if ( !h )
+    {
+        unsigned index = osgEarth::as<unsigned>(layer, 0);
+        h = OGR_DS_GetLayer(ds, index);
+    }
+    return h;
+}
+
+bool
+OGRHandlePool::checkout(OGRDataSourceH& out_ds, OGRLayerH& out_layer)
+{
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        if ( !_idle.empty() )
+        {
+            out_ds    = _idle.back()._ds;
+            out_layer = _idle.back()._layer;
+            _idle.pop_back();
+            _checkedOut.insert( out_ds );
+            return true;
+        }
+    }
+
+    // Nothing idle; open a new set of handles. Use a private (non-shared)
+    // data source since OGR shares handles across threads otherwise.
+    GDAL_SCOPED_LOCK;
+
+    OGRSFDriverH driver = _driver;
+    out_ds = OGROpen( _source.c_str(), 0, &driver );
+    if ( !out_ds )
+    {
+        OE_WARN << LC << "Failed to open \"" << _source << "\"" << std::endl;
+        return false;
+    }
+
+    out_layer = openLayer( out_ds, _layer );
+    if ( !out_layer )
+    {
+        OGRReleaseDataSource( out_ds );
+        out_ds = 0L;
+        return false;
+    }
+
+    Threading::ScopedMutexLock lock( _mutex );
+    _checkedOut.insert( out_ds );
+    ++_numHandles;
+    OE_DEBUG << LC << "Opened handle " << _numHandles << " on \"" << _source << "\"" << std::endl;
+    return true;
+}
+
+void
+OGRHandlePool::checkin(OGRDataSourceH ds, OGRLayerH layer)
+{
+    if ( !ds )
+        return;
+
+    // close stale handles, and any beyond what the pool keeps idle.
+    bool close = false;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        _checkedOut.erase( ds );
+        close = _stale.erase( ds ) > 0 || _idle.size() >= MAX_IDLE_HANDLES;
+        if ( close )
+            --_numHandles;
+    }
+
+    if ( close )
+    {
+        GDAL_SCOPED_LOCK;
+        OGRReleaseDataSource( ds );
+        return;
+    }
+
+    // clear any lingering state before the next reader gets it.
+    {
+        OGRScopedLock lock( !_concurrent );
+        OGR_L_SetSpatialFilter( layer, 0L );
+        OGR_L_SetAttributeFilter( layer, 0L );
+        OGR_L_ResetReading( layer );
+    }
+
+    Threading::ScopedMutexLock lock( _mutex );
+    _idle.push_back( Handles(ds, layer) );
+}
+
+void
+OGRHandlePool::invalidate()
+{
+    std::vector<Handles> idle;
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        idle.swap( _idle );
+        _stale.insert( _checkedOut.begin(), _checkedOut.end() );
+        _numHandles -= idle.size();
+    }
+
+    GDAL_SCOPED_LOCK;
+    for(std::vector<Handles>::iterator i = idle.begin(); i != idle.end(); ++i)
+    {
+        OGRReleaseDataSource( i->_ds );
+    }
+}
+
+unsigned
+OGRHandlePool::getNumHandles() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _numHandles;
+}
+
+//........................................................................
+
+OGRScopedLock::OGRScopedLock(bool lock) :
+_locked( lock )
+{
+    if ( _locked )
+        Registry::instance()->getGDALMutex().lock();
+}
+
+OGRScopedLock::~OGRScopedLock()
+{
+    if ( _locked )
+        Registry::instance()->getGDALMutex().unlock();
+}
@@ -19,6 +19,7 @@
 #include "KMLReader"
 #include "KML_Root"
 #include "KML_Geometry"
+#include "KMLStreamReader"
 #include <osgEarth/Registry>
 #include <osgEarth/Capabilities>
 #include <osgEarth/XmlUtils>
@@ -30,6 +31,52 @@
 using namespace osgEarth_kml;
 using namespace osgEarth;
 
+namespace
+{
+    // Prepares a context for reading into "root". The default cache and
+    // options are owned by the caller and must outlive the read.
+    void initContext(KMLContext&           cx,
+                     osg::Group*           root,
+                     MapNode*              mapNode,
+                     const KMLOptions*     options,
+                     const osgDB::Options* dbOptions,
+                     URIResultCache&       defaultUriCache,
+                     const KMLOptions&     blankOptions)
+    {
+        URIContext context(dbOptions);
+
+        cx._mapNode   = mapNode;
+        cx._sheet     = new StyleSheet();
+        cx._options   = options;
+        //cx._srs      = SpatialReference::create( "wgs84", "egm96" );
+        // Use the geographic srs of the map so that clamping will occur against the correct vertical datum.
+        cx._srs = mapNode->getMapSRS()->getGeographicSRS();
+        cx._referrer = context.referrer();
+        cx._groupStack.push( root );
+
+        // clone the dbOptions, and install a resource cache if there isn't one already:
+        if ( !URIResultCache::from(dbOptions) )
+        {
+            osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions();
+            defaultUriCache.apply( newOptions );
+            cx._dbOptions = newOptions;
+        }
+        else
+        {
+            cx._dbOptions = dbOptions;
+        }
+
+        // intialize the KML options with the defaults if necessary:
+        if ( cx._options == 0L )
+            cx._options = &blankOptions;
+
+        if ( cx._options->iconAndLabelGroup().valid() && cx._options->declutter() == true )
+        {
+            Decluttering::setEnabled( cx._options->iconAndLabelGroup()->getOrCreateStateSet(), true );
+        }
+    }
+}
+
 
 KMLReader::KMLReader( MapNode* mapNode, const KMLOptions* options ) :
 _mapNode( mapNode ),
@@ -44,6 +91,35 @@ KMLReader::read( std::istream& in, const osgDB::Options* dbOptions )
     // pull the URI context out of the DB options:
     URIContext context(dbOptions);
 
+    if ( _options && _options->streaming() == true )
+    {
+        osg::Group* root = new osg::Group();
+        root->setName( context.referrer() );
+
+        KMLContext     cx;
+        URIResultCache defaultUriCache;
+        KMLOptions     blankOptions;
+        initContext( cx, root, _mapNode, _options, dbOptions, defaultUriCache, blankOptions );
+
+        KMLStreamReader reader( cx );
+        reader.read( in );
+
+        const KMLStreamReader::Stats& stats = reader.getStats();
+        OE_INFO << LC << "Streamed " << (double)stats.bytes/1048576.0 << " MB of KML in "
+            << stats.time << "s ("
+            << (stats.time > 0.0 ? (double)stats.bytes/1048576.0/stats.time : 0.0) << " MB/s); "
+            << stats.placemarks << " placemarks, "
+            << stats.batches << " batches, "
+            << stats.deferred << " deferred, peak buffered "
+            << (double)stats.peakBufferedBytes/1048576.0 << " MB"
+            << std::endl;
+
+        // Make sure the KML gets rendered after the terrain.
+        root->getOrCreateStateSet()->setRenderBinDetails(2, "RenderBin");
+
+        return root;
+    }
+
 	// Load the XML
     osg::Timer_t start = osg::Timer::instance()->tick();
 	std::stringstream buffer;
@@ -75,38 +151,9 @@ KMLReader::read( xml_document<>& doc, const osgDB::Options* dbOptions )
 	root->setName( context.referrer() );
 
     KMLContext cx;
-    cx._mapNode   = _mapNode;
-    cx._sheet     = new StyleSheet();
-    cx._options   = _options;
-    //cx._srs      = SpatialReference::create( "wgs84", "egm96" );
-    // Use the geographic srs of the map so that clamping will occur against the correct vertical datum.
-    cx._srs = _mapNode->getMapSRS()->getGeographicSRS();
-    cx._referrer = context.referrer();
-    cx._groupStack.push( root );
-
-
-    // clone the dbOptions, and install a resource cache if there isn't one already:
     URIResultCache defaultUriCache;
-    if ( !URIResultCache::from(dbOptions) )
-    {
-        osgDB::Options* newOptions = Registry::instance()->cloneOrCreateOptions();
-        defaultUriCache.apply( newOptions );
-        cx._dbOptions = newOptions;
-    }
-    else
-    {
-        cx._dbOptions = dbOptions;
-    }
-
-    // intialize the KML options with the defaults if necessary:
     KMLOptions blankOptions;
-    if ( cx._options == 0L )
-        cx._options = &blankOptions;
-
-    if ( cx._options->iconAndLabelGroup().valid() && cx._options->declutter() == true )
-    {
-        Decluttering::setEnabled( cx._options->iconAndLabelGroup()->getOrCreateStateSet(), true );
-    }
+    initContext( cx, root, _mapNode, _options, dbOptions, defaultUriCache, blankOptions );
 
     //const Config* top = conf.hasChild("kml" ) ? conf.child_ptr("kml") : &conf;
 	xml_node<> *top = doc.first_node("kml", 0, false);
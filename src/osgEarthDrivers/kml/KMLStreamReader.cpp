@@ -0,0 +1,625 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "KMLStreamReader"
+#include "KML_Document"
+#include "KML_Folder"
+#include "KML_Placemark"
+#include "KML_Style"
+#include "KML_StyleMap"
+#include "KML_Schema"
+#include "KML_GroundOverlay"
+#include "KML_ScreenOverlay"
+#include "KML_PhotoOverlay"
+#include "KML_NetworkLink"
+#include "KML_NetworkLinkControl"
+#include <OpenThreads/Thread>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/Condition>
+#include <OpenThreads/ScopedLock>
+#include <osg/Timer>
+#include <osgEarth/StringUtils>
+#include <deque>
+#include <cctype>
+#include <cstring>
+
+using namespace osgEarth_kml;
+using namespace osgEarth;
+
+// bytes requested from the stream at a time
+#define CHUNK_SIZE (1024*1024)
+
+// elements per batch handed to the build thread
+#define BATCH_SIZE 256
+
+// maximum raw text waiting in the build queue before the reader blocks
+#define MAX_QUEUED_BYTES (64*1024*1024)
+
+namespace
+{
+    /**
+     * A unit of work for the build thread. Jobs are processed in the order
+     * they were queued, which is document order.
+     */
+    struct Job : public osg::Referenced
+    {
+        enum Type
+        {
+            ATTACH,      // add _group to _parent
+            PROPERTIES,  // apply a container's own elements (name, visibility...) to _group
+            ELEMENTS     // build feature and style elements into _group
+        };
+
+        Job(Type type, osg::Group* group) : _type(type), _group(group), _bytes(0) { }
+
+        void add(const std::string& name, const std::string& text)
+        {
+            _names.push_back( name );
+            _texts.push_back( text );
+            _bytes += text.size();
+        }
+
+        Type                     _type;
+        osg::ref_ptr<osg::Group> _parent;
+        osg::ref_ptr<osg::Group> _group;
+        std::vector<std::string> _names;  // lower-case local element names
+        std::vector<std::string> _texts;  // raw XML, one element each
+        size_t                   _bytes;
+    };
+
+    /**
+     * Bounded job queue between the reading and building threads.
+     */
+    class JobQueue
+    {
+    public:
+        JobQueue() : _bytes(0), _closed(false) { }
+
+        void push(Job* job)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            while( _bytes > MAX_QUEUED_BYTES )
+                _cond.wait( &_mutex );
+            _jobs.push_back( job );
+            _bytes += job->_bytes;
+            _cond.broadcast();
+        }
+
+        // blocks until a job is available; returns NULL once closed and drained.
+        Job* pop(osg::ref_ptr<Job>& out)
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            while( _jobs.empty() && !_closed )
+                _cond.wait( &_mutex );
+            if ( _jobs.empty() )
+                return 0L;
+            out = _jobs.front();
+            _jobs.pop_front();
+            _bytes -= out->_bytes;
+            _cond.broadcast();
+            return out.get();
+        }
+
+        void close()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            _closed = true;
+            _cond.broadcast();
+        }
+
+        size_t bytes()
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _mutex );
+            return _bytes;
+        }
+
+    private:
+        std::deque< osg::ref_ptr<Job> > _jobs;
+        size_t                          _bytes;
+        bool                            _closed;
+        OpenThreads::Mutex              _mutex;
+        OpenThreads::Condition          _cond;
+    };
+
+    /**
+     * Build thread: parses each queued element with rapidxml and runs the
+     * usual scan/scan2/build passes on it. It owns the context (style sheet,
+     * group stack) for the duration of the read.
+     */
+    class BuildThread : public OpenThreads::Thread
+    {
+    public:
+        BuildThread(JobQueue& queue, KMLContext& cx) : _queue(queue), _cx(cx), _deferred(0u) { }
+
+        void run()
+        {
+            osg::ref_ptr<Job> job;
+            while( _queue.pop(job) )
+            {
+                if ( job->_type == Job::ATTACH )
+                {
+                    job->_parent->addChild( job->_group.get() );
+                }
+                else
+                {
+                    for(unsigned i=0; i<job->_texts.size(); ++i)
+                    {
+                        build( job->_type, job->_names[i], job->_texts[i], job->_group.get(), false );
+                    }
+                }
+                job = 0L;
+            }
+
+            // forward references are resolvable now. Style maps go first,
+            // since features may refer to them.
+            for(unsigned pass=0; pass<2; ++pass)
+            {
+                for(unsigned i=0; i<_held.size(); ++i)
+                {
+                    bool isStyleMap = _held[i]->_names[0] == "stylemap";
+                    if ( isStyleMap == (pass == 0) )
+                        build( Job::ELEMENTS, _held[i]->_names[0], _held[i]->_texts[0], _held[i]->_group.get(), true );
+                }
+            }
+            _held.clear();
+        }
+
+        unsigned getNumDeferred() const { return _deferred; }
+
+    private:
+        // whether an element refers to a local style that isn't in the sheet yet.
+        bool refersToUnknownStyle(const std::string& name, xml_node<>* node)
+        {
+            std::string url;
+            if ( name == "placemark" )
+            {
+                url = getValue(node, "styleurl");
+            }
+            else if ( name == "stylemap" )
+            {
+                url = getValue(node->first_node("pair", 0, false), "styleurl");
+            }
+            return url.length() > 1 && url[0] == '#' && _cx._sheet->getStyle(url, false) == 0L;
+        }
+
+        void build(Job::Type type, const std::string& name, const std::string& text, osg::Group* group, bool final)
+        {
+            // rapidxml parses in place, so work on a copy; the original text is
+            // still needed if the element has to wait for a style.
+            std::vector<char> buf( text.begin(), text.end() );
+            buf.push_back( 0 );
+
+            xml_document<> doc;
+            try {
+                doc.parse<0>( &buf[0] );
+            }
+            catch(const rapidxml::parse_error& e) {
+                OE_WARN << LC << "Skipping malformed <" << name << "> element: " << e.what() << std::endl;
+                return;
+            }
+
+            xml_node<>* node = doc.first_node();
+            if ( !node )
+                return;
+
+            if ( type == Job::PROPERTIES )
+            {
+                KML_Feature container;
+                container.build( node, _cx, group );
+                return;
+            }
+
+            if ( !final && refersToUnknownStyle(name, node) )
+            {
+                osg::ref_ptr<Job> held = new Job( Job::ELEMENTS, group );
+                held->add( name, text );
+                _held.push_back( held.get() );
+                ++_deferred;
+                return;
+            }
+
+            _cx._groupStack.push( group );
+
+            if ( name == "placemark" )
+            {
+                KML_Placemark i; i.scan(node, _cx); i.scan2(node, _cx); i.build(node, _cx);
+            }
+            else if ( name == "style" )
+            {
+                KML_Style i; i.scan(node, _cx); i.scan2(node, _cx);
+            }
+            else if ( name == "stylemap" )
+            {
+                KML_StyleMap i; i.scan(node, _cx); i.scan2(node, _cx);
+            }
+            else if ( name == "groundoverlay" )
+            {
+                KML_GroundOverlay i; i.scan(node, _cx); i.scan2(node, _cx); i.build(node, _cx);
+            }
+            else if ( name == "screenoverlay" )
+            {
+                KML_ScreenOverlay i; i.scan(node, _cx); i.scan2(node, _cx); i.build(node, _cx);
+            }
+            else if ( name == "photooverlay" )
+            {
+                KML_PhotoOverlay i; i.scan(node, _cx); i.scan2(node, _cx); i.build(node, _cx);
+            }
+            else if ( name == "networklink" )
+            {
+                KML_NetworkLink i; i.scan(node, _cx); i.scan2(node, _cx); i.build(node, _cx);
+            }
+            else if ( name == "schema" )
+            {
+                KML_Schema i; i.scan(node, _cx); i.scan2(node, _cx);
+            }
+            else if ( name == "networklinkcontrol" )
+            {
+                KML_NetworkLinkControl i; i.scan(node, _cx); i.scan2(node, _cx);
+            }
+
+            _cx._groupStack.pop();
+        }
+
+        JobQueue&                       _queue;
+        KMLContext&                     _cx;
+        std::vector< osg::ref_ptr<Job> > _held;
+        unsigned                        _deferred;
+    };
+
+    bool isElement(const std::string& name)
+    {
+        return
+            name == "placemark"     || name == "style"         || name == "stylemap"    ||
+            name == "groundoverlay" || name == "screenoverlay" || name == "photooverlay" ||
+            name == "networklink"   || name == "schema"        || name == "networklinkcontrol";
+    }
+
+    bool isContainer(const std::string& name)
+    {
+        return name == "document" || name == "folder";
+    }
+
+    /**
+     * Incremental XML tokenizer over a std::istream. It keeps only the text
+     * from the oldest position still needed (the start of the element being
+     * cut out, or else the read position) to the end of the last chunk.
+     */
+    class Scanner
+    {
+    public:
+        Scanner(std::istream& in) : _in(in), _pos(0), _keep(std::string::npos), _bytes(0) { }
+
+        // reads another chunk; false at the end of the stream.
+        bool fill()
+        {
+            if ( !_in.good() )
+                return false;
+            size_t size = _buf.size();
+            _buf.resize( size + CHUNK_SIZE );
+            _in.read( &_buf[size], CHUNK_SIZE );
+            size_t n = (size_t)_in.gcount();
+            _buf.resize( size + n );
+            _bytes += n;
+            return n > 0;
+        }
+
+        // discards text that is no longer needed. Positions are only stable
+        // between calls to this.
+        void compact()
+        {
+            size_t drop = _keep != std::string::npos ? osg::minimum(_keep, _pos) : _pos;
+            if ( drop > CHUNK_SIZE )
+            {
+                _buf.erase( 0, drop );
+                _pos -= drop;
+                if ( _keep != std::string::npos )
+                    _keep -= drop;
+            }
+        }
+
+        // finds a string at or after "from", reading more as needed.
+        size_t find(const char* s, size_t from)
+        {
+            size_t len = strlen(s);
+            for(;;)
+            {
+                size_t i = _buf.find( s, from );
+                if ( i != std::string::npos )
+                    return i;
+                if ( _buf.size() >= len )
+                    from = osg::maximum( from, _buf.size() - len + 1 );
+                if ( !fill() )
+                    return std::string::npos;
+            }
+        }
+
+        // makes sure at least "count" bytes are available at "at".
+        bool ensure(size_t at, size_t count)
+        {
+            while( _buf.size() < at + count )
+                if ( !fill() )
+                    return false;
+            return true;
+        }
+
+        bool startsWith(size_t at, const char* s)
+        {
+            size_t len = strlen(s);
+            return ensure(at, len) && _buf.compare(at, len, s) == 0;
+        }
+
+        // finds the '>' that ends the tag starting at "from", skipping quoted values.
+        size_t findTagEnd(size_t from)
+        {
+            char quote = 0;
+            for(size_t i = from; ; ++i)
+            {
+                if ( i >= _buf.size() && !fill() )
+                    return std::string::npos;
+                char c = _buf[i];
+                if ( quote )
+                {
+                    if ( c == quote )
+                        quote = 0;
+                }
+                else if ( c == '"' || c == '\'' )
+                {
+                    quote = c;
+                }
+                else if ( c == '>' )
+                {
+                    return i;
+                }
+            }
+        }
+
+        // lower-case element name without any namespace prefix.
+        std::string localName(size_t from, size_t end) const
+        {
+            size_t i = from;
+            while( i < end && !isspace((unsigned char)_buf[i]) && _buf[i] != '/' && _buf[i] != '>' )
+                ++i;
+            std::string name = _buf.substr( from, i-from );
+            std::string::size_type colon = name.find(':');
+            if ( colon != std::string::npos )
+                name = name.substr( colon+1 );
+            return toLower( name );
+        }
+
+        std::istream&      _in;
+        std::string        _buf;
+        size_t             _pos;   // read position
+        size_t             _keep;  // start of the element being cut out, or npos
+        unsigned long long _bytes;
+    };
+
+    // hands a partial batch to the build thread.
+    void flush(JobQueue& queue, osg::ref_ptr<Job>& batch, KMLStreamReader::Stats& stats)
+    {
+        if ( batch.valid() )
+        {
+            queue.push( batch.get() );
+            batch = 0L;
+            stats.batches++;
+        }
+    }
+
+    // an open element outside of any cut-out element.
+    struct Level
+    {
+        Level(const std::string& name, osg::Group* group) : _name(name), _group(group) { }
+        std::string              _name;
+        osg::ref_ptr<osg::Group> _group;      // containers only
+        std::string              _properties; // a container's own elements
+    };
+}
+
+//------------------------------------------------------------------------
+
+KMLStreamReader::KMLStreamReader(KMLContext& cx) :
+_cx( cx )
+{
+    //nop
+}
+
+bool
+KMLStreamReader::read(std::istream& in)
+{
+    _stats = Stats();
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    osg::ref_ptr<osg::Group> root = _cx._groupStack.top();
+
+    JobQueue queue;
+    BuildThread builder( queue, _cx );
+    builder.start();
+
+    Scanner scanner( in );
+    std::vector<Level> stack;
+
+    // the element being cut out:
+    enum { NONE, ELEMENT, PROPERTY, SKIP } capture = NONE;
+    unsigned    captureDepth = 0;
+    std::string captureName;
+
+    // the batch being filled:
+    osg::ref_ptr<Job> batch;
+
+    bool foundRoot = false;
+
+    for(;;)
+    {
+        scanner.compact();
+
+        _stats.peakBufferedBytes = osg::maximum(
+            _stats.peakBufferedBytes,
+            (unsigned long long)(scanner._buf.capacity() + queue.bytes()) );
+
+        size_t lt = scanner.find( "<", scanner._pos );
+        if ( lt == std::string::npos )
+            break;
+
+        // skip markup that isn't an element:
+        const char* skips[4][2] = { {"<!--", "-->"}, {"<![CDATA[", "]]>"}, {"<?", "?>"}, {"<!", ">"} };
+        bool skipped = false, truncated = false;
+        for(unsigned s=0; s<4 && !skipped; ++s)
+        {
+            if ( scanner.startsWith(lt, skips[s][0]) )
+            {
+                size_t end = scanner.find( skips[s][1], lt + strlen(skips[s][0]) );
+                if ( end == std::string::npos )
+                    truncated = true;
+                else
+                    scanner._pos = end + strlen(skips[s][1]);
+                skipped = true;
+            }
+        }
+        if ( truncated )
+            break;
+        if ( skipped )
+            continue;
+
+        size_t gt = scanner.findTagEnd( lt+1 );
+        if ( gt == std::string::npos )
+            break;
+
+        bool        isEnd  = scanner._buf[lt+1] == '/';
+        bool        isLeaf = !isEnd && scanner._buf[gt-1] == '/';
+        std::string name   = scanner.localName( lt + (isEnd ? 2 : 1), gt );
+        scanner._pos = gt + 1;
+
+        // inside an element being cut out: just track the nesting.
+        if ( capture != NONE )
+        {
+            if ( !isEnd && !isLeaf )
+                ++captureDepth;
+            else if ( isEnd )
+                --captureDepth;
+        }
+
+        // a new element to cut out, or a container to open or close?
+        else if ( isEnd )
+        {
+            if ( !stack.empty() )
+            {
+                Level& level = stack.back();
+                if ( level._group.valid() )
+                    flush( queue, batch, _stats );
+
+                if ( level._group.valid() && !level._properties.empty() )
+                {
+                    osg::ref_ptr<Job> props = new Job( Job::PROPERTIES, level._group.get() );
+                    props->add( level._name, "<" + level._name + ">" + level._properties + "</" + level._name + ">" );
+                    queue.push( props.get() );
+                }
+                stack.pop_back();
+            }
+            continue;
+        }
+        else if ( stack.empty() )
+        {
+            if ( name == "kml" && !foundRoot )
+            {
+                foundRoot = true;
+                stack.push_back( Level(name, root.get()) );
+                if ( isLeaf )
+                    stack.pop_back();
+                continue;
+            }
+            capture = SKIP;
+            captureDepth = isLeaf ? 0 : 1;
+        }
+        else if ( isContainer(name) )
+        {
+            // flush first, so siblings keep their order.
+            flush( queue, batch, _stats );
+
+            osg::Group* parent = 0L;
+            for(int i=stack.size()-1; i>=0 && !parent; --i)
+                parent = stack[i]._group.get();
+
+            osg::ref_ptr<Job> attach = new Job( Job::ATTACH, new osg::Group() );
+            attach->_parent = parent;
+            queue.push( attach.get() );
+
+            stack.push_back( Level(name, attach->_group.get()) );
+            if ( isLeaf )
+                stack.pop_back();
+            continue;
+        }
+        else
+        {
+            bool ownProperty = stack.back()._name != "kml" && isContainer(stack.back()._name);
+            capture      = isElement(name) ? ELEMENT : ownProperty ? PROPERTY : SKIP;
+            captureDepth = isLeaf ? 0 : 1;
+            captureName  = name;
+            if ( capture != SKIP )
+                scanner._keep = lt;
+        }
+
+        // finished cutting out an element?
+        if ( capture != NONE && captureDepth == 0 )
+        {
+            if ( capture == ELEMENT )
+            {
+                osg::Group* group = 0L;
+                for(int i=stack.size()-1; i>=0 && !group; --i)
+                    group = stack[i]._group.get();
+
+                if ( batch.valid() && batch->_group.get() != group )
+                    flush( queue, batch, _stats );
+
+                if ( !batch.valid() )
+                    batch = new Job( Job::ELEMENTS, group );
+
+                batch->add( captureName, scanner._buf.substr(scanner._keep, scanner._pos - scanner._keep) );
+
+                _stats.elements++;
+                if ( captureName == "placemark" )
+                    _stats.placemarks++;
+
+                if ( batch->_texts.size() >= BATCH_SIZE )
+                    flush( queue, batch, _stats );
+            }
+            else if ( capture == PROPERTY )
+            {
+                stack.back()._properties.append( scanner._buf, scanner._keep, scanner._pos - scanner._keep );
+            }
+
+            capture = NONE;
+            scanner._keep = std::string::npos;
+        }
+    }
+
+    flush( queue, batch, _stats );
+
+    queue.close();
+    builder.join();
+
+    _stats.bytes    = scanner._bytes;
+    _stats.deferred = builder.getNumDeferred();
+    _stats.time     = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    if ( !foundRoot )
+    {
+        OE_WARN << LC << "No <kml> root element found in the stream" << std::endl;
+        return false;
+    }
+
+    return true;
+}
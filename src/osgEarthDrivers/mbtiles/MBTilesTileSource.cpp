@@ -112,6 +112,16 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
         return Status::Error( Stringify()
             << "Database \"" << fullFilename << "\": " << sqlite3_errmsg(_database) );
     }
+
+    // In write mode, use write-ahead logging so the pooled read connections
+    // don't block on (or get blocked by) the writer.
+    if ( readWrite )
+    {
+        if ( SQLITE_OK != sqlite3_exec(_database, "PRAGMA journal_mode=WAL", 0L, 0L, 0L) )
+        {
+            OE_INFO << LC << "WAL mode not available; reads will wait on writes" << std::endl;
+        }
+    }
     
     // New database setup:
     if ( isNewDatabase )
@@ -252,6 +262,9 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
     unsigned char *data = _emptyImage->data(0,0);
     memset(data, 0, 4 * size * size);
 
+    // read connections for fetching tiles concurrently.
+    _pool = new ConnectionPool( fullFilename );
+
     return STATUS_OK;
 }    
 
@@ -266,15 +279,51 @@ MBTilesTileSource::getCachePolicyHint(const Profile* targetProfile) const
 }
 
 
+void
+MBTilesTileSource::getTileID(const TileKey& key, ConnectionPool::TileID& out_id) const
+{
+    out_id.z = key.getLevelOfDetail();
+    out_id.x = key.getTileX();
+
+    // flip Y axis
+    unsigned int numRows, numCols;
+    key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
+    out_id.y = numRows - key.getTileY() - 1;
+}
+
+osg::Image*
+MBTilesTileSource::decodeImage(const std::string& data) const
+{
+    const std::string* dataBuffer = &data;
+
+    // decompress if necessary:
+    std::string value;
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(data);
+        if ( !_compressor->decompress(inputStream, value) )
+        {
+            OE_WARN << LC << "Decompression failed" << std::endl;
+            return NULL;
+        }
+        dataBuffer = &value;
+    }
+
+    // decode the raw image data:
+    std::istringstream inputStream(*dataBuffer);
+    osgDB::ReaderWriter::ReadResult rr = _rw->readImage( inputStream );
+    if (rr.validImage())
+    {
+        return rr.takeImage();
+    }
+    return NULL;
+}
+
 osg::Image*
 MBTilesTileSource::createImage(const TileKey&    key,
                                ProgressCallback* progress)
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
-    int x = key.getTileX();
-    int y = key.getTileY();
 
     if (z < (int)_minLevel)
     {
@@ -287,83 +336,71 @@ MBTilesTileSource::createImage(const TileKey&    key,
         return NULL;
     }
 
-    unsigned int numRows, numCols;
-    key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
-    y  = numRows - y - 1;
+    ConnectionPool::TileID id;
+    getTileID( key, id );
 
-    //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
+    // Fetch the raw tile on a pooled connection; no lock, and the
+    // decompression and decoding happen outside the database entirely.
+    std::string data;
+    if ( !_pool->readTile(id, data) )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_DEBUG << LC << "No tile for " << key.str() << std::endl;
         return NULL;
     }
 
-    bool valid = true;        
-
-    sqlite3_bind_int( select, 1, z );
-    sqlite3_bind_int( select, 2, x );
-    sqlite3_bind_int( select, 3, y );
+    return decodeImage( data );
+}
 
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
-    if ( rc == SQLITE_ROW)
-    {                     
-        // the pointer returned from _blob gets freed internally by sqlite, supposedly
-        const char* data = (const char*)sqlite3_column_blob( select, 0 );
-        int dataLen = sqlite3_column_bytes( select, 0 );
+void
+MBTilesTileSource::createImages(const std::vector<TileKey>&              keys,
+                                std::vector< osg::ref_ptr<osg::Image> >& out_images,
+                                ProgressCallback*                        progress)
+{
+    out_images.clear();
+    out_images.resize( keys.size() );
 
-        std::string dataBuffer( data, dataLen );
+    // Read all the in-range tiles in one transaction on one connection:
+    std::vector<ConnectionPool::TileID> ids;
+    std::vector<unsigned>               indices;
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        int z = keys[i].getLevelOfDetail();
+        if (z < (int)_minLevel)
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
-            {
-                OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
-            else
-            {
-                dataBuffer = value;
-            }
+            out_images[i] = _emptyImage.get();
         }
-
-        // decode the raw image data:
-        if ( valid )
+        else if (z <= (int)_maxLevel)
         {
-            std::istringstream inputStream(dataBuffer);
-            osgDB::ReaderWriter::ReadResult rr = _rw->readImage( inputStream );
-            if (rr.validImage())
-            {
-                result = rr.takeImage();                
-            }
+            ConnectionPool::TileID id;
+            getTileID( keys[i], id );
+            ids.push_back( id );
+            indices.push_back( i );
         }
     }
-    else
+
+    if ( ids.empty() )
+        return;
+
+    std::vector<std::string> data;
+    _pool->readTiles( ids, data );
+
+    // ..then decode them after the connection is back in the pool.
+    for(unsigned i=0; i<data.size(); ++i)
     {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
-    }
+        if ( progress && progress->isCanceled() )
+            break;
 
-    sqlite3_finalize( select );
-    return result;
+        if ( !data[i].empty() )
+        {
+            out_images[indices[i]] = decodeImage( data[i] );
+        }
+    }
 }
 
-bool 
-MBTilesTileSource::storeImage(const TileKey&    key,
-                              osg::Image*       image,
-                              ProgressCallback* progress)
+bool
+MBTilesTileSource::encodeImage(osg::Image* image, std::string& out_value) const
 {
-    if ( (getMode() & MODE_WRITE) == 0 )
-        return false;
-
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     // encode the data stream:
     std::stringstream buf;
     osgDB::ReaderWriter::WriteResult wr;
@@ -383,20 +420,27 @@ MBTilesTileSource::storeImage(const TileKey&    key,
         return false;
     }
 
-    std::string value = buf.str();
+    out_value = buf.str();
     
     // compress if necessary:
     if ( _compressor.valid() )
     {
         std::ostringstream output;
-        if ( !_compressor->compress(output, value) )
+        if ( !_compressor->compress(output, out_value) )
         {
             OE_WARN << LC << "Compressor failed" << std::endl;
             return false;
         }
-        value = output.str();
+        out_value = output.str();
     }
 
+    return true;
+}
+
+bool
+MBTilesTileSource::insertTile(sqlite3_stmt* insert, const TileKey& key, const std::string& value)
+{
+    // assume the mutex is locked.
     int z = key.getLOD();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -406,16 +450,6 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
-    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
-    if ( rc != SQLITE_OK )
-    {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-        return NULL;
-    }
-
     // bind parameters:
     sqlite3_bind_int( insert, 1, z );
     sqlite3_bind_int( insert, 2, x );
@@ -427,6 +461,7 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     // run the sql.
     bool ok = true;
     int tries = 0;
+    int rc;
     do {
         rc = sqlite3_step(insert);
     }
@@ -435,15 +470,101 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     if (SQLITE_OK != rc && SQLITE_DONE != rc)
     {
 #if SQLITE_VERSION_NUMBER >= 3007015
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed to insert tile " << key.str() << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
 #else
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
+        OE_WARN << LC << "Failed to insert tile " << key.str() << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
 #endif        
         ok = false;
     }
 
+    sqlite3_reset( insert );
+    sqlite3_clear_bindings( insert );
+
+    return ok;
+}
+
+bool 
+MBTilesTileSource::storeImage(const TileKey&    key,
+                              osg::Image*       image,
+                              ProgressCallback* progress)
+{
+    if ( (getMode() & MODE_WRITE) == 0 )
+        return false;
+
+    // encoding doesn't touch the database, so it happens outside the lock.
+    std::string value;
+    if ( !encodeImage(image, value) )
+        return false;
+
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    // Prep the insert statement:
+    sqlite3_stmt* insert = NULL;
+    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
+    if ( rc != SQLITE_OK )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        return false;
+    }
+
+    bool ok = insertTile( insert, key, value );
+
+    sqlite3_finalize( insert );
+
+    return ok;
+}
+
+bool
+MBTilesTileSource::storeImages(const std::vector<TileKey>&                    keys,
+                               const std::vector< osg::ref_ptr<osg::Image> >& images,
+                               ProgressCallback*                              progress)
+{
+    if ( (getMode() & MODE_WRITE) == 0 )
+        return false;
+
+    bool ok = true;
+
+    // encode the whole batch before taking the lock.
+    std::vector<std::string> values( keys.size() );
+    for(unsigned i=0; i<keys.size() && i<images.size(); ++i)
+    {
+        if ( progress && progress->isCanceled() )
+            return false;
+
+        if ( images[i].valid() && !encodeImage(images[i].get(), values[i]) )
+            ok = false;
+    }
+
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    // one transaction and one prepared statement for the batch:
+    sqlite3_stmt* insert = NULL;
+    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
+    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
+    if ( rc != SQLITE_OK )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        return false;
+    }
+
+    bool transaction = SQLITE_OK == sqlite3_exec(_database, "BEGIN TRANSACTION", 0L, 0L, 0L);
+
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        if ( !values[i].empty() && !insertTile(insert, keys[i], values[i]) )
+            ok = false;
+    }
+
     sqlite3_finalize( insert );
 
+    if ( transaction && SQLITE_OK != sqlite3_exec(_database, "COMMIT TRANSACTION", 0L, 0L, 0L) )
+    {
+        OE_WARN << LC << "Failed to commit a batch of " << keys.size() << " tiles; " << sqlite3_errmsg(_database) << std::endl;
+        sqlite3_exec(_database, "ROLLBACK TRANSACTION", 0L, 0L, 0L);
+        ok = false;
+    }
+
     return ok;
 }
 
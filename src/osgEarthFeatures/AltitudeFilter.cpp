@@ -19,9 +19,14 @@
 #include <osgEarthFeatures/AltitudeFilter>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/GeoData>
+#include <osg/Timer>
 
 #define LC "[AltitudeFilter] "
 
+// Session object key and size of the elevation tile cache shared by clamping operations
+#define TILE_CACHE_KEY  "AltitudeFilter.tileCache"
+#define TILE_CACHE_SIZE 500
+
 using namespace osgEarth;
 using namespace osgEarth::Features;
 using namespace osgEarth::Symbology;
@@ -29,7 +34,8 @@ using namespace osgEarth::Symbology;
 //---------------------------------------------------------------------------
 
 AltitudeFilter::AltitudeFilter() :
-_maxRes ( 0.0f )
+_maxRes      ( 0.0f ),
+_clampingTime( 0.0 )
 {
     //NOP
 }
@@ -136,7 +142,9 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 void
 AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
 {
-    const Session* session = cx.getSession();
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    Session* session = cx.getSession();
 
     // the map against which we'll be doing elevation clamping
     //MapFrame mapf = session->createMapFrame( Map::ELEVATION_LAYERS );
@@ -152,6 +160,21 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     // want a result even if it's low res
     eq.setFallBackOnNoData( true );
 
+    // share elevation tiles with the other compilations in this session, so
+    // neighboring feature tiles don't each start with a cold cache. The cache
+    // is replaced whenever the map changes; compilations still running on an
+    // older map keep the old cache, or their own if it has been replaced.
+    int revision = mapf.getRevision();
+    osg::ref_ptr<ElevationQueryTileCache> tileCache = session->getObject<ElevationQueryTileCache>( TILE_CACHE_KEY );
+    if ( !tileCache.valid() || (int)tileCache->getRevision() < revision )
+    {
+        tileCache = session->putObject( TILE_CACHE_KEY, new ElevationQueryTileCache(revision, TILE_CACHE_SIZE) );
+    }
+    if ( (int)tileCache->getRevision() == revision )
+    {
+        eq.setTileCache( tileCache.get() );
+    }
+
     NumericExpression scaleExpr;
     if ( _altitude->verticalScale().isSet() )
         scaleExpr = *_altitude->verticalScale();
@@ -173,7 +196,16 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     bool vertEquiv =
         featureSRS->isVertEquivalentTo( mapSRS );
 
+    osg::ref_ptr<const SpatialReference> featureSRSwithMapVertDatum = !vertEquiv ?
+        SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString()) : 0L;
+
+    // First pass: evaluate the per-feature expressions and gather every point
+    // that needs an elevation (each vertex, or each part's centroid).
+    std::vector<FeatureRecord> records;
+    records.reserve( features.size() );
 
+    std::vector<PartRecord>  parts;
+    std::vector<osg::Vec3d>  samplePoints;
 
     for( FeatureList::iterator i = features.begin(); i != features.end(); ++i )
     {
@@ -186,23 +218,61 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             feature->eval( temp, &cx );
         }
 
-        double maxTerrainZ  = -DBL_MAX;
-        double minTerrainZ  =  DBL_MAX;
-        double minHAT       =  DBL_MAX;
-        double maxHAT       = -DBL_MAX;
+        FeatureRecord record;
+        record._feature   = feature;
+        record._firstPart = parts.size();
 
-        double scaleZ = 1.0;
+        record._scaleZ = 1.0;
         if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-            scaleZ = feature->eval( scaleExpr, &cx );
+            record._scaleZ = feature->eval( scaleExpr, &cx );
 
-        double offsetZ = 0.0;
+        record._offsetZ = 0.0;
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-            offsetZ = feature->eval( offsetExpr, &cx );
+            record._offsetZ = feature->eval( offsetExpr, &cx );
         
         GeometryIterator gi( feature->getGeometry() );
         while( gi.hasMore() )
         {
-            Geometry* geom = gi.next();
+            PartRecord part;
+            part._geom       = gi.next();
+            part._firstPoint = samplePoints.size();
+            parts.push_back( part );
+
+            if ( perVertex )
+            {
+                samplePoints.insert( samplePoints.end(), part._geom->begin(), part._geom->end() );
+            }
+            else
+            {
+                const osg::Vec2d& center = part._geom->getBounds().center2d();
+                samplePoints.push_back( osg::Vec3d(center.x(), center.y(), 0.0) );
+            }
+        }
+
+        record._lastPart = parts.size();
+        records.push_back( record );
+    }
+
+    // Sample the terrain for all of them at once.
+    std::vector<double> elevations;
+    eq.sampleElevations( samplePoints, featureSRS.get(), elevations, _maxRes );
+
+    // Second pass: apply the elevations.
+    for( std::vector<FeatureRecord>::const_iterator r = records.begin(); r != records.end(); ++r )
+    {
+        Feature* feature = r->_feature;
+        double   scaleZ  = r->_scaleZ;
+        double   offsetZ = r->_offsetZ;
+
+        double maxTerrainZ  = -DBL_MAX;
+        double minTerrainZ  =  DBL_MAX;
+        double minHAT       =  DBL_MAX;
+        double maxHAT       = -DBL_MAX;
+
+        for( unsigned pi = r->_firstPart; pi < r->_lastPart; ++pi )
+        {
+            Geometry* geom  = parts[pi]._geom;
+            unsigned  first = parts[pi]._firstPoint;
 
             // Absolute heights in Z. Only need to collect the HATs; the geometry
             // remains unchanged.
@@ -210,49 +280,41 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             {
                 if ( perVertex )
                 {
-                    std::vector<double> elevations;
-                    elevations.reserve( geom->size() );
-
-                    if ( eq.getElevations( geom->asVector(), featureSRS, elevations, _maxRes ) )
+                    for( unsigned i=0; i<geom->size(); ++i )
                     {
-                        for( unsigned i=0; i<geom->size(); ++i )
-                        {
-                            osg::Vec3d& p = (*geom)[i];
+                        osg::Vec3d& p = (*geom)[i];
+                        double elevation = elevations[first+i] != NO_DATA_VALUE ? elevations[first+i] : 0.0;
 
-                            p.z() *= scaleZ;
-                            p.z() += offsetZ;
+                        p.z() *= scaleZ;
+                        p.z() += offsetZ;
 
-                            double z = p.z();
+                        double z = p.z();
 
-                            if ( !vertEquiv )
-                            {
-                                osg::Vec3d tempgeo;
-                                if ( !featureSRS->transform(p, mapSRS->getGeographicSRS(), tempgeo) )
-                                    z = tempgeo.z();
-                            }
+                        if ( !vertEquiv )
+                        {
+                            osg::Vec3d tempgeo;
+                            if ( !featureSRS->transform(p, mapSRS->getGeographicSRS(), tempgeo) )
+                                z = tempgeo.z();
+                        }
 
-                            double hat = z - elevations[i];
+                        double hat = z - elevation;
 
-                            if ( hat > maxHAT )
-                                maxHAT = hat;
-                            if ( hat < minHAT )
-                                minHAT = hat;
+                        if ( hat > maxHAT )
+                            maxHAT = hat;
+                        if ( hat < minHAT )
+                            minHAT = hat;
 
-                            if ( elevations[i] > maxTerrainZ )
-                                maxTerrainZ = elevations[i];
-                            if ( elevations[i] < minTerrainZ )
-                                minTerrainZ = elevations[i];
-                        }
+                        if ( elevation > maxTerrainZ )
+                            maxTerrainZ = elevation;
+                        if ( elevation < minTerrainZ )
+                            minTerrainZ = elevation;
                     }
                 }
                 else // per centroid
                 {
-                    osgEarth::Bounds bounds = geom->getBounds();
-                    const osg::Vec2d& center = bounds.center2d();
-                    GeoPoint centroid(featureSRS, center.x(), center.y());
-                    double   centroidElevation;
+                    double centroidElevation = elevations[first];
 
-                    if ( eq.getElevation( centroid, centroidElevation, _maxRes ) )
+                    if ( centroidElevation != NO_DATA_VALUE )
                     {
                         for( unsigned i=0; i<geom->size(); ++i )
                         {
@@ -288,53 +350,42 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             // and record HATs along the way.
             else if ( _altitude->clamping() == AltitudeSymbol::CLAMP_RELATIVE_TO_TERRAIN )
             {
-                osg::ref_ptr<const SpatialReference> featureSRSwithMapVertDatum = !vertEquiv ?
-                    SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString()) : 0L;
-
                 if ( perVertex )
                 {
-                    std::vector<double> elevations;
-                    elevations.reserve( geom->size() );
-
-                    if ( eq.getElevations( geom->asVector(), featureSRS, elevations, _maxRes ) )
+                    for( unsigned i=0; i<geom->size(); ++i )
                     {
-                        for( unsigned i=0; i<geom->size(); ++i )
-                        {
-                            osg::Vec3d& p = (*geom)[i];
+                        osg::Vec3d& p = (*geom)[i];
+                        double elevation = elevations[first+i] != NO_DATA_VALUE ? elevations[first+i] : 0.0;
 
-                            p.z() *= scaleZ;
-                            p.z() += offsetZ;
+                        p.z() *= scaleZ;
+                        p.z() += offsetZ;
 
-                            double hat = p.z();
-                            p.z() = elevations[i] + p.z();
+                        double hat = p.z();
+                        p.z() = elevation + p.z();
 
-                            // if necessary, convert the Z value (which is now in the map's SRS) back to
-                            // the feature's SRS.
-                            if ( !vertEquiv )
-                            {
-                                featureSRSwithMapVertDatum->transform(p, featureSRS, p);
-                            }
+                        // if necessary, convert the Z value (which is now in the map's SRS) back to
+                        // the feature's SRS.
+                        if ( !vertEquiv )
+                        {
+                            featureSRSwithMapVertDatum->transform(p, featureSRS, p);
+                        }
 
-                            if ( hat > maxHAT )
-                                maxHAT = hat;
-                            if ( hat < minHAT )
-                                minHAT = hat;
+                        if ( hat > maxHAT )
+                            maxHAT = hat;
+                        if ( hat < minHAT )
+                            minHAT = hat;
 
-                            if ( elevations[i] > maxTerrainZ )
-                                maxTerrainZ = elevations[i];
-                            if ( elevations[i] < minTerrainZ )
-                                minTerrainZ = elevations[i];
-                        }
+                        if ( elevation > maxTerrainZ )
+                            maxTerrainZ = elevation;
+                        if ( elevation < minTerrainZ )
+                            minTerrainZ = elevation;
                     }
                 }
                 else // per-centroid
                 {
-                    osgEarth::Bounds bounds = geom->getBounds();
-                    const osg::Vec2d& center = bounds.center2d();
-                    GeoPoint centroid(featureSRS, center.x(), center.y());
-                    double   centroidElevation;
+                    double centroidElevation = elevations[first];
 
-                    if ( eq.getElevation( centroid, centroidElevation, _maxRes ) )
+                    if ( centroidElevation != NO_DATA_VALUE )
                     {
                         for( unsigned i=0; i<geom->size(); ++i )
                         {
@@ -371,35 +422,25 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             {
                 if ( perVertex )
                 {
-                    eq.getElevations( geom->asVector(), featureSRS, true, _maxRes );
-                    
-                    // if necessary, transform the Z values (which are now in the map SRS) back
-                    // into the feature's SRS.
-                    if ( !vertEquiv )
+                    for( unsigned i=0; i<geom->size(); ++i )
                     {
-                        osg::ref_ptr<const SpatialReference> featureSRSwithMapVertDatum =
-                            SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString());
+                        osg::Vec3d& p = (*geom)[i];
+                        if ( elevations[first+i] != NO_DATA_VALUE )
+                            p.z() = elevations[first+i];
 
-                        osg::Vec3d tempgeo;
-                        for( unsigned i=0; i<geom->size(); ++i )
+                        // if necessary, transform the Z value (which is now in the map SRS) back
+                        // into the feature's SRS.
+                        if ( !vertEquiv )
                         {
-                            osg::Vec3d& p = (*geom)[i];
                             featureSRSwithMapVertDatum->transform(p, featureSRS, p);
                         }
                     }
                 }
                 else // per-centroid
                 {
-                    osgEarth::Bounds bounds = geom->getBounds();
-                    const osg::Vec2d& center = bounds.center2d();
-                    GeoPoint centroid(featureSRS, center.x(), center.y());
-                    double   centroidElevation;
-
-                    osg::ref_ptr<const SpatialReference> featureSRSWithMapVertDatum;
-                    if ( !vertEquiv )
-                        featureSRSWithMapVertDatum = SpatialReference::create(featureSRS->getHorizInitString(), mapSRS->getVertInitString());
+                    double centroidElevation = elevations[first];
 
-                    if ( eq.getElevation( centroid, centroidElevation, _maxRes ) )
+                    if ( centroidElevation != NO_DATA_VALUE )
                     {
                         for( unsigned i=0; i<geom->size(); ++i )
                         {
@@ -407,7 +448,7 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
                             p.z() = centroidElevation;
                             if ( !vertEquiv )
                             {
-                                featureSRSWithMapVertDatum->transform(p, featureSRS, p);
+                                featureSRSwithMapVertDatum->transform(p, featureSRS, p);
                             }
                         }
                     }
@@ -436,4 +477,9 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
             feature->set( "__max_terrain_z", maxTerrainZ );
         }
     }
+
+    _clampingTime = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    OE_DEBUG << LC << "Clamped " << features.size() << " features (" << samplePoints.size()
+        << " samples) in " << _clampingTime << " s" << std::endl;
 }
@@ -92,10 +92,26 @@ namespace
     }
 }
 
+namespace
+{
+    // whether a geometry has any (untessellated) polygon outlines.
+    bool hasPolygonPrimitives(const osg::Geometry* geom)
+    {
+        for(unsigned i=0; i<geom->getNumPrimitiveSets(); ++i)
+        {
+            GLenum mode = geom->getPrimitiveSet(i)->getMode();
+            if ( mode == osg::PrimitiveSet::LINE_LOOP || mode == osg::PrimitiveSet::POLYGON )
+                return true;
+        }
+        return false;
+    }
+}
+
 BuildGeometryFilter::BuildGeometryFilter( const Style& style ) :
 _style        ( style ),
 _maxAngle_deg ( 180.0 ),
-_geoInterp    ( GEOINTERP_RHUMB_LINE )
+_geoInterp    ( GEOINTERP_RHUMB_LINE ),
+_tessellator  ( Tessellator::METHOD_EAR_CLIPPING )
 {
     //nop
 }
@@ -621,9 +637,12 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
     }
     
 
-    if ( tessellate )
+    if ( tessellate && hasPolygonPrimitives(osgGeom) )
     {
         osgEarth::Tessellator oeTess;
+        oeTess.setMethod( *_tessellator );
+        // the z-order path may already have emitted triangles for some rings.
+        oeTess.setKeepOtherPrimitives( _tessellator == Tessellator::METHOD_ZORDER_EAR_CLIPPING );
         if (!oeTess.tessellateGeometry(*osgGeom))
         {
             //fallback to osg tessellator
@@ -642,9 +661,12 @@ BuildGeometryFilter::tileAndBuildPolygon(Geometry*               ring,
 
     // non-cropped way
     buildPolygon(ring, featureSRS, mapSRS, makeECEF, tessellate, osgGeom, world2local);
-    if ( tessellate )
+    if ( tessellate && hasPolygonPrimitives(osgGeom) )
     {
         osgEarth::Tessellator oeTess;
+        oeTess.setMethod( *_tessellator );
+        // the z-order path may already have emitted triangles for some rings.
+        oeTess.setKeepOtherPrimitives( _tessellator == Tessellator::METHOD_ZORDER_EAR_CLIPPING );
         if (!oeTess.tessellateGeometry(*osgGeom))
         {
             //fallback to osg tessellator
@@ -678,6 +700,54 @@ BuildGeometryFilter::buildPolygon(Geometry*               ring,
     transformAndLocalize( ring->asVector(), featureSRS, allPoints.get(), mapSRS, world2local, makeECEF );
 
     Polygon* poly = dynamic_cast<Polygon*>(ring);
+
+    // The z-order tessellator bridges the holes itself, so hand it the rings
+    // as-is and emit triangles directly. If it fails, fall through and build
+    // the bridged outline for the tessellate pass in tileAndBuildPolygon.
+    if ( tessellate && _tessellator == Tessellator::METHOD_ZORDER_EAR_CLIPPING )
+    {
+        osg::ref_ptr<osg::Vec3Array> rings = new osg::Vec3Array( allPoints->begin(), allPoints->end() );
+        std::vector<unsigned> holeStarts;
+
+        if ( poly )
+        {
+            for( RingCollection::const_iterator h = poly->getHoles().begin(); h != poly->getHoles().end(); ++h )
+            {
+                Geometry* hole = h->get();
+                if ( hole->isValid() )
+                {
+                    holeStarts.push_back( rings->size() );
+                    transformAndLocalize( hole->asVector(), featureSRS, rings.get(), mapSRS, world2local, makeECEF );
+                }
+            }
+        }
+
+        std::vector<unsigned> indices;
+        Tessellator tess;
+        if ( tess.tessellatePolygon(*rings, 0, rings->size(), holeStarts, indices) )
+        {
+            osg::Vec3Array* v = static_cast<osg::Vec3Array*>(osgGeom->getVertexArray());
+            if ( !v )
+            {
+                v = new osg::Vec3Array();
+                osgGeom->setVertexArray( v );
+            }
+
+            unsigned offset = v->size();
+            std::copy(rings->begin(), rings->end(), std::back_inserter(*v));
+
+            osg::DrawElementsUInt* tris = new osg::DrawElementsUInt( GL_TRIANGLES );
+            tris->reserve( indices.size() );
+            for(std::vector<unsigned>::const_iterator i = indices.begin(); i != indices.end(); ++i)
+                tris->push_back( offset + *i );
+            osgGeom->addPrimitiveSet( tris );
+
+            return;
+        }
+
+        OE_DEBUG << LC << "Z-order tessellation failed; using hole bridging (" << osgGeom->getName() << ")" << std::endl;
+    }
+
     if ( poly )
     {
         RingCollection ordered(poly->getHoles().begin(), poly->getHoles().end());
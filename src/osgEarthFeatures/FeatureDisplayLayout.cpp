@@ -26,8 +26,10 @@ using namespace osgEarth::Symbology;
 //------------------------------------------------------------------------
 
 FeatureLevel::FeatureLevel( const Config& conf ) :
-_minRange( 0.0f ),
-_maxRange( FLT_MAX )
+_minRange         ( 0.0f ),
+_maxRange         ( FLT_MAX ),
+_simplifyTolerance( 0.0f ),
+_simplifyMethod   ( SimplifyFilter::METHOD_DOUGLAS_PEUCKER )
 {
     fromConfig( conf );
 }
@@ -52,6 +54,9 @@ FeatureLevel::fromConfig( const Config& conf )
     conf.getIfSet( "max_range", _maxRange );
     conf.getIfSet( "style",     _styleName ); 
     conf.getIfSet( "class",     _styleName ); // alias
+    conf.getIfSet( "simplify_tolerance", _simplifyTolerance );
+    conf.getIfSet( "simplify_method", "douglas_peucker", _simplifyMethod, SimplifyFilter::METHOD_DOUGLAS_PEUCKER );
+    conf.getIfSet( "simplify_method", "visvalingam",     _simplifyMethod, SimplifyFilter::METHOD_VISVALINGAM );
 }
 
 Config
@@ -61,6 +66,9 @@ FeatureLevel::getConfig() const
     conf.addIfSet( "min_range", _minRange );
     conf.addIfSet( "max_range", _maxRange );
     conf.addIfSet( "style",     _styleName );
+    conf.addIfSet( "simplify_tolerance", _simplifyTolerance );
+    conf.addIfSet( "simplify_method", "douglas_peucker", _simplifyMethod, SimplifyFilter::METHOD_DOUGLAS_PEUCKER );
+    conf.addIfSet( "simplify_method", "visvalingam",     _simplifyMethod, SimplifyFilter::METHOD_VISVALINGAM );
     return conf;
 }
 
@@ -33,7 +33,9 @@
 #include <osgEarth/FadeEffect>
 #include <osgEarth/NodeUtils>
 #include <osgEarth/Registry>
+#include <osgEarth/StringUtils>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/Units>
 
 #include <osg/CullFace>
 #include <osg/PagedLOD>
@@ -56,6 +58,9 @@ using namespace osgEarth::Symbology;
 #define OE_TEST OE_NULL
 //#define OE_TEST OE_NOTICE
 
+// number of simplified feature sets to keep in memory
+#define SIMPLIFIED_CACHE_SIZE 128
+
 namespace
 {
     // callback to force features onto the high-latency queue.
@@ -251,7 +256,9 @@ _overlayInstalled   ( 0L ),
 _overlayPlaceholder ( 0L ),
 _clampable          ( 0L ),
 _drapeable          ( 0L ),
-_overlayChange      ( OVERLAY_NO_CHANGE )
+_overlayChange      ( OVERLAY_NO_CHANGE ),
+_simplifiedCache    ( true, SIMPLIFIED_CACHE_SIZE ),
+_selectorTableSheet ( 0L )
 {
     ctor();
 }
@@ -273,7 +280,9 @@ _overlayInstalled   ( 0L ),
 _overlayPlaceholder ( 0L ),
 _clampable          ( 0L ),
 _drapeable          ( 0L ),
-_overlayChange      ( OVERLAY_NO_CHANGE )
+_overlayChange      ( OVERLAY_NO_CHANGE ),
+_simplifiedCache    ( true, SIMPLIFIED_CACHE_SIZE ),
+_selectorTableSheet ( 0L )
 {
     ctor();
 }
@@ -494,6 +503,10 @@ void
 FeatureModelGraph::dirty()
 {
     _dirty = true;
+    _simplifiedCache.clear();
+
+    Threading::ScopedMutexLock lock( _selectorTableMutex );
+    _selectorTable = 0L;
 }
 
 std::ostream& operator << (std::ostream& in, const osg::Vec3d& v) { in << v.x() << ", " << v.y() << ", " << v.z(); return in; }
@@ -964,7 +977,7 @@ FeatureModelGraph::buildLevel( const FeatureLevel& level, const GeoExtent& exten
         if ( style )
         {
             // found a specific style to use.
-            node = createStyleGroup( *style, query, index );
+            node = createStyleGroup( *style, query, index, &level );
             if ( node )
                 group->addChild( node );
         }
@@ -973,7 +986,7 @@ FeatureModelGraph::buildLevel( const FeatureLevel& level, const GeoExtent& exten
             const StyleSelector* selector = _session->styles()->getSelector( *level.styleName() );
             if ( selector )
             {
-                buildStyleGroups( selector, query, index, group.get() );
+                buildStyleGroups( selector, query, index, group.get(), &level );
             }
         }
     }
@@ -989,7 +1002,7 @@ FeatureModelGraph::buildLevel( const FeatureLevel& level, const GeoExtent& exten
                 *_session->getFeatureSource()->getFeatureSourceOptions().name() );
         }
 
-        osg::Node* node = build( defaultStyle, query, extent, index );
+        osg::Node* node = build( defaultStyle, query, extent, index, &level );
         if ( node )
             group->addChild( node );
     }
@@ -1047,7 +1060,8 @@ osg::Group*
 FeatureModelGraph::build(const Style&         defaultStyle, 
                          const Query&         baseQuery, 
                          const GeoExtent&     workingExtent,
-                         FeatureIndexBuilder* index)
+                         FeatureIndexBuilder* index,
+                         const FeatureLevel*  level)
 {
     osg::ref_ptr<osg::Group> group = new osg::Group();
 
@@ -1109,21 +1123,68 @@ FeatureModelGraph::build(const Style&         defaultStyle,
         // a create a node for each style group.
         if ( styles->selectors().size() > 0 )
         {
-            for( StyleSelectorList::const_iterator i = styles->selectors().begin(); i != styles->selectors().end(); ++i )
+            osg::ref_ptr<StyleSelectorTable> table = getStyleSelectorTable();
+
+            // sort the features for all the compiled selectors out of a single query,
+            // instead of re-querying the source once per selector.
+            const FeatureProfile* featureProfile = source->getFeatureProfile();
+            Bounds bounds = baseQuery.bounds().isSet() ? *baseQuery.bounds() : featureProfile->getExtent().bounds();
+            FilterContext binContext( _session.get(), featureProfile, GeoExtent(featureProfile->getSRS(), bounds), index );
+
+            StyleSelectorTable::Bins bins;
+            if ( table->getNumCompiled() > 0 )
+            {
+                Query query( baseQuery );
+                query.setMap( _session->getMap() );
+
+                FeatureList features;
+                queryFeatures( query, level, index, features );
+                table->sort( features, binContext, bins );
+            }
+
+            StyleSelectorTable::Bins::iterator bin = bins.begin();
+
+            for( unsigned s = 0; s < table->getNumSelectors(); ++s )
             {
                 // pull the selected style...
-                const StyleSelector& sel = *i;
+                const StyleSelector& sel = table->getSelector( s );
+
+                // the selector was compiled; its features are already sorted.
+                if ( table->isCompiled(s) )
+                {
+                    for( ; bin != bins.end() && bin->selector == s; ++bin )
+                    {
+                        Style combinedStyle;
+
+                        // an expression selector skips features whose style does not resolve.
+                        if ( sel.styleExpression().isSet() )
+                        {
+                            resolveExpressionStyle( bin->styleKey, *sel.styleExpression(), combinedStyle );
+                            if ( combinedStyle.empty() )
+                                continue;
+                        }
+                        else
+                        {
+                            const Style* selectedStyle = styles->getStyle( bin->styleKey );
+                            combinedStyle = selectedStyle ? defaultStyle.combineWith( *selectedStyle ) : defaultStyle;
+                        }
+
+                        osg::Group* styleGroup = createStyleGroup( combinedStyle, bin->features, binContext );
+                        if ( styleGroup && !group->containsNode(styleGroup) )
+                            group->addChild( styleGroup );
+                    }
+                }
 
                 // if the selector uses an expression to select the style name, then we must perform the
                 // query and then SORT the features into style groups.
-                if ( sel.styleExpression().isSet() )
+                else if ( sel.styleExpression().isSet() )
                 {
                     // merge the selector's query into the existing query
                     Query combinedQuery = baseQuery.combineWith( *sel.query() );
                     combinedQuery.setMap( _session->getMap() );
 
                     // query, sort, and add each style group to th parent:
-                    queryAndSortIntoStyleGroups( combinedQuery, *sel.styleExpression(), index, group );
+                    queryAndSortIntoStyleGroups( combinedQuery, *sel.styleExpression(), index, group, level );
                 }
 
                 // otherwise, all feature returned by this query will have the same style:
@@ -1138,7 +1199,7 @@ FeatureModelGraph::build(const Style&         defaultStyle,
                     combinedQuery.setMap( _session->getMap() );
 
                     // then create the node.
-                    osg::Group* styleGroup = createStyleGroup( combinedStyle, combinedQuery, index );
+                    osg::Group* styleGroup = createStyleGroup( combinedStyle, combinedQuery, index, level );
 
                     if ( styleGroup && !group->containsNode(styleGroup) )
                         group->addChild( styleGroup );
@@ -1165,7 +1226,7 @@ FeatureModelGraph::build(const Style&         defaultStyle,
             if ( defaultStyle.empty() )
                 combinedStyle = *styles->getDefaultStyle();
 
-            osg::Group* styleGroup = createStyleGroup( combinedStyle, baseQuery, index );
+            osg::Group* styleGroup = createStyleGroup( combinedStyle, baseQuery, index, level );
 
             if ( styleGroup && !group->containsNode(styleGroup) )
                 group->addChild( styleGroup );
@@ -1183,7 +1244,8 @@ void
 FeatureModelGraph::buildStyleGroups(const StyleSelector* selector,
                                     const Query&         baseQuery,
                                     FeatureIndexBuilder* index,
-                                    osg::Group*          parent)
+                                    osg::Group*          parent,
+                                    const FeatureLevel*  level)
 {
     OE_TEST << LC << "buildStyleGroups: " << selector->name() << std::endl;
 
@@ -1196,7 +1258,7 @@ FeatureModelGraph::buildStyleGroups(const StyleSelector* selector,
         combinedQuery.setMap( _session->getMap() );
 
         // query, sort, and add each style group to the parent:
-        queryAndSortIntoStyleGroups( combinedQuery, *selector->styleExpression(), index, parent );
+        queryAndSortIntoStyleGroups( combinedQuery, *selector->styleExpression(), index, parent, level );
     }
 
     // otherwise, all feature returned by this query will have the same style:
@@ -1213,7 +1275,7 @@ FeatureModelGraph::buildStyleGroups(const StyleSelector* selector,
         combinedQuery.setMap( _session->getMap() );
 
         // then create the node.
-        osg::Node* node = createStyleGroup( style, combinedQuery, index );
+        osg::Node* node = createStyleGroup( style, combinedQuery, index, level );
         if ( node && !parent->containsNode(node) )
             parent->addChild( node );
     }
@@ -1231,7 +1293,8 @@ void
 FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
                                                const StringExpression& styleExpr,
                                                FeatureIndexBuilder*    index,
-                                               osg::Group*             parent)
+                                               osg::Group*             parent,
+                                               const FeatureLevel*     level)
 {
     // the profile of the features
     const FeatureProfile* featureProfile = _session->getFeatureSource()->getFeatureProfile();
@@ -1240,8 +1303,9 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
     const GeoExtent& extent = featureProfile->getExtent();
     
     // query the feature source:
-    osg::ref_ptr<FeatureCursor> cursor = _session->getFeatureSource()->createFeatureCursor( query );
-    if ( !cursor.valid() )
+    FeatureList features;
+    queryFeatures( query, level, index, features );
+    if ( features.empty() )
         return;
 
     // establish the working bounds and a context:
@@ -1251,14 +1315,11 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
 
     // visit each feature and run the expression to sort it into a bin.
     std::map<std::string, FeatureList> styleBins;
-    while( cursor->hasMore() )
+    for( FeatureList::iterator i = features.begin(); i != features.end(); ++i )
     {
-        osg::ref_ptr<Feature> feature = cursor->nextFeature();
-        if ( feature.valid() )
-        {
-            const std::string& styleString = feature->eval( styleExprCopy, &context );
-            styleBins[styleString].push_back( feature.get() );
-        }
+        Feature* feature = i->get();
+        const std::string& styleString = feature->eval( styleExprCopy, &context );
+        styleBins[styleString].push_back( feature );
     }
 
     // next create a style group per bin.
@@ -1269,26 +1330,7 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
 
         // resolve the style:
         Style combinedStyle;
-
-        // if the style string begins with an open bracket, it's an inline style definition.
-        if ( styleString.length() > 0 && styleString.at(0) == '{' )
-        {
-            Config conf( "style", styleString );
-            conf.setReferrer( styleExpr.uriContext().referrer() );
-            conf.set( "type", "text/css" );
-            combinedStyle = Style(conf);
-        }
-
-        // otherwise, look up the style in the stylesheet. Do NOT fall back on a default
-        // style in this case: for style expressions, the user must be explicity about 
-        // default styling; this is because there is no other way to exclude unwanted
-        // features.
-        else
-        {
-            const Style* selectedStyle = _session->styles()->getStyle(styleString, false);
-            if ( selectedStyle )
-                combinedStyle = *selectedStyle;
-        }
+        resolveExpressionStyle( styleString, styleExpr, combinedStyle );
 
         // if there is a valid style, create the node and add it. (Otherwise we will skip
         // the feature.)
@@ -1302,6 +1344,61 @@ FeatureModelGraph::queryAndSortIntoStyleGroups(const Query&            query,
 }
 
 
+/**
+ * Resolves the result of a style expression to a style: either an inline
+ * CSS definition or the name of a style in the stylesheet.
+ */
+void
+FeatureModelGraph::resolveExpressionStyle(const std::string&      styleString,
+                                          const StringExpression& styleExpr,
+                                          Style&                  output) const
+{
+    // if the style string begins with an open bracket, it's an inline style definition.
+    if ( styleString.length() > 0 && styleString.at(0) == '{' )
+    {
+        Config conf( "style", styleString );
+        conf.setReferrer( styleExpr.uriContext().referrer() );
+        conf.set( "type", "text/css" );
+        output = Style(conf);
+    }
+
+    // otherwise, look up the style in the stylesheet. Do NOT fall back on a default
+    // style in this case: for style expressions, the user must be explicity about 
+    // default styling; this is because there is no other way to exclude unwanted
+    // features.
+    else
+    {
+        const Style* selectedStyle = _session->styles()->getStyle(styleString, false);
+        if ( selectedStyle )
+            output = *selectedStyle;
+    }
+}
+
+
+/**
+ * Returns the stylesheet's selectors compiled into a decision table,
+ * compiling them on first use (or when the stylesheet changes).
+ */
+osg::ref_ptr<StyleSelectorTable>
+FeatureModelGraph::getStyleSelectorTable()
+{
+    Threading::ScopedMutexLock lock( _selectorTableMutex );
+
+    const StyleSheet* styles = _session->styles();
+    if ( !_selectorTable.valid() ||
+         _selectorTableSheet != styles ||
+         _selectorTable->getNumSelectors() != styles->selectors().size() )
+    {
+        _selectorTable = new StyleSelectorTable( styles, _options.localSelectors() == true );
+        _selectorTableSheet = styles;
+
+        OE_DEBUG << LC << "Compiled " << _selectorTable->getNumCompiled() << " of "
+            << _selectorTable->getNumSelectors() << " style selectors" << std::endl;
+    }
+    return _selectorTable;
+}
+
+
 osg::Group*
 FeatureModelGraph::createStyleGroup(const Style&         style, 
                                     FeatureList&         workingSet, 
@@ -1365,7 +1462,8 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
 osg::Group*
 FeatureModelGraph::createStyleGroup(const Style&         style, 
                                     const Query&         query, 
-                                    FeatureIndexBuilder* index)
+                                    FeatureIndexBuilder* index,
+                                    const FeatureLevel*  level)
 {
     osg::Group* styleGroup = 0L;
 
@@ -1376,9 +1474,10 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
     const GeoExtent& extent = featureProfile->getExtent();
     
     // query the feature source:
-    osg::ref_ptr<FeatureCursor> cursor = _session->getFeatureSource()->createFeatureCursor( query );
+    FeatureList workingSet;
+    queryFeatures( query, level, index, workingSet );
 
-    if ( cursor.valid() && cursor->hasMore() )
+    if ( !workingSet.empty() )
     {
         Bounds cellBounds =
             query.bounds().isSet() ? *query.bounds() : extent.bounds();
@@ -1388,9 +1487,6 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
         // start by culling our feature list to the working extent. By default, this is done by
         // checking feature centroids. But the user can override this to crop feature geometry to
         // the cell boundaries.
-        FeatureList workingSet;
-        cursor->fill( workingSet );
-
         styleGroup = createStyleGroup(style, workingSet, context);
     }
 
@@ -1399,6 +1495,75 @@ FeatureModelGraph::createStyleGroup(const Style&         style,
 }
 
 
+/**
+ * Queries the feature source, and simplifies the results if the level
+ * calls for it. Simplified sets are cached, so revisiting a tile at the
+ * same level costs a copy instead of a query and a simplification pass.
+ * The tile's index, if any, learns how many features are coming so it
+ * can size its ID ranges.
+ */
+void
+FeatureModelGraph::queryFeatures(const Query&         query,
+                                 const FeatureLevel*  level,
+                                 FeatureIndexBuilder* index,
+                                 FeatureList&         output)
+{
+    FeatureSource* source = _session->getFeatureSource();
+    FeatureSourceIndexNode* indexNode = dynamic_cast<FeatureSourceIndexNode*>( index );
+
+    if ( !level || level->simplifyTolerance().getOrUse(0.0f) <= 0.0f )
+    {
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor( query );
+        if ( cursor.valid() )
+            cursor->fill( output );
+        if ( indexNode )
+            indexNode->expectFeatures( output.size() );
+        return;
+    }
+
+    // the level tolerance is in meters; the filter works in feature SRS units.
+    const SpatialReference* srs = source->getFeatureProfile()->getSRS();
+    double tolerance = level->simplifyTolerance().get();
+    if ( srs->isGeographic() )
+        tolerance /= srs->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0;
+    else if ( Units::canConvert(Units::METERS, srs->getUnits()) )
+        tolerance = Units::METERS.convertTo( srs->getUnits(), tolerance );
+
+    std::string key = Stringify()
+        << tolerance << "|" << (int)level->simplifyMethod().get() << "|" << query.getConfig().toJSON(false);
+
+    FeatureList simplified;
+    LRUCache<std::string, FeatureList>::Record rec;
+    if ( _simplifiedCache.get(key, rec) )
+    {
+        simplified = rec.value();
+    }
+    else
+    {
+        osg::ref_ptr<FeatureCursor> cursor = source->createFeatureCursor( query );
+        if ( cursor.valid() )
+            cursor->fill( simplified );
+
+        SimplifyFilter simplify( tolerance );
+        simplify.method() = level->simplifyMethod().get();
+        unsigned removed = simplify.simplify( simplified );
+
+        OE_DEBUG << LC << "Simplified " << simplified.size() << " features (" << removed << " points removed)" << std::endl;
+
+        _simplifiedCache.insert( key, simplified );
+    }
+
+    // hand out copies, since the filters downstream modify features in place.
+    for( FeatureList::const_iterator i = simplified.begin(); i != simplified.end(); ++i )
+    {
+        output.push_back( new Feature(*i->get(), osg::CopyOp::DEEP_COPY_ALL) );
+    }
+
+    if ( indexNode )
+        indexNode->expectFeatures( simplified.size() );
+}
+
+
 void
 FeatureModelGraph::checkForGlobalStyles( const Style& style )
 {
@@ -1609,6 +1774,9 @@ FeatureModelGraph::redraw()
             _session->getFeatureSource(),
             Registry::objectIndex(),
             _options.featureIndexing().get() );
+
+        // tiles that use compact IDs override this with their own base.
+        Registry::objectIndex()->tagBase( this, 0u );
     }
 
     // zero out any decorators
@@ -20,6 +20,7 @@
 #include <osgEarthFeatures/ResampleFilter>
 #include <osgEarthFeatures/BufferFilter>
 #include <osgEarthFeatures/ConvertTypeFilter>
+#include <osgEarthFeatures/InMemoryFeatureSource>
 #include <osgEarth/Registry>
 #include <osg/Notify>
 #include <osgDB/ReadFile>
@@ -32,7 +33,8 @@ using namespace osgEarth::Symbology;
 using namespace OpenThreads;
 
 FeatureSourceOptions::FeatureSourceOptions(const ConfigOptions& options) :
-DriverConfigOptions( options )
+DriverConfigOptions( options ),
+_inMemory          ( false )
 {
     fromConfig( _conf );
 }
@@ -52,6 +54,7 @@ FeatureSourceOptions::fromConfig( const Config& conf )
     conf.getObjIfSet( "cache_policy", _cachePolicy );
     conf.getIfSet   ( "geo_interpolation", "great_circle", _geoInterp, GEOINTERP_GREAT_CIRCLE );
     conf.getIfSet   ( "geo_interpolation", "rhumb_line",   _geoInterp, GEOINTERP_RHUMB_LINE );
+    conf.getIfSet   ( "in_memory",    _inMemory );
 
     const ConfigSet& children = conf.children();
     for( ConfigSet::const_iterator i = children.begin(); i != children.end(); ++i )
@@ -99,6 +102,7 @@ FeatureSourceOptions::getConfig() const
     conf.updateObjIfSet( "cache_policy", _cachePolicy );
     conf.updateIfSet   ( "geo_interpolation", "great_circle", _geoInterp, GEOINTERP_GREAT_CIRCLE );
     conf.updateIfSet   ( "geo_interpolation", "rhumb_line",   _geoInterp, GEOINTERP_RHUMB_LINE );
+    conf.updateIfSet   ( "in_memory",    _inMemory );
     
     for( FeatureFilterList::const_iterator i = _filters.begin(); i != _filters.end(); ++i )
     {
@@ -208,6 +212,11 @@ FeatureSourceFactory::create( const FeatureSourceOptions& options )
                 featureSource->setName( *options.name() );
             else
                 featureSource->setName( options.getDriver() );
+
+            if ( options.inMemory() == true )
+            {
+                featureSource = new InMemoryFeatureSource( featureSource );
+            }
         }
         else
         {
@@ -27,37 +27,23 @@ using namespace osgEarth::Features;
 //#undef  OE_DEBUG
 //#define OE_DEBUG OE_INFO
 
-namespace
-{
-    // nifty template to iterate over a map's keys
-    template<typename T>
-    struct KeyIter : public T::iterator
-    {
-        KeyIter() : T::iterator() { }
-        KeyIter(typename T::iterator i) : T::iterator(i) { }
-        typename T::key_type* operator->() { return (typename T::key_type* const)&(T::iterator::operator->()->first); }
-        typename T::key_type operator*() { return T::iterator::operator*().first; }
-    };
-
-    template<typename T>
-    struct ConstKeyIter : public T::const_iterator
-    {
-        ConstKeyIter() : T::const_iterator() { }
-        ConstKeyIter(typename T::const_iterator i) : T::const_iterator(i) { }
-        typename T::key_type* operator->() { return (typename T::key_type* const)&(T::const_iterator::operator->()->first); }
-        typename T::key_type operator*() { return T::const_iterator::operator*().first; }
-    };
-}
+// Number of object IDs a tile reserves at a time
+#define RANGE_SIZE 256u
+
+// Most object IDs a tile that uses compact IDs can hold
+#define COMPACT_RANGE_SIZE 65535u
 
 //-----------------------------------------------------------------------------
 
 
 FeatureSourceIndexOptions::FeatureSourceIndexOptions(const Config& conf) :
 _enabled      ( true ),
-_embedFeatures( false )
+_embedFeatures( false ),
+_compactIDs   ( false )
 {
     conf.getIfSet( "enabled",        _enabled );
     conf.getIfSet( "embed_features", _embedFeatures );
+    conf.getIfSet( "compact_ids",    _compactIDs );
 }
 
 Config
@@ -66,6 +52,7 @@ FeatureSourceIndexOptions::getConfig() const
     Config conf("feature_indexing");
     conf.addIfSet( "enabled",        _enabled );
     conf.addIfSet( "embed_features", _embedFeatures );
+    conf.addIfSet( "compact_ids",    _compactIDs );
     return conf;
 }
 
@@ -87,51 +74,85 @@ FeatureSourceIndexNode::~FeatureSourceIndexNode()
 {
     if ( _index.valid() )
     {
-        // must copy and clear the original list first to dereference the RefIDPair instances.
-        std::set<FeatureID> fidsToRemove;
-        fidsToRemove.insert( KeyIter<FIDMap>(_fids.begin()), KeyIter<FIDMap>(_fids.end()) );
-        _fids.clear();
+        OE_DEBUG << LC << "Removing " << _ranges._oids.size() << " fids\n";
+        _index->release( _ranges );
+    }
+}
 
-        OE_DEBUG << LC << "Removing " << fidsToRemove.size() << " fids\n";
-        _index->removeFIDs( fidsToRemove.begin(), fidsToRemove.end() );
+ObjectID
+FeatureSourceIndexNode::assign(Feature* feature)
+{
+    // assume the mutex is locked
+    ObjectID base = _ranges._base;
+    ObjectID oid  = _index->assign( feature, _ranges );
+
+    // the first compact range sets the base for the whole tile.
+    if ( _ranges._base != base )
+    {
+        _index->getMasterIndex()->tagBase( this, _ranges._base );
     }
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagDrawable(osg::Drawable* drawable, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagDrawable( drawable, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    Threading::ScopedMutexLock lock( _mutex );
+    ObjectID oid = assign( feature );
+    if ( oid == OSGEARTH_OBJECTID_EMPTY ) return oid;
+
+    if ( _index->getCompactIDs() )
+        _index->getMasterIndex()->tagDrawable( drawable, oid, _ranges._base );
+    else
+        _index->getMasterIndex()->tagDrawable( drawable, oid );
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagAllDrawables(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagAllDrawables( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    Threading::ScopedMutexLock lock( _mutex );
+    ObjectID oid = assign( feature );
+    if ( oid == OSGEARTH_OBJECTID_EMPTY ) return oid;
+
+    if ( _index->getCompactIDs() )
+        _index->getMasterIndex()->tagAllDrawables( node, oid, _ranges._base );
+    else
+        _index->getMasterIndex()->tagAllDrawables( node, oid );
+    return oid;
 }
 
 ObjectID
 FeatureSourceIndexNode::tagNode(osg::Node* node, Feature* feature)
 {
     if ( !feature || !_index.valid() ) return OSGEARTH_OBJECTID_EMPTY;
-    RefIDPair* r = _index->tagNode( node, feature );
-    if ( r ) _fids[ feature->getFID() ] = r;
-    return r ? r->_oid : OSGEARTH_OBJECTID_EMPTY;
+    Threading::ScopedMutexLock lock( _mutex );
+    ObjectID oid = assign( feature );
+    if ( oid == OSGEARTH_OBJECTID_EMPTY ) return oid;
+
+    // the node uniform always holds a full ID.
+    _index->getMasterIndex()->tagNode( node, oid );
+
+    OE_DEBUG << LC << "Tagging feature ID = " << feature->getFID() << " => " << oid << " (" << feature->getString("name") << ")\n";
+    return oid;
+}
+
+void
+FeatureSourceIndexNode::expectFeatures(unsigned count)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _ranges._expected += count;
 }
 
 bool
 FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
 {
-    ConstKeyIter<FIDMap> start( _fids.begin() );
-    ConstKeyIter<FIDMap> end  ( _fids.end() );
-    for(ConstKeyIter<FIDMap> i = start; i != end; ++i )
+    Threading::ScopedMutexLock lock( _mutex );
+    for(std::map<FeatureID, ObjectID>::const_iterator i = _ranges._oids.begin(); i != _ranges._oids.end(); ++i)
     {
-        output.push_back( *i );
+        output.push_back( i->first );
     }
 
     return true;
@@ -142,132 +163,199 @@ FeatureSourceIndexNode::getAllFIDs(std::vector<FeatureID>& output) const
 #undef  LC
 #define LC "[FeatureSourceIndex] "
 
-FeatureSourceIndex::FeatureSourceIndex(FeatureSource* featureSource, 
+FeatureSourceIndex::FeatureSourceIndex(FeatureSource* featureSource,
                                        ObjectIndex*   index,
                                        const FeatureSourceIndexOptions& options) :
-_featureSource  ( featureSource ), 
+_featureSource  ( featureSource ),
 _masterIndex    ( index ),
-_options        ( options )
+_options        ( options ),
+_size           ( 0u )
 {
-    _embed = 
+    _embed =
         _options.embedFeatures() == true ||
         featureSource == 0L ||
         featureSource->supportsGetFeature() == false;
+
+    _compact = _options.compactIDs() == true;
 }
 
 FeatureSourceIndex::~FeatureSourceIndex()
 {
-    if ( _masterIndex.valid() && !_oids.empty() )
+    if ( _masterIndex.valid() )
     {
-        // remove all OIDs from the master index.
-        _masterIndex->remove( KeyIter<OIDMap>(_oids.begin()), KeyIter<OIDMap>(_oids.end()) );
+        // remove all remaining ranges from the master index.
+        for(RangeMap::iterator i = _ranges.begin(); i != _ranges.end(); ++i)
+        {
+            _masterIndex->removeRange( i->first, i->second->_capacity );
+        }
     }
 
-    _oids.clear();
+    _ranges.clear();
     _fids.clear();
-    _embeddedFeatures.clear();
 }
 
-RefIDPair*
-FeatureSourceIndex::tagDrawable(osg::Drawable* drawable, Feature* feature)
+int
+FeatureSourceIndex::size() const
 {
-    if ( !feature ) return 0L;
-
     Threading::ScopedMutexLock lock(_mutex);
-    
-    RefIDPair* p = 0L;
+    return _size;
+}
+
+ObjectIDRange*
+FeatureSourceIndex::getRange(ObjectID oid) const
+{
+    // assume the mutex is locked
+    RangeMap::const_iterator i = _ranges.upper_bound( oid );
+    if ( i == _ranges.begin() )
+        return 0L;
+    --i;
+    ObjectIDRange* range = i->second.get();
+    return oid - range->_first < range->_fids.size() ? range : 0L;
+}
+
+ObjectID
+FeatureSourceIndex::assign(Feature* feature, ObjectIDRanges& tile)
+{
+    if ( !feature || !_masterIndex.valid() ) return OSGEARTH_OBJECTID_EMPTY;
+
     FeatureID fid = feature->getFID();
 
-    FIDMap::const_iterator f = _fids.find( fid );
-    if ( f != _fids.end() )
-    {
-        ObjectID oid = f->second->_oid;
-        _masterIndex->tagDrawable( drawable, oid );
-        p = f->second.get();
-    }
-    else
+    // NOTE: the caller holds the tile's lock, but the tile's ranges are
+    // shared with the rest of the index, so do everything under ours.
+    Threading::ScopedMutexLock lock(_mutex);
+
+    // already tagged in this tile?
+    std::map<FeatureID, ObjectID>::const_iterator t = tile._oids.find( fid );
+    if ( t != tile._oids.end() )
+        return t->second;
+
+    // With full IDs, a feature that is already live in another tile keeps
+    // its ID, and this tile holds that tile's range as well.
+    if ( !_compact )
     {
-        ObjectID oid = _masterIndex->tagDrawable( drawable, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-    
-        if ( _embed )
+        FIDMap::const_iterator f = _fids.find( fid );
+        if ( f != _fids.end() )
         {
-            _embeddedFeatures[fid] = feature;
+            ObjectID oid = f->second;
+            ObjectIDRange* owner = getRange( oid );
+            if ( owner )
+            {
+                bool held = false;
+                for(unsigned i=0; i<tile._held.size() && !held; ++i)
+                    held = tile._held[i].get() == owner;
+
+                if ( !held )
+                {
+                    owner->_users++;
+                    tile._held.push_back( owner );
+                }
+                tile._oids[fid] = oid;
+                return oid;
+            }
         }
     }
 
-    return p;
-}
+    // reserve a new range if necessary.
+    if ( tile._current == 0L || tile._current->_fids.size() == tile._current->_capacity )
+    {
+        unsigned capacity = RANGE_SIZE;
+        ObjectID first    = OSGEARTH_OBJECTID_EMPTY;
 
-RefIDPair*
-FeatureSourceIndex::tagAllDrawables(osg::Node* node, Feature* feature)
-{
-    if ( !feature ) return 0L;
+        if ( _compact )
+        {
+            // size the range from the features the tile still expects to tag;
+            // without a hint, go one block at a time.
+            unsigned assigned = tile._oids.size();
+            if ( tile._expected > assigned )
+                capacity = osg::minimum( tile._expected - assigned, COMPACT_RANGE_SIZE );
+
+            // the first range sets the tile's base; the later ones have to
+            // stay within reach of it.
+            if ( tile._base == OSGEARTH_OBJECTID_EMPTY )
+            {
+                first = _masterIndex->insertRange( this, capacity );
+            }
+            else
+            {
+                first = _masterIndex->insertRange( this, capacity, tile._base );
+                if ( first == OSGEARTH_OBJECTID_EMPTY && capacity > RANGE_SIZE )
+                {
+                    capacity = RANGE_SIZE;
+                    first = _masterIndex->insertRange( this, capacity, tile._base );
+                }
+            }
+
+            if ( first == OSGEARTH_OBJECTID_EMPTY )
+            {
+                OE_WARN << LC << "No compact IDs left for tile (max " << COMPACT_RANGE_SIZE << " features); "
+                    << "feature " << fid << " will not be indexed\n";
+                return OSGEARTH_OBJECTID_EMPTY;
+            }
+        }
+        else
+        {
+            first = _masterIndex->insertRange( this, capacity );
+            if ( first == OSGEARTH_OBJECTID_EMPTY )
+                return OSGEARTH_OBJECTID_EMPTY;
+        }
 
-    Threading::ScopedMutexLock lock(_mutex);
-    
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
+        ObjectIDRange* range = new ObjectIDRange( first, capacity );
+        range->_users = 1u;
+        _ranges[first] = range;
+        tile._held.push_back( range );
+        tile._current = range;
+
+        // compact offsets start at 1, since 0 means "no object".
+        if ( _compact && tile._base == OSGEARTH_OBJECTID_EMPTY )
+            tile._base = first - 1u;
+    }
 
-    FIDMap::const_iterator f = _fids.find( fid );
-    if ( f != _fids.end() )
+    ObjectIDRange* range = tile._current;
+    ObjectID oid = range->_first + range->_fids.size();
+    range->_fids.push_back( fid );
+    if ( _embed )
     {
-        ObjectID oid = f->second->_oid;
-        _masterIndex->tagAllDrawables( node, oid );
-        p = f->second.get();
+        range->_features.push_back( feature );
     }
-    else
+
+    if ( !_compact )
     {
-        ObjectID oid = _masterIndex->tagAllDrawables( node, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-    
-        if ( _embed )
-        {
-            _embeddedFeatures[fid] = feature;
-        }
+        _fids[fid] = oid;
     }
+    tile._oids[fid] = oid;
+    _size++;
 
-    return p;
+    return oid;
 }
 
-RefIDPair*
-FeatureSourceIndex::tagNode(osg::Node* node, Feature* feature)
+void
+FeatureSourceIndex::release(ObjectIDRanges& tile)
 {
-    if ( !feature ) return 0L;
-
     Threading::ScopedMutexLock lock(_mutex);
-    
-    RefIDPair* p = 0L;
-    FeatureID fid = feature->getFID();
-    ObjectID oid;
 
-    FIDMap::const_iterator f = _fids.find( fid );
-    if ( f != _fids.end() )
+    for(unsigned i=0; i<tile._held.size(); ++i)
     {
-        oid = f->second->_oid;
-        _masterIndex->tagNode( node, oid );
-        p = f->second.get();
-    }
-    else
-    {
-        oid = _masterIndex->tagNode( node, this );
-        p = new RefIDPair( fid, oid );
-        _fids[fid] = p;
-        _oids[oid] = fid;
-    
-        if ( _embed )
+        ObjectIDRange* range = tile._held[i].get();
+        if ( --range->_users > 0u )
+            continue;
+
+        for(unsigned j=0; j<range->_fids.size(); ++j)
         {
-            _embeddedFeatures[fid] = feature;
+            FIDMap::iterator f = _fids.find( range->_fids[j] );
+            if ( f != _fids.end() && f->second == range->_first + j )
+                _fids.erase( f );
         }
-    }
+        _size -= range->_fids.size();
 
-    OE_DEBUG << LC << "Tagging feature ID = " << fid << " => " << oid << " (" << feature->getString("name") << ")\n";
+        if ( _masterIndex.valid() )
+            _masterIndex->removeRange( range->_first, range->_capacity );
+
+        _ranges.erase( range->_first );
+    }
 
-    return p;
+    tile._held.clear();
+    tile._current = 0L;
+    tile._oids.clear();
 }
 
 Feature*
@@ -275,19 +363,18 @@ FeatureSourceIndex::getFeature(ObjectID oid) const
 {
     Feature* feature = 0L;
     Threading::ScopedMutexLock lock(_mutex);
-    OIDMap::const_iterator i = _oids.find( oid );
-    if ( i != _oids.end() )
+    ObjectIDRange* range = getRange( oid );
+    if ( range )
     {
-        FeatureID fid = i->second;
+        unsigned i = oid - range->_first;
 
         if ( _embed )
         {
-            FeatureMap::const_iterator j = _embeddedFeatures.find( fid );
-            feature = j != _embeddedFeatures.end() ? j->second.get() : 0L;
+            feature = i < range->_features.size() ? range->_features[i].get() : 0L;
         }
         else if ( _featureSource.valid() && _featureSource->supportsGetFeature() )
         {
-            feature = _featureSource->getFeature( fid );
+            feature = _featureSource->getFeature( range->_fids[i] );
         }
     }
     return feature;
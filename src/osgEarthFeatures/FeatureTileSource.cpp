@@ -31,7 +31,8 @@ using namespace osgEarth::Symbology;
 
 FeatureTileSourceOptions::FeatureTileSourceOptions( const ConfigOptions& options ) :
 TileSourceOptions( options ),
-_geomTypeOverride( Geometry::TYPE_UNKNOWN )
+_geomTypeOverride( Geometry::TYPE_UNKNOWN ),
+_geometryCacheSize( 0u )
 {
     fromConfig( _conf );
 }
@@ -43,6 +44,7 @@ FeatureTileSourceOptions::getConfig() const
 
     conf.updateObjIfSet( "features", _featureOptions );
     conf.updateObjIfSet( "styles", _styles );
+    conf.updateIfSet( "geometry_cache_size", _geometryCacheSize );
 
     if ( _geomTypeOverride.isSet() ) {
         if ( _geomTypeOverride == Geometry::TYPE_LINESTRING )
@@ -69,6 +71,8 @@ FeatureTileSourceOptions::fromConfig( const Config& conf )
     conf.getObjIfSet( "features", _featureOptions );
 
     conf.getObjIfSet( "styles", _styles );
+
+    conf.getIfSet( "geometry_cache_size", _geometryCacheSize );
     
     std::string gt = conf.value( "geometry_type" );
     if ( gt == "line" || gt == "lines" || gt == "linestring" )
@@ -136,6 +140,14 @@ FeatureTileSource::initialize(const osgDB::Options* dbOptions)
     // Create a session for feature processing. No map.
     _session = new Session( 0L, _options.styles().get(), _features.get(), dbOptions );
 
+    // Prepared geometry tiles, shared by the raster tiles under them:
+    if ( _options.geometryCacheSize() > 0u && supportsGeometryCache() )
+    {
+        _pyramid = new GeometryTilePyramid( _features.get(), getPixelsPerTile(), _options.geometryCacheSize().get() );
+        _pyramid->setGeometryTypeOverride( _options.geometryTypeOverride() );
+        OE_INFO << LC << "Geometry tile cache enabled (" << _options.geometryCacheSize().get() << " tiles)" << std::endl;
+    }
+
     _initialized = true;
     return STATUS_OK;
 }
@@ -206,18 +218,18 @@ FeatureTileSource::createImage( const TileKey& key, ProgressCallback* progress )
             {
                 const StyleSelector& sel = *i;
                 const Style* style = styles->getStyle( sel.getSelectedStyleName() );
-                queryAndRenderFeaturesForStyle( *style, sel.query().value(), buildData.get(), key.getExtent(), image.get() );
+                queryAndRenderFeaturesForStyle( *style, sel.query().value(), buildData.get(), key, image.get() );
             }
         }
         else
         {
             const Style* style = styles->getDefaultStyle();
-            queryAndRenderFeaturesForStyle( *style, Query(), buildData.get(), key.getExtent(), image.get() );
+            queryAndRenderFeaturesForStyle( *style, Query(), buildData.get(), key, image.get() );
         }
     }
     else
     {
-        queryAndRenderFeaturesForStyle( Style(), Query(), buildData.get(), key.getExtent(), image.get() );
+        queryAndRenderFeaturesForStyle( Style(), Query(), buildData.get(), key, image.get() );
     }
 
     // final tile processing after all styles are done
@@ -293,3 +305,22 @@ FeatureTileSource::queryAndRenderFeaturesForStyle(const Style&     style,
     }
 }
 
+bool
+FeatureTileSource::queryAndRenderFeaturesForStyle(const Style&     style,
+                                                  const Query&     query,
+                                                  osg::Referenced* data,
+                                                  const TileKey&   key,
+                                                  osg::Image*      out_image)
+{
+    if ( !_pyramid.valid() )
+    {
+        return queryAndRenderFeaturesForStyle( style, query, data, key.getExtent(), out_image );
+    }
+
+    // features come from the geometry tile, already in the image SRS.
+    FeatureList cellFeatures;
+    if ( !_pyramid->getFeatures(query, key, cellFeatures) || cellFeatures.empty() )
+        return false;
+
+    return renderFeaturesForStyle( _session.get(), style, cellFeatures, data, key.getExtent(), out_image );
+}
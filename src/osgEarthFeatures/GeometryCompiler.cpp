@@ -33,6 +33,7 @@
 #include <osgEarth/Capabilities>
 #include <osgEarth/ShaderGenerator>
 #include <osgEarth/ShaderUtils>
+#include <osgEarth/TaskService>
 #include <osgEarth/Utils>
 #include <osg/MatrixTransform>
 #include <osg/Timer>
@@ -71,7 +72,9 @@ _shaderPolicy          ( SHADERPOLICY_GENERATE ),
 _geoInterp             ( GEOINTERP_GREAT_CIRCLE ),
 _optimizeStateSharing  ( true ),
 _optimize              ( false ),
-_validate              ( false )
+_validate              ( false ),
+_tessellator           ( Tessellator::METHOD_EAR_CLIPPING ),
+_compileThreads        ( 1u )
 {
    //nop
 }
@@ -91,7 +94,9 @@ _shaderPolicy          ( s_defaults.shaderPolicy().value() ),
 _geoInterp             ( s_defaults.geoInterp().value() ),
 _optimizeStateSharing  ( s_defaults.optimizeStateSharing().value() ),
 _optimize              ( s_defaults.optimize().value() ),
-_validate              ( s_defaults.validate().value() )
+_validate              ( s_defaults.validate().value() ),
+_tessellator           ( s_defaults.tessellator().value() ),
+_compileThreads        ( s_defaults.compileThreads().value() )
 {
     fromConfig(_conf);
 }
@@ -112,10 +117,14 @@ GeometryCompilerOptions::fromConfig( const Config& conf )
     conf.getIfSet   ( "optimize_state_sharing", _optimizeStateSharing );
     conf.getIfSet   ( "optimize", _optimize );
     conf.getIfSet   ( "validate", _validate );
+    conf.getIfSet   ( "compile_threads", _compileThreads );
 
     conf.getIfSet( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.getIfSet( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
     conf.getIfSet( "shader_policy", "generate", _shaderPolicy, SHADERPOLICY_GENERATE );
+
+    conf.getIfSet( "tessellator", "ear_clipping", _tessellator, Tessellator::METHOD_EAR_CLIPPING );
+    conf.getIfSet( "tessellator", "zorder",       _tessellator, Tessellator::METHOD_ZORDER_EAR_CLIPPING );
 }
 
 Config
@@ -135,10 +144,14 @@ GeometryCompilerOptions::getConfig() const
     conf.addIfSet   ( "optimize_state_sharing", _optimizeStateSharing );
     conf.addIfSet   ( "optimize", _optimize );
     conf.addIfSet   ( "validate", _validate );
+    conf.addIfSet   ( "compile_threads", _compileThreads );
 
     conf.addIfSet( "shader_policy", "disable",  _shaderPolicy, SHADERPOLICY_DISABLE );
     conf.addIfSet( "shader_policy", "inherit",  _shaderPolicy, SHADERPOLICY_INHERIT );
     conf.addIfSet( "shader_policy", "generate", _shaderPolicy, SHADERPOLICY_GENERATE );
+
+    conf.addIfSet( "tessellator", "ear_clipping", _tessellator, Tessellator::METHOD_EAR_CLIPPING );
+    conf.addIfSet( "tessellator", "zorder",       _tessellator, Tessellator::METHOD_ZORDER_EAR_CLIPPING );
     return conf;
 }
 
@@ -151,6 +164,188 @@ GeometryCompilerOptions::mergeConfig( const Config& conf )
 
 //-----------------------------------------------------------------------
 
+namespace
+{
+    // Don't bother splitting a feature list into batches smaller than this;
+    // the dispatch overhead would outweigh the gain.
+    const unsigned MIN_FEATURES_PER_BATCH = 32u;
+
+    enum Phase
+    {
+        PHASE_EXTRUDE,
+        PHASE_BUILD_GEOMETRY
+    };
+
+    osg::Node* extrude(FeatureList&                   features,
+                       FilterContext&                 cx,
+                       const Style&                   style,
+                       const GeometryCompilerOptions& options)
+    {
+        ExtrudeGeometryFilter extrude;
+        extrude.setStyle( style );
+
+        // apply per-feature naming if requested.
+        if ( options.featureName().isSet() )
+            extrude.setFeatureNameExpr( *options.featureName() );
+
+        if ( options.mergeGeometry().isSet() )
+            extrude.setMergeGeometry( *options.mergeGeometry() );
+
+        return extrude.push( features, cx );
+    }
+
+    osg::Node* buildGeometry(FeatureList&                   features,
+                             FilterContext&                 cx,
+                             const Style&                   style,
+                             const GeometryCompilerOptions& options)
+    {
+        BuildGeometryFilter filter( style );
+        filter.maxGranularity() = *options.maxGranularity();
+        filter.geoInterp()      = *options.geoInterp();
+        filter.tessellator()    = *options.tessellator();
+
+        if ( options.featureName().isSet() )
+            filter.featureName() = *options.featureName();
+
+        return filter.push( features, cx );
+    }
+
+    /**
+     * A batch of features run through the per-feature phases of the
+     * compiler: optional altitude clamping, followed by extrusion or
+     * geometry building.
+     */
+    struct CompileBatch
+    {
+        CompileBatch() : _phase(PHASE_BUILD_GEOMETRY), _clamp(false), _style(0L), _options(0L) { }
+
+        void execute()
+        {
+            if ( _clamp )
+            {
+                AltitudeFilter clamp;
+                clamp.setPropertiesFromStyle( *_style );
+                _cx = clamp.push( _features, _cx );
+            }
+
+            if ( _phase == PHASE_EXTRUDE )
+                _node = extrude( _features, _cx, *_style, *_options );
+            else
+                _node = buildGeometry( _features, _cx, *_style, *_options );
+        }
+
+        Phase                          _phase;
+        bool                           _clamp;
+        const Style*                   _style;
+        const GeometryCompilerOptions* _options;
+        FeatureList                    _features;
+        FilterContext                  _cx;
+        osg::ref_ptr<osg::Node>        _node;
+    };
+
+    typedef ParallelTask<CompileBatch> CompileTask;
+
+    /**
+     * Runs the per-feature phases over the working set. When parallel
+     * compilation is enabled and the working set is large enough, the
+     * features are split into one contiguous batch per thread; the calling
+     * thread takes the first batch and the others run on the Registry's
+     * compile pool. The batch results are added to the output group in
+     * feature order, so the output does not depend on thread scheduling.
+     *
+     * Returns true if any geometry was generated.
+     */
+    bool runPerFeaturePhases(Phase                          phase,
+                             FeatureList&                   workingSet,
+                             FilterContext&                 cx,
+                             const Style&                   style,
+                             bool                           clamp,
+                             const GeometryCompilerOptions& options,
+                             osg::Group*                    output)
+    {
+        unsigned numBatches = osg::minimum(
+            osg::maximum( options.compileThreads().get(), 1u ),
+            (unsigned)workingSet.size() / MIN_FEATURES_PER_BATCH );
+
+        if ( numBatches <= 1 )
+        {
+            if ( clamp )
+            {
+                AltitudeFilter filter;
+                filter.setPropertiesFromStyle( style );
+                cx = filter.push( workingSet, cx );
+            }
+
+            osg::Node* node =
+                phase == PHASE_EXTRUDE ? extrude( workingSet, cx, style, options ) :
+                buildGeometry( workingSet, cx, style, options );
+
+            if ( node )
+                output->addChild( node );
+
+            return node != 0L;
+        }
+
+        TaskService* service = Registry::instance()->getCompileTaskService( numBatches-1 );
+
+        // partition the working set into contiguous batches.
+        std::vector< osg::ref_ptr<CompileTask> > tasks( numBatches );
+        Threading::MultiEvent semaphore( numBatches-1 );
+
+        unsigned batchSize = (unsigned)workingSet.size() / numBatches;
+        for(unsigned b=0; b<numBatches; ++b)
+        {
+            CompileTask* task = b > 0 ? new CompileTask( &semaphore ) : new CompileTask();
+            task->_phase   = phase;
+            task->_clamp   = clamp;
+            task->_style   = &style;
+            task->_options = &options;
+            task->_cx      = cx;
+
+            if ( b+1 < numBatches )
+            {
+                FeatureList::iterator end = workingSet.begin();
+                std::advance( end, batchSize );
+                task->_features.splice( task->_features.end(), workingSet, workingSet.begin(), end );
+            }
+            else
+            {
+                task->_features.swap( workingSet );
+            }
+
+            tasks[b] = task;
+        }
+
+        for(unsigned b=1; b<numBatches; ++b)
+        {
+            service->add( tasks[b].get() );
+        }
+
+        // run the first batch on this thread while the others are in flight.
+        tasks[0]->execute();
+
+        semaphore.wait();
+
+        // merge the results and restore the working set, in order.
+        bool gotNodes = false;
+        for(unsigned b=0; b<numBatches; ++b)
+        {
+            if ( tasks[b]->_node.valid() )
+            {
+                output->addChild( tasks[b]->_node.get() );
+                gotNodes = true;
+            }
+            workingSet.splice( workingSet.end(), tasks[b]->_features );
+        }
+
+        cx = tasks[0]->_cx;
+
+        return gotNodes;
+    }
+}
+
+//-----------------------------------------------------------------------
+
 GeometryCompiler::GeometryCompiler()
 {
     //nop
@@ -440,59 +635,25 @@ GeometryCompiler::compile(FeatureList&          workingSet,
     // extruded geometry
     if ( extrusion )
     {
-        if ( altRequired )
-        {
-            AltitudeFilter clamp;
-            clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
-            altRequired = false;
-        }
-
-        ExtrudeGeometryFilter extrude;
-        extrude.setStyle( style );
-
-        // apply per-feature naming if requested.
-        if ( _options.featureName().isSet() )
-            extrude.setFeatureNameExpr( *_options.featureName() );
-
-        if ( _options.mergeGeometry().isSet() )
-            extrude.setMergeGeometry( *_options.mergeGeometry() );
+        if ( trackHistory && altRequired ) history.push_back( "altitude" );
 
-        osg::Node* node = extrude.push( workingSet, sharedCX );
-        if ( node )
+        if ( runPerFeaturePhases(PHASE_EXTRUDE, workingSet, sharedCX, style, altRequired, _options, resultGroup.get()) )
         {
             if ( trackHistory ) history.push_back( "extrude" );
-            resultGroup->addChild( node );
         }
-        
+        altRequired = false;
     }
 
     // simple geometry
     else if ( point || line || polygon )
     {
-        if ( altRequired )
-        {
-            AltitudeFilter clamp;
-            clamp.setPropertiesFromStyle( style );
-            sharedCX = clamp.push( workingSet, sharedCX );
-            if ( trackHistory ) history.push_back( "altitude" );
-            altRequired = false;
-        }
-
-        BuildGeometryFilter filter( style );
-        filter.maxGranularity() = *_options.maxGranularity();
-        filter.geoInterp()      = *_options.geoInterp();
-
-        if ( _options.featureName().isSet() )
-            filter.featureName() = *_options.featureName();
+        if ( trackHistory && altRequired ) history.push_back( "altitude" );
 
-        osg::Node* node = filter.push( workingSet, sharedCX );
-        if ( node )
+        if ( runPerFeaturePhases(PHASE_BUILD_GEOMETRY, workingSet, sharedCX, style, altRequired, _options, resultGroup.get()) )
         {
             if ( trackHistory ) history.push_back( "geometry" );
-            resultGroup->addChild( node );
         }
+        altRequired = false;
     }
 
     if ( text || icon )
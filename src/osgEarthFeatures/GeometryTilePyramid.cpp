@@ -0,0 +1,254 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/GeometryTilePyramid>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarthFeatures/SimplifyFilter>
+#include <osgEarth/Notify>
+#include <osg/Timer>
+
+#define LC "[GeometryTilePyramid] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // Geometry tiles are cropped this much larger than their extent, so that
+    // the renderer's own crop margin and line buffering still see the
+    // geometry just outside each raster tile.
+    const double CROP_MARGIN = 1.25;
+}
+
+//------------------------------------------------------------------------
+
+GeometryTilePyramid::GeometryTilePyramid(FeatureSource* source,
+                                         unsigned       tileSize,
+                                         unsigned       maxTiles) :
+_source       ( source ),
+_tileSize     ( osg::maximum(tileSize, 1u) ),
+_levelsPerTile( 2u ),
+_tiles        ( true, osg::maximum(maxTiles, 1u) )
+{
+#ifndef OSGEARTH_HAVE_GEOS
+    OE_INFO << LC << "GEOS is not available; tiles will hold uncropped geometry" << std::endl;
+#endif
+}
+
+double
+GeometryTilePyramid::getResolution(const TileKey& key) const
+{
+    const GeoExtent& extent = key.getExtent();
+    return osg::minimum(extent.width(), extent.height()) / (double)_tileSize;
+}
+
+bool
+GeometryTilePyramid::getFeatures(const Query&      query,
+                                 const TileKey&    key,
+                                 FeatureList&      output,
+                                 ProgressCallback* progress)
+{
+    if ( !_source.valid() || !_source->getFeatureProfile() || !key.valid() )
+        return false;
+
+    std::string queryKey = query.getConfig().toJSON(false) + "|";
+
+    unsigned lod      = key.getLOD();
+    unsigned firstLOD = lod > _levelsPerTile ? lod - _levelsPerTile : 0u;
+
+    // simplify to half a pixel at the raster level.
+    double tolerance = 0.5 * getResolution(key);
+
+    // Use the finest cached ancestor that was simplified enough for this level:
+    osg::ref_ptr<GeometryTile> tile;
+    for(int l = (int)lod; l >= (int)firstLOD && !tile.valid(); --l)
+    {
+        TileCache::Record rec;
+        if ( _tiles.get(queryKey + key.createAncestorKey(l).str(), rec) && rec.value()->_tolerance <= tolerance )
+        {
+            tile = rec.value().get();
+        }
+    }
+
+    // ..or build one for the raster level _levelsPerTile below the ancestor.
+    if ( !tile.valid() )
+    {
+        TileKey tileKey = key.createAncestorKey( firstLOD );
+        double tileTolerance = 0.5 * getResolution(tileKey) / (double)(1u << _levelsPerTile);
+
+        tile = buildTile( query, tileKey, tileTolerance, progress );
+        if ( !tile.valid() )
+            return false;
+
+        _tiles.insert( queryKey + tileKey.str(), tile.get() );
+    }
+
+    // Collect the features that touch this raster tile.
+    GeoExtent extent( key.getExtent() );
+    extent.scale( CROP_MARGIN, CROP_MARGIN );
+
+    for(std::vector<Entry>::const_iterator i = tile->_entries.begin(); i != tile->_entries.end(); ++i)
+    {
+        const Bounds& b = i->_bounds;
+        if ( b.xMin() <= extent.xMax() && b.xMax() >= extent.xMin() &&
+             b.yMin() <= extent.yMax() && b.yMax() >= extent.yMin() )
+        {
+            output.push_back( i->_feature.get() );
+        }
+    }
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _stats.requests++;
+
+    return true;
+}
+
+GeometryTilePyramid::GeometryTile*
+GeometryTilePyramid::buildTile(const Query&      query,
+                               const TileKey&    tileKey,
+                               double            tolerance,
+                               ProgressCallback* progress)
+{
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    osg::ref_ptr<GeometryTile> tile = new GeometryTile();
+    tile->_tolerance = tolerance;
+
+    const SpatialReference* tileSRS = tileKey.getProfile()->getSRS();
+
+    GeoExtent cropExtent( tileKey.getExtent() );
+    cropExtent.scale( CROP_MARGIN, CROP_MARGIN );
+
+    // Intersect the crop extent with the features extent in WGS84, and
+    // query the source with the result (as FeatureTileSource does).
+    const GeoExtent& featuresExtent = _source->getFeatureProfile()->getExtent();
+    const SpatialReference* geoSRS = featuresExtent.getSRS()->getGeographicSRS();
+
+    GeoExtent queryExtentWGS84 = featuresExtent.transform( geoSRS ).intersectionSameSRS( cropExtent.transform(geoSRS) );
+    if ( !queryExtentWGS84.isValid() )
+        return tile.release();
+
+    GeoExtent queryExtent = queryExtentWGS84.transform( featuresExtent.getSRS() );
+
+    Query localQuery = query;
+    localQuery.bounds() =
+        query.bounds().isSet() ? query.bounds()->unionWith( queryExtent.bounds() ) :
+        queryExtent.bounds();
+
+#ifdef OSGEARTH_HAVE_GEOS
+    osg::ref_ptr<Symbology::Polygon> cropPoly = new Symbology::Polygon( 4 );
+    cropPoly->push_back( osg::Vec3d( cropExtent.xMin(), cropExtent.yMin(), 0 ));
+    cropPoly->push_back( osg::Vec3d( cropExtent.xMax(), cropExtent.yMin(), 0 ));
+    cropPoly->push_back( osg::Vec3d( cropExtent.xMax(), cropExtent.yMax(), 0 ));
+    cropPoly->push_back( osg::Vec3d( cropExtent.xMin(), cropExtent.yMax(), 0 ));
+#endif
+
+    FeatureList features;
+
+    osg::ref_ptr<FeatureCursor> cursor = _source->createFeatureCursor( localQuery );
+    while( cursor.valid() && cursor->hasMore() )
+    {
+        if ( progress && progress->isCanceled() )
+            return 0L;
+
+        osg::ref_ptr<Feature> feature = cursor->nextFeature();
+        Geometry* geom = feature.valid() ? feature->getGeometry() : 0L;
+        if ( !geom || !feature->getSRS() )
+            continue;
+
+        // apply a type override if requested:
+        if (_typeOverride.isSet() &&
+            _typeOverride != geom->getComponentType() )
+        {
+            geom = geom->cloneAs( _typeOverride.value() );
+            if ( !geom )
+                continue;
+            feature->setGeometry( geom );
+        }
+
+        // transform into the tile SRS once, for all the raster tiles.
+        feature->transform( tileSRS );
+        geom = feature->getGeometry();
+
+#ifdef OSGEARTH_HAVE_GEOS
+        // crop to the tile. The renderer crops again anyway, so without GEOS
+        // the whole geometry is kept.
+        osg::ref_ptr<Geometry> cropped;
+        if ( geom->crop(cropPoly.get(), cropped) )
+        {
+            feature->setGeometry( cropped.get() );
+        }
+        else if ( cropped.valid() )
+        {
+            // valid but empty: no part of it is in this tile.
+            continue;
+        }
+#endif
+
+        features.push_back( feature.get() );
+    }
+
+    unsigned pointsIn = 0, pointsOut = 0;
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+        pointsIn += i->get()->getGeometry()->getTotalPointCount();
+
+    // simplify the whole tile at once, so that edges shared by neighboring
+    // features (e.g. adjacent parcels) stay shared.
+    SimplifyFilter simplify( tolerance );
+    simplify.simplify( features );
+
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        Geometry* geom = i->get()->getGeometry();
+        pointsOut += geom->getTotalPointCount();
+
+        Entry entry;
+        entry._feature = i->get();
+        entry._bounds  = geom->getBounds();
+        tile->_entries.push_back( entry );
+    }
+
+    double time = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    OE_DEBUG << LC << "Built " << tileKey.str() << ": " << tile->_entries.size() << " features, "
+        << pointsIn << " => " << pointsOut << " points in " << time << " s" << std::endl;
+
+    Threading::ScopedMutexLock lock( _statsMutex );
+    _stats.tilesBuilt++;
+    _stats.features  += tile->_entries.size();
+    _stats.pointsIn  += pointsIn;
+    _stats.pointsOut += pointsOut;
+    _stats.buildTime += time;
+
+    return tile.release();
+}
+
+void
+GeometryTilePyramid::clear()
+{
+    _tiles.clear();
+}
+
+GeometryTilePyramid::Stats
+GeometryTilePyramid::getStats() const
+{
+    Threading::ScopedMutexLock lock( _statsMutex );
+    return _stats;
+}
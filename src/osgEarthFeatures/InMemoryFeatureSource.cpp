@@ -0,0 +1,398 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/InMemoryFeatureSource>
+#include <osgEarthFeatures/FeatureCursor>
+#include <osgEarth/Notify>
+#include <osg/Timer>
+#include <algorithm>
+#include <cmath>
+
+#define LC "[InMemoryFeatureSource] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    // maximum number of children per R-tree node.
+    const unsigned NODE_CAPACITY = 16u;
+
+    template<typename T>
+    struct LessCenterX {
+        bool operator()(const T& lhs, const T& rhs) const {
+            return lhs.xmin+lhs.xmax < rhs.xmin+rhs.xmax;
+        }
+    };
+
+    template<typename T>
+    struct LessCenterY {
+        bool operator()(const T& lhs, const T& rhs) const {
+            return lhs.ymin+lhs.ymax < rhs.ymin+rhs.ymax;
+        }
+    };
+
+    /**
+     * Sort-Tile-Recursive packing of one R-tree level: sorts the children
+     * into vertical slices by X and then into runs by Y, and creates one
+     * parent per run of NODE_CAPACITY children.
+     */
+    template<typename T>
+    void strPack(std::vector<T>& children, std::vector<T>& parents)
+    {
+        unsigned n          = children.size();
+        unsigned numParents = (n + NODE_CAPACITY - 1) / NODE_CAPACITY;
+        unsigned numSlices  = (unsigned)ceil(sqrt((double)numParents));
+        unsigned sliceSize  = numSlices * NODE_CAPACITY;
+
+        std::sort( children.begin(), children.end(), LessCenterX<T>() );
+
+        parents.reserve( numParents );
+
+        for(unsigned s = 0; s < n; s += sliceSize)
+        {
+            unsigned sliceEnd = osg::minimum(s + sliceSize, n);
+            std::sort( children.begin()+s, children.begin()+sliceEnd, LessCenterY<T>() );
+
+            for(unsigned i = s; i < sliceEnd; i += NODE_CAPACITY)
+            {
+                T parent;
+                parent.first = i;
+                parent.count = osg::minimum(NODE_CAPACITY, sliceEnd - i);
+                parent.xmin  = children[i].xmin;
+                parent.ymin  = children[i].ymin;
+                parent.xmax  = children[i].xmax;
+                parent.ymax  = children[i].ymax;
+
+                for(unsigned c = i+1; c < i+parent.count; ++c)
+                {
+                    parent.xmin = osg::minimum(parent.xmin, children[c].xmin);
+                    parent.ymin = osg::minimum(parent.ymin, children[c].ymin);
+                    parent.xmax = osg::maximum(parent.xmax, children[c].xmax);
+                    parent.ymax = osg::maximum(parent.ymax, children[c].ymax);
+                }
+
+                parents.push_back( parent );
+            }
+        }
+    }
+
+    /**
+     * Cursor over the index hits. Unless told otherwise, each feature is
+     * cloned as it's returned, since downstream filters modify features
+     * in place.
+     */
+    struct InMemoryFeatureCursor : public FeatureCursor
+    {
+        InMemoryFeatureCursor(const std::vector< osg::ref_ptr<Feature> >& features,
+                              std::vector<unsigned>&                      hits,
+                              const FeatureSource*                        source,
+                              bool                                        clone) :
+            _features( features ),
+            _source  ( source ),
+            _next    ( 0u ),
+            _clone   ( clone )
+        {
+            _hits.swap( hits );
+            skipBlacklisted();
+        }
+
+        bool hasMore() const
+        {
+            return _next < _hits.size();
+        }
+
+        Feature* nextFeature()
+        {
+            if ( !hasMore() )
+                return 0L;
+
+            Feature* f = _features[_hits[_next++]].get();
+            _lastFeatureReturned = _clone ? osg::clone( f, osg::CopyOp::DEEP_COPY_ALL ) : f;
+            skipBlacklisted();
+            return _lastFeatureReturned.get();
+        }
+
+    private:
+        void skipBlacklisted()
+        {
+            while( _next < _hits.size() && _source->isBlacklisted(_features[_hits[_next]]->getFID()) )
+                ++_next;
+        }
+
+        const std::vector< osg::ref_ptr<Feature> >& _features;
+        osg::ref_ptr<const FeatureSource>           _source;   // keeps _features alive
+        std::vector<unsigned>                       _hits;
+        unsigned                                    _next;
+        bool                                        _clone;
+        osg::ref_ptr<Feature>                       _lastFeatureReturned;
+    };
+}
+
+//------------------------------------------------------------------------
+
+InMemoryFeatureSource::InMemoryFeatureSource(FeatureSource* source) :
+FeatureSource( source ? source->getFeatureSourceOptions() : FeatureSourceOptions() ),
+_source      ( source ),
+_passThrough ( false ),
+_clone       ( true )
+{
+    if ( _source.valid() )
+        setName( _source->getName() );
+}
+
+void
+InMemoryFeatureSource::initialize(const osgDB::Options* dbOptions)
+{
+    if ( _source.valid() )
+    {
+        _source->initialize( dbOptions );
+        load();
+    }
+}
+
+const FeatureProfile*
+InMemoryFeatureSource::createFeatureProfile()
+{
+    return _source.valid() ? _source->getFeatureProfile() : 0L;
+}
+
+const FeatureSchema&
+InMemoryFeatureSource::getSchema() const
+{
+    static FeatureSchema s_emptySchema;
+    return _source.valid() ? _source->getSchema() : s_emptySchema;
+}
+
+Geometry::Type
+InMemoryFeatureSource::getGeometryType() const
+{
+    return _source.valid() ? _source->getGeometryType() : Geometry::TYPE_UNKNOWN;
+}
+
+bool
+InMemoryFeatureSource::hasEmbeddedStyles() const
+{
+    return _source.valid() && _source->hasEmbeddedStyles();
+}
+
+void
+InMemoryFeatureSource::load()
+{
+    if ( !_source->getFeatureProfile() )
+    {
+        OE_WARN << LC << "Source \"" << _source->getName() << "\" has no profile; nothing to load" << std::endl;
+        return;
+    }
+
+    // A tiled source only answers per-tile queries, so one query for
+    // everything would come back empty (or with just the root tile).
+    if ( _source->getFeatureProfile()->getTiled() )
+    {
+        OE_WARN << LC << "Source \"" << _source->getName() << "\" is tiled and cannot be "
+            << "loaded into memory; queries will go to the source directly" << std::endl;
+        _passThrough = true;
+        return;
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    Stats stats;
+
+    osg::ref_ptr<FeatureCursor> cursor = _source->createFeatureCursor( Query() );
+    while( cursor.valid() && cursor->hasMore() )
+    {
+        osg::ref_ptr<Feature> feature = cursor->nextFeature();
+        if ( !feature.valid() )
+            continue;
+
+        _fidIndex[feature->getFID()] = _features.size();
+        _features.push_back( feature.get() );
+
+        unsigned points = feature->getGeometry() ? feature->getGeometry()->getTotalPointCount() : 0u;
+        stats.points += points;
+        stats.bytes  += sizeof(Feature) + points*sizeof(osg::Vec3d) + feature->getAttrs().size()*sizeof(AttributeValue);
+    }
+
+    buildIndex();
+
+    stats.features = _features.size();
+    stats.bytes   += _fidIndex.size() * (sizeof(FeatureID) + sizeof(unsigned));
+    for(unsigned i=0; i<_levels.size(); ++i)
+        stats.bytes += _levels[i].size() * sizeof(Entry);
+    stats.loadTime = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+
+    {
+        Threading::ScopedMutexLock lock( _statsMutex );
+        _stats = stats;
+    }
+
+    OE_INFO << LC << "Loaded " << stats.features << " features from \"" << _source->getName()
+        << "\" (" << stats.points << " points, " << stats.bytes/1024 << " KB) in "
+        << stats.loadTime << " s" << std::endl;
+}
+
+void
+InMemoryFeatureSource::buildIndex()
+{
+    _levels.clear();
+
+    EntryVector leaves;
+    leaves.reserve( _features.size() );
+    for(unsigned i=0; i<_features.size(); ++i)
+    {
+        const Geometry* geom = _features[i]->getGeometry();
+        if ( !geom )
+            continue;
+
+        Bounds b = geom->getBounds();
+        if ( !b.isValid() )
+            continue;
+
+        Entry e;
+        e.xmin  = b.xMin();
+        e.ymin  = b.yMin();
+        e.xmax  = b.xMax();
+        e.ymax  = b.yMax();
+        e.first = i;
+        e.count = 0u;
+        leaves.push_back( e );
+    }
+
+    if ( leaves.empty() )
+        return;
+
+    _levels.push_back( EntryVector() );
+    _levels.back().swap( leaves );
+
+    // pack levels bottom-up until one node is left.
+    while( _levels.back().size() > 1 )
+    {
+        EntryVector parents;
+        strPack( _levels.back(), parents );
+        _levels.push_back( EntryVector() );
+        _levels.back().swap( parents );
+    }
+}
+
+void
+InMemoryFeatureSource::search(unsigned               level,
+                              unsigned               first,
+                              unsigned               count,
+                              const Bounds&          bounds,
+                              std::vector<unsigned>& out_hits) const
+{
+    const EntryVector& entries = _levels[level];
+    for(unsigned i = first; i < first+count; ++i)
+    {
+        const Entry& e = entries[i];
+        if ( e.xmax < bounds.xMin() || e.xmin > bounds.xMax() ||
+             e.ymax < bounds.yMin() || e.ymin > bounds.yMax() )
+        {
+            continue;
+        }
+
+        if ( level == 0 )
+            out_hits.push_back( e.first );
+        else
+            search( level-1, e.first, e.count, bounds, out_hits );
+    }
+}
+
+FeatureCursor*
+InMemoryFeatureSource::createFeatureCursor(const Symbology::Query& query)
+{
+    if ( !_source.valid() )
+        return 0L;
+
+    // driver-specific expressions can only be evaluated by the source itself.
+    if ( _passThrough || query.expression().isSet() || query.orderby().isSet() )
+    {
+        return _source->createFeatureCursor( query );
+    }
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    std::vector<unsigned> hits;
+
+    optional<Bounds> bounds = query.bounds();
+    if ( !bounds.isSet() && query.tileKey().isSet() && getFeatureProfile() )
+    {
+        GeoExtent extent = query.tileKey()->getExtent().transform( getFeatureProfile()->getSRS() );
+        if ( extent.isValid() )
+            bounds = extent.bounds();
+    }
+
+    if ( bounds.isSet() )
+    {
+        if ( !_levels.empty() )
+        {
+            search( _levels.size()-1, 0u, _levels.back().size(), *bounds, hits );
+
+            // return the features in source order, like the wrapped source would.
+            std::sort( hits.begin(), hits.end() );
+        }
+    }
+    else
+    {
+        hits.reserve( _features.size() );
+        for(unsigned i=0; i<_features.size(); ++i)
+            hits.push_back( i );
+    }
+
+    double t = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+    {
+        Threading::ScopedMutexLock lock( _statsMutex );
+        _stats.queries++;
+        _stats.queryTime += t;
+    }
+
+    return new InMemoryFeatureCursor( _features, hits, this, _clone );
+}
+
+Feature*
+InMemoryFeatureSource::getFeature(FeatureID fid)
+{
+    if ( _passThrough )
+        return _source->getFeature( fid );
+
+    std::map<FeatureID, unsigned>::const_iterator i = _fidIndex.find( fid );
+    if ( i == _fidIndex.end() || isBlacklisted(fid) )
+        return 0L;
+
+    Feature* f = _features[i->second].get();
+    return _clone ? osg::clone( f, osg::CopyOp::DEEP_COPY_ALL ) : f;
+}
+
+int
+InMemoryFeatureSource::getFeatureCount() const
+{
+    if ( _passThrough )
+        return _source->getFeatureCount();
+
+    return (int)_features.size();
+}
+
+InMemoryFeatureSource::Stats
+InMemoryFeatureSource::getStats() const
+{
+    Threading::ScopedMutexLock lock( _statsMutex );
+    return _stats;
+}
@@ -0,0 +1,388 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/SimplifyFilter>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <set>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+OSGEARTH_REGISTER_SIMPLE_FEATUREFILTER(simplify, SimplifyFilter );
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef std::vector<osg::Vec3d>         Points;
+    typedef std::pair<double, double>       VertexKey;
+    typedef std::vector<VertexKey>          Neighbors;
+    typedef std::map<VertexKey, Neighbors>  NeighborMap;
+
+    inline VertexKey vertexKey(const osg::Vec3d& p)
+    {
+        return VertexKey(p.x(), p.y());
+    }
+
+    inline bool isRing(const Geometry* part)
+    {
+        return
+            part->getType() == Geometry::TYPE_RING ||
+            part->getType() == Geometry::TYPE_POLYGON;
+    }
+
+    // squared distance from p to the segment ab, in XY.
+    double segmentDistance2(const osg::Vec3d& p, const osg::Vec3d& a, const osg::Vec3d& b)
+    {
+        double dx = b.x()-a.x(), dy = b.y()-a.y();
+        double len2 = dx*dx + dy*dy;
+        double t = len2 > 0.0 ? ((p.x()-a.x())*dx + (p.y()-a.y())*dy) / len2 : 0.0;
+        t = osg::clampBetween(t, 0.0, 1.0);
+        double ex = a.x() + t*dx - p.x(), ey = a.y() + t*dy - p.y();
+        return ex*ex + ey*ey;
+    }
+
+    double triangleArea(const osg::Vec3d& a, const osg::Vec3d& b, const osg::Vec3d& c)
+    {
+        return 0.5 * fabs( (b.x()-a.x())*(c.y()-a.y()) - (c.x()-a.x())*(b.y()-a.y()) );
+    }
+
+    // Douglas-Peucker; keeps both endpoints.
+    void douglasPeucker(const Points& input, double tolerance, Points& output)
+    {
+        std::vector<bool> keep( input.size(), false );
+        keep.front() = true;
+        keep.back()  = true;
+
+        double tolerance2 = tolerance*tolerance;
+
+        std::vector< std::pair<unsigned, unsigned> > stack;
+        stack.push_back( std::make_pair(0u, (unsigned)input.size()-1) );
+        while( !stack.empty() )
+        {
+            unsigned first = stack.back().first, last = stack.back().second;
+            stack.pop_back();
+
+            double   maxDist2 = 0.0;
+            unsigned maxIndex = first;
+            for(unsigned i=first+1; i<last; ++i)
+            {
+                double d2 = segmentDistance2( input[i], input[first], input[last] );
+                if ( d2 > maxDist2 )
+                {
+                    maxDist2 = d2;
+                    maxIndex = i;
+                }
+            }
+
+            if ( maxDist2 > tolerance2 )
+            {
+                keep[maxIndex] = true;
+                stack.push_back( std::make_pair(first, maxIndex) );
+                stack.push_back( std::make_pair(maxIndex, last) );
+            }
+        }
+
+        for(unsigned i=0; i<input.size(); ++i)
+        {
+            if ( keep[i] )
+                output.push_back( input[i] );
+        }
+    }
+
+    // Visvalingam-Whyatt; keeps both endpoints.
+    void visvalingam(const Points& input, double tolerance, Points& output)
+    {
+        int n = (int)input.size();
+        double threshold = tolerance*tolerance;
+
+        std::vector<int>    prev( n ), next( n );
+        std::vector<double> area( n, DBL_MAX );
+        std::vector<bool>   removed( n, false );
+        std::set< std::pair<double, int> > queue;
+
+        for(int i=0; i<n; ++i)
+        {
+            prev[i] = i-1;
+            next[i] = i+1;
+            if ( i > 0 && i < n-1 )
+            {
+                area[i] = triangleArea( input[i-1], input[i], input[i+1] );
+                queue.insert( std::make_pair(area[i], i) );
+            }
+        }
+
+        while( !queue.empty() && queue.begin()->first < threshold )
+        {
+            double minArea = queue.begin()->first;
+            int    i       = queue.begin()->second;
+            queue.erase( queue.begin() );
+            removed[i] = true;
+
+            int p = prev[i], q = next[i];
+            next[p] = q;
+            prev[q] = p;
+
+            // recompute the neighbors; an area never drops below that of the
+            // point just removed, so the removal order stays monotonic.
+            int neighbors[2] = { p, q };
+            for(int k=0; k<2; ++k)
+            {
+                int j = neighbors[k];
+                if ( j > 0 && j < n-1 )
+                {
+                    queue.erase( std::make_pair(area[j], j) );
+                    area[j] = osg::maximum( triangleArea(input[prev[j]], input[j], input[next[j]]), minArea );
+                    queue.insert( std::make_pair(area[j], j) );
+                }
+            }
+        }
+
+        for(int i=0; i<n; ++i)
+        {
+            if ( !removed[i] )
+                output.push_back( input[i] );
+        }
+    }
+
+    // Simplifies a chain between two pinned vertices. The chain is processed
+    // in a canonical direction so that a chain shared by two rings (which
+    // traverse it in opposite directions) gives the same result in both.
+    void simplifyChain(Points& chain, double tolerance, SimplifyFilter::Method method, Points& output)
+    {
+        if ( chain.size() <= 2 )
+        {
+            output.insert( output.end(), chain.begin(), chain.end() );
+            return;
+        }
+
+        VertexKey front = vertexKey(chain.front()), back = vertexKey(chain.back());
+        bool reverse =
+            back < front ||
+            ( back == front && vertexKey(chain[chain.size()-2]) < vertexKey(chain[1]) );
+
+        if ( reverse )
+            std::reverse( chain.begin(), chain.end() );
+
+        Points simplified;
+        if ( method == SimplifyFilter::METHOD_VISVALINGAM )
+            visvalingam( chain, tolerance, simplified );
+        else
+            douglasPeucker( chain, tolerance, simplified );
+
+        if ( reverse )
+            std::reverse( simplified.begin(), simplified.end() );
+
+        output.insert( output.end(), simplified.begin(), simplified.end() );
+    }
+
+    void addNeighbor(NeighborMap& map, const osg::Vec3d& p, const osg::Vec3d& neighbor)
+    {
+        Neighbors& n = map[vertexKey(p)];
+        VertexKey key = vertexKey(neighbor);
+        if ( std::find(n.begin(), n.end(), key) == n.end() )
+            n.push_back( key );
+    }
+}
+
+//------------------------------------------------------------------------
+
+SimplifyFilter::SimplifyFilter() :
+_tolerance       ( 0.0 ),
+_method          ( METHOD_DOUGLAS_PEUCKER ),
+_preserveTopology( true )
+{
+    //NOP
+}
+
+SimplifyFilter::SimplifyFilter( double tolerance ) :
+_tolerance       ( tolerance ),
+_method          ( METHOD_DOUGLAS_PEUCKER ),
+_preserveTopology( true )
+{
+    //NOP
+}
+
+SimplifyFilter::SimplifyFilter( const Config& conf ) :
+_tolerance       ( 0.0 ),
+_method          ( METHOD_DOUGLAS_PEUCKER ),
+_preserveTopology( true )
+{
+    if (conf.key() == "simplify")
+    {
+        conf.getIfSet( "tolerance", _tolerance );
+        conf.getIfSet( "method", "douglas_peucker", _method, METHOD_DOUGLAS_PEUCKER );
+        conf.getIfSet( "method", "visvalingam",     _method, METHOD_VISVALINGAM );
+        conf.getIfSet( "preserve_topology", _preserveTopology );
+    }
+}
+
+Config
+SimplifyFilter::getConfig() const
+{
+    Config config( "simplify" );
+    config.addIfSet( "tolerance", _tolerance );
+    config.addIfSet( "method", "douglas_peucker", _method, METHOD_DOUGLAS_PEUCKER );
+    config.addIfSet( "method", "visvalingam",     _method, METHOD_VISVALINGAM );
+    config.addIfSet( "preserve_topology", _preserveTopology );
+    return config;
+}
+
+unsigned
+SimplifyFilter::simplify( FeatureList& features ) const
+{
+    double tolerance = _tolerance.get();
+    if ( tolerance <= 0.0 )
+        return 0u;
+
+    // collect the line and ring parts of all the features.
+    std::vector<Geometry*> parts;
+    for( FeatureList::iterator i = features.begin(); i != features.end(); ++i )
+    {
+        Geometry* geom = i->get() ? i->get()->getGeometry() : 0L;
+        if ( !geom )
+            continue;
+
+        GeometryIterator iter( geom, true );
+        while( iter.hasMore() )
+        {
+            Geometry* part = iter.next();
+            if ( part->getType() != Geometry::TYPE_POINTSET && part->size() > 2 )
+                parts.push_back( part );
+        }
+    }
+
+    // Find the distinct neighbors of every vertex. A vertex with exactly two
+    // is in the middle of a line or of an edge shared by several rings, and
+    // may go; any other vertex is a junction or an endpoint, and is pinned.
+    NeighborMap neighbors;
+    bool preserveTopology = _preserveTopology.get();
+    if ( preserveTopology )
+    {
+        for( std::vector<Geometry*>::const_iterator i = parts.begin(); i != parts.end(); ++i )
+        {
+            const Points& points = (*i)->asVector();
+            bool ring = isRing( *i );
+            unsigned n = points.size();
+            for( unsigned v=0; v<n; ++v )
+            {
+                if ( v > 0 )
+                    addNeighbor( neighbors, points[v], points[v-1] );
+                else if ( ring )
+                    addNeighbor( neighbors, points[v], points[n-1] );
+
+                if ( v+1 < n )
+                    addNeighbor( neighbors, points[v], points[v+1] );
+                else if ( ring )
+                    addNeighbor( neighbors, points[v], points[0] );
+            }
+        }
+    }
+
+    unsigned removed = 0u;
+
+    for( std::vector<Geometry*>::iterator i = parts.begin(); i != parts.end(); ++i )
+    {
+        Points& points = (*i)->asVector();
+        bool ring = isRing( *i );
+
+        // work on rings without an explicit closing point.
+        bool closed = ring && vertexKey(points.front()) == vertexKey(points.back());
+        Points input( points.begin(), closed ? points.end()-1 : points.end() );
+
+        unsigned n = input.size();
+        unsigned minPoints = ring ? 3u : 2u;
+        if ( n <= minPoints )
+            continue;
+
+        // pinned vertices split the part into chains.
+        std::vector<unsigned> pins;
+        for( unsigned v=0; v<n; ++v )
+        {
+            bool pinned =
+                (!ring && (v == 0 || v == n-1)) ||
+                (preserveTopology && neighbors[vertexKey(input[v])].size() != 2);
+
+            if ( pinned )
+                pins.push_back( v );
+        }
+
+        // a ring touching nothing: pin its lowest vertex, so the same ring in
+        // another feature (an island and its hole) starts at the same place.
+        if ( pins.empty() )
+        {
+            unsigned lowest = 0;
+            if ( preserveTopology )
+            {
+                for( unsigned v=1; v<n; ++v )
+                    if ( vertexKey(input[v]) < vertexKey(input[lowest]) )
+                        lowest = v;
+            }
+            pins.push_back( lowest );
+        }
+
+        Points output;
+        output.reserve( n );
+
+        unsigned numChains = ring ? pins.size() : pins.size()-1;
+        for( unsigned c=0; c<numChains; ++c )
+        {
+            unsigned first = pins[c];
+            unsigned last  = pins[(c+1) % pins.size()];
+
+            Points chain;
+            unsigned v = first;
+            do {
+                chain.push_back( input[v] );
+                v = (v+1) % n;
+            }
+            while( v != last );
+            chain.push_back( input[last] );
+
+            simplifyChain( chain, tolerance, _method.get(), output );
+
+            // the next chain starts with this chain's last point.
+            output.pop_back();
+        }
+
+        if ( !ring )
+            output.push_back( input.back() );
+
+        if ( output.size() < minPoints )
+            continue;
+
+        if ( closed )
+            output.push_back( output.front() );
+
+        removed += points.size() - output.size();
+        points.swap( output );
+    }
+
+    return removed;
+}
+
+FilterContext
+SimplifyFilter::push( FeatureList& input, FilterContext& context )
+{
+    simplify( input );
+    return context;
+}
@@ -0,0 +1,647 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/StyleSelectorTable>
+#include <osgEarth/StringUtils>
+#include <algorithm>
+#include <cstdlib>
+
+#define LC "[StyleSelectorTable] "
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+//------------------------------------------------------------------------
+
+namespace
+{
+    typedef StyleSelectorTable::Term Term;
+
+    enum Truth { TRUTH_FALSE, TRUTH_TRUE, TRUTH_UNKNOWN };
+
+    enum TokenType { TOKEN_END, TOKEN_IDENT, TOKEN_STRING, TOKEN_NUMBER, TOKEN_OP, TOKEN_LPAREN, TOKEN_RPAREN, TOKEN_COMMA };
+
+    struct Token
+    {
+        TokenType   type;
+        std::string text;
+        double      number;
+        bool        quoted;  // a "double quoted" identifier, never a keyword
+    };
+
+    bool isIdentChar(char c)
+    {
+        return isalnum((unsigned char)c) || c == '_' || c == '.';
+    }
+
+    // Splits a WHERE expression into tokens. Returns false on anything
+    // outside the supported subset.
+    bool tokenize(const std::string& in, std::vector<Token>& out)
+    {
+        unsigned i = 0, n = in.length();
+        while( i < n )
+        {
+            char c = in[i];
+            Token t;
+            t.type = TOKEN_END;
+            t.number = 0.0;
+            t.quoted = false;
+
+            if ( isspace((unsigned char)c) )
+            {
+                ++i;
+                continue;
+            }
+            else if ( c == '(' ) { t.type = TOKEN_LPAREN; ++i; }
+            else if ( c == ')' ) { t.type = TOKEN_RPAREN; ++i; }
+            else if ( c == ',' ) { t.type = TOKEN_COMMA;  ++i; }
+            else if ( c == '\'' || c == '"' )
+            {
+                // string literal or quoted identifier; a doubled quote escapes itself.
+                t.type = c == '\'' ? TOKEN_STRING : TOKEN_IDENT;
+                t.quoted = true;
+                for( ++i; ; ++i )
+                {
+                    if ( i >= n )
+                        return false;
+                    if ( in[i] == c )
+                    {
+                        if ( i+1 < n && in[i+1] == c )
+                            ++i;
+                        else
+                            break;
+                    }
+                    t.text += in[i];
+                }
+                ++i;
+            }
+            else if ( isdigit((unsigned char)c) || ((c == '-' || c == '.') && i+1 < n && (isdigit((unsigned char)in[i+1]) || in[i+1] == '.')) )
+            {
+                const char* begin = in.c_str() + i;
+                char* end = 0L;
+                t.type = TOKEN_NUMBER;
+                t.number = strtod( begin, &end );
+                if ( end == begin )
+                    return false;
+                t.text = std::string( begin, (const char*)end );
+                i += (unsigned)(end - begin);
+            }
+            else if ( isIdentChar(c) )
+            {
+                t.type = TOKEN_IDENT;
+                while( i < n && isIdentChar(in[i]) )
+                    t.text += in[i++];
+            }
+            else if ( c == '=' || c == '!' || c == '<' || c == '>' )
+            {
+                t.type = TOKEN_OP;
+                t.text = c;
+                ++i;
+                if ( i < n && (in[i] == '=' || (c == '<' && in[i] == '>')) )
+                    t.text += in[i++];
+                if ( t.text == "!" )
+                    return false;
+            }
+            else
+            {
+                return false;
+            }
+
+            out.push_back( t );
+        }
+
+        Token end;
+        end.type = TOKEN_END;
+        end.number = 0.0;
+        end.quoted = false;
+        out.push_back( end );
+        return true;
+    }
+
+    // Recursive-descent parser for the supported WHERE subset:
+    //   or      := and ( OR and )*
+    //   and     := not ( AND not )*
+    //   not     := NOT not | primary
+    //   primary := '(' or ')' | ident op literal | ident [NOT] IN '(' literal (, literal)* ')'
+    //            | ident IS [NOT] NULL
+    struct Parser
+    {
+        Parser(const std::vector<Token>& tokens, std::vector<Term>& terms) :
+            _tokens(tokens), _terms(terms), _pos(0) { }
+
+        const std::vector<Token>& _tokens;
+        std::vector<Term>&        _terms;
+        unsigned                  _pos;
+
+        const Token& peek() const { return _tokens[_pos]; }
+
+        bool isKeyword(const Token& t) const
+        {
+            if ( t.type != TOKEN_IDENT || t.quoted )
+                return false;
+            std::string s = toLower(t.text);
+            return s == "and" || s == "or" || s == "not" || s == "in" || s == "is" || s == "null" || s == "like" || s == "between";
+        }
+
+        bool keyword(const char* kw)
+        {
+            const Token& t = peek();
+            if ( t.type == TOKEN_IDENT && !t.quoted && ciEquals(t.text, kw) )
+            {
+                ++_pos;
+                return true;
+            }
+            return false;
+        }
+
+        unsigned add(const Term& term)
+        {
+            _terms.push_back( term );
+            return _terms.size()-1;
+        }
+
+        Term logical(Term::Op op)
+        {
+            Term term;
+            term.op = op;
+            term.numeric = false;
+            return term;
+        }
+
+        bool parse()
+        {
+            unsigned root;
+            if ( !parseOr(root) || peek().type != TOKEN_END )
+                return false;
+
+            // make sure the root term is the last one.
+            if ( root != _terms.size()-1 )
+            {
+                Term t = logical(Term::OP_AND);
+                t.operands.push_back( root );
+                add( t );
+            }
+            return true;
+        }
+
+        bool parseBinary(Term::Op op, const char* kw, unsigned& out)
+        {
+            unsigned lhs;
+            if ( !(op == Term::OP_OR ? parseBinary(Term::OP_AND, "AND", lhs) : parseNot(lhs)) )
+                return false;
+
+            if ( !keyword(kw) )
+            {
+                out = lhs;
+                return true;
+            }
+
+            Term t = logical(op);
+            t.operands.push_back( lhs );
+            do
+            {
+                unsigned rhs;
+                if ( !(op == Term::OP_OR ? parseBinary(Term::OP_AND, "AND", rhs) : parseNot(rhs)) )
+                    return false;
+                t.operands.push_back( rhs );
+            }
+            while( keyword(kw) );
+
+            out = add( t );
+            return true;
+        }
+
+        bool parseOr(unsigned& out)
+        {
+            return parseBinary( Term::OP_OR, "OR", out );
+        }
+
+        bool parseNot(unsigned& out)
+        {
+            if ( keyword("NOT") )
+            {
+                unsigned operand;
+                if ( !parseNot(operand) )
+                    return false;
+                Term t = logical(Term::OP_NOT);
+                t.operands.push_back( operand );
+                out = add( t );
+                return true;
+            }
+            return parsePrimary( out );
+        }
+
+        bool parseLiteral(Term& term)
+        {
+            const Token& t = peek();
+            bool numeric;
+            if ( t.type == TOKEN_NUMBER )
+                numeric = true;
+            else if ( t.type == TOKEN_STRING )
+                numeric = false;
+            else
+                return false;
+
+            // all the literals of an IN list must be of the same kind.
+            if ( !term.strings.empty() && numeric != term.numeric )
+                return false;
+
+            term.numeric = numeric;
+            term.strings.push_back( t.text );
+            term.numbers.push_back( t.number );
+            ++_pos;
+            return true;
+        }
+
+        bool parsePrimary(unsigned& out)
+        {
+            if ( peek().type == TOKEN_LPAREN )
+            {
+                ++_pos;
+                if ( !parseOr(out) || peek().type != TOKEN_RPAREN )
+                    return false;
+                ++_pos;
+                return true;
+            }
+
+            const Token& ident = peek();
+            if ( ident.type != TOKEN_IDENT || isKeyword(ident) )
+                return false;
+            ++_pos;
+
+            Term term;
+            term.attr = ident.text;
+            term.numeric = false;
+
+            if ( keyword("IS") )
+            {
+                bool negate = keyword("NOT");
+                if ( !keyword("NULL") )
+                    return false;
+                term.op = negate ? Term::OP_IS_NOT_NULL : Term::OP_IS_NULL;
+                out = add( term );
+                return true;
+            }
+
+            bool negate = keyword("NOT");
+            if ( keyword("IN") )
+            {
+                if ( peek().type != TOKEN_LPAREN )
+                    return false;
+                ++_pos;
+                for( ;; )
+                {
+                    if ( !parseLiteral(term) )
+                        return false;
+                    if ( peek().type != TOKEN_COMMA )
+                        break;
+                    ++_pos;
+                }
+
+                if ( peek().type != TOKEN_RPAREN )
+                    return false;
+                ++_pos;
+
+                term.op = Term::OP_IN;
+                out = add( term );
+                if ( negate )
+                {
+                    Term t = logical(Term::OP_NOT);
+                    t.operands.push_back( out );
+                    out = add( t );
+                }
+                return true;
+            }
+            else if ( negate || peek().type != TOKEN_OP )
+            {
+                return false;
+            }
+
+            const std::string& op = peek().text;
+            if      ( op == "=" || op == "==" ) term.op = Term::OP_EQ;
+            else if ( op == "!=" || op == "<>" ) term.op = Term::OP_NE;
+            else if ( op == "<"  ) term.op = Term::OP_LT;
+            else if ( op == "<=" ) term.op = Term::OP_LE;
+            else if ( op == ">"  ) term.op = Term::OP_GT;
+            else if ( op == ">=" ) term.op = Term::OP_GE;
+            else return false;
+            ++_pos;
+
+            if ( !parseLiteral(term) )
+                return false;
+
+            out = add( term );
+            return true;
+        }
+    };
+
+    template<typename T>
+    Truth compare(Term::Op op, const T& lhs, const T& rhs)
+    {
+        bool result =
+            op == Term::OP_EQ ? lhs == rhs :
+            op == Term::OP_NE ? !(lhs == rhs) :
+            op == Term::OP_LT ? lhs <  rhs :
+            op == Term::OP_LE ? lhs <= rhs :
+            op == Term::OP_GT ? lhs >  rhs :
+                                lhs >= rhs;
+        return result ? TRUTH_TRUE : TRUTH_FALSE;
+    }
+
+    // Evaluates a compiled term with SQL's three-valued logic: a comparison
+    // against a missing or NULL attribute is unknown, and only a TRUE
+    // result selects the feature.
+    Truth evaluate(const std::vector<Term>& terms, unsigned i, const Feature* feature)
+    {
+        const Term& term = terms[i];
+
+        switch( term.op )
+        {
+        case Term::OP_AND:
+        case Term::OP_OR:
+            {
+                Truth stop   = term.op == Term::OP_AND ? TRUTH_FALSE : TRUTH_TRUE;
+                Truth result = term.op == Term::OP_AND ? TRUTH_TRUE  : TRUTH_FALSE;
+                for( unsigned k=0; k<term.operands.size(); ++k )
+                {
+                    Truth t = evaluate( terms, term.operands[k], feature );
+                    if ( t == stop )
+                        return stop;
+                    if ( t == TRUTH_UNKNOWN )
+                        result = TRUTH_UNKNOWN;
+                }
+                return result;
+            }
+
+        case Term::OP_NOT:
+            {
+                Truth t = evaluate( terms, term.operands[0], feature );
+                return t == TRUTH_UNKNOWN ? t : t == TRUTH_TRUE ? TRUTH_FALSE : TRUTH_TRUE;
+            }
+
+        default:
+            break;
+        }
+
+        AttributeTable::const_iterator a = feature->getAttrs().find( term.attr );
+        bool isNull = a == feature->getAttrs().end() || !a->second.second.set;
+
+        if ( term.op == Term::OP_IS_NULL )
+            return isNull ? TRUTH_TRUE : TRUTH_FALSE;
+        if ( term.op == Term::OP_IS_NOT_NULL )
+            return isNull ? TRUTH_FALSE : TRUTH_TRUE;
+        if ( isNull )
+            return TRUTH_UNKNOWN;
+
+        if ( term.numeric )
+        {
+            double value = a->second.getDouble();
+            if ( term.op == Term::OP_IN )
+                return std::find(term.numbers.begin(), term.numbers.end(), value) != term.numbers.end() ? TRUTH_TRUE : TRUTH_FALSE;
+            return compare( term.op, value, term.numbers[0] );
+        }
+        else
+        {
+            std::string value = a->second.getString();
+            if ( term.op == Term::OP_IN )
+                return std::find(term.strings.begin(), term.strings.end(), value) != term.strings.end() ? TRUTH_TRUE : TRUTH_FALSE;
+            return compare( term.op, value, term.strings[0] );
+        }
+    }
+
+    // Orders output bins by selector, then by style key.
+    struct BinOrder
+    {
+        BinOrder(const StyleSelectorTable::Bins& bins) : _bins(bins) { }
+        const StyleSelectorTable::Bins& _bins;
+
+        bool operator()(unsigned lhs, unsigned rhs) const
+        {
+            const StyleSelectorTable::Bin& a = _bins[lhs];
+            const StyleSelectorTable::Bin& b = _bins[rhs];
+            return a.selector < b.selector || (a.selector == b.selector && a.styleKey < b.styleKey);
+        }
+    };
+}
+
+//------------------------------------------------------------------------
+
+StyleSelectorTable::StyleSelectorTable(const StyleSheet* sheet, bool evaluateQueries) :
+_numCompiled( 0 )
+{
+    if ( !sheet )
+        return;
+
+    for( StyleSelectorList::const_iterator i = sheet->selectors().begin(); i != sheet->selectors().end(); ++i )
+    {
+        _entries.push_back( Entry() );
+        Entry& entry = _entries.back();
+        entry.selector   = *i;
+        entry.compiled   = false;
+        entry.dispatched = false;
+
+        const optional<Query>& query = i->query();
+
+        if ( !query.isSet() )
+        {
+            entry.compiled = true;
+        }
+        else if ( !query->bounds().isSet() && !query->tileKey().isSet() && !query->orderby().isSet() )
+        {
+            if ( !query->expression().isSet() || trim(*query->expression()).empty() )
+                entry.compiled = true;
+            else if ( evaluateQueries )
+                entry.compiled = compile( *query->expression(), entry.terms );
+        }
+
+        if ( entry.compiled )
+        {
+            ++_numCompiled;
+        }
+        else
+        {
+            OE_DEBUG << LC << "Selector \"" << i->name() << "\" will run its own query" << std::endl;
+        }
+    }
+
+    // "attr = 'value'" and "attr IN ('a', 'b')" go in the equality table, so that
+    // a tile with dozens of such selectors costs one lookup per attribute.
+    for( unsigned s=0; s<_entries.size(); ++s )
+    {
+        Entry& entry = _entries[s];
+        if ( !entry.compiled )
+            continue;
+
+        if ( entry.terms.size() == 1 &&
+             !entry.terms[0].numeric &&
+             (entry.terms[0].op == Term::OP_EQ || entry.terms[0].op == Term::OP_IN) )
+        {
+            const Term& term = entry.terms[0];
+            ValueTable& values = _dispatch[term.attr];
+            for( unsigned v=0; v<term.strings.size(); ++v )
+            {
+                std::vector<unsigned>& selectors = values[term.strings[v]];
+                if ( selectors.empty() || selectors.back() != s )
+                    selectors.push_back( s );
+            }
+            entry.dispatched = true;
+        }
+        else
+        {
+            _evaluated.push_back( s );
+        }
+    }
+}
+
+bool
+StyleSelectorTable::compile(const std::string& expr, std::vector<Term>& terms)
+{
+    std::vector<Token> tokens;
+    if ( !tokenize(expr, tokens) )
+        return false;
+
+    Parser parser( tokens, terms );
+    if ( !parser.parse() )
+    {
+        terms.clear();
+        return false;
+    }
+    return true;
+}
+
+bool
+StyleSelectorTable::matches(const Entry& entry, const Feature* feature) const
+{
+    return entry.terms.empty() || evaluate(entry.terms, entry.terms.size()-1, feature) == TRUTH_TRUE;
+}
+
+void
+StyleSelectorTable::sort(const FeatureList&   features,
+                         const FilterContext& context,
+                         Bins&                output) const
+{
+    // style keys are interned, so placing a feature costs an integer lookup
+    // instead of a string comparison per bin.
+    std::map<std::string, unsigned> keyIds;
+    std::vector<unsigned>           selectorKeys( _entries.size(), 0u );
+
+    // per-call copies of the style expressions, since evaluation binds variables in them.
+    std::map<unsigned, StringExpression> exprs;
+
+    for( unsigned s=0; s<_entries.size(); ++s )
+    {
+        const StyleSelector& sel = _entries[s].selector;
+        if ( sel.styleExpression().isSet() )
+        {
+            exprs[s] = *sel.styleExpression();
+        }
+        else
+        {
+            std::map<std::string, unsigned>::iterator k = keyIds.insert(
+                std::make_pair(sel.getSelectedStyleName(), (unsigned)keyIds.size()) ).first;
+            selectorKeys[s] = k->second;
+        }
+    }
+
+    Bins bins;
+    std::map<std::pair<unsigned,unsigned>, unsigned> binIds;
+    std::vector<unsigned> matched;
+
+    for( FeatureList::const_iterator f = features.begin(); f != features.end(); ++f )
+    {
+        Feature* feature = f->get();
+        if ( !feature )
+            continue;
+
+        matched.clear();
+
+        for( DispatchTable::const_iterator d = _dispatch.begin(); d != _dispatch.end(); ++d )
+        {
+            const AttributeTable& attrs = feature->getAttrs();
+            AttributeTable::const_iterator a = attrs.find( d->first );
+            if ( a != attrs.end() && a->second.second.set )
+            {
+                ValueTable::const_iterator v = d->second.find( a->second.getString() );
+                if ( v != d->second.end() )
+                    matched.insert( matched.end(), v->second.begin(), v->second.end() );
+            }
+        }
+
+        for( unsigned e=0; e<_evaluated.size(); ++e )
+        {
+            if ( matches(_entries[_evaluated[e]], feature) )
+                matched.push_back( _evaluated[e] );
+        }
+
+        for( unsigned m=0; m<matched.size(); ++m )
+        {
+            unsigned s = matched[m];
+
+            unsigned key;
+            std::map<unsigned, StringExpression>::iterator expr = exprs.find( s );
+            if ( expr != exprs.end() )
+            {
+                const std::string& styleString = feature->eval( expr->second, &context );
+                key = keyIds.insert( std::make_pair(styleString, (unsigned)keyIds.size()) ).first->second;
+            }
+            else
+            {
+                key = selectorKeys[s];
+            }
+
+            std::pair<std::map<std::pair<unsigned,unsigned>, unsigned>::iterator, bool> b =
+                binIds.insert( std::make_pair(std::make_pair(s, key), (unsigned)bins.size()) );
+
+            if ( b.second )
+            {
+                bins.push_back( Bin() );
+                bins.back().selector = s;
+            }
+
+            Bin& bin = bins[b.first->second];
+            if ( m == 0 )
+                bin.features.push_back( feature );
+            else
+                bin.features.push_back( new Feature(*feature, osg::CopyOp::DEEP_COPY_ALL) );
+        }
+    }
+
+    // resolve the interned keys back to strings for the caller.
+    std::vector<const std::string*> keys( keyIds.size(), 0L );
+    for( std::map<std::string, unsigned>::const_iterator k = keyIds.begin(); k != keyIds.end(); ++k )
+        keys[k->second] = &k->first;
+
+    for( std::map<std::pair<unsigned,unsigned>, unsigned>::const_iterator b = binIds.begin(); b != binIds.end(); ++b )
+        bins[b->second].styleKey = *keys[b->first.second];
+
+    std::vector<unsigned> order( bins.size() );
+    for( unsigned i=0; i<order.size(); ++i )
+        order[i] = i;
+    std::sort( order.begin(), order.end(), BinOrder(bins) );
+
+    output.reserve( output.size() + bins.size() );
+    for( unsigned i=0; i<order.size(); ++i )
+    {
+        Bin& bin = bins[order[i]];
+        output.push_back( Bin() );
+        output.back().selector = bin.selector;
+        output.back().styleKey = bin.styleKey;
+        output.back().features.swap( bin.features );
+    }
+}
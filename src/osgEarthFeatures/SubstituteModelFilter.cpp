@@ -159,6 +159,15 @@ SubstituteModelFilter::process(const FeatureList&           features,
     if ( modelSymbol )
         headingEx = *modelSymbol->heading();
 
+    // With instancing, every tile draws the same prototype from the scene-wide
+    // palette instead of cloning the model for itself. (Not for icons, which get
+    // per-tile state below, or clustering, which rebuilds the geometry.)
+    bool usePalette =
+        _useDrawInstanced &&
+        !_cluster         &&
+        !iconSymbol       &&
+        Registry::capabilities().supportsDrawInstanced();
+
     for( FeatureList::const_iterator f = features.begin(); f != features.end(); ++f )
     {
         Feature* input = f->get();
@@ -210,9 +219,21 @@ SubstituteModelFilter::process(const FeatureList&           features,
         osg::ref_ptr<osg::Node>& model = uniqueModels[key];
         if ( !model.valid() )
         {
-            // Always clone the cached instance so we're not processing data that's
-            // already in the scene graph. -gw
-            context.resourceCache()->cloneOrCreateInstanceNode(instance.get(), model);
+            if ( usePalette )
+            {
+                osg::ref_ptr<osg::Node> shared;
+                if ( context.resourceCache()->getOrCreateInstanceNode(instance.get(), shared) )
+                {
+                    Registry::instancePalette()->getOrCreatePrototype(
+                        instance->getConfig().toJSON(false), shared.get(), model );
+                }
+            }
+            else
+            {
+                // Always clone the cached instance so we're not processing data that's
+                // already in the scene graph. -gw
+                context.resourceCache()->cloneOrCreateInstanceNode(instance.get(), model);
+            }
 
             // if icon decluttering is off, install an AutoTransform.
             if ( iconSymbol )
@@ -40,13 +40,14 @@ namespace
         "#extension GL_EXT_gpu_shader4 : enable \n" 
         "#extension GL_ARB_draw_instanced: enable \n" 
 
-        "uniform sampler2D oe_tile_elevationTex; \n"
-        "uniform mat4 oe_tile_elevationTexMatrix; \n"
         "uniform vec2 oe_trees_span; \n"
 
         "uniform vec4 oe_tile_key; \n"
 
         "varying float oe_modelsplat_dist; \n"
+
+        // terrain SDK; decodes quantized elevation textures
+        "float oe_terrain_getElevation(in vec2 uv); \n"
         
         "float oe_modelsplat_rand(vec2 co) \n"
         "{\n"
@@ -63,15 +64,7 @@ namespace
         "    vec2 offset = -0.5*span + span*rxy; \n"
         "    VertexMODEL.xy += offset; \n"
 
-        // matrix mult probably unnecessary 
-        "    vec4 rc = oe_tile_elevationTexMatrix * vec4(rx, ry, 0.0, 1.0); \n"
-     
-        // scale and bias the tex coords for heightfield sampling:
-        // "17" is the tile size. Obviously this needs to be parameterized.
-        "    rc *= 16.0/17.0; \n"
-        "    rc += 0.5/17.0; \n"
-
-        "    float h = texture2D(oe_tile_elevationTex, rc.st).r; \n"
+        "    float h = oe_terrain_getElevation(rxy); \n"
         "    VertexMODEL.z += h; \n"
         "} \n";
 
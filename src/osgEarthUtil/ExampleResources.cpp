@@ -26,6 +26,7 @@
 #include <osgEarthUtil/MGRSFormatter>
 #include <osgEarthUtil/MouseCoordsTool>
 #include <osgEarthUtil/AutoClipPlaneHandler>
+#include <osgEarthUtil/TilePrefetcher>
 #include <osgEarthUtil/DataScanner>
 #include <osgEarthUtil/Sky>
 #include <osgEarthUtil/Ocean>
@@ -484,6 +485,7 @@ MapNodeHelper::parse(MapNode*             mapNode,
     bool useCoords     = args.read("--coords") || useMGRS || useDMS || useDD;
     bool useOrtho      = args.read("--ortho");
     bool useAutoClip   = args.read("--autoclip");
+    bool usePrefetch   = args.read("--prefetch");
     bool useShadows    = args.read("--shadows");
     bool animateSky    = args.read("--animate-sky");
     bool showActivity  = args.read("--activity");
@@ -715,6 +717,12 @@ MapNodeHelper::parse(MapNode*             mapNode,
         mapNode->addCullCallback( new AutoClipPlaneCullCallback(mapNode) );
     }
 
+    // Install a predictive tile prefetcher
+    if ( usePrefetch )
+    {
+        mapNode->addCullCallback( new TilePrefetcher(mapNode) );
+    }
+
     // Install logarithmic depth buffer on main camera
     if ( useLogDepth )
     {
@@ -193,6 +193,9 @@ RTTPicker::getOrCreatePickContext(osg::View* view)
 
     // default value for the objectid override uniform:
     rttSS->addUniform( new osg::Uniform(Registry::objectIndex()->getObjectIDUniformName().c_str(), 0u) );
+
+    // default base for compact vertex IDs (full IDs need zero):
+    rttSS->addUniform( new osg::Uniform(Registry::objectIndex()->getObjectIDBaseUniformName().c_str(), 0u) );
     
     // install the pick camera on the main camera.
     view->getCamera()->addChild( c._pickCamera.get() );
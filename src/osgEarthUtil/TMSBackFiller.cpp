@@ -22,19 +22,176 @@
 #include <osgEarthUtil/TMSBackFiller>
 #include <osgEarth/ImageUtils>
 #include <osgEarth/FileUtils>
+#include <osgEarth/GeoCommon>
 #include <osgEarth/ImageMosaic>
 
+#include <osg/Math>
+#include <osg/Timer>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
+#include <OpenThreads/ScopedLock>
+#include <OpenThreads/Thread>
+
+#include <cmath>
 
 #define LC "[TMSBackFiller] "
 
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
-TMSBackFiller::TMSBackFiller()
+namespace
+{
+    /** Runs TMSBackFiller::processKeys on its own thread */
+    struct BackFillThread : public OpenThreads::Thread
+    {
+        BackFillThread( TMSBackFiller* filler ) : _filler( filler ) { }
+        void run() { _filler->processKeys(); }
+        TMSBackFiller* _filler;
+    };
+
+    // Each child tile becomes one quadrant of its parent. Child 0 is the
+    // northwest tile; image rows run south to north, so the northern
+    // children land in the upper half of the parent.
+    void getQuadrantOffset( unsigned quadrant, int s, int t, int& col, int& row )
+    {
+        col = (quadrant & 1u) ? s/2 : 0;
+        row = quadrant < 2u ? t/2 : 0;
+    }
+
+    /** 2x2 box filter of an 8-bit image with N channels, written into one quadrant of the output */
+    template<unsigned N>
+    void boxFilter8( const osg::Image* in, osg::Image* out, int col, int row )
+    {
+        int w = in->s()/2, h = in->t()/2;
+        for(int y=0; y<h; ++y)
+        {
+            const unsigned char* r0 = in->data( 0, 2*y );
+            const unsigned char* r1 = in->data( 0, 2*y+1 );
+            unsigned char*       o  = out->data( col, row+y );
+
+            for(int x=0; x<w; ++x, r0 += 2*N, r1 += 2*N, o += N)
+            {
+                for(unsigned c=0; c<N; ++c)
+                {
+                    o[c] = (unsigned char)((r0[c] + r0[N+c] + r1[c] + r1[N+c] + 2u) >> 2);
+                }
+            }
+        }
+    }
+
+    /** 2x2 box filter of a single channel float image (heightfield), skipping no-data samples */
+    void boxFilterFloat( const osg::Image* in, osg::Image* out, int col, int row )
+    {
+        int w = in->s()/2, h = in->t()/2;
+        for(int y=0; y<h; ++y)
+        {
+            const float* r0 = (const float*)in->data( 0, 2*y );
+            const float* r1 = (const float*)in->data( 0, 2*y+1 );
+            float*       o  = (float*)out->data( col, row+y );
+
+            for(int x=0; x<w; ++x, r0 += 2, r1 += 2, ++o)
+            {
+                float sum = 0.0f;
+                int   num = 0;
+                if ( r0[0] != NO_DATA_VALUE ) { sum += r0[0]; ++num; }
+                if ( r0[1] != NO_DATA_VALUE ) { sum += r0[1]; ++num; }
+                if ( r1[0] != NO_DATA_VALUE ) { sum += r1[0]; ++num; }
+                if ( r1[1] != NO_DATA_VALUE ) { sum += r1[1]; ++num; }
+                *o = num > 0 ? sum/(float)num : NO_DATA_VALUE;
+            }
+        }
+    }
+
+    // Lanczos-2 weights for a 2:1 reduction. Output pixel i is centered
+    // between input pixels 2i and 2i+1 and samples input pixels 2i-3..2i+4.
+    #define LANCZOS_TAPS 8
+
+    struct LanczosWeights
+    {
+        float w[LANCZOS_TAPS];
+
+        LanczosWeights()
+        {
+            float sum = 0.0f;
+            for(int k=0; k<LANCZOS_TAPS; ++k)
+            {
+                double d = ((double)(k-3) - 0.5) * 0.5;
+                w[k] = (float)(sinc(d) * sinc(d*0.5));
+                sum += w[k];
+            }
+            for(int k=0; k<LANCZOS_TAPS; ++k)
+                w[k] /= sum;
+        }
+
+        static double sinc( double x )
+        {
+            x *= osg::PI;
+            return x == 0.0 ? 1.0 : sin(x)/x;
+        }
+    };
+
+    /**
+     * Lanczos-2 reduction of an 8-bit image, written into one quadrant of
+     * the output. Samples past the edges of the child are clamped.
+     */
+    void lanczosFilter8( const osg::Image* in, osg::Image* out, int col, int row, unsigned n )
+    {
+        static const LanczosWeights weights;
+        const float* w = weights.w;
+
+        int inW = in->s(), inH = in->t();
+        int outW = inW/2, outH = inH/2;
+
+        // horizontal pass into a half-width float buffer:
+        std::vector<float> temp( outW * inH * n );
+        for(int y=0; y<inH; ++y)
+        {
+            const unsigned char* r = in->data( 0, y );
+            float* t = &temp[y * outW * n];
+            for(int x=0; x<outW; ++x)
+            {
+                for(unsigned c=0; c<n; ++c)
+                {
+                    float sum = 0.0f;
+                    for(int k=0; k<LANCZOS_TAPS; ++k)
+                    {
+                        int i = osg::clampBetween( 2*x + k - 3, 0, inW-1 );
+                        sum += w[k] * (float)r[i*n + c];
+                    }
+                    t[x*n + c] = sum;
+                }
+            }
+        }
+
+        // vertical pass into the output:
+        for(int y=0; y<outH; ++y)
+        {
+            unsigned char* o = out->data( col, row+y );
+            for(int x=0; x<outW*(int)n; ++x)
+            {
+                float sum = 0.0f;
+                for(int k=0; k<LANCZOS_TAPS; ++k)
+                {
+                    int j = osg::clampBetween( 2*y + k - 3, 0, inH-1 );
+                    sum += w[k] * temp[j * outW * n + x];
+                }
+                o[x] = (unsigned char)osg::clampBetween( sum + 0.5f, 0.0f, 255.0f );
+            }
+        }
+    }
+}
+
+
+TMSBackFiller::TMSBackFiller() :
+_minLevel      ( 0u ),
+_maxLevel      ( 0u ),
+_verbose       ( false ),
+_numThreads    ( osg::maximum( OpenThreads::GetNumberOfProcessors(), 1 ) ),
+_filter        ( FILTER_BOX ),
+_maxCachedBytes( 512u * 1024u * 1024u ),
+_cachedBytes   ( 0u )
 {
 }
 
@@ -43,6 +200,9 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
 {               
     std::string fullPath = getFullPath( "", tms );        
     _options = options;
+    _stats = Stats();
+
+    osg::Timer_t start = osg::Timer::instance()->tick();
 
     //Read the tilemap
     _tileMap = TileMapReaderWriter::read( fullPath, 0 );
@@ -62,67 +222,234 @@ void TMSBackFiller::process( const std::string& tms, osgDB::Options* options )
 
         GeoExtent extent( profile->getSRS(), _bounds );           
 
-        //Process each level in it's entirety
+        //Process each level in it's entirety. The tiles built at one level
+        //are the children of the next one, so they stay in memory until then.
         for (int level = firstLevel; level >= static_cast<int>(_minLevel); level--)
         {
             if (_verbose) OE_NOTICE << "Processing level " << level << std::endl;                
 
+            osg::Timer_t levelStart = osg::Timer::instance()->tick();
+            unsigned built = getStats().tilesBuilt;
+
             TileKey ll = profile->createTileKey(extent.xMin(), extent.yMin(), level);
             TileKey ur = profile->createTileKey(extent.xMax(), extent.yMax(), level);
 
+            _keys.clear();
             for (unsigned int x = ll.getTileX(); x <= ur.getTileX(); x++)
             {
                 for (unsigned int y = ur.getTileY(); y <= ll.getTileY(); y++)
                 {
-                    TileKey key = TileKey(level, x, y, profile.get());
-                    processKey( key );
+                    _keys.push_back( TileKey(level, x, y, profile.get()) );
                 }
             }                
 
+            _nextKey.exchange( 0u );
+
+            unsigned numThreads = osg::minimum( _numThreads, (unsigned)_keys.size() );
+            if ( numThreads <= 1u )
+            {
+                processKeys();
+            }
+            else
+            {
+                std::vector< BackFillThread* > threads;
+                for (unsigned i = 0; i < numThreads; ++i)
+                {
+                    threads.push_back( new BackFillThread(this) );
+                    threads.back()->start();
+                }
+                for (unsigned i = 0; i < threads.size(); ++i)
+                {
+                    threads[i]->join();
+                    delete threads[i];
+                }
+            }
+
+            // children that had no parent in the bounds are no longer needed.
+            _children.swap( _parents );
+            _parents.clear();
+            _cachedBytes = 0u;
+            for (ImageMap::const_iterator i = _children.begin(); i != _children.end(); ++i)
+            {
+                _cachedBytes += i->second->getTotalSizeInBytes();
+            }
+
+            if (_verbose)
+            {
+                double s = osg::Timer::instance()->delta_s( levelStart, osg::Timer::instance()->tick() );
+                unsigned count = getStats().tilesBuilt - built;
+                OE_NOTICE << "Level " << level << ": " << count << " tiles in " << s << "s ("
+                    << (s > 0.0 ? (double)count/s : 0.0) << " tiles/s)" << std::endl;
+            }
         }            
+
+        _children.clear();
+        _cachedBytes = 0u;
     }
     else
     {
         OE_NOTICE << "Failed to load TileMap from " << _tmsPath << std::endl;
     }
+
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _statsMutex );
+    _stats.elapsed = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
 }
 
-void TMSBackFiller::processKey( const TileKey& key )
+TMSBackFiller::Stats TMSBackFiller::getStats() const
+{
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _statsMutex );
+    return _stats;
+}
+
+void TMSBackFiller::processKeys()
+{
+    for (unsigned i = (++_nextKey) - 1u; i < _keys.size(); i = (++_nextKey) - 1u)
+    {
+        processKey( _keys[i] );
+    }
+}
+
+bool TMSBackFiller::processKey( const TileKey& key )
 {
     if (_verbose) OE_NOTICE << "Processing key " << key.str() << std::endl;
 
-    //Get all of the child tiles for this key, load them and mosaic them into a new tile
-    TileKey ulKey = key.createChildKey( 0 );
-    TileKey urKey = key.createChildKey( 1 );
-    TileKey llKey = key.createChildKey( 2 );
-    TileKey lrKey = key.createChildKey( 3 );
-
-    osg::ref_ptr< osg::Image > ul = readTile( ulKey );
-    osg::ref_ptr< osg::Image > ur = readTile( urKey );
-    osg::ref_ptr< osg::Image > ll = readTile( llKey );
-    osg::ref_ptr< osg::Image > lr = readTile( lrKey );
-
-    if (ul.valid() && ur.valid() && ll.valid() && lr.valid())
-    {            
-        //Merge them together
-        ImageMosaic mosaic;
-        mosaic.getImages().push_back( TileImage( ul.get(), ulKey ) );
-        mosaic.getImages().push_back( TileImage( ur.get(), urKey ) );
-        mosaic.getImages().push_back( TileImage( ll.get(), llKey ) );
-        mosaic.getImages().push_back( TileImage( lr.get(), lrKey ) );            
-
-        osg::ref_ptr< osg::Image> merged = mosaic.createImage();
-        if (merged.valid())
+    //Get all of the child tiles for this key and downsample them into a new tile
+    osg::ref_ptr< osg::Image > children[4];
+    bool complete = true;
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        complete = getChild( key.createChildKey(i), children[i] ) && complete;
+    }
+
+    osg::ref_ptr< osg::Image > image;
+    if ( complete )
+    {
+        image = downsample( key, children );
+    }
+
+    if ( !image.valid() )
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _statsMutex );
+        _stats.tilesSkipped++;
+        return false;
+    }
+
+    writeTile( key, image.get() );
+
+    // keep the tile around for its parent, if there is room.
+    if ( key.getLevelOfDetail() > _minLevel )
+    {
+        unsigned bytes = image->getTotalSizeInBytes();
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _cacheMutex );
+        if ( _cachedBytes + bytes <= _maxCachedBytes )
         {
-            //Resize the image so it's the same size as one of the input files
-            osg::ref_ptr<osg::Image> resized;
-            ImageUtils::resizeImage( merged.get(), ul->s(), ul->t(), resized );
-            std::string outputFilename = getFilename( key );                
-            writeTile( key, resized.get() );
+            _parents[key] = image.get();
+            _cachedBytes += bytes;
         }
-    }                
+    }
+
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _statsMutex );
+    _stats.tilesBuilt++;
+    return true;
 }    
 
+bool TMSBackFiller::getChild( const TileKey& key, osg::ref_ptr< osg::Image >& output )
+{
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _cacheMutex );
+        ImageMap::iterator i = _children.find( key );
+        if ( i != _children.end() )
+        {
+            // each child has one parent, so it can go once taken.
+            output = i->second.get();
+            _cachedBytes -= output->getTotalSizeInBytes();
+            _children.erase( i );
+        }
+    }
+
+    if ( output.valid() )
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _statsMutex );
+        _stats.tilesReused++;
+        return true;
+    }
+
+    output = readTile( key );
+    if ( output.valid() )
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _statsMutex );
+        _stats.tilesRead++;
+    }
+    return output.valid();
+}
+
+osg::Image* TMSBackFiller::downsample( const TileKey& key, osg::ref_ptr< osg::Image > children[4] ) const
+{
+    const osg::Image* first = children[0].get();
+    int s = first->s(), t = first->t();
+
+    // The direct path needs four equal, even sized children in a format
+    // it knows; everything else is mosaicked and resized.
+    bool direct = (s % 2) == 0 && (t % 2) == 0 && first->r() == 1;
+    for (unsigned i = 1; i < 4 && direct; ++i)
+    {
+        const osg::Image* child = children[i].get();
+        direct =
+            child->s() == s && child->t() == t && child->r() == 1 &&
+            child->getPixelFormat() == first->getPixelFormat() &&
+            child->getDataType()    == first->getDataType();
+    }
+
+    unsigned n = osg::Image::computeNumComponents( first->getPixelFormat() );
+    bool isByte  = first->getDataType() == GL_UNSIGNED_BYTE && n >= 1u && n <= 4u;
+    bool isFloat = first->getDataType() == GL_FLOAT && n == 1u;
+    direct = direct && (isByte || isFloat);
+
+    if ( direct )
+    {
+        osg::ref_ptr< osg::Image > output = new osg::Image();
+        output->allocateImage( s, t, 1, first->getPixelFormat(), first->getDataType(), first->getPacking() );
+        output->setInternalTextureFormat( first->getInternalTextureFormat() );
+
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            int col, row;
+            getQuadrantOffset( i, s, t, col, row );
+            const osg::Image* child = children[i].get();
+
+            if ( isFloat )
+                boxFilterFloat( child, output.get(), col, row );
+            else if ( _filter == FILTER_LANCZOS )
+                lanczosFilter8( child, output.get(), col, row, n );
+            else if ( n == 4u )
+                boxFilter8<4>( child, output.get(), col, row );
+            else if ( n == 3u )
+                boxFilter8<3>( child, output.get(), col, row );
+            else if ( n == 2u )
+                boxFilter8<2>( child, output.get(), col, row );
+            else
+                boxFilter8<1>( child, output.get(), col, row );
+        }
+        return output.release();
+    }
+
+    //Merge them together
+    ImageMosaic mosaic;
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        mosaic.getImages().push_back( TileImage( children[i].get(), key.createChildKey(i) ) );
+    }
+
+    osg::ref_ptr< osg::Image> merged = mosaic.createImage();
+    if (!merged.valid())
+        return 0L;
+
+    //Resize the image so it's the same size as one of the input files
+    osg::ref_ptr<osg::Image> resized;
+    ImageUtils::resizeImage( merged.get(), s, t, resized );
+    return resized.release();
+}
+
 std::string TMSBackFiller::getFilename( const TileKey& key )
 {
     return _tileMap->getURL( key, false );        
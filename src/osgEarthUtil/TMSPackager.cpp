@@ -26,6 +26,10 @@
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/WriteFile>
+#include <osgDB/Registry>
+#include <osg/Timer>
+#include <fstream>
+#include <sstream>
 
 
 #define LC "[TMSPackager] "
@@ -33,6 +37,36 @@
 using namespace osgEarth::Util;
 using namespace osgEarth;
 
+namespace
+{
+    /**
+     * Encodes and writes one created tile on an encoder thread.
+     */
+    struct EncodeTileTask : public TaskRequest
+    {
+        EncodeTileTask(TMSPackager* packager, const TileKey& key, osg::Image* image, const std::string& path, unsigned bytes) :
+            _packager( packager ),
+            _key     ( key ),
+            _image   ( image ),
+            _path    ( path ),
+            _bytes   ( bytes )
+        {
+            //nop
+        }
+
+        void operator()( ProgressCallback* progress )
+        {
+            _packager->encodeTile( _key, _image.get(), _path, _bytes );
+        }
+
+        TMSPackager*             _packager;
+        TileKey                  _key;
+        osg::ref_ptr<osg::Image> _image;
+        std::string              _path;
+        unsigned                 _bytes;
+    };
+}
+
 WriteTMSTileHandler::WriteTMSTileHandler(TerrainLayer* layer,  Map* map, TMSPackager* packager):
     _layer( layer ),
     _map(map),
@@ -61,17 +95,23 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
     ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
     ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layer.get() );
 
-    // Get the path to write to
-    std::string path = getPathForTile( key );
-
-    // Don't write out a new file if we're not overwriting
-    if (osgDB::fileExists(path) && !_packager->getOverwrite())
+    // Get the path to write to (tiles in an archive don't have one)
+    std::string path;
+    if ( !_packager->getWriteMBTiles() )
     {
-        return true;
+        path = getPathForTile( key );
+
+        // Don't write out a new file if we're not overwriting
+        if (osgDB::fileExists(path) && !_packager->getOverwrite())
+        {
+            return true;
+        }
+
+        // attempt to create the output folder:        
+        osgEarth::makeDirectoryForFile( path );       
     }
 
-    // attempt to create the output folder:        
-    osgEarth::makeDirectoryForFile( path );       
+    osg::Timer_t start = osg::Timer::instance()->tick();
 
 
     if (imageLayer)
@@ -98,14 +138,16 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             }
 
             // OE_NOTICE << "Created image for " << key.str() << std::endl;
-            osg::ref_ptr< const osg::Image > final = geoImage.getImage();                        
+            osg::ref_ptr< osg::Image > final = geoImage.getImage();                        
 
             // convert to RGB if necessary            
             if ( _packager->getExtension() == "jpg" && final->getPixelFormat() != GL_RGB )
             {
-                final = ImageUtils::convertToRGB8( final );
+                final = ImageUtils::convertToRGB8( final.get() );
             }            
-            return osgDB::writeImageFile(*final, path, _packager->getOptions());
+
+            double createTime = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+            return _packager->writeTile( key, final.get(), path, createTime );
         }            
     }
     else if (elevationLayer )
@@ -116,7 +158,9 @@ bool WriteTMSTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
             // convert the HF to an image
             ImageToHeightFieldConverter conv;
             osg::ref_ptr< osg::Image > image = conv.convert( hf.getHeightField(), _packager->getElevationPixelDepth() );				            
-            return osgDB::writeImageFile(*image.get(), path, _packager->getOptions());
+
+            double createTime = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+            return _packager->writeTile( key, image.get(), path, createTime );
         }            
     }
         
@@ -200,10 +244,22 @@ _visitor(new TileVisitor()),
     _height(0),
     _overwrite(false),
     _keepEmpties(false),
-    _applyAlphaMask(false)
+    _applyAlphaMask(false),
+    _numEncoderThreads(0u),
+    _maxPendingBytes(256u * 1024u * 1024u),
+    _writeMBTiles(false),
+    _batchSize(64u),
+    _batchBytes(0u),
+    _pendingBytes(0u),
+    _pendingTiles(0u)
 {
 }
 
+TMSPackager::~TMSPackager()
+{
+    waitForPendingTiles();
+}
+
 const std::string& TMSPackager::getDestination() const
 {
     return _destination;
@@ -294,6 +350,300 @@ void TMSPackager::setVisitor(TileVisitor* visitor)
     _visitor = visitor;
 }    
 
+unsigned TMSPackager::getNumEncoderThreads() const
+{
+    return _numEncoderThreads;
+}
+
+void TMSPackager::setNumEncoderThreads(unsigned value)
+{
+    _numEncoderThreads = value;
+}
+
+unsigned long long TMSPackager::getMaxPendingBytes() const
+{
+    return _maxPendingBytes;
+}
+
+void TMSPackager::setMaxPendingBytes(unsigned long long value)
+{
+    _maxPendingBytes = value;
+}
+
+bool TMSPackager::getWriteMBTiles() const
+{
+    return _writeMBTiles;
+}
+
+void TMSPackager::setWriteMBTiles(bool value)
+{
+    _writeMBTiles = value;
+}
+
+unsigned TMSPackager::getBatchSize() const
+{
+    return _batchSize;
+}
+
+void TMSPackager::setBatchSize(unsigned value)
+{
+    _batchSize = osg::maximum(value, 1u);
+}
+
+std::string TMSPackager::getMBTilesFileName() const
+{
+    return osgDB::concatPaths( _destination, toLegalFileName(_layerName) + ".mbtiles" );
+}
+
+TMSPackager::Stats TMSPackager::getStats() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+    return _stats;
+}
+
+bool TMSPackager::writeTile(const TileKey& key, osg::Image* image, const std::string& path, double createTime)
+{
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+        _stats.createTime += createTime;
+    }
+
+    unsigned bytes = image->getTotalSizeInBytes();
+
+    if ( !_encoders.valid() )
+    {
+        // encode and write right here.
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _pendingMutex );
+            _pendingBytes += bytes;
+            _pendingTiles++;
+        }
+        return encodeTile( key, image, path, bytes );
+    }
+
+    // Wait for room in the memory budget. Tiles held in a partial archive
+    // batch only leave the budget when the batch is written, so flush it
+    // rather than wait on it.
+    osg::Timer_t start = osg::Timer::instance()->tick();
+    for(;;)
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _pendingMutex );
+            if ( _pendingTiles == 0 || _maxPendingBytes == 0 || _pendingBytes + bytes <= _maxPendingBytes )
+            {
+                _pendingBytes += bytes;
+                _pendingTiles++;
+                break;
+            }
+        }
+
+        bool batched = false;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _batchMutex );
+            batched = !_batchKeys.empty();
+        }
+
+        if ( batched )
+        {
+            flushBatch();
+        }
+        else
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _pendingMutex );
+            if ( _pendingTiles > 0 && _pendingBytes + bytes > _maxPendingBytes )
+                _pendingChanged.wait( &_pendingMutex, 100 );
+        }
+    }
+
+    double waitTime = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+        _stats.waitTime += waitTime;
+    }
+
+    _encoders->add( new EncodeTileTask(this, key, image, path, bytes) );
+    return true;
+}
+
+bool TMSPackager::encodeTile(const TileKey& key, osg::Image* image, const std::string& path, unsigned bytes)
+{
+    if ( _archive.valid() )
+    {
+        // queue it for the next batch; the archive encodes and inserts a
+        // batch at a time.
+        bool flush = false;
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _batchMutex );
+            _batchKeys.push_back( key );
+            _batchImages.push_back( image );
+            _batchBytes += bytes;
+            flush = _batchKeys.size() >= _batchSize;
+        }
+
+        if ( flush )
+        {
+            flushBatch();
+        }
+        return true;
+    }
+
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+
+    // encode to memory first so the encode and write times are separate.
+    std::string data;
+    bool encoded = false;
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension( _extension );
+    if ( rw )
+    {
+        std::stringstream buf;
+        osgDB::ReaderWriter::WriteResult wr = rw->writeImage( *image, buf, _writeOptions.get() );
+        if ( wr.success() )
+        {
+            data = buf.str();
+            encoded = true;
+        }
+    }
+
+    osg::Timer_t t1 = osg::Timer::instance()->tick();
+
+    bool ok = false;
+    double bytesWritten = 0.0;
+    if ( encoded )
+    {
+        std::ofstream out( path.c_str(), std::ios::out | std::ios::binary );
+        out.write( data.c_str(), data.size() );
+        ok = !out.fail();
+        bytesWritten = (double)data.size();
+    }
+    else
+    {
+        // some plugins can only write to files.
+        ok = osgDB::writeImageFile( *image, path, _writeOptions.get() );
+    }
+
+    osg::Timer_t t2 = osg::Timer::instance()->tick();
+
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+        _stats.encodeTime += osg::Timer::instance()->delta_s( t0, encoded ? t1 : t2 );
+        _stats.writeTime  += encoded ? osg::Timer::instance()->delta_s( t1, t2 ) : 0.0;
+    }
+
+    recordTile( key, ok, bytesWritten );
+    releasePending( 1u, bytes );
+    return ok;
+}
+
+void TMSPackager::flushBatch()
+{
+    std::vector<TileKey>                    keys;
+    std::vector< osg::ref_ptr<osg::Image> > images;
+    unsigned                                bytes;
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _batchMutex );
+        keys.swap( _batchKeys );
+        images.swap( _batchImages );
+        bytes = _batchBytes;
+        _batchBytes = 0u;
+    }
+
+    if ( keys.empty() )
+        return;
+
+    osg::Timer_t t0 = osg::Timer::instance()->tick();
+    bool ok = _archive->storeImages( keys, images, 0L );
+    double writeTime = osg::Timer::instance()->delta_s( t0, osg::Timer::instance()->tick() );
+
+    if ( !ok )
+    {
+        OE_WARN << LC << "Failed to write a batch of " << keys.size() << " tiles to " << getMBTilesFileName() << std::endl;
+    }
+
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+        _stats.writeTime += writeTime;
+    }
+
+    for(unsigned i=0; i<keys.size(); ++i)
+    {
+        recordTile( keys[i], ok, 0.0 );
+    }
+
+    releasePending( keys.size(), bytes );
+}
+
+void TMSPackager::releasePending(unsigned tiles, unsigned bytes)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _pendingMutex );
+    _pendingTiles -= osg::minimum( tiles, _pendingTiles );
+    _pendingBytes -= osg::minimum( (unsigned long long)bytes, _pendingBytes );
+    _pendingChanged.broadcast();
+}
+
+void TMSPackager::recordTile(const TileKey& key, bool ok, double bytesWritten)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+    if ( ok )
+    {
+        _stats.tilesWritten++;
+        _stats.bytesWritten += bytesWritten;
+        _stats.maxLevel = osg::maximum( _stats.maxLevel, (int)key.getLevelOfDetail() );
+    }
+    else
+    {
+        _stats.tilesFailed++;
+    }
+}
+
+void TMSPackager::waitForPendingTiles()
+{
+    if ( _encoders.valid() )
+    {
+        // Send a poison pill to stop the threads once the queue is empty.
+        _encoders->add( new PoisonPill() );
+        while ( _encoders->areThreadsRunning() )
+        {
+            OpenThreads::Thread::microSleep( 10000 );
+        }
+        _encoders = 0L;
+    }
+
+    if ( _archive.valid() )
+    {
+        flushBatch();
+        _archive = 0L;
+    }
+}
+
+bool TMSPackager::openArchive(Map* map)
+{
+    osgDB::makeDirectory( _destination );
+
+    Config conf;
+    conf.set( "driver",   "mbtiles" );
+    conf.set( "filename", getMBTilesFileName() );
+    conf.set( "format",   _extension );
+    conf.add( "profile",  map->getProfile()->toProfileOptions().getConfig() );
+
+    TileSourceOptions options( conf );
+    _archive = TileSourceFactory::create( options );
+    if ( !_archive.valid() )
+    {
+        OE_WARN << LC << "Failed to load the mbtiles driver" << std::endl;
+        return false;
+    }
+
+    TileSource::Status status = _archive->open( TileSource::MODE_WRITE | TileSource::MODE_CREATE );
+    if ( status.isError() )
+    {
+        OE_WARN << LC << "Failed to open " << getMBTilesFileName() << ": " << status.message() << std::endl;
+        _archive = 0L;
+        return false;
+    }
+
+    return true;
+}
+
 void TMSPackager::run( TerrainLayer* layer,  Map* map  )
 {    
     // Get a test image from the root keys
@@ -381,13 +731,47 @@ void TMSPackager::run( TerrainLayer* layer,  Map* map  )
     }
 
 
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+        _stats = Stats();
+    }
+    osg::Timer_t start = osg::Timer::instance()->tick();
+
+    if ( _writeMBTiles && !openArchive(map) )
+    {
+        return;
+    }
+
+    if ( _numEncoderThreads > 0 )
+    {
+        _encoders = new TaskService( "TMSPackager", _numEncoderThreads );
+    }
+
     _handler = new WriteTMSTileHandler(layer, map, this);    
     _visitor->setTileHandler( _handler );    
     _visitor->run( map->getProfile() );    
+
+    // everything must be on disk before the metadata goes out.
+    waitForPendingTiles();
+
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock( _statsMutex );
+    _stats.elapsed = osg::Timer::instance()->delta_s( start, osg::Timer::instance()->tick() );
+    if ( _writeMBTiles )
+    {
+        std::ifstream archive( getMBTilesFileName().c_str(), std::ios::in | std::ios::binary | std::ios::ate );
+        if ( archive.is_open() )
+            _stats.bytesWritten = (double)archive.tellg();
+    }
 }
 
 void TMSPackager::writeXML( TerrainLayer* layer, Map* map)
 {
+    // an MBTiles file carries its own metadata.
+    if ( _writeMBTiles )
+    {
+        return;
+    }
+
      // create the tile map metadata:
     osg::ref_ptr<TMS::TileMap> tileMap = TMS::TileMap::create(
         "",
@@ -421,4 +805,4 @@ void TMSPackager::writeXML( TerrainLayer* layer, Map* map)
     std::string tileMapFilename = osgDB::concatPaths( osgDB::concatPaths(_destination, toLegalFileName( _layerName )), "tms.xml");
     OE_NOTICE << "Layer name " << _layerName << std::endl;
     TMS::TileMapReaderWriter::write( tileMap.get(), tileMapFilename );
-}
\ No newline at end of file
+}
\ No newline at end of file
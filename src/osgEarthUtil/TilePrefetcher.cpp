@@ -0,0 +1,339 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+ * Copyright 2015 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/TilePrefetcher>
+#include <osgEarth/MapNode>
+#include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/Notify>
+#include <osgEarth/CullingUtils>
+#include <osgUtil/CullVisitor>
+
+#define LC "[TilePrefetcher] "
+
+using namespace osgEarth::Util;
+using namespace osgEarth;
+
+// how much eye point history (seconds) to use for velocity estimation
+#define HISTORY_SECONDS 1.0
+
+// ignore camera motion slower than this (meters per second)
+#define MIN_SPEED 1.0
+
+// maximum number of issued keys to remember (for de-duplication and hit tracking)
+#define MAX_ISSUED 8192
+
+namespace
+{
+    /**
+     * Background task that creates one tile's worth of data for every
+     * image and elevation layer, which populates each layer's cache.
+     */
+    struct PrefetchTask : public TaskRequest
+    {
+        PrefetchTask(const TileKey& key, const MapFrame& frame, TilePrefetcher* prefetcher, double maxWait, float priority) :
+            TaskRequest( priority ),
+            _key       ( key ),
+            _frame     ( frame ),
+            _prefetcher( prefetcher ),
+            _maxWait   ( maxWait ),
+            _created   ( osg::Timer::instance()->tick() )
+        {
+            //nop
+        }
+
+        void operator()( ProgressCallback* progress )
+        {
+            osg::ref_ptr<TilePrefetcher> prefetcher;
+            if ( !_prefetcher.lock(prefetcher) )
+                return;
+
+            // If the request sat in the queue longer than the look-ahead time,
+            // the camera has already been there (or gone elsewhere).
+            if ( osg::Timer::instance()->delta_s(_created, osg::Timer::instance()->tick()) > _maxWait )
+            {
+                prefetcher->onPrefetchCompleted( _key, true );
+                return;
+            }
+
+            for(ImageLayerVector::const_iterator i = _frame.imageLayers().begin(); i != _frame.imageLayers().end(); ++i)
+            {
+                ImageLayer* layer = i->get();
+                if ( layer->getEnabled() && layer->isKeyInRange(_key) && !layer->isCached(_key) )
+                {
+                    layer->createImage( _key, progress );
+                }
+
+                if ( progress && progress->isCanceled() )
+                    break;
+            }
+
+            for(ElevationLayerVector::const_iterator i = _frame.elevationLayers().begin(); i != _frame.elevationLayers().end(); ++i)
+            {
+                ElevationLayer* layer = i->get();
+                if ( layer->getEnabled() && layer->isKeyInRange(_key) && !layer->isCached(_key) )
+                {
+                    layer->createHeightField( _key, progress );
+                }
+
+                if ( progress && progress->isCanceled() )
+                    break;
+            }
+
+            prefetcher->onPrefetchCompleted( _key, false );
+        }
+
+        TileKey                           _key;
+        MapFrame                          _frame;
+        osg::observer_ptr<TilePrefetcher> _prefetcher;
+        double                            _maxWait;
+        osg::Timer_t                      _created;
+    };
+}
+
+//...................................................................
+
+TilePrefetcher::TilePrefetcher(MapNode* mapNode) :
+_mapNode     ( mapNode ),
+_frame       ( mapNode ? mapNode->getMap() : 0L ),
+_pending     ( 0 ),
+_tokens      ( 0.0 ),
+_lastTime    ( -1.0 ),
+_lookAhead   ( 3.0 ),
+_numSamples  ( 4u ),
+_maxPending  ( 32u ),
+_maxPerSecond( 50.0 ),
+_rangeFactor ( 7.0 ),
+_maxLOD      ( 19u )
+{
+    _service = new TaskService( "TilePrefetcher", 2 );
+
+    // track which prefetched tiles the terrain actually uses.
+    if ( mapNode && mapNode->getTerrain() )
+    {
+        mapNode->getTerrain()->addTerrainCallback( new TerrainCallbackAdapter<TilePrefetcher>(this) );
+    }
+}
+
+TilePrefetcher::~TilePrefetcher()
+{
+    if ( _service.valid() )
+    {
+        _service->cancelAll();
+    }
+}
+
+void
+TilePrefetcher::setNumThreads(unsigned value)
+{
+    _service->setNumThreads( osg::maximum(value, 1u) );
+}
+
+TilePrefetcher::Stats
+TilePrefetcher::getStats() const
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    return _stats;
+}
+
+void
+TilePrefetcher::resetStats()
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    _stats = Stats();
+}
+
+void
+TilePrefetcher::operator()(osg::Node* node, osg::NodeVisitor* nv)
+{
+    osgUtil::CullVisitor* cv = Culling::asCullVisitor(nv);
+    if ( cv && nv->getFrameStamp() )
+    {
+        predict( cv->getEyePoint(), nv->getFrameStamp()->getReferenceTime() );
+    }
+
+    traverse( node, nv );
+}
+
+void
+TilePrefetcher::predict(const osg::Vec3d& eye, double time)
+{
+    osg::ref_ptr<MapNode> mapNode;
+    if ( !_mapNode.lock(mapNode) )
+        return;
+
+    Threading::ScopedMutexLock lock( _mutex );
+
+    // multiple cameras may call us in the same frame; only sample once.
+    if ( time <= _lastTime )
+        return;
+
+    // refill the request budget.
+    if ( _lastTime >= 0.0 && _maxPerSecond > 0.0 )
+    {
+        _tokens = osg::minimum( _tokens + (time-_lastTime)*_maxPerSecond, _maxPerSecond );
+    }
+    _lastTime = time;
+
+    // record the eye history and estimate the velocity from it.
+    _history.push_back( Sample(time, eye) );
+    while( _history.size() > 2 && time - _history.front()._time > HISTORY_SECONDS )
+        _history.pop_front();
+
+    if ( _history.size() < 2 )
+        return;
+
+    double dt = _history.back()._time - _history.front()._time;
+    if ( dt <= 0.0 )
+        return;
+
+    osg::Vec3d velocity = (_history.back()._eye - _history.front()._eye) / dt;
+    if ( velocity.length() < MIN_SPEED )
+        return;
+
+    _frame.sync();
+    const Profile* profile = _frame.getProfile();
+    if ( !profile )
+        return;
+
+    // sample the extrapolated trajectory; nearer samples get higher priority.
+    for(unsigned s=1; s<=_numSamples; ++s)
+    {
+        double t = _lookAhead * (double)s / (double)_numSamples;
+        osg::Vec3d futureEye = eye + velocity*t;
+
+        GeoPoint future;
+        if ( !future.fromWorld(mapNode->getMapSRS(), futureEye) )
+            continue;
+
+        GeoPoint futureInProfile = future.transform( profile->getSRS() );
+        if ( !futureInProfile.isValid() )
+            continue;
+
+        unsigned lod = computeLOD( profile, futureInProfile.z() );
+
+        TileKey key = profile->createTileKey( futureInProfile.x(), futureInProfile.y(), lod );
+        if ( !key.valid() )
+            continue;
+
+        float priority = -(float)t;
+
+        // the tile under the predicted eye, its neighbors, and its parent
+        // (which the engine will need first on the way down).
+        prefetch( key, priority );
+        for(int dx=-1; dx<=1; ++dx)
+        {
+            for(int dy=-1; dy<=1; ++dy)
+            {
+                if ( dx != 0 || dy != 0 )
+                    prefetch( key.createNeighborKey(dx, dy), priority - 0.5f );
+            }
+        }
+        if ( lod > 0 )
+            prefetch( key.createParentKey(), priority + 0.5f );
+    }
+}
+
+void
+TilePrefetcher::prefetch(const TileKey& key, float priority)
+{
+    // NOTE: called with _mutex held.
+    if ( !key.valid() || _issued.find(key) != _issued.end() )
+        return;
+
+    bool overBudget =
+        (_maxPending > 0 && _pending >= _maxPending) ||
+        (_maxPerSecond > 0.0 && _tokens < 1.0);
+
+    if ( overBudget )
+    {
+        _stats.deferred++;
+        return;
+    }
+
+    _issued[key] = false;
+    _issuedOrder.push_back( key );
+    while( _issuedOrder.size() > MAX_ISSUED )
+    {
+        _issued.erase( _issuedOrder.front() );
+        _issuedOrder.pop_front();
+    }
+
+    if ( _maxPerSecond > 0.0 )
+        _tokens -= 1.0;
+
+    _pending++;
+    _stats.requested++;
+
+    _service->add( new PrefetchTask(key, _frame, this, _lookAhead, priority) );
+}
+
+unsigned
+TilePrefetcher::computeLOD(const Profile* profile, double height) const
+{
+    // Estimate the LOD the terrain engine will select for the ground directly
+    // below the eye: a tile subdivides when the camera is closer than its
+    // radius times the range factor.
+    double h = osg::maximum( height, 1.0 );
+
+    const SpatialReference* srs = profile->getSRS();
+    double metersPerUnit = 1.0;
+    if ( srs->isGeographic() )
+        metersPerUnit = srs->getEllipsoid()->getRadiusEquator() * osg::PI / 180.0;
+
+    unsigned lod = 0;
+    for( ; lod < _maxLOD; ++lod )
+    {
+        double tileWidth, tileHeight;
+        profile->getTileDimensions( lod+1, tileWidth, tileHeight );
+        double radius = 0.5 * osg::Vec2d(tileWidth, tileHeight).length() * metersPerUnit;
+        if ( h > radius * _rangeFactor )
+            break;
+    }
+    return lod;
+}
+
+void
+TilePrefetcher::onTileAdded(const TileKey& key, osg::Node* tile, TerrainCallbackContext& context)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+    std::map<TileKey, bool>::iterator i = _issued.find( key );
+    if ( i != _issued.end() && i->second == false )
+    {
+        i->second = true;
+        _stats.hits++;
+    }
+}
+
+void
+TilePrefetcher::onPrefetchCompleted(const TileKey& key, bool expired)
+{
+    Threading::ScopedMutexLock lock( _mutex );
+
+    if ( _pending > 0 )
+        _pending--;
+
+    if ( expired )
+    {
+        _stats.expired++;
+    }
+    else
+    {
+        _stats.completed++;
+    }
+}